@@ -0,0 +1,41 @@
+#include "bench_utils.h"
+#include "gtcal/batch_solver.h"
+
+#include <benchmark/benchmark.h>
+
+// Optimizes a whole calibration with identical data across optimizers and thread counts. iSAM2 streams the
+// frames and runs one extra iteration, the batch optimizers accumulate the frames and optimize once. Thread
+// counts only matter when gtsam is built with TBB. Args: optimizer (0: iSAM2, 1: Levenberg-Marquardt,
+// 2: Dogleg), number of threads, number of frames.
+static void BM_BatchOptimizer(benchmark::State& bench_state) {
+  gtcal::BatchSolver::Options options;
+  options.optimizer_type = static_cast<gtcal::BatchSolver::OptimizerType>(bench_state.range(0));
+  options.num_threads = bench_state.range(1);
+  options.use_target_factors = true;
+  const size_t num_frames = bench_state.range(2);
+  const auto sequence = gtcal::bench::MakeSequence(num_frames, gtcal::bench::MakeTarget(130), false);
+  const gtcal::BatchSolver solver(sequence.target_points3d, options);
+
+  // Start every frame but the first slightly off the ground truth.
+  const gtsam::Pose3 perturbation(gtsam::Rot3::RzRyRx(0.01, -0.01, 0.02), {0.01, -0.01, 0.01});
+  for (auto _ : bench_state) {
+    auto camera = gtcal::bench::MakeCamera(false, sequence.poses_target_cam.front());
+    gtcal::BatchSolver::State state({camera});
+    for (size_t ii = 0; ii < num_frames; ii++) {
+      camera->setCameraPose(ii == 0 ? sequence.poses_target_cam.at(ii)
+                                    : sequence.poses_target_cam.at(ii) * perturbation);
+      solver.solve(sequence.frames.at(ii), state);
+    }
+    if (!solver.optimize(state)) {
+      bench_state.SkipWithError("Optimization failed.");
+      break;
+    }
+  }
+  bench_state.counters["frames/s"] =
+      benchmark::Counter(num_frames, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_BatchOptimizer)
+    ->ArgsProduct({{0, 1, 2}, {1, 2, 4, 8, 16, 32, 64}, {100, 1000}})
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
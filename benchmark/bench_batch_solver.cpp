@@ -0,0 +1,142 @@
+#include "bench_utils.h"
+#include "gtcal/batch_solver.h"
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+/**
+ * @brief Return a solver state after streaming the given frames into it.
+ *
+ */
+std::unique_ptr<gtcal::BatchSolver::State> SolveFrames(
+    const gtcal::BatchSolver& solver, const gtcal::bench::Sequence& sequence, const size_t num_frames,
+    const gtcal::BatchSolver::Options& options = gtcal::BatchSolver::Options()) {
+  auto camera = gtcal::bench::MakeCamera(false, sequence.poses_target_cam.front());
+  auto state = std::make_unique<gtcal::BatchSolver::State>(
+      std::vector<std::shared_ptr<gtcal::Camera>>{camera}, options);
+  for (size_t ii = 0; ii < num_frames; ii++) {
+    camera->setCameraPose(sequence.poses_target_cam.at(ii));
+    solver.solve(sequence.frames.at(ii), *state);
+  }
+  return state;
+}
+
+}  // namespace
+
+// Streams frames into iSAM2. Args: number of frames, graph shape (0: landmark variables, 1: target factors).
+static void BM_BatchSolverStream(benchmark::State& bench_state) {
+  const size_t num_frames = bench_state.range(0);
+  gtcal::BatchSolver::Options options;
+  options.use_target_factors = bench_state.range(1) != 0;
+  const auto sequence = gtcal::bench::MakeSequence(num_frames, gtcal::bench::MakeTarget(130), false);
+  const gtcal::BatchSolver solver(sequence.target_points3d, options);
+
+  size_t num_variables = 0;
+  for (auto _ : bench_state) {
+    const auto state = SolveFrames(solver, sequence, num_frames);
+    num_variables = state->current_estimate.size();
+  }
+  bench_state.counters["variables"] = num_variables;
+  bench_state.counters["frames/s"] =
+      benchmark::Counter(num_frames, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_BatchSolverStream)->ArgsProduct({{10, 50, 200}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+// Cost of a single iSAM2 update once the graph already holds some frames. Args: number of frames already in
+// the graph, graph shape (0: landmark variables, 1: target factors).
+static void BM_BatchSolverUpdate(benchmark::State& bench_state) {
+  const size_t num_frames = bench_state.range(0);
+  gtcal::BatchSolver::Options options;
+  options.use_target_factors = bench_state.range(1) != 0;
+  const auto sequence = gtcal::bench::MakeSequence(num_frames + 1, gtcal::bench::MakeTarget(130), false);
+  const gtcal::BatchSolver solver(sequence.target_points3d, options);
+
+  gtcal::alloc::AllocationStats allocations;
+  for (auto _ : bench_state) {
+    bench_state.PauseTiming();
+    auto state = SolveFrames(solver, sequence, num_frames);
+    state->cameras.front()->setCameraPose(sequence.poses_target_cam.back());
+    bench_state.ResumeTiming();
+
+    const gtcal::alloc::Scope scope;
+    solver.solve(sequence.frames.back(), *state);
+    allocations += scope.stats();
+  }
+  // Allocations of the calling thread only, iSAM2 may run parts of the update on TBB workers.
+  gtcal::bench::SetAllocationCounters(bench_state, allocations, static_cast<double>(bench_state.iterations()),
+                                      "update");
+}
+BENCHMARK(BM_BatchSolverUpdate)
+    ->ArgsProduct({{10, 100, 400}, {0, 1}})
+    ->Iterations(10)
+    ->Unit(benchmark::kMillisecond);
+
+// Streams frames into iSAM2 with different relinearization policies. Args: number of frames, policy (0: one
+// threshold for every variable, 1: looser calibration threshold, 2: freeze converged intrinsics).
+static void BM_BatchSolverRelinearization(benchmark::State& bench_state) {
+  const size_t num_frames = bench_state.range(0);
+  gtcal::BatchSolver::Options options;
+  options.use_target_factors = true;
+  if (bench_state.range(1) == 1) {
+    options.calibration_relinearize_threshold = 0.1;
+  } else if (bench_state.range(1) == 2) {
+    options.freeze_converged_calibration = true;
+  }
+  const auto sequence = gtcal::bench::MakeSequence(num_frames, gtcal::bench::MakeTarget(130), false);
+  const gtcal::BatchSolver solver(sequence.target_points3d, options);
+
+  size_t num_relinearized = 0;
+  for (auto _ : bench_state) {
+    const auto state = SolveFrames(solver, sequence, num_frames, options);
+    num_relinearized = state->num_variables_relinearized;
+  }
+  bench_state.counters["relinearized/frame"] = static_cast<double>(num_relinearized) / num_frames;
+  bench_state.counters["frames/s"] =
+      benchmark::Counter(num_frames, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_BatchSolverRelinearization)
+    ->ArgsProduct({{200, 1000}, {0, 1, 2}})
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond);
+
+// Builds the factors of a whole sequence without optimizing, as solve() does before each update. Args: number
+// of frames, number of target points, graph shape (0: landmark variables, 1: target factors).
+static void BM_BatchSolverGraph(benchmark::State& bench_state) {
+  const size_t num_frames = bench_state.range(0);
+  gtcal::BatchSolver::Options options;
+  options.use_target_factors = bench_state.range(2) != 0;
+  const auto sequence =
+      gtcal::bench::MakeSequence(num_frames, gtcal::bench::MakeTarget(bench_state.range(1)), false);
+  const gtcal::BatchSolver solver(sequence.target_points3d, options);
+  const auto camera = gtcal::bench::MakeCamera(false, sequence.poses_target_cam.front());
+
+  size_t num_factors = 0;
+  const gtcal::alloc::Scope scope;
+  for (auto _ : bench_state) {
+    gtsam::NonlinearFactorGraph graph;
+    gtsam::Values values;
+    solver.addCalibrationPriors(0, camera, graph, values);
+    solver.addPosePrior(0, sequence.poses_target_cam.front(), graph);
+    if (!options.use_target_factors) {
+      solver.addLandmarkPriors(sequence.frames.front(), sequence.target_points3d, graph);
+    }
+    for (size_t ii = 0; ii < num_frames; ii++) {
+      if (options.use_target_factors) {
+        solver.addTargetFactors(0, camera, ii, sequence.frames.at(ii), graph);
+      } else {
+        solver.addLandmarkFactors(0, camera, ii, sequence.frames.at(ii), graph);
+      }
+    }
+    num_factors = graph.size();
+    benchmark::DoNotOptimize(graph);
+  }
+  bench_state.counters["factors"] = num_factors;
+  gtcal::bench::SetAllocationCounters(bench_state, scope.stats(),
+                                      static_cast<double>(bench_state.iterations() * num_factors), "factor");
+  bench_state.counters["frames/s"] =
+      benchmark::Counter(num_frames, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_BatchSolverGraph)
+    ->ArgsProduct({{10, 100, 1000}, {30, 130, 520}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,58 @@
+#include "bench_utils.h"
+
+#include <benchmark/benchmark.h>
+
+// Projects every point of a target into a camera. Args: camera model (0: Cal3_S2, 1: Cal3Fisheye), number of
+// target points.
+static void BM_CameraProject(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const auto target = gtcal::bench::MakeTarget(bench_state.range(1));
+  const auto sequence = gtcal::bench::MakeSequence(1, target, fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+
+  for (auto _ : bench_state) {
+    for (const auto& pt3d_target : sequence.target_points3d) {
+      benchmark::DoNotOptimize(camera->project(pt3d_target));
+    }
+  }
+  bench_state.SetItemsProcessed(
+      static_cast<int64_t>(bench_state.iterations() * sequence.target_points3d.size()));
+}
+BENCHMARK(BM_CameraProject)->ArgsProduct({{0, 1}, {30, 130, 520}})->Unit(benchmark::kMicrosecond);
+
+// Moves the camera, then projects every point of a target, as the pose solvers do on every residual
+// evaluation. Args: camera model (0: Cal3_S2, 1: Cal3Fisheye), number of target points.
+static void BM_CameraSetPoseProject(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const auto target = gtcal::bench::MakeTarget(bench_state.range(1));
+  const auto sequence = gtcal::bench::MakeSequence(1, target, fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+
+  for (auto _ : bench_state) {
+    for (const auto& pt3d_target : sequence.target_points3d) {
+      camera->setCameraPose(sequence.poses_target_cam.front());
+      benchmark::DoNotOptimize(camera->project(pt3d_target));
+    }
+  }
+  bench_state.SetItemsProcessed(
+      static_cast<int64_t>(bench_state.iterations() * sequence.target_points3d.size()));
+}
+BENCHMARK(BM_CameraSetPoseProject)->ArgsProduct({{0, 1}, {30, 130, 520}})->Unit(benchmark::kMicrosecond);
+
+// Projects every point of a target in a single batch, through the plane homography. Args: camera model (0:
+// Cal3_S2, 1: Cal3Fisheye), number of target points.
+static void BM_CameraProjectBatch(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const auto target = gtcal::bench::MakeTarget(bench_state.range(1));
+  const auto sequence = gtcal::bench::MakeSequence(1, target, fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+  gtsam::Point2Vector uvs;
+
+  for (auto _ : bench_state) {
+    camera->project(sequence.target_points3d, uvs);
+    benchmark::DoNotOptimize(uvs.data());
+  }
+  bench_state.SetItemsProcessed(
+      static_cast<int64_t>(bench_state.iterations() * sequence.target_points3d.size()));
+}
+BENCHMARK(BM_CameraProjectBatch)->ArgsProduct({{0, 1}, {30, 130, 520}})->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,74 @@
+#include "gtcal/corner_detector.h"
+#include "gtcal/corner_refiner.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Return a fronto-parallel 1280x720 image of a 10x13 target with 48 pixel squares.
+ *
+ */
+gtcal::Image MakeCheckerboard() {
+  static constexpr int kSquare = 48;
+  gtcal::Image image(1280, 720, 210);
+  const int x0 = (1280 - 14 * kSquare) / 2, y0 = (720 - 11 * kSquare) / 2;
+  for (int y = y0; y < y0 + 11 * kSquare; y++) {
+    for (int x = x0; x < x0 + 14 * kSquare; x++) {
+      if ((((x - x0) / kSquare + (y - y0) / kSquare) & 1) == 0) {
+        image.at(x, y) = 40;
+      }
+    }
+  }
+  return image;
+}
+
+}  // namespace
+
+// Corner response of a 1280x720 image.
+static void BM_CornerResponse(benchmark::State& bench_state) {
+  const gtcal::Image image = MakeCheckerboard();
+  std::vector<int16_t> response;
+  for (auto _ : bench_state) {
+    gtcal::CornerDetector::CornerResponse(image, response);
+    benchmark::DoNotOptimize(response.data());
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * image.pixels.size()));
+}
+BENCHMARK(BM_CornerResponse)->Unit(benchmark::kMicrosecond);
+
+// Detection throughput over 64 images. Args: number of threads.
+static void BM_CornerDetector(benchmark::State& bench_state) {
+  const std::vector<gtcal::Image> images(64, MakeCheckerboard());
+  gtcal::CornerDetector::Options options;
+  options.num_threads = bench_state.range(0);
+  const gtcal::CornerDetector detector(gtcal::utils::CalibrationTarget(0.1, 10, 13), options);
+  std::vector<std::vector<gtcal::Measurement>> measurements;
+  for (auto _ : bench_state) {
+    benchmark::DoNotOptimize(detector.detect(images, 0, measurements));
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * images.size()));
+}
+BENCHMARK(BM_CornerDetector)->RangeMultiplier(2)->Range(1, 16)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Sub-pixel refinement of the 130 corners of a 1280x720 image, four corners per batch.
+static void BM_CornerRefiner(benchmark::State& bench_state) {
+  const gtcal::Image image = MakeCheckerboard();
+  const gtcal::CornerDetector detector(gtcal::utils::CalibrationTarget(0.1, 10, 13));
+  std::vector<gtcal::Measurement> detected;
+  if (!detector.detect(image, 0, detected)) {
+    bench_state.SkipWithError("Target not detected.");
+    return;
+  }
+  const gtcal::CornerRefiner refiner;
+  std::vector<gtcal::Measurement> measurements;
+  std::vector<gtsam::Matrix2> covariances;
+  for (auto _ : bench_state) {
+    measurements = detected;
+    benchmark::DoNotOptimize(refiner.refine(image, measurements, covariances));
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * detected.size()));
+}
+BENCHMARK(BM_CornerRefiner)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,70 @@
+#include "gtcal/detection_importer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Return a CSV dump of about the given size with frames of 130 detections.
+ *
+ */
+std::string MakeCsv(const size_t num_bytes) {
+  std::string csv;
+  csv.reserve(num_bytes + 64);
+  char line[96];
+  for (size_t ii = 0; csv.size() < num_bytes; ii++) {
+    const size_t frame = ii / 130;
+    const int size = std::snprintf(line, sizeof(line), "%zu,%zu,%zu,%.4f,%.4f\n", 1700000000000000000 + frame,
+                                   frame % 4, ii % 130, 100. + 0.37 * (ii % 977), 50. + 0.53 * (ii % 613));
+    csv.append(line, size);
+  }
+  return csv;
+}
+
+/**
+ * @brief Return a JSONL dump of about the given size with frames of 130 detections.
+ *
+ */
+std::string MakeJsonl(const size_t num_bytes) {
+  std::string jsonl;
+  jsonl.reserve(num_bytes + 4096);
+  char detection[64];
+  for (size_t frame = 0; jsonl.size() < num_bytes; frame++) {
+    jsonl += "{\"timestamp_ns\": " + std::to_string(frame * 33000000) +
+             ", \"camera_id\": " + std::to_string(frame % 4) + ", \"detections\": [";
+    for (size_t jj = 0; jj < 130; jj++) {
+      const int size = std::snprintf(detection, sizeof(detection), "%s[%zu, %.4f, %.4f]", jj > 0 ? ", " : "",
+                                     jj, 100. + 0.37 * jj, 50. + 0.53 * frame);
+      jsonl.append(detection, size);
+    }
+    jsonl += "]}\n";
+  }
+  return jsonl;
+}
+
+}  // namespace
+
+// Parse throughput of a 256 MB dump held in memory. Args: format (0: CSV, 1: JSONL), number of threads.
+static void BM_DetectionImporter(benchmark::State& bench_state) {
+  static const std::string csv = MakeCsv(size_t{256} << 20);
+  static const std::string jsonl = MakeJsonl(size_t{256} << 20);
+  const std::string& text = bench_state.range(0) == 0 ? csv : jsonl;
+
+  gtcal::DetectionImporter::Options options;
+  options.num_threads = bench_state.range(1);
+  gtcal::DetectionImporter importer(options);
+  for (auto _ : bench_state) {
+    gtcal::MeasurementBlock measurements;
+    importer.importText(text, measurements);
+    benchmark::DoNotOptimize(measurements.size());
+  }
+  bench_state.SetBytesProcessed(static_cast<int64_t>(bench_state.iterations() * text.size()));
+  bench_state.counters["measurements"] = importer.stats().num_measurements;
+}
+BENCHMARK(BM_DetectionImporter)
+    ->ArgsProduct({{0, 1}, {1, 2, 4, 8, 16, 32}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,78 @@
+#include "bench_utils.h"
+#include "gtcal/detection_log.h"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+
+namespace {
+
+/**
+ * @brief Write a log with the given number of frames of the synthetic sequence and return its path.
+ *
+ */
+std::string WriteLog(const size_t num_frames, const gtcal::DetectionLogWriter::Compression compression) {
+  const auto sequence = gtcal::bench::MakeSequence(25, gtcal::bench::MakeTarget(130), false);
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "gtcal_bench_detection_log.bin").string();
+  gtcal::DetectionLogWriter::Options options;
+  options.compression = compression;
+  gtcal::DetectionLogWriter writer(path, options);
+  for (size_t ii = 0; ii < num_frames; ii++) {
+    writer.append(static_cast<int64_t>(ii), sequence.frames.at(ii % sequence.frames.size()));
+  }
+  writer.close();
+  return path;
+}
+
+}  // namespace
+
+// Replays every frame of a log and touches every measurement. Args: number of frames, compression
+// (0: none, 1: LZ4), verify checksums.
+static void BM_DetectionLogReplay(benchmark::State& bench_state) {
+  const size_t num_frames = bench_state.range(0);
+  const std::string path =
+      WriteLog(num_frames, static_cast<gtcal::DetectionLogWriter::Compression>(bench_state.range(1)));
+  const size_t file_size = std::filesystem::file_size(path);
+  gtcal::DetectionLogReader::Options options;
+  options.verify_checksums = bench_state.range(2) != 0;
+
+  for (auto _ : bench_state) {
+    gtcal::DetectionLogReader reader(path, options);
+    double sum = 0.;
+    gtcal::MeasurementSpan measurements;
+    for (size_t ii = 0; ii < reader.numFrames(); ii++) {
+      if (!reader.frame(ii, measurements)) {
+        bench_state.SkipWithError("Failed to read frame.");
+        break;
+      }
+      for (size_t jj = 0; jj < measurements.size(); jj++) {
+        sum += measurements.u()[jj] + measurements.v()[jj];
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  bench_state.SetBytesProcessed(static_cast<int64_t>(bench_state.iterations() * file_size));
+  std::filesystem::remove(path);
+}
+BENCHMARK(BM_DetectionLogReplay)
+    ->ArgsProduct({{10000, 100000}, {0, 1}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// Writes frames to a log. Args: number of frames, compression (0: none, 1: LZ4).
+static void BM_DetectionLogWrite(benchmark::State& bench_state) {
+  const size_t num_frames = bench_state.range(0);
+  const auto compression = static_cast<gtcal::DetectionLogWriter::Compression>(bench_state.range(1));
+  size_t file_size = 0;
+  for (auto _ : bench_state) {
+    const std::string path = WriteLog(num_frames, compression);
+    bench_state.PauseTiming();
+    file_size = std::filesystem::file_size(path);
+    std::filesystem::remove(path);
+    bench_state.ResumeTiming();
+  }
+  bench_state.counters["bytes/frame"] = static_cast<double>(file_size) / num_frames;
+  bench_state.counters["frames/s"] =
+      benchmark::Counter(num_frames, benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_DetectionLogWrite)->ArgsProduct({{10000}, {0, 1}})->Unit(benchmark::kMillisecond);
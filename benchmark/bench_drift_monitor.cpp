@@ -0,0 +1,34 @@
+#include "bench_utils.h"
+#include "gtcal/drift_monitor.h"
+
+#include <benchmark/benchmark.h>
+
+// Streams frames through a drift monitor past its warmup, i.e. the cost per camera frame in production. Args:
+// pose solver (0: Ceres, 1: gtsam), camera model (0: Cal3_S2, 1: Cal3Fisheye), number of target points.
+static void BM_DriftMonitor(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(1) != 0;
+  const auto sequence =
+      gtcal::bench::MakeSequence(250, gtcal::bench::MakeTarget(bench_state.range(2)), fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, gtsam::Pose3());
+  gtcal::DriftMonitor::Options options;
+  options.pose_solver_type = bench_state.range(0) == 0 ? gtcal::DriftMonitor::PoseSolverType::CERES
+                                                       : gtcal::DriftMonitor::PoseSolverType::GTSAM;
+  gtcal::DriftMonitor monitor(*camera, sequence.target_points3d, options);
+  for (size_t ii = 0; ii < options.warmup_frames; ii++) {
+    monitor.addFrame(sequence.frames.at(ii));
+  }
+
+  size_t frame_index = 0;
+  const gtcal::alloc::Scope scope;
+  for (auto _ : bench_state) {
+    if (!monitor.addFrame(sequence.frames.at(frame_index)).accepted) {
+      bench_state.SkipWithError("Frame rejected.");
+      break;
+    }
+    frame_index = (frame_index + 1) % sequence.frames.size();
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations()));
+  gtcal::bench::SetAllocationCounters(bench_state, scope.stats(),
+                                      static_cast<double>(bench_state.iterations()), "frame");
+}
+BENCHMARK(BM_DriftMonitor)->ArgsProduct({{0, 1}, {0, 1}, {130, 520}})->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,50 @@
+#include "bench_utils.h"
+#include "gtcal/fleet_scheduler.h"
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// Number of single-camera calibration jobs and frames per job of the fleet scheduler benchmark.
+static constexpr size_t kNumJobs = 32;
+static constexpr size_t kFramesPerJob = 20;
+
+}  // namespace
+
+// Calibrates 32 independent cameras of 20 frames each, 5 frames per step. Args: number of worker threads,
+// camera model (0: Cal3_S2, 1: Cal3Fisheye).
+static void BM_FleetScheduler(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(1) != 0;
+  const auto sequence = gtcal::bench::MakeSequence(kFramesPerJob, gtcal::bench::MakeTarget(130), fisheye);
+  const auto pts3d_target = std::make_shared<const gtsam::Point3Vector>(sequence.target_points3d);
+  auto measurements = std::make_shared<gtcal::MeasurementBlock>();
+  for (const auto& frame : sequence.frames) {
+    measurements->appendFrame(frame);
+  }
+
+  // The scheduler spreads the jobs over threads, each solver runs on one.
+  gtcal::BatchSolver::Options solver_options;
+  solver_options.num_threads = 1;
+  gtcal::FleetScheduler::Options options;
+  options.num_threads = bench_state.range(0);
+  gtcal::FleetScheduler scheduler(options);
+
+  for (auto _ : bench_state) {
+    for (size_t ii = 0; ii < kNumJobs; ii++) {
+      const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+      scheduler.submit(
+          gtcal::MakeCalibrationJob(pts3d_target, {camera}, measurements, solver_options, 5, nullptr));
+    }
+    scheduler.wait();
+  }
+  if (scheduler.stats().num_succeeded != scheduler.stats().num_submitted) {
+    bench_state.SkipWithError("Calibration job failed.");
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * kNumJobs));
+  bench_state.counters["p99_job_ms"] =
+      1e-6 * static_cast<double>(scheduler.jobLatency().percentile(99.0).count());
+}
+BENCHMARK(BM_FleetScheduler)
+    ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
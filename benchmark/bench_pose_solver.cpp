@@ -0,0 +1,243 @@
+#include "bench_utils.h"
+#include "gtcal/pose_solver.h"
+#include "gtcal/pose_solver_gtsam.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Number of frames solved per benchmark iteration by the pose solver benchmarks.
+static constexpr size_t kNumFrames = 64;
+
+/**
+ * @brief Solve every frame of a sequence from a perturbed ground truth pose, spreading the frames over
+ * threads. Each thread gets its own solver and camera clone, as the solvers move the camera. Return the
+ * number of frames that failed, and add the heap activity of the solves to allocations.
+ *
+ */
+template <typename MakeSolver>
+size_t SolveFrames(const MakeSolver& make_solver, const gtcal::bench::Sequence& sequence,
+                   const std::shared_ptr<gtcal::Camera>& camera, const size_t num_threads,
+                   gtcal::alloc::AllocationStats& allocations) {
+  const gtsam::Pose3 perturbation(gtsam::Rot3::RzRyRx(0.02, -0.02, 0.03), {0.02, -0.01, 0.02});
+  std::atomic<size_t> next_frame{0}, num_failures{0};
+  std::mutex allocations_mutex;
+  const auto worker = [&]() {
+    const auto solver = make_solver();
+    const std::shared_ptr<gtcal::Camera> worker_camera = camera->clone();
+    const gtcal::alloc::Scope scope;
+    for (size_t ii = next_frame.fetch_add(1); ii < sequence.frames.size(); ii = next_frame.fetch_add(1)) {
+      gtsam::Pose3 pose_target_cam = sequence.poses_target_cam.at(ii) * perturbation;
+      if (!solver->solve(sequence.frames.at(ii), sequence.target_points3d, worker_camera, pose_target_cam)) {
+        num_failures.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    const gtcal::alloc::AllocationStats stats = scope.stats();
+    const std::lock_guard<std::mutex> lock(allocations_mutex);
+    allocations += stats;
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t tt = 1; tt < num_threads; tt++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return num_failures.load();
+}
+
+// Reprojection residual of a target point mapped through a homography built for it alone, the per-point
+// baseline of gtcal::PlanarTargetProjection.
+struct PerPointPlanarResidual {
+  gtsam::Point2 uv;
+  gtsam::Point3 pt3d_target;
+  std::shared_ptr<gtcal::Camera> camera;
+
+  bool operator()(const double* const pose_target_cam_arr, double* residuals) const {
+    const gtsam::Pose3 pose_target_cam(
+        gtsam::Rot3::RzRyRx(pose_target_cam_arr[3], pose_target_cam_arr[4], pose_target_cam_arr[5]),
+        gtsam::Point3(pose_target_cam_arr[0], pose_target_cam_arr[1], pose_target_cam_arr[2]));
+    const gtsam::Point2 uv_projected = camera->projectPlanar(pose_target_cam, pt3d_target);
+    if (!gtcal::utils::FilterPixelCoords(uv_projected, camera->width(), camera->height())) {
+      return false;
+    }
+    residuals[0] = uv_projected.x() - uv.x();
+    residuals[1] = uv_projected.y() - uv.y();
+    return true;
+  }
+};
+
+}  // namespace
+
+// Evaluates the Ceres reprojection residual of every point of a target. Args: camera model (0: Cal3_S2,
+// 1: Cal3Fisheye), number of target points.
+static void BM_ReprojectionErrorResidual(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const auto sequence =
+      gtcal::bench::MakeSequence(1, gtcal::bench::MakeTarget(bench_state.range(1)), fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+  std::vector<gtcal::ReprojectionErrorResidual> residuals;
+  for (const auto& meas : sequence.frames.front()) {
+    residuals.emplace_back(meas.uv, sequence.target_points3d.at(meas.point_id), camera);
+  }
+
+  const gtsam::Pose3& pose_target_cam = sequence.poses_target_cam.front();
+  const gtsam::Point3 rpy = pose_target_cam.rotation().rpy();
+  const double pose_target_cam_arr[6] = {pose_target_cam.x(), pose_target_cam.y(), pose_target_cam.z(),
+                                         rpy.x(),             rpy.y(),             rpy.z()};
+  double error[2];
+  const gtcal::alloc::Scope scope;
+  for (auto _ : bench_state) {
+    for (const auto& residual : residuals) {
+      benchmark::DoNotOptimize(residual(pose_target_cam_arr, error));
+    }
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * residuals.size()));
+  gtcal::bench::SetAllocationCounters(bench_state, scope.stats(),
+                                      static_cast<double>(bench_state.iterations() * residuals.size()),
+                                      "residual");
+}
+BENCHMARK(BM_ReprojectionErrorResidual)->ArgsProduct({{0, 1}, {30, 130, 520}})->Unit(benchmark::kMicrosecond);
+
+// Evaluates the residuals and Jacobians of every point of a planar target at one pose, as the Ceres pose
+// solver does once per iteration. Args: camera model (0: Cal3_S2, 1: Cal3Fisheye), number of target points,
+// projection (0: one homography per point and numeric differentiation step, 1: batched per evaluation point).
+static void BM_PlanarReprojectionJacobians(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const bool batched = bench_state.range(2) != 0;
+  const auto sequence =
+      gtcal::bench::MakeSequence(1, gtcal::bench::MakeTarget(bench_state.range(1)), fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+
+  const gtsam::Pose3& pose_target_cam = sequence.poses_target_cam.front();
+  const gtsam::Point3 rpy = pose_target_cam.rotation().rpy();
+  double pose_target_cam_arr[6] = {pose_target_cam.x(), pose_target_cam.y(), pose_target_cam.z(),
+                                   rpy.x(),             rpy.y(),             rpy.z()};
+  const double* parameters[1] = {pose_target_cam_arr};
+
+  gtcal::PlanarTargetProjection projection(camera, pose_target_cam_arr);
+  std::vector<std::unique_ptr<ceres::CostFunction>> residuals;
+  for (const auto& meas : sequence.frames.front()) {
+    const gtsam::Point3& pt3d_target = sequence.target_points3d.at(meas.point_id);
+    if (batched) {
+      residuals.emplace_back(
+          new gtcal::PlanarReprojectionErrorResidual(meas.uv, projection, projection.addPoint(pt3d_target)));
+    } else {
+      residuals.emplace_back(new ceres::NumericDiffCostFunction<PerPointPlanarResidual, ceres::CENTRAL, 2, 6>(
+          new PerPointPlanarResidual{meas.uv, pt3d_target, camera}));
+    }
+  }
+
+  double error[2], jacobian[12];
+  double* jacobians[1] = {jacobian};
+  const gtcal::alloc::Scope scope;
+  for (auto _ : bench_state) {
+    if (batched) {
+      projection.PrepareForEvaluation(true, true);
+    }
+    for (const auto& residual : residuals) {
+      benchmark::DoNotOptimize(residual->Evaluate(parameters, error, jacobians));
+    }
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * residuals.size()));
+  gtcal::bench::SetAllocationCounters(bench_state, scope.stats(),
+                                      static_cast<double>(bench_state.iterations() * residuals.size()),
+                                      "residual");
+}
+BENCHMARK(BM_PlanarReprojectionJacobians)
+    ->ArgsProduct({{0, 1}, {30, 130, 520, 2000}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Solves 64 frames with the Ceres pose solver. Args: camera model (0: Cal3_S2, 1: Cal3Fisheye), number of
+// target points, number of threads.
+static void BM_PoseSolver(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const auto sequence =
+      gtcal::bench::MakeSequence(kNumFrames, gtcal::bench::MakeTarget(bench_state.range(1)), fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+  const auto make_solver = []() { return std::make_unique<gtcal::PoseSolver>(); };
+
+  gtcal::alloc::AllocationStats allocations;
+  for (auto _ : bench_state) {
+    if (SolveFrames(make_solver, sequence, camera, bench_state.range(2), allocations) > 0) {
+      bench_state.SkipWithError("Pose solver failed.");
+      break;
+    }
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * kNumFrames));
+  gtcal::bench::SetAllocationCounters(bench_state, allocations,
+                                      static_cast<double>(bench_state.iterations() * kNumFrames), "frame");
+}
+BENCHMARK(BM_PoseSolver)
+    ->ArgsProduct({{0, 1}, {30, 130, 520}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Solves 64 frames with the gtsam pose solver. Args: camera model (0: Cal3_S2, 1: Cal3Fisheye), number of
+// target points, number of threads.
+static void BM_PoseSolverGtsam(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const auto sequence =
+      gtcal::bench::MakeSequence(kNumFrames, gtcal::bench::MakeTarget(bench_state.range(1)), fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+  const auto make_solver = []() {
+    return std::make_unique<gtcal::PoseSolverGtsam>(gtcal::PoseSolverGtsam::Options());
+  };
+
+  gtcal::alloc::AllocationStats allocations;
+  for (auto _ : bench_state) {
+    if (SolveFrames(make_solver, sequence, camera, bench_state.range(2), allocations) > 0) {
+      bench_state.SkipWithError("Pose solver failed.");
+      break;
+    }
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * kNumFrames));
+  gtcal::bench::SetAllocationCounters(bench_state, allocations,
+                                      static_cast<double>(bench_state.iterations() * kNumFrames), "frame");
+}
+BENCHMARK(BM_PoseSolverGtsam)
+    ->ArgsProduct({{0, 1}, {30, 130, 520}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Solves 64 frames of a dense target on one thread, with and without the coarse-to-fine schedule. Args:
+// solver (0: Ceres, 1: gtsam), number of target points, coarse-to-fine (0: off, 1: on).
+static void BM_PoseSolverCoarseToFine(benchmark::State& bench_state) {
+  const auto sequence =
+      gtcal::bench::MakeSequence(kNumFrames, gtcal::bench::MakeTarget(bench_state.range(1)), false);
+  const auto camera = gtcal::bench::MakeCamera(false, sequence.poses_target_cam.front());
+  gtcal::CoarseToFineOptions coarse_to_fine;
+  coarse_to_fine.enabled = bench_state.range(2) != 0;
+
+  gtcal::alloc::AllocationStats allocations;
+  for (auto _ : bench_state) {
+    size_t num_failures = 0;
+    if (bench_state.range(0) == 0) {
+      const auto make_solver = [&]() { return std::make_unique<gtcal::PoseSolver>(false, coarse_to_fine); };
+      num_failures = SolveFrames(make_solver, sequence, camera, 1, allocations);
+    } else {
+      gtcal::PoseSolverGtsam::Options options;
+      options.coarse_to_fine = coarse_to_fine;
+      const auto make_solver = [&]() { return std::make_unique<gtcal::PoseSolverGtsam>(options); };
+      num_failures = SolveFrames(make_solver, sequence, camera, 1, allocations);
+    }
+    if (num_failures > 0) {
+      bench_state.SkipWithError("Pose solver failed.");
+      break;
+    }
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * kNumFrames));
+  gtcal::bench::SetAllocationCounters(bench_state, allocations,
+                                      static_cast<double>(bench_state.iterations() * kNumFrames), "frame");
+}
+BENCHMARK(BM_PoseSolverCoarseToFine)
+    ->ArgsProduct({{0, 1}, {520, 2000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
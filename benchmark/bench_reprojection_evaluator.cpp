@@ -0,0 +1,30 @@
+#include "bench_utils.h"
+#include "gtcal/reprojection_evaluator.h"
+
+#include <benchmark/benchmark.h>
+
+// Evaluates the reprojection residuals of a whole dataset. Args: camera model (0: Cal3_S2, 1: Cal3Fisheye),
+// number of frames (of 520 points each), number of threads.
+static void BM_ReprojectionEvaluator(benchmark::State& bench_state) {
+  const bool fisheye = bench_state.range(0) != 0;
+  const size_t num_frames = bench_state.range(1);
+  const auto sequence = gtcal::bench::MakeSequence(num_frames, gtcal::bench::MakeTarget(520), fisheye);
+  const auto camera = gtcal::bench::MakeCamera(fisheye, sequence.poses_target_cam.front());
+  gtcal::MeasurementBlock measurements;
+  for (const auto& frame : sequence.frames) {
+    measurements.appendFrame(frame);
+  }
+
+  gtcal::ReprojectionEvaluator::Options options;
+  options.num_threads = bench_state.range(2);
+  const gtcal::ReprojectionEvaluator evaluator(options);
+  for (auto _ : bench_state) {
+    benchmark::DoNotOptimize(
+        evaluator.evaluate({camera}, sequence.poses_target_cam, sequence.target_points3d, measurements));
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * measurements.size()));
+}
+BENCHMARK(BM_ReprojectionEvaluator)
+    ->ArgsProduct({{0, 1}, {100, 2000}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,60 @@
+#include "bench_utils.h"
+#include "gtcal/result_cache.h"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+
+// Key of a calibration problem, paid on every submission. Args: number of frames, number of target points.
+static void BM_ResultCacheKey(benchmark::State& bench_state) {
+  const auto sequence = gtcal::bench::MakeSequence(static_cast<size_t>(bench_state.range(0)),
+                                                   gtcal::bench::MakeTarget(bench_state.range(1)), false);
+  gtcal::MeasurementBlock measurements;
+  for (const auto& frame : sequence.frames) {
+    measurements.appendFrame(frame);
+  }
+  const std::vector<std::shared_ptr<gtcal::Camera>> cameras = {
+      gtcal::bench::MakeCamera(false, gtsam::Pose3())};
+  const gtcal::BatchSolver::Options options;
+
+  for (auto _ : bench_state) {
+    benchmark::DoNotOptimize(
+        gtcal::ComputeResultCacheKey(measurements, sequence.target_points3d, cameras, options));
+  }
+  const size_t measurement_size = 2 * sizeof(float) + sizeof(uint16_t) + sizeof(uint32_t);
+  bench_state.SetBytesProcessed(
+      static_cast<int64_t>(bench_state.iterations() * measurements.size() * measurement_size));
+}
+BENCHMARK(BM_ResultCacheKey)->ArgsProduct({{100, 1000}, {130, 520}})->Unit(benchmark::kMicrosecond);
+
+// Lookup of a stored calibration, i.e. the cost of a resubmitted problem. Args: number of cameras, number of
+// entries in the cache.
+static void BM_ResultCacheHit(benchmark::State& bench_state) {
+  const std::string directory =
+      (std::filesystem::temp_directory_path() / "gtcal_bench_result_cache").string();
+  std::filesystem::remove_all(directory);
+  {
+    gtcal::ResultCache cache(directory);
+    gtcal::CachedCalibration stored;
+    for (int64_t ii = 0; ii < bench_state.range(0); ii++) {
+      stored.cameras.push_back(gtcal::bench::MakeCamera(ii % 2 == 1, gtsam::Pose3()));
+    }
+    const auto num_entries = static_cast<uint64_t>(bench_state.range(1));
+    for (uint64_t key = 0; key < num_entries; key++) {
+      cache.store(key, stored);
+    }
+
+    uint64_t key = 0;
+    gtcal::CachedCalibration result;
+    for (auto _ : bench_state) {
+      if (!cache.lookup(key, result)) {
+        bench_state.SkipWithError("Cache miss.");
+        break;
+      }
+      key = (key + 1) % num_entries;
+    }
+    bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations()));
+  }
+  std::filesystem::remove_all(directory);
+}
+BENCHMARK(BM_ResultCacheHit)->ArgsProduct({{1, 8}, {16, 1024}})->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,68 @@
+#include "gtcal/scenario_generator.h"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Return a rig with a 10x13 target, a pinhole and a fisheye camera.
+ *
+ */
+gtcal::Rig MakeRig() {
+  gtcal::Rig rig;
+  std::string error;
+  gtcal::ParseRig("target 0.05 10 13\n"
+                  "camera 0 pinhole 1280 720 900 900 640 360\n"
+                  "camera 1 fisheye 1280 720 600 600 640 360 -0.02 0.01 0 0\n",
+                  rig, error);
+  return rig;
+}
+
+}  // namespace
+
+// Generation throughput of 16384 frames into a MeasurementBlock. Args: number of threads.
+static void BM_ScenarioGenerator(benchmark::State& bench_state) {
+  gtcal::ScenarioGenerator::Options options;
+  options.num_frames = 16384;
+  options.num_threads = bench_state.range(0);
+  const gtcal::ScenarioGenerator generator(MakeRig(), options);
+  gtcal::MeasurementBlock block;
+  for (auto _ : bench_state) {
+    block.clear();
+    generator.generate(0, options.num_frames, block);
+    benchmark::DoNotOptimize(block.u().data());
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * options.num_frames));
+}
+BENCHMARK(BM_ScenarioGenerator)
+    ->RangeMultiplier(4)
+    ->Range(1, 16)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Generation of 16384 frames streamed into a detection log, 4096 frames per batch. Args: number of threads.
+static void BM_ScenarioGeneratorLog(benchmark::State& bench_state) {
+  gtcal::ScenarioGenerator::Options options;
+  options.num_frames = 16384;
+  options.num_threads = bench_state.range(0);
+  const gtcal::ScenarioGenerator generator(MakeRig(), options);
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "gtcal_bench_scenario_generator.bin").string();
+  for (auto _ : bench_state) {
+    gtcal::DetectionLogWriter writer(path);
+    if (!generator.generate(writer) || !writer.close()) {
+      bench_state.SkipWithError("Failed to write the log.");
+      break;
+    }
+  }
+  std::filesystem::remove(path);
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * options.num_frames));
+}
+BENCHMARK(BM_ScenarioGeneratorLog)
+    ->RangeMultiplier(4)
+    ->Range(1, 16)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,86 @@
+#include "gtcal/corner_detector.h"
+#include "gtcal/target_renderer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <gtsam/geometry/Cal3Fisheye.h>
+#include <gtsam/geometry/Cal3_S2.h>
+
+#include <vector>
+
+namespace {
+
+const gtcal::utils::CalibrationTarget kTarget(0.05, 10, 13);
+
+/**
+ * @brief Return a 1280x720 camera, pinhole or fisheye.
+ *
+ */
+gtcal::Camera MakeCamera(const bool fisheye) {
+  gtcal::Camera camera;
+  if (fisheye) {
+    camera.setCameraModel<gtsam::Cal3Fisheye>(
+        1280, 720, gtsam::Cal3Fisheye(600., 600., 0., 640., 360., -0.02, 0.01, 0., 0.));
+  } else {
+    camera.setCameraModel<gtsam::Cal3_S2>(1280, 720, gtsam::Cal3_S2(900., 900., 0., 640., 360.));
+  }
+  return camera;
+}
+
+/**
+ * @brief Return 64 poses looking at the target center from 0.8 m, tilted by up to about 0.3 rad.
+ *
+ */
+std::vector<gtsam::Pose3> MakePoses() {
+  std::vector<gtsam::Pose3> poses_target_cam;
+  const gtsam::Point3 center = kTarget.get3dCenter();
+  for (size_t ii = 0; ii < 64; ii++) {
+    const gtsam::Rot3 R = gtsam::Rot3::RzRyRx(0.3 * std::sin(0.7 * ii), 0.3 * std::cos(1.3 * ii), 0.1 * ii);
+    poses_target_cam.emplace_back(R, center - R.rotate(gtsam::Point3(0., 0., 0.8)));
+  }
+  return poses_target_cam;
+}
+
+}  // namespace
+
+// Rendering throughput of 64 noisy, blurred 1280x720 images. Args: fisheye, number of threads.
+static void BM_TargetRenderer(benchmark::State& bench_state) {
+  gtcal::TargetRenderer::Options options;
+  options.blur_sigma = 0.8;
+  options.noise_sigma = 2.0;
+  options.vignetting = 0.3;
+  options.num_threads = bench_state.range(1);
+  const gtcal::TargetRenderer renderer(kTarget, MakeCamera(bench_state.range(0) != 0), options);
+  const std::vector<gtsam::Pose3> poses_target_cam = MakePoses();
+  std::vector<gtcal::Image> images;
+  for (auto _ : bench_state) {
+    renderer.render(poses_target_cam, images);
+    benchmark::DoNotOptimize(images.data());
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * poses_target_cam.size()));
+}
+BENCHMARK(BM_TargetRenderer)
+    ->ArgsProduct({{0, 1}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// End-to-end throughput: render 64 images, then detect the target in them. Args: number of threads.
+static void BM_RenderAndDetect(benchmark::State& bench_state) {
+  gtcal::TargetRenderer::Options render_options;
+  render_options.blur_sigma = 0.8;
+  render_options.noise_sigma = 2.0;
+  render_options.num_threads = bench_state.range(0);
+  const gtcal::TargetRenderer renderer(kTarget, MakeCamera(false), render_options);
+  gtcal::CornerDetector::Options detect_options;
+  detect_options.num_threads = bench_state.range(0);
+  const gtcal::CornerDetector detector(kTarget, detect_options);
+  const std::vector<gtsam::Pose3> poses_target_cam = MakePoses();
+  std::vector<gtcal::Image> images;
+  std::vector<std::vector<gtcal::Measurement>> measurements;
+  for (auto _ : bench_state) {
+    renderer.render(poses_target_cam, images);
+    benchmark::DoNotOptimize(detector.detect(images, 0, measurements));
+  }
+  bench_state.SetItemsProcessed(static_cast<int64_t>(bench_state.iterations() * poses_target_cam.size()));
+}
+BENCHMARK(BM_RenderAndDetect)->RangeMultiplier(4)->Range(1, 16)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "gtcal_test_utils.h"
+#include "gtcal/alloc_tracker.h"
+#include "gtcal/camera.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+namespace bench {
+
+// A synthetic calibration sequence: ground truth frame poses and the measurements seen at each of them.
+struct Sequence {
+  gtsam::Point3Vector target_points3d;
+  gtsam::Pose3Vector poses_target_cam;
+  std::vector<std::vector<Measurement>> frames;
+};
+
+/**
+ * @brief Return a camera with the default test intrinsics.
+ *
+ * @param fisheye if true, return a Cal3Fisheye camera, otherwise a Cal3_S2 one.
+ * @param pose_target_cam camera pose in the target frame.
+ * @return std::shared_ptr<Camera>
+ */
+inline std::shared_ptr<Camera> MakeCamera(const bool fisheye, const gtsam::Pose3& pose_target_cam) {
+  auto camera = std::make_shared<Camera>();
+  if (fisheye) {
+    camera->setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                               gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0., 0., 0., 0.),
+                                               pose_target_cam);
+  } else {
+    camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3_S2(FX, FY, 0., CX, CY),
+                                           pose_target_cam);
+  }
+  return camera;
+}
+
+/**
+ * @brief Return a target with about the requested number of points, with the same 10x13 aspect as the test
+ * target and spacing scaled so it fills the same area.
+ *
+ * @param num_points requested number of target points.
+ * @return utils::CalibrationTarget
+ */
+inline utils::CalibrationTarget MakeTarget(const size_t num_points) {
+  const double scale = std::sqrt(static_cast<double>(num_points) / 130.0);
+  const size_t num_rows = std::max<size_t>(2, static_cast<size_t>(std::round(10 * scale)));
+  const size_t num_cols = std::max<size_t>(2, static_cast<size_t>(std::round(13 * scale)));
+  return utils::CalibrationTarget(0.15 * 10 / num_rows, num_rows, num_cols);
+}
+
+/**
+ * @brief Return a sequence of frames looking at the target from slightly different poses, all of them
+ * seeing the whole target.
+ *
+ * @param num_frames number of frames.
+ * @param target calibration target.
+ * @param fisheye camera model used to generate the measurements.
+ * @return Sequence
+ */
+inline Sequence MakeSequence(const size_t num_frames, const utils::CalibrationTarget& target,
+                             const bool fisheye) {
+  Sequence sequence;
+  sequence.target_points3d = target.pointsTarget();
+  const gtsam::Point3 center = target.get3dCenter();
+  const auto camera = MakeCamera(fisheye, gtsam::Pose3());
+
+  for (size_t ii = 0; ii < num_frames; ii++) {
+    // Walk a 5x5 grid of offsets in front of the target, backing off a little after each pass.
+    const double dx = 0.04 * (static_cast<double>(ii % 5) - 2.);
+    const double dy = 0.04 * (static_cast<double>((ii / 5) % 5) - 2.);
+    const double dz = -0.85 - 0.01 * static_cast<double>(ii / 25 % 10);
+    const gtsam::Rot3 R_target_cam = gtsam::Rot3::RzRyRx(-0.5 * dy, 0.5 * dx, 0.);
+    const gtsam::Pose3 pose_target_cam(R_target_cam, {center.x() + dx, center.y() + dy, dz});
+    camera->setCameraPose(pose_target_cam);
+
+    std::vector<Measurement> measurements;
+    measurements.reserve(sequence.target_points3d.size());
+    for (size_t jj = 0; jj < sequence.target_points3d.size(); jj++) {
+      const gtsam::Point2 uv = camera->project(sequence.target_points3d.at(jj));
+      if (utils::FilterPixelCoords(uv, camera->width(), camera->height())) {
+        measurements.emplace_back(uv, 0, jj);
+      }
+    }
+    sequence.poses_target_cam.push_back(pose_target_cam);
+    sequence.frames.push_back(std::move(measurements));
+  }
+  return sequence;
+}
+
+/**
+ * @brief Report the heap activity of the benchmarked code as the "allocs/<item>" and "bytes/<item>" counters,
+ * e.g. "allocs/frame". gtcal_benchmarks links alloc_tracker, so every allocation is counted.
+ *
+ * @param bench_state benchmark state.
+ * @param stats heap activity over every iteration.
+ * @param num_items number of items processed over every iteration.
+ * @param item item name.
+ */
+inline void SetAllocationCounters(benchmark::State& bench_state, const alloc::AllocationStats& stats,
+                                  const double num_items, const std::string& item) {
+  bench_state.counters["allocs/" + item] = static_cast<double>(stats.allocations) / std::max(num_items, 1.);
+  bench_state.counters["bytes/" + item] = static_cast<double>(stats.bytes) / std::max(num_items, 1.);
+}
+
+}  // namespace bench
+}  // namespace gtcal
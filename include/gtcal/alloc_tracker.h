@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Scoped allocation accounting. Compiled in with -DGTCAL_ENABLE_ALLOC_TRACKING (CMake option
+// GTCAL_ENABLE_ALLOC_TRACKING), compiled out otherwise. Counting itself needs the alloc_tracker library,
+// which replaces the global operator new and delete of the program that links it.
+#ifdef GTCAL_ENABLE_ALLOC_TRACKING
+#define GTCAL_ALLOC_CONCAT_IMPL(a, b) a##b
+#define GTCAL_ALLOC_CONCAT(a, b) GTCAL_ALLOC_CONCAT_IMPL(a, b)
+#define GTCAL_ALLOC_SCOPE(name) \
+  const ::gtcal::alloc::Scope GTCAL_ALLOC_CONCAT(gtcal_alloc_scope_, __LINE__)(name)
+#else
+#define GTCAL_ALLOC_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace gtcal {
+namespace alloc {
+
+// Maximum number of distinct scope names. Scopes past it are counted in ScopeTotals() under "(other)".
+static constexpr size_t kMaxScopes = 64;
+
+// Heap activity counted by the replaced operator new and delete.
+struct AllocationStats {
+  uint64_t allocations = 0;
+  uint64_t deallocations = 0;
+  uint64_t bytes = 0;  // Bytes requested by the allocations.
+
+  AllocationStats operator-(const AllocationStats& other) const {
+    return {allocations - other.allocations, deallocations - other.deallocations, bytes - other.bytes};
+  }
+
+  AllocationStats& operator+=(const AllocationStats& other) {
+    allocations += other.allocations;
+    deallocations += other.deallocations;
+    bytes += other.bytes;
+    return *this;
+  }
+};
+
+// Accumulated heap activity of every scope with the same name.
+struct ScopeTotal {
+  const char* name = nullptr;
+  uint64_t calls = 0;
+  AllocationStats stats;
+};
+
+/**
+ * @brief Return the heap activity of the calling thread since it started. Only counts while the alloc_tracker
+ * library is linked in, see IsCounting().
+ *
+ * @return AllocationStats
+ */
+AllocationStats ThreadStats();
+
+/**
+ * @brief Return true if the replaced operator new is counting, i.e. the program links alloc_tracker and no
+ * other library replaced operator new first.
+ *
+ * @return true
+ * @return false
+ */
+bool IsCounting();
+
+/**
+ * @brief Add the heap activity of one call of a scope to the totals of its name. Doesn't allocate.
+ *
+ * @param name scope name. Must outlive the program, e.g. a string literal.
+ * @param stats heap activity of the call.
+ */
+void RecordScope(const char* name, const AllocationStats& stats);
+
+/**
+ * @brief Return the totals of every named scope recorded since the last ResetScopeTotals(), in order of first
+ * use.
+ *
+ * @return std::vector<ScopeTotal>
+ */
+std::vector<ScopeTotal> ScopeTotals();
+
+/**
+ * @brief Forget the totals of every named scope.
+ *
+ */
+void ResetScopeTotals();
+
+/**
+ * @brief Write the totals of every named scope as a table, with the allocations and bytes per call.
+ *
+ * @param os output stream.
+ */
+void WriteScopeReport(std::ostream& os);
+
+/**
+ * @brief Scoped counter of the heap activity of the calling thread. Nested scopes are inclusive: an outer
+ * scope counts the allocations of the scopes inside it. If named, the activity is added to the totals of the
+ * name when the scope closes. Prefer the GTCAL_ALLOC_SCOPE macro in library code, which compiles out without
+ * GTCAL_ENABLE_ALLOC_TRACKING.
+ */
+class Scope {
+public:
+  explicit Scope(const char* name = nullptr) : name_(name), begin_(ThreadStats()) {}
+
+  ~Scope() {
+    if (name_ != nullptr) {
+      RecordScope(name_, stats());
+    }
+  }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+  /**
+   * @brief Return the heap activity of the calling thread since the scope opened.
+   *
+   * @return AllocationStats
+   */
+  AllocationStats stats() const { return ThreadStats() - begin_; }
+
+private:
+  const char* const name_;
+  const AllocationStats begin_;
+};
+
+}  // namespace alloc
+}  // namespace gtcal
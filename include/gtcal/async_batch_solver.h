@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtsam/nonlinear/Values.h>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/bounded_queue.h"
+#include "gtcal/latency_histogram.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+class AsyncBatchSolver {
+public:
+  // What push() does when the ingestion queue is full.
+  enum class DropPolicy {
+    BLOCK,        // Wait for the optimizer thread to free a slot (up to Options::block_timeout).
+    DROP_NEWEST,  // Reject the frame being pushed.
+    DROP_OLDEST   // Evict the oldest queued frame to make room.
+  };
+
+  struct Options {
+    // Maximum number of frames waiting for the optimizer thread. Rounded up to a power of two.
+    size_t queue_capacity = 64;
+
+    // Backpressure policy when the queue is full.
+    DropPolicy drop_policy = DropPolicy::BLOCK;
+
+    // Maximum time push() waits for a free slot with DropPolicy::BLOCK before rejecting the frame.
+    std::chrono::microseconds block_timeout = std::chrono::seconds(1);
+  };
+
+  // Latest estimate published by the optimizer thread.
+  struct Snapshot {
+    // iSAM2 estimate after the last update.
+    gtsam::Values estimate;
+
+    // Number of frames incorporated in the estimate.
+    size_t num_frames = 0;
+  };
+
+  // Frame counters.
+  struct Stats {
+    size_t num_pushed = 0;     // Frames accepted into the queue.
+    size_t num_dropped = 0;    // Frames rejected or evicted because the queue was full.
+    size_t num_processed = 0;  // Frames added to the solver.
+    size_t num_failed = 0;     // Frames for which the solver threw.
+  };
+
+public:
+  /**
+   * @brief Construct a new Async Batch Solver object and start the optimizer thread.
+   *
+   * @param solver solver used to build the factors for each frame.
+   * @param state solver state, owned by the optimizer thread until stop() is called.
+   * @param options queue options.
+   */
+  AsyncBatchSolver(const BatchSolver& solver, std::unique_ptr<BatchSolver::State> state,
+                   const Options& options);
+  AsyncBatchSolver(const BatchSolver& solver, std::unique_ptr<BatchSolver::State> state);
+
+  /**
+   * @brief Destroy the Async Batch Solver object. Stops the optimizer thread after draining the queue.
+   *
+   */
+  ~AsyncBatchSolver();
+
+  AsyncBatchSolver(const AsyncBatchSolver&) = delete;
+  AsyncBatchSolver& operator=(const AsyncBatchSolver&) = delete;
+
+  /**
+   * @brief Return true if the frame was queued. Return false if it was dropped according to the drop policy
+   * or if the solver was stopped. Safe to call from any number of threads. All measurements must be from the
+   * same camera (see BatchSolver::solve).
+   *
+   * @param measurements frame measurements, moved into the queue on success and left untouched if the frame
+   * is rejected, so that the caller may retry or log it.
+   * @return true
+   * @return false
+   */
+  bool push(std::vector<Measurement>&& measurements);
+
+  /**
+   * @brief Return the latest published estimate. Never blocks the optimizer thread. Returns nullptr until
+   * the first frame has been processed.
+   *
+   * @return std::shared_ptr<const Snapshot>
+   */
+  std::shared_ptr<const Snapshot> snapshot() const { return snapshot_.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Block until every frame queued so far has been processed or dropped.
+   *
+   */
+  void flush();
+
+  /**
+   * @brief Drain the queue, stop the optimizer thread and hand back the solver state. Further pushes are
+   * rejected.
+   *
+   * @return std::unique_ptr<BatchSolver::State>
+   */
+  std::unique_ptr<BatchSolver::State> stop();
+
+  /**
+   * @brief Return the frame counters.
+   *
+   * @return Stats
+   */
+  Stats stats() const;
+
+  /**
+   * @brief Return the histogram of the time frames spend in the queue.
+   *
+   * @return const LatencyHistogram&
+   */
+  const LatencyHistogram& queueWaitHistogram() const { return queue_wait_histogram_; }
+
+  /**
+   * @brief Return the histogram of the time spent building factors and updating iSAM per frame.
+   *
+   * @return const LatencyHistogram&
+   */
+  const LatencyHistogram& updateHistogram() const { return update_histogram_; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Frame {
+    std::vector<Measurement> measurements;
+    Clock::time_point enqueue_time;
+  };
+
+  /**
+   * @brief Optimizer thread loop.
+   *
+   */
+  void run();
+
+  /**
+   * @brief Retire a frame that left the queue and wake up flush().
+   *
+   */
+  void retire();
+
+  /**
+   * @brief Wake up the optimizer thread.
+   *
+   */
+  void notifyWork();
+
+private:
+  const BatchSolver solver_;
+  const Options options_;
+  std::unique_ptr<BatchSolver::State> state_;
+
+  BoundedQueue<Frame> queue_;
+  std::atomic<std::shared_ptr<const Snapshot>> snapshot_;
+
+  // Wake-up counter for the optimizer thread and stop flag.
+  std::atomic<uint64_t> work_epoch_{0};
+  std::atomic<bool> stop_requested_{false};
+  std::atomic<bool> stopped_{false};
+
+  // Counters. num_retired_ counts frames that left the queue (processed, failed or evicted).
+  std::atomic<size_t> num_pushed_{0};
+  std::atomic<size_t> num_dropped_{0};
+  std::atomic<size_t> num_processed_{0};
+  std::atomic<size_t> num_failed_{0};
+  std::atomic<size_t> num_retired_{0};
+
+  LatencyHistogram queue_wait_histogram_;
+  LatencyHistogram update_histogram_;
+
+  std::thread optimizer_thread_;
+};
+
+}  // namespace gtcal
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 
 #include <gtsam/nonlinear/ISAM2.h>
@@ -8,12 +9,67 @@
 #include <gtsam/linear/NoiseModel.h>
 
 #include "gtcal/camera.h"
+#include "gtcal/measurement_block.h"
 
 namespace gtcal {
-struct Measurement;
 
 class BatchSolver {
 public:
+  // Optimizer used by the solver. ISAM2 updates the estimate incrementally in solve(). The batch optimizers
+  // only accumulate factors in solve() and optimize the whole graph in optimize().
+  enum class OptimizerType { ISAM2, LEVENBERG_MARQUARDT, DOGLEG };
+
+  // Variable ordering used by the batch optimizers. METIS requires gtsam built with METIS support.
+  enum class OrderingType { COLAMD, METIS, NATURAL };
+
+  // Noise models for the different types of factors and optimizer settings.
+  struct Options {
+    // Default noise model for initial camera pose prior.
+    gtsam::noiseModel::Diagonal::shared_ptr pose_prior_noise_model = nullptr;
+
+    // Default noise model for the landmark priors.
+    gtsam::noiseModel::Diagonal::shared_ptr landmark_prior_noise_model = nullptr;
+
+    // Default noise model for the pixel measurements.
+    gtsam::noiseModel::Isotropic::shared_ptr pixel_meas_noise_model = nullptr;
+
+    // If true, target points are baked into TargetProjectionFactors that only connect the frame pose and the
+    // intrinsics. Otherwise each target point is an L(point_id) landmark variable with a tight prior.
+    bool use_target_factors = false;
+
+    // Optimizer and, for the batch optimizers, variable ordering and maximum number of iterations.
+    OptimizerType optimizer_type = OptimizerType::ISAM2;
+    OrderingType ordering_type = OrderingType::COLAMD;
+    size_t max_iterations = 100;
+
+    // Maximum number of threads used for linearization and elimination (0 for all cores). Only has an effect
+    // when gtsam is built with TBB. The limit applies to the work of this solver, not to the whole process,
+    // so solvers with different limits can run concurrently.
+    size_t num_threads = 0;
+
+    // iSAM2 relinearization thresholds per variable type, applied to every component of the variable's
+    // tangent space delta, and number of updates between relinearization checks.
+    double pose_relinearize_threshold = 0.01;
+    double landmark_relinearize_threshold = 0.01;
+    double calibration_relinearize_threshold = 0.01;
+    size_t relinearize_skip = 1;
+
+    // If true, a camera's intrinsics are held at their linearization point once their marginal standard
+    // deviations have converged: every calibration_check_interval frames of the camera, the largest relative
+    // change of the sigmas since the last check is compared against calibration_freeze_tolerance, and the
+    // intrinsics are frozen after calibration_freeze_checks consecutive checks below it. iSAM2 only.
+    bool freeze_converged_calibration = false;
+    size_t calibration_check_interval = 5;
+    double calibration_freeze_tolerance = 0.01;
+    size_t calibration_freeze_checks = 3;
+
+    Options()
+      : pose_prior_noise_model(gtsam::noiseModel::Diagonal::Sigmas(
+            (gtsam::Vector(6) << gtsam::Vector3::Constant(0.1), gtsam::Vector3::Constant(0.1)).finished()))
+      , landmark_prior_noise_model(gtsam::noiseModel::Isotropic::Sigma(3, 1e-8))
+      , pixel_meas_noise_model(gtsam::noiseModel::Isotropic::Sigma(2, 1.0)) {}
+  };
+
   // State of the solver.
   struct State {
     // To keep track of the camera order in the solver.
@@ -25,6 +81,18 @@ public:
     // To keep track of the number of times each camera's model and pose has been updated.
     std::vector<size_t> num_camera_updates;
 
+    // Total number of frames added to the solver. Each frame gets its own pose variable X(frame index).
+    size_t num_frames = 0;
+
+    // Calibration convergence tracking: marginal sigmas at the last check, number of consecutive converged
+    // checks and whether the intrinsics are frozen, per camera.
+    std::vector<gtsam::Vector> calibration_sigmas;
+    std::vector<size_t> calibration_converged_checks;
+    std::vector<bool> calibration_frozen;
+
+    // Total number of variables relinearized by iSAM2 updates.
+    size_t num_variables_relinearized = 0;
+
     // Solver components.
     gtsam::ISAM2 isam;
     gtsam::NonlinearFactorGraph graph;
@@ -38,42 +106,61 @@ public:
     size_t numCameras() const { return cameras.size(); }
 
     /**
-     * @brief Construct a new State object.
+     * @brief Construct a new State object. The iSAM2 relinearization parameters are taken from the solver
+     * options.
      *
      * @param camera_models
+     * @param options solver options.
      */
-    explicit State(const std::vector<std::shared_ptr<Camera>>& camera_models);
-  };
-
-  // Noise models for the different types of factors.
-  struct Options {
-    // Default noise model for initial camera pose prior.
-    gtsam::noiseModel::Diagonal::shared_ptr pose_prior_noise_model = nullptr;
-
-    // Default noise model for the landmark priors.
-    gtsam::noiseModel::Diagonal::shared_ptr landmark_prior_noise_model = nullptr;
-
-    // Default noise model for the pixel measurements.
-    gtsam::noiseModel::Isotropic::shared_ptr pixel_meas_noise_model = nullptr;
-
-    Options()
-      : pose_prior_noise_model(gtsam::noiseModel::Diagonal::Sigmas(
-            (gtsam::Vector(6) << gtsam::Vector3::Constant(0.1), gtsam::Vector3::Constant(0.1)).finished()))
-      , landmark_prior_noise_model(gtsam::noiseModel::Isotropic::Sigma(3, 1e-8))
-      , pixel_meas_noise_model(gtsam::noiseModel::Isotropic::Sigma(2, 1.0)) {}
+    explicit State(const std::vector<std::shared_ptr<Camera>>& camera_models,
+                   const Options& options = Options());
   };
 
 public:
   BatchSolver(const gtsam::Point3Vector& pts3d_target, const Options& options = Options());
 
   /**
-   * @brief
+   * @brief Add a frame of measurements from a single camera to the graph and update iSAM. The camera's
+   * current pose is used as the initial estimate for the frame pose. The camera's pose and calibration are
+   * updated with the latest estimate afterwards. If the update throws (e.g. an indeterminant system), the
+   * exception propagates and the state is left as it was before the call.
    *
-   * @param measurements
-   * @param state
+   * @param measurements measurements taken by the same camera at one pose.
+   * @param state solver state to update.
    */
   void solve(const std::vector<Measurement>& measurements, State& state) const;
 
+  /**
+   * @brief Add a frame of measurements from a single camera stored as a structure of arrays, e.g. a frame of
+   * a MeasurementBlock. Same as the std::vector overload otherwise.
+   *
+   * @param measurements measurements taken by the same camera at one pose.
+   * @param state solver state to update.
+   */
+  void solve(const MeasurementSpan& measurements, State& state) const;
+
+  /**
+   * @brief Add a frame of measurements with a pixel covariance per measurement, e.g. from the CornerRefiner,
+   * used as their noise models instead of pixel_meas_noise_model. Same as the other overloads otherwise.
+   *
+   * @param measurements measurements taken by the same camera at one pose.
+   * @param covariances pixel covariance of each measurement.
+   * @param state solver state to update.
+   */
+  void solve(const std::vector<Measurement>& measurements, const std::vector<gtsam::Matrix2>& covariances,
+             State& state) const;
+
+  /**
+   * @brief Optimize the whole graph. With the batch optimizers, this runs Levenberg-Marquardt or Dogleg on
+   * every factor added so far; with ISAM2 it runs one more iSAM2 iteration. The cameras' calibrations are
+   * updated with the result. Return false if the optimizer threw (e.g. an indeterminant system).
+   *
+   * @param state solver state to optimize.
+   * @return true
+   * @return false
+   */
+  bool optimize(State& state) const;
+
   /**
    * @brief
    *
@@ -100,22 +187,42 @@ public:
    *
    * @param camera_index
    * @param camera
-   * @param num_camera_update
-   * @param measurements
+   * @param pose_index
+   * @param measurements std::vector<Measurement> or MeasurementSpan.
    * @param graph
+   * @param covariances pixel covariance of each measurement, or nullptr for pixel_meas_noise_model.
    */
+  template <typename MeasurementRange>
   void addLandmarkFactors(const size_t camera_index, const std::shared_ptr<gtcal::Camera>& camera,
-                          const size_t num_camera_update, const std::vector<Measurement>& measurements,
-                          gtsam::NonlinearFactorGraph& graph) const;
+                          const size_t pose_index, const MeasurementRange& measurements,
+                          gtsam::NonlinearFactorGraph& graph,
+                          const std::vector<gtsam::Matrix2>* covariances = nullptr) const;
+
+  /**
+   * @brief Add a TargetProjectionFactor between the frame pose and the camera calibration for each
+   * measurement.
+   *
+   * @param camera_index index of the camera in the solver state.
+   * @param camera camera that took the measurements.
+   * @param pose_index index of the frame pose.
+   * @param measurements measurements of the frame, std::vector<Measurement> or MeasurementSpan.
+   * @param graph graph to add the factors to.
+   * @param covariances pixel covariance of each measurement, or nullptr for pixel_meas_noise_model.
+   */
+  template <typename MeasurementRange>
+  void addTargetFactors(const size_t camera_index, const std::shared_ptr<gtcal::Camera>& camera,
+                        const size_t pose_index, const MeasurementRange& measurements,
+                        gtsam::NonlinearFactorGraph& graph,
+                        const std::vector<gtsam::Matrix2>* covariances = nullptr) const;
 
   /**
    * @brief
    *
-   * @param camera_index
+   * @param pose_index
    * @param pose_target_cam
    * @param graph
    */
-  void addPosePrior(const size_t camera_index, const gtsam::Pose3& pose_target_cam,
+  void addPosePrior(const size_t pose_index, const gtsam::Pose3& pose_target_cam,
                     gtsam::NonlinearFactorGraph& graph) const;
 
   /**
@@ -125,9 +232,37 @@ public:
    */
   const gtsam::Point3Vector& targetPoints() const { return pts3d_target_; }
 
+private:
+  /**
+   * @brief Implementation of solve() for both measurement containers, with optional per-measurement pixel
+   * covariances.
+   *
+   */
+  template <typename MeasurementRange>
+  void solveFrame(const MeasurementRange& measurements, State& state,
+                  const std::vector<gtsam::Matrix2>* covariances = nullptr) const;
+
+  /**
+   * @brief Return the noise model of the measurement at an index: a Gaussian with its covariance, or
+   * pixel_meas_noise_model without covariances.
+   *
+   */
+  gtsam::SharedNoiseModel pixelNoiseModel(const std::vector<gtsam::Matrix2>* covariances,
+                                          const size_t index) const;
+
+  /**
+   * @brief Runs gtsam's TBB work with at most Options::num_threads threads. Defined in the source file to
+   * keep TBB out of this header.
+   *
+   */
+  class ThreadArena;
+
 private:
   const gtsam::Point3Vector pts3d_target_;
   const Options options_;
+
+  // Shared by copies of the solver, which have the same options.
+  std::shared_ptr<ThreadArena> thread_arena_;
 };
 
 }  // namespace gtcal
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gtcal {
+
+// Repetitions of one benchmark of a Google Benchmark JSON run (--benchmark_format=json or
+// --benchmark_out_format=json), with the times converted to nanoseconds per iteration.
+struct BenchmarkSamples {
+  std::string name;  // Run name, e.g. "BM_PoseSolver/0/130/4/real_time".
+  std::vector<double> real_time_ns;
+  std::vector<double> cpu_time_ns;
+};
+
+/**
+ * @brief Return true if the text was a Google Benchmark JSON run holding at least one benchmark. Repetitions
+ * of the same benchmark are gathered in order of appearance. Aggregates (mean, median, ...) are skipped,
+ * unless a benchmark only has aggregates (--benchmark_report_aggregates_only), in which case its median is
+ * used as a single sample.
+ *
+ * @param text JSON text.
+ * @param benchmarks parsed benchmarks, in order of first appearance.
+ * @param error description of the first error, if any.
+ * @return true
+ * @return false
+ */
+bool ParseBenchmarkJson(std::string_view text, std::vector<BenchmarkSamples>& benchmarks, std::string& error);
+
+/**
+ * @brief Return true if the file was read and parsed. See ParseBenchmarkJson().
+ *
+ */
+bool LoadBenchmarkJson(const std::string& path, std::vector<BenchmarkSamples>& benchmarks,
+                       std::string& error);
+
+/**
+ * @brief Return the two-sided p-value of the Mann-Whitney U test of two samples, i.e. the probability of a
+ * rank sum at least as extreme if both samples came from the same distribution. The exact distribution of U
+ * is used when both samples have at most kMaxExactSize values, the normal approximation with tie and
+ * continuity corrections otherwise. Return 1 if either sample is empty.
+ *
+ * @param a first sample.
+ * @param b second sample.
+ * @return double
+ */
+double MannWhitneyPValue(const std::vector<double>& a, const std::vector<double>& b);
+
+/**
+ * @brief Compares two Google Benchmark runs of gtcal, e.g. before and after an upgrade. A benchmark regresses
+ * if its median time grew by more than the threshold and the Mann-Whitney U test over the repetitions of both
+ * runs rejects equal distributions at the given significance level. Benchmarks with too few repetitions for
+ * the test to ever reach that level are judged on the threshold alone.
+ */
+class BenchmarkComparator {
+public:
+  static constexpr size_t kMaxExactSize = 25;
+
+  enum class Verdict { UNCHANGED, IMPROVEMENT, REGRESSION, MISSING, NEW };
+
+  struct Options {
+    // Relative change of the median time above which a benchmark is flagged.
+    double threshold = 0.05;
+
+    // Significance level of the Mann-Whitney U test.
+    double alpha = 0.05;
+
+    // Compare the CPU times instead of the real times.
+    bool use_cpu_time = false;
+  };
+
+  struct Comparison {
+    std::string name;
+    Verdict verdict = Verdict::UNCHANGED;
+    size_t baseline_repetitions = 0;
+    size_t contender_repetitions = 0;
+    double baseline_median_ns = 0.0;
+    double contender_median_ns = 0.0;
+    double change = 0.0;    // contender_median_ns / baseline_median_ns - 1.
+    double p_value = 1.0;   // NaN if the test couldn't be applied.
+  };
+
+public:
+  BenchmarkComparator();
+  explicit BenchmarkComparator(const Options& options);
+
+  /**
+   * @brief Return the comparison of every benchmark of either run, in the baseline order followed by the
+   * benchmarks only in the contender.
+   *
+   * @param baseline benchmarks of the reference run.
+   * @param contender benchmarks of the run to check.
+   * @return std::vector<Comparison>
+   */
+  std::vector<Comparison> compare(const std::vector<BenchmarkSamples>& baseline,
+                                  const std::vector<BenchmarkSamples>& contender) const;
+
+  /**
+   * @brief Write a compact text report: the flagged benchmarks (every benchmark if verbose), the worst
+   * change of each benchmark family (e.g. BM_PoseSolver) and a summary line.
+   *
+   * @param comparisons comparisons returned by compare().
+   * @param os output stream.
+   * @param verbose if true, list unchanged benchmarks too.
+   */
+  void writeReport(const std::vector<Comparison>& comparisons, std::ostream& os,
+                   const bool verbose = false) const;
+
+  /**
+   * @brief Write the options and every comparison as JSON.
+   *
+   * @param comparisons comparisons returned by compare().
+   * @param os output stream.
+   */
+  void writeJson(const std::vector<Comparison>& comparisons, std::ostream& os) const;
+
+  /**
+   * @brief Return the number of regressions among the comparisons.
+   *
+   * @param comparisons comparisons returned by compare().
+   * @return size_t
+   */
+  static size_t NumRegressions(const std::vector<Comparison>& comparisons);
+
+  /**
+   * @brief Return the name of a verdict, e.g. "REGRESSION".
+   *
+   * @param verdict verdict.
+   * @return const char*
+   */
+  static const char* VerdictName(const Verdict verdict);
+
+private:
+  const Options options_;
+};
+
+}  // namespace gtcal
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace gtcal {
+namespace io {
+
+/**
+ * @brief Append-only byte buffer for trivially copyable values, written in native byte order.
+ */
+class ByteWriter {
+public:
+  /**
+   * @brief Append a trivially copyable value.
+   *
+   * @tparam T value type.
+   * @param value value to append.
+   */
+  template <typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "ByteWriter only writes trivially copyable types.");
+    writeBytes(&value, sizeof(T));
+  }
+
+  /**
+   * @brief Append a length-prefixed array of trivially copyable values.
+   *
+   * @tparam T value type.
+   * @param values values to append.
+   */
+  template <typename T>
+  void writeVector(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>, "ByteWriter only writes trivially copyable types.");
+    write<uint32_t>(static_cast<uint32_t>(values.size()));
+    writeBytes(values.data(), values.size() * sizeof(T));
+  }
+
+  /**
+   * @brief Append raw bytes.
+   *
+   * @param data pointer to the bytes.
+   * @param size number of bytes.
+   */
+  void writeBytes(const void* data, const size_t size) {
+    const auto* bytes = static_cast<const char*>(data);
+    buffer_.append(bytes, size);
+  }
+
+  /**
+   * @brief Return the written bytes.
+   *
+   * @return const std::string&
+   */
+  const std::string& buffer() const { return buffer_; }
+
+  /**
+   * @brief Move the written bytes out of the writer.
+   *
+   * @return std::string
+   */
+  std::string release() { return std::move(buffer_); }
+
+  /**
+   * @brief Return the number of bytes written.
+   *
+   * @return size_t
+   */
+  size_t size() const { return buffer_.size(); }
+
+private:
+  std::string buffer_;
+};
+
+/**
+ * @brief Bounds-checked reader over a byte range. Every read returns false instead of reading past the end.
+ */
+class ByteReader {
+public:
+  ByteReader(const void* data, const size_t size) : data_(static_cast<const char*>(data)), size_(size) {}
+  explicit ByteReader(std::string_view bytes) : ByteReader(bytes.data(), bytes.size()) {}
+
+  /**
+   * @brief Return true if a trivially copyable value was read. Return false if there aren't enough bytes.
+   *
+   * @tparam T value type.
+   * @param value read value.
+   * @return true
+   * @return false
+   */
+  template <typename T>
+  bool read(T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "ByteReader only reads trivially copyable types.");
+    return readBytes(&value, sizeof(T));
+  }
+
+  /**
+   * @brief Return true if a length-prefixed array was read. Return false if there aren't enough bytes.
+   *
+   * @tparam T value type.
+   * @param values read values.
+   * @return true
+   * @return false
+   */
+  template <typename T>
+  bool readVector(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>, "ByteReader only reads trivially copyable types.");
+    uint32_t size = 0;
+    if (!read(size) || static_cast<size_t>(size) * sizeof(T) > remaining()) {
+      return false;
+    }
+    values.resize(size);
+    return readBytes(values.data(), values.size() * sizeof(T));
+  }
+
+  /**
+   * @brief Return true if the requested number of bytes was copied out. Return false otherwise.
+   *
+   * @param data destination.
+   * @param size number of bytes.
+   * @return true
+   * @return false
+   */
+  bool readBytes(void* data, const size_t size) {
+    if (size > remaining()) {
+      return false;
+    }
+    std::memcpy(data, data_ + offset_, size);
+    offset_ += size;
+    return true;
+  }
+
+  /**
+   * @brief Return true if the requested number of bytes was skipped. Return false otherwise.
+   *
+   * @param size number of bytes.
+   * @return true
+   * @return false
+   */
+  bool skip(const size_t size) {
+    if (size > remaining()) {
+      return false;
+    }
+    offset_ += size;
+    return true;
+  }
+
+  /**
+   * @brief Return a pointer to the current read position.
+   *
+   * @return const char*
+   */
+  const char* current() const { return data_ + offset_; }
+
+  /**
+   * @brief Return the number of bytes left.
+   *
+   * @return size_t
+   */
+  size_t remaining() const { return size_ - offset_; }
+
+  /**
+   * @brief Return the current read offset.
+   *
+   * @return size_t
+   */
+  size_t offset() const { return offset_; }
+
+private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t offset_ = 0;
+};
+
+/**
+ * @brief Return the 32-bit FNV-1a hash of a byte range. Used to detect torn or corrupted records.
+ *
+ * @param data pointer to the bytes.
+ * @param size number of bytes.
+ * @return uint32_t
+ */
+inline uint32_t Fnv1a32(const void* data, const size_t size) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  uint32_t hash = 2166136261u;
+  for (size_t ii = 0; ii < size; ii++) {
+    hash ^= bytes[ii];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+namespace detail {
+
+static constexpr uint64_t kXxPrime64_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t kXxPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t kXxPrime64_3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t kXxPrime64_4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t kXxPrime64_5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t Rotl64(const uint64_t x, const int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t XxRound64(uint64_t acc, const uint64_t input) {
+  acc += input * kXxPrime64_2;
+  return Rotl64(acc, 31) * kXxPrime64_1;
+}
+
+inline uint64_t XxMergeRound64(uint64_t acc, const uint64_t value) {
+  acc ^= XxRound64(0, value);
+  return acc * kXxPrime64_1 + kXxPrime64_4;
+}
+
+template <typename T>
+T XxRead(const unsigned char* bytes) {
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Return the 64-bit XXH64 hash of a byte range, as specified by the xxHash reference (little-endian
+ * reads, so hashes match the reference on little-endian hosts). Hashes several GB/s, used to key content.
+ *
+ * @param data pointer to the bytes.
+ * @param size number of bytes.
+ * @param seed hash seed.
+ * @return uint64_t
+ */
+inline uint64_t XxHash64(const void* data, const size_t size, const uint64_t seed = 0) {
+  using namespace detail;
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  const unsigned char* const end = bytes + size;
+  uint64_t hash = 0;
+  if (size >= 32) {
+    // Four lanes over 32-byte stripes.
+    uint64_t v1 = seed + kXxPrime64_1 + kXxPrime64_2;
+    uint64_t v2 = seed + kXxPrime64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kXxPrime64_1;
+    for (; end - bytes >= 32; bytes += 32) {
+      v1 = XxRound64(v1, XxRead<uint64_t>(bytes));
+      v2 = XxRound64(v2, XxRead<uint64_t>(bytes + 8));
+      v3 = XxRound64(v3, XxRead<uint64_t>(bytes + 16));
+      v4 = XxRound64(v4, XxRead<uint64_t>(bytes + 24));
+    }
+    hash = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+    hash = XxMergeRound64(hash, v1);
+    hash = XxMergeRound64(hash, v2);
+    hash = XxMergeRound64(hash, v3);
+    hash = XxMergeRound64(hash, v4);
+  } else {
+    hash = seed + kXxPrime64_5;
+  }
+  hash += static_cast<uint64_t>(size);
+
+  // Tail.
+  for (; end - bytes >= 8; bytes += 8) {
+    hash ^= XxRound64(0, XxRead<uint64_t>(bytes));
+    hash = Rotl64(hash, 27) * kXxPrime64_1 + kXxPrime64_4;
+  }
+  if (end - bytes >= 4) {
+    hash ^= static_cast<uint64_t>(XxRead<uint32_t>(bytes)) * kXxPrime64_1;
+    hash = Rotl64(hash, 23) * kXxPrime64_2 + kXxPrime64_3;
+    bytes += 4;
+  }
+  for (; bytes < end; bytes++) {
+    hash ^= *bytes * kXxPrime64_5;
+    hash = Rotl64(hash, 11) * kXxPrime64_1;
+  }
+
+  // Avalanche.
+  hash ^= hash >> 33;
+  hash *= kXxPrime64_2;
+  hash ^= hash >> 29;
+  hash *= kXxPrime64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/**
+ * @brief Return the IEEE 754 half precision encoding of a float, rounded to nearest even. Values too large
+ * for half precision become infinities.
+ *
+ * @param value value to encode.
+ * @return uint16_t
+ */
+inline uint16_t FloatToHalf(const float value) {
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+  const uint32_t abs = bits & 0x7FFFFFFFu;
+
+  // NaN and infinity.
+  if (abs >= 0x7F800000u) {
+    return sign | 0x7C00u | (abs > 0x7F800000u ? 0x0200u : 0u);
+  }
+
+  // Rounds to infinity (65520 and up).
+  if (abs >= 0x477FF000u) {
+    return sign | 0x7C00u;
+  }
+
+  // Subnormal half (below 2^-14), or zero below 2^-25.
+  if (abs < 0x38800000u) {
+    if (abs < 0x33000000u) {
+      return sign;
+    }
+    const uint32_t exponent = abs >> 23;
+    const uint32_t mantissa = (abs & 0x7FFFFFu) | 0x800000u;
+    const uint32_t shift = 126 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+      half++;
+    }
+    return sign | static_cast<uint16_t>(half);
+  }
+
+  // Normal half: rebias the exponent and round the mantissa.
+  uint32_t half = (abs - 0x38000000u) >> 13;
+  const uint32_t remainder = abs & 0x1FFFu;
+  if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+    half++;
+  }
+  return sign | static_cast<uint16_t>(half);
+}
+
+/**
+ * @brief Return the float value of an IEEE 754 half precision encoding.
+ *
+ * @param half encoded value.
+ * @return float
+ */
+inline float HalfToFloat(const uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1Fu;
+  uint32_t mantissa = half & 0x3FFu;
+  uint32_t bits = 0;
+  if (exponent == 0x1Fu) {
+    bits = sign | 0x7F800000u | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa != 0) {
+    // Subnormal half, normalized for the float encoding.
+    uint32_t float_exponent = 113;
+    while ((mantissa & 0x400u) == 0) {
+      mantissa <<= 1;
+      float_exponent--;
+    }
+    bits = sign | (float_exponent << 23) | ((mantissa & 0x3FFu) << 13);
+  } else {
+    bits = sign;
+  }
+  float value = 0.f;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace io
+}  // namespace gtcal
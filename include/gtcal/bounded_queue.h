@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace gtcal {
+
+/**
+ * @brief Lock-free bounded queue (Vyukov's array queue). Any number of threads may push. It is meant to be
+ * drained by a single consumer, but popping from several threads is also safe, which lets producers evict
+ * the oldest item when the queue is full.
+ *
+ * @tparam T item type. Must be default constructible and move assignable.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+  /**
+   * @brief Construct a new Bounded Queue object.
+   *
+   * @param capacity requested capacity, rounded up to the next power of two.
+   */
+  explicit BoundedQueue(const size_t capacity)
+    : capacity_(std::bit_ceil(capacity < 2 ? size_t{2} : capacity)), mask_(capacity_ - 1),
+      cells_(std::make_unique<Cell[]>(capacity_)) {
+    for (size_t ii = 0; ii < capacity_; ii++) {
+      cells_[ii].sequence.store(ii, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  /**
+   * @brief Return true if the item was pushed. Return false if the queue is full, in which case the item is
+   * left untouched.
+   *
+   * @param item item to move into the queue.
+   * @return true
+   * @return false
+   */
+  bool tryPush(T& item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t seq = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.data = std::move(item);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Return true if an item was popped into the given argument. Return false if the queue is empty.
+   *
+   * @param item popped item.
+   * @return true
+   * @return false
+   */
+  bool tryPop(T& item) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t seq = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          item = std::move(cell.data);
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Return the approximate number of items in the queue. Only exact when no other thread is pushing
+   * or popping.
+   *
+   * @return size_t
+   */
+  size_t sizeApprox() const {
+    const size_t enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+    const size_t dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+  /**
+   * @brief Return the queue capacity.
+   *
+   * @return size_t
+   */
+  size_t capacity() const { return capacity_; }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence{0};
+    T data{};
+  };
+
+  // Keep producer and consumer positions on separate cache lines.
+  static constexpr size_t kCacheLineSize = 64;
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_{0};
+  alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_{0};
+};
+
+}  // namespace gtcal
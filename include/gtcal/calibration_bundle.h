@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtsam/base/Matrix.h>
+#include <gtsam/geometry/Point2.h>
+#include <gtsam/geometry/Rot3.h>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/camera.h"
+#include "gtcal/mapped_file.h"
+
+namespace gtcal {
+
+/**
+ * Calibration bundle file layout (native byte order). The file is meant to be memory-mapped and used as is:
+ *
+ *   header:   "GTCALBDL" | u32 version | u32 num_cameras | u64 file size | u32 FNV-1a of the camera records |
+ *             u32 reserved
+ *   cameras:  CalibrationBundleCamera[num_cameras]
+ *   maps:     one undistortion map per camera, each 64-byte aligned
+ *
+ * A map has an entry per pixel (x, y) of the undistorted and rectified image, row by row, holding the offset
+ * (du, dv) from (x, y) to the pixel to sample in the original image. Offsets are stored instead of absolute
+ * coordinates so the 16 bit formats keep their precision on large images. Pixels whose ray misses the
+ * original image hold NaN (float formats) or kFixedPointMapInvalid (fixed point).
+ */
+static constexpr char kCalibrationBundleMagic[8] = {'G', 'T', 'C', 'A', 'L', 'B', 'D', 'L'};
+static constexpr uint32_t kCalibrationBundleVersion = 1;
+
+// Alignment of the maps in the file.
+static constexpr uint64_t kCalibrationBundleMapAlignment = 64;
+
+// Map entry formats: float32 pairs, float16 pairs, or int16 pairs in 1/16 pixel.
+enum class MapFormat : uint32_t { NONE = 0, FLOAT32 = 1, FLOAT16 = 2, FIXED16 = 3 };
+static constexpr int kFixedPointMapFractionBits = 4;
+static constexpr int16_t kFixedPointMapInvalid = INT16_MIN;
+
+// Camera record, read in place from the mapping.
+struct CalibrationBundleCamera {
+  uint32_t model_type = 0;  // Camera::ModelType.
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t num_intrinsics = 0;
+  double intrinsics[8] = {};  // Camera::intrinsicsParameters() order.
+  double pose[7] = {};        // Camera pose as x, y, z, qw, qx, qy, qz.
+
+  // Marginal covariance of the gtsam calibration (fx, fy, s, u0, v0[, k1, k2, k3, k4]), row-major. All zeros
+  // if it couldn't be computed.
+  uint32_t covariance_dim = 0;
+  uint32_t map_format = 0;  // MapFormat.
+  double covariance[81] = {};
+
+  // Pinhole intrinsics (fx, fy, cx, cy) of the undistorted image and rectifying rotation (qw, qx, qy, qz)
+  // from the camera frame to the rectified frame.
+  double map_intrinsics[4] = {};
+  double map_rotation[4] = {};
+
+  // Location of the map in the file, 0 if there's no map.
+  uint64_t map_offset = 0;
+  uint64_t map_size = 0;
+};
+static_assert(sizeof(CalibrationBundleCamera) == 872, "Camera record layout changed.");
+
+struct CalibrationBundleOptions {
+  // Format of the undistortion maps, NONE to only store the calibration.
+  MapFormat map_format = MapFormat::FLOAT32;
+
+  // Rectifying rotation per camera (camera frame to rectified frame). Empty for plain undistortion.
+  std::vector<gtsam::Rot3> rectification_rotations;
+
+  // Number of threads computing the maps (0 for all cores).
+  size_t num_threads = 0;
+};
+
+/**
+ * @brief Return true if the bundle was written. The maps sample the original image of each camera into a
+ * pinhole image of the same size and intrinsics (fx, fy, cx, cy).
+ *
+ * @param path bundle file path.
+ * @param cameras calibrated cameras.
+ * @param covariances marginal covariance of each camera's calibration, or empty matrices if unknown.
+ * @param options bundle options.
+ * @return true
+ * @return false
+ */
+bool WriteCalibrationBundle(const std::string& path, const std::vector<std::shared_ptr<Camera>>& cameras,
+                            const std::vector<gtsam::Matrix>& covariances,
+                            const CalibrationBundleOptions& options);
+
+/**
+ * @brief Same as above for the cameras of a solver state, with the covariances taken from iSAM2 or computed
+ * from the graph for the batch optimizers.
+ *
+ */
+bool WriteCalibrationBundle(const std::string& path, const BatchSolver::State& state,
+                            const CalibrationBundleOptions& options);
+
+/**
+ * @brief Memory-mapped calibration bundle. Nothing is computed or copied when a bundle is opened beyond
+ * validating its records.
+ */
+class CalibrationBundleReader {
+public:
+  /**
+   * @brief Construct a new Calibration Bundle Reader object and map the bundle. Check isOpen() for failures.
+   *
+   * @param path bundle file path.
+   */
+  explicit CalibrationBundleReader(const std::string& path);
+
+  /**
+   * @brief Return true if the bundle was mapped and its records are valid.
+   *
+   * @return true
+   * @return false
+   */
+  bool isOpen() const { return is_open_; }
+
+  /**
+   * @brief Return the number of cameras.
+   *
+   * @return size_t
+   */
+  size_t numCameras() const { return num_cameras_; }
+
+  /**
+   * @brief Return the record of a camera.
+   *
+   * @param index camera index.
+   * @return const CalibrationBundleCamera&
+   */
+  const CalibrationBundleCamera& camera(const size_t index) const;
+
+  /**
+   * @brief Return a pointer to the camera's map entries, or nullptr if it has no map.
+   *
+   * @param index camera index.
+   * @return const void*
+   */
+  const void* mapData(const size_t index) const;
+
+  /**
+   * @brief Return true if the pixel of the undistorted image has a source pixel in the original image.
+   *
+   * @param index camera index.
+   * @param x column in the undistorted image.
+   * @param y row in the undistorted image.
+   * @param uv pixel to sample in the original image.
+   * @return true
+   * @return false
+   */
+  bool sourcePixel(const size_t index, const size_t x, const size_t y, gtsam::Point2& uv) const;
+
+  /**
+   * @brief Return a camera model with the camera's calibration and pose.
+   *
+   * @param index camera index.
+   * @return std::shared_ptr<Camera>
+   */
+  std::shared_ptr<Camera> makeCamera(const size_t index) const;
+
+private:
+  io::MappedFile file_;
+  bool is_open_ = false;
+  size_t num_cameras_ = 0;
+  const CalibrationBundleCamera* cameras_ = nullptr;
+};
+
+}  // namespace gtcal
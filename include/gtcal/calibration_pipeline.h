@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gtsam/geometry/Pose3.h>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/bounded_queue.h"
+#include "gtcal/latency_histogram.h"
+#include "gtcal/rig.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief End-to-end calibration from detection logs. Three stages run concurrently and hand frames over
+ * through bounded queues:
+ *
+ *   read:  one thread reads the frames of the detection logs in order.
+ *   pose:  worker threads initialize each frame's pose from the target homography and refine it with
+ *          PoseSolver or PoseSolverGtsam, using the rig's initial intrinsics.
+ *   batch: the calling thread puts the frames back in order, selects keyframes and adds them to the
+ *          BatchSolver, then optimizes the whole problem once every frame was processed.
+ */
+class CalibrationPipeline {
+public:
+  enum class PoseSolverType { CERES, GTSAM };
+
+  struct Options {
+    // Total number of threads (0 for all cores). One reads, the batch stage runs on the calling thread and
+    // the rest solve frame poses (at least one).
+    size_t num_threads = 0;
+
+    // Solver used to refine the homography pose of each frame.
+    PoseSolverType pose_solver_type = PoseSolverType::CERES;
+
+    // Frames with fewer measurements, or whose RMS reprojection error after the pose solve is larger (in
+    // pixels), are rejected.
+    size_t min_measurements = 12;
+    double max_pose_rms_error = 5.0;
+
+    // A frame becomes a keyframe if its pose moved at least this far (meters) or rotated at least this much
+    // (degrees) from the camera's last keyframe.
+    double keyframe_min_translation = 0.05;
+    double keyframe_min_rotation_deg = 5.0;
+
+    // Capacity of the queues between the stages.
+    size_t queue_capacity = 256;
+  };
+
+  // Frame counters.
+  struct Stats {
+    size_t num_frames = 0;          // Frames read from the logs.
+    size_t num_rejected = 0;        // Frames rejected by the pose stage.
+    size_t num_keyframes = 0;       // Frames added to the batch solver.
+    size_t num_batch_failures = 0;  // Keyframes for which the batch solver threw.
+  };
+
+  // A frame added to the batch solver.
+  struct Keyframe {
+    size_t camera_id = 0;
+    int64_t timestamp_ns = 0;
+    size_t pose_index = 0;  // Index of the frame pose in the solver state, X(pose_index).
+  };
+
+public:
+  /**
+   * @brief Construct a new Calibration Pipeline object.
+   *
+   * @param rig rig with the target geometry and the initial camera models.
+   * @param solver_options batch solver options.
+   * @param options pipeline options.
+   */
+  CalibrationPipeline(const Rig& rig, const BatchSolver::Options& solver_options, const Options& options);
+  CalibrationPipeline(const Rig& rig, const BatchSolver::Options& solver_options);
+
+  /**
+   * @brief Return true if every log was read and the final optimization succeeded. Frames of the logs are
+   * processed in the order given. Meant to be called once per pipeline.
+   *
+   * @param log_paths detection log file paths.
+   * @return true
+   * @return false
+   */
+  bool run(const std::vector<std::string>& log_paths);
+
+  /**
+   * @brief Write the calibrated rig followed by one frame record per keyframe (see rig.h). Return false if
+   * the file couldn't be written.
+   *
+   * @param path output file path.
+   * @return true
+   * @return false
+   */
+  bool writeResult(const std::string& path) const;
+
+  /**
+   * @brief Return the solver state. The cameras hold the calibrated intrinsics after run().
+   *
+   * @return const BatchSolver::State&
+   */
+  const BatchSolver::State& state() const { return *state_; }
+
+  /**
+   * @brief Return the keyframes added to the solver, in order.
+   *
+   * @return const std::vector<Keyframe>&
+   */
+  const std::vector<Keyframe>& keyframes() const { return keyframes_; }
+
+  /**
+   * @brief Return the frame counters.
+   *
+   * @return Stats
+   */
+  Stats stats() const;
+
+  /**
+   * @brief Return the per-frame time histograms of the read, pose and batch stages. Batch times only cover
+   * keyframes.
+   *
+   * @return const LatencyHistogram&
+   */
+  const LatencyHistogram& readHistogram() const { return read_histogram_; }
+  const LatencyHistogram& poseHistogram() const { return pose_histogram_; }
+  const LatencyHistogram& batchHistogram() const { return batch_histogram_; }
+
+  /**
+   * @brief Return the wall time of the final optimization and of the whole run.
+   *
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds optimizeTime() const { return optimize_time_; }
+  std::chrono::nanoseconds runTime() const { return run_time_; }
+
+  /**
+   * @brief Return the number of pose solver threads used by the last run.
+   *
+   * @return size_t
+   */
+  size_t numPoseThreads() const { return num_pose_threads_; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // A frame on its way through the stages.
+  struct Frame {
+    size_t sequence = 0;
+    int64_t timestamp_ns = 0;
+    std::vector<Measurement> measurements;
+    gtsam::Pose3 pose_target_cam;
+    bool accepted = false;
+  };
+
+  /**
+   * @brief Read the logs into the pose queue.
+   *
+   */
+  void readFrames(const std::vector<std::string>& log_paths, BoundedQueue<Frame>& pose_queue);
+
+  /**
+   * @brief Solve the poses of the frames of the pose queue and pass them on to the batch queue.
+   *
+   */
+  void solvePoses(BoundedQueue<Frame>& pose_queue, BoundedQueue<Frame>& batch_queue);
+
+  /**
+   * @brief Return true if the frame is a keyframe of its camera, in which case it becomes the camera's last
+   * keyframe.
+   *
+   */
+  bool isKeyframe(const Frame& frame);
+
+  /**
+   * @brief Add a keyframe to the batch solver.
+   *
+   */
+  void addKeyframe(const Frame& frame);
+
+private:
+  const Rig rig_;
+  const gtsam::Point3Vector pts3d_target_;
+  const BatchSolver solver_;
+  const Options options_;
+  std::unique_ptr<BatchSolver::State> state_;
+
+  // Last keyframe pose per camera.
+  std::vector<std::optional<gtsam::Pose3>> last_keyframe_poses_;
+  std::vector<Keyframe> keyframes_;
+
+  // Stage synchronization.
+  std::atomic<bool> reading_done_{false};
+  std::atomic<bool> read_failed_{false};
+  std::atomic<size_t> num_frames_{0};
+  std::atomic<size_t> num_rejected_{0};
+  size_t num_batch_failures_ = 0;
+  size_t num_pose_threads_ = 0;
+
+  LatencyHistogram read_histogram_;
+  LatencyHistogram pose_histogram_;
+  LatencyHistogram batch_histogram_;
+  std::chrono::nanoseconds optimize_time_{0};
+  std::chrono::nanoseconds run_time_{0};
+};
+
+}  // namespace gtcal
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <gtsam/geometry/Point3.h>
+
+namespace gtcal {
+namespace utils {
+
+/**
+ * @brief Planar grid target. Points are ordered column-major (point id = column * num_rows + row) and lie in
+ * the z = 0 plane of the target frame.
+ */
+class CalibrationTarget {
+public:
+  CalibrationTarget(const double grid_spacing, const size_t num_rows, const size_t num_cols)
+    : grid_spacing_(grid_spacing), num_rows_(num_rows), num_cols_(num_cols),
+      grid_pts3d_target_(generateGridPts3d(grid_spacing, num_rows, num_cols)) {}
+
+  /**
+   * @brief Return target 3D points in the target frame.
+   *
+   * @return const gtsam::Point3Vector&
+   */
+  const gtsam::Point3Vector& pointsTarget() const { return grid_pts3d_target_; }
+
+  /**
+   * @brief Return the grid spacing.
+   *
+   * @return double
+   */
+  double gridSpacing() const { return grid_spacing_; }
+
+  /**
+   * @brief Return the number of rows.
+   *
+   * @return size_t
+   */
+  size_t numRows() const { return num_rows_; }
+
+  /**
+   * @brief Return the number of columns.
+   *
+   * @return size_t
+   */
+  size_t numCols() const { return num_cols_; }
+
+  /**
+   * @brief Return the target center point in target frame with a z-coordinate = 0.0.
+   *
+   * @return gtsam::Point3
+   */
+  gtsam::Point3 get3dCenter() const {
+    const double x_center = (grid_spacing_ * num_cols_) / 2.0;
+    const double y_center = (grid_spacing_ * num_rows_) / 2.0;
+
+    return {x_center, y_center, z_coordinate_};
+  }
+
+private:
+  /**
+   * @brief Return vector with 3D points of calibration target in target frame using the target's grid
+   * spacing, number of rows and columns.
+   *
+   * @param grid_spacing spacing between target points.
+   * @param num_rows  number of rows.
+   * @param num_cols number of cols.
+   * @return gtsam::Point3Vector
+   */
+  gtsam::Point3Vector generateGridPts3d(const double grid_spacing, const size_t num_rows,
+                                        const size_t num_cols) {
+    gtsam::Point3Vector grid_pts3d;
+    grid_pts3d.reserve(num_rows * num_cols);
+
+    for (size_t jj = 0; jj < num_cols; jj++) {
+      for (size_t ii = 0; ii < num_rows; ii++) {
+        const gtsam::Point3 pt3d =
+            (gtsam::Point3() << jj * grid_spacing, ii * grid_spacing, z_coordinate_).finished();
+        grid_pts3d.push_back(pt3d);
+      }
+    }
+
+    return grid_pts3d;
+  }
+
+private:
+  const double grid_spacing_;
+  const size_t num_rows_;
+  const size_t num_cols_;
+  const double z_coordinate_ = 0.0;  // Declared before the points, which are generated with it.
+  const gtsam::Point3Vector grid_pts3d_target_;
+};
+
+}  // namespace utils
+}  // namespace gtcal
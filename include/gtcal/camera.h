@@ -7,10 +7,73 @@
 #include <gtsam/geometry/Point3.h>
 #include <gtsam/geometry/Pose3.h>
 
+#include <cmath>
+#include <limits>
 #include <variant>
 
+#include "gtcal/trace.h"
+
 namespace gtcal {
 
+/**
+ * @brief Return true if every point lies in the z = 0 plane, as the points of a utils::CalibrationTarget do
+ * in the target frame.
+ *
+ * @param pts3d points to check.
+ * @return true
+ * @return false
+ */
+inline bool IsPlanarTarget(const gtsam::Point3Vector& pts3d) {
+  for (const gtsam::Point3& pt3d : pts3d) {
+    if (pt3d.z() != 0.0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Return the homography [r1 r2 t] mapping points (x, y, 1) of the z = 0 plane of the world frame to
+ * normalized image coordinates, where r1, r2 are the first two columns of the world to camera rotation and t
+ * its translation.
+ *
+ * @param pose_world_camera camera pose in the world frame.
+ * @return gtsam::Matrix3
+ */
+inline gtsam::Matrix3 NormalizedPlanarHomography(const gtsam::Pose3& pose_world_camera) {
+  const gtsam::Matrix3 R_camera_world = pose_world_camera.rotation().matrix().transpose();
+  gtsam::Matrix3 H;
+  H.leftCols<2>() = R_camera_world.leftCols<2>();
+  H.col(2) = -(R_camera_world * pose_world_camera.translation());
+  return H;
+}
+
+/**
+ * @brief Map the points of the z = 0 plane through a homography, writing NaN for points that end up behind
+ * the camera (w <= 0). The loop has no branches nor calls so that it vectorizes.
+ *
+ * @param H homography mapping (x, y, 1) to homogeneous image coordinates.
+ * @param pts3d points of the plane, z is ignored.
+ * @param size number of points.
+ * @param uvs mapped points.
+ */
+inline void ProjectPlanarPoints(const gtsam::Matrix3& H, const gtsam::Point3* pts3d, const size_t size,
+                                gtsam::Point2* uvs) {
+  const double h00 = H(0, 0), h01 = H(0, 1), h02 = H(0, 2);
+  const double h10 = H(1, 0), h11 = H(1, 1), h12 = H(1, 2);
+  const double h20 = H(2, 0), h21 = H(2, 1), h22 = H(2, 2);
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double* __restrict in = pts3d->data();
+  double* __restrict out = uvs->data();
+  for (size_t ii = 0; ii < size; ii++) {
+    const double x = in[3 * ii], y = in[3 * ii + 1];
+    const double w = h20 * x + h21 * y + h22;
+    const double inv_w = w > 0.0 ? 1.0 / w : nan;
+    out[2 * ii] = (h00 * x + h01 * y + h02) * inv_w;
+    out[2 * ii + 1] = (h10 * x + h11 * y + h12) * inv_w;
+  }
+}
+
 template <typename T>
 class CameraWrapper {
 public:
@@ -29,6 +92,93 @@ public:
     return camera.project(pt3d_world);
   }
 
+  /**
+   * @brief Project a batch of 3D points given in the world frame. Points behind the camera are set to NaN
+   * instead of throwing. When every point lies in the z = 0 plane of the world frame (a calibration target
+   * seen from a camera posed in the target frame), the whole batch goes through planarHomography() in a
+   * single pass, followed by the distortion of Cal3Fisheye cameras. Other inputs are projected point by
+   * point.
+   *
+   * @param pts3d_world 3D points to project in world frame.
+   * @param uvs projections, one per point.
+   */
+  void project(const gtsam::Point3Vector& pts3d_world, gtsam::Point2Vector& uvs) const {
+    uvs.resize(pts3d_world.size());
+    if (pts3d_world.empty()) {
+      return;
+    }
+    if (!IsPlanarTarget(pts3d_world)) {
+      gtsam::PinholeCamera<T> camera(pose_world_camera_, calibration_);
+      for (size_t ii = 0; ii < pts3d_world.size(); ii++) {
+        try {
+          uvs[ii] = camera.project(pts3d_world[ii]);
+        } catch (const gtsam::CheiralityException&) {
+          uvs[ii] = gtsam::Point2::Constant(std::numeric_limits<double>::quiet_NaN());
+        }
+      }
+      return;
+    }
+
+    projectPlanar(pose_world_camera_, pts3d_world.data(), pts3d_world.size(), uvs.data());
+  }
+
+  /**
+   * @brief Return the projection of a point of the z = 0 plane of the world frame by the camera at the given
+   * pose, NaN if the point is behind the camera. Unlike updatePose() followed by project(), the camera isn't
+   * modified, and the point goes through the plane homography instead of a full pose transform. The
+   * homography is built for this point alone, so several points seen from the same pose should go through
+   * the batch overload below.
+   *
+   * @param pose_world_camera camera pose in the world frame.
+   * @param pt3d_world point to project, z is ignored.
+   * @return gtsam::Point2
+   */
+  gtsam::Point2 projectPlanar(const gtsam::Pose3& pose_world_camera, const gtsam::Point3& pt3d_world) const {
+    gtsam::Point2 uv;
+    projectPlanar(pose_world_camera, &pt3d_world, 1, &uv);
+    return uv;
+  }
+
+  /**
+   * @brief Project a batch of points of the z = 0 plane of the world frame by the camera at the given pose,
+   * NaN for points behind the camera. The homography is computed once for the whole batch, which then goes
+   * through it in a single pass, followed by the distortion of Cal3Fisheye cameras. The camera isn't
+   * modified.
+   *
+   * @param pose_world_camera camera pose in the world frame.
+   * @param pts3d_world points to project, z is ignored.
+   * @param size number of points.
+   * @param uvs projections, one per point.
+   */
+  void projectPlanar(const gtsam::Pose3& pose_world_camera, const gtsam::Point3* pts3d_world,
+                     const size_t size, gtsam::Point2* uvs) const {
+    ProjectPlanarPoints(planarHomography(pose_world_camera), pts3d_world, size, uvs);
+    if constexpr (!std::is_same_v<T, gtsam::Cal3_S2>) {
+      for (size_t ii = 0; ii < size; ii++) {
+        if (!std::isnan(uvs[ii].x())) {
+          uvs[ii] = calibration_.uncalibrate(uvs[ii]);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Return the homography mapping points (x, y, 1) of the z = 0 plane of the world frame to pixels
+   * for Cal3_S2 cameras, K * [r1 r2 t]. Cal3Fisheye cameras aren't projective, so for them it stops at the
+   * undistorted stage and maps to normalized image coordinates, which calibration().uncalibrate() distorts
+   * into pixels.
+   *
+   * @param pose_world_camera camera pose in the world frame.
+   * @return gtsam::Matrix3
+   */
+  gtsam::Matrix3 planarHomography(const gtsam::Pose3& pose_world_camera) const {
+    if constexpr (std::is_same_v<T, gtsam::Cal3_S2>) {
+      return calibration_.K() * NormalizedPlanarHomography(pose_world_camera);
+    } else {
+      return NormalizedPlanarHomography(pose_world_camera);
+    }
+  }
+
   /**
    * @brief Update the camera's calibration.
    *
@@ -142,6 +292,7 @@ public:
    * @return gtsam::Point2
    */
   gtsam::Point2 project(const gtsam::Point3& pt3d_world) const {
+    GTCAL_TRACE_ZONE("Camera::project");
     return std::visit(
         [&](auto&& arg) -> gtsam::Point2 {
           using T = std::decay_t<decltype(arg)>;
@@ -156,6 +307,48 @@ public:
         camera_);
   }
 
+  /**
+   * @brief Project a batch of 3D points given in world frame, NaN for points behind the camera. Planar
+   * targets go through the homography fast path, see CameraWrapper::project().
+   *
+   * @param pts3d_world 3D points in world frame to project.
+   * @param uvs projections, one per point.
+   */
+  void project(const gtsam::Point3Vector& pts3d_world, gtsam::Point2Vector& uvs) const {
+    GTCAL_TRACE_ZONE("Camera::projectBatch");
+    std::visit([&](auto&& arg) -> void { arg->project(pts3d_world, uvs); }, camera_);
+  }
+
+  /**
+   * @brief Return the projection of a point of the z = 0 plane of the world frame by the camera at the given
+   * pose, NaN if the point is behind the camera. The camera pose isn't modified.
+   *
+   * @param pose_world_camera camera pose in the world frame.
+   * @param pt3d_world point to project, z is ignored.
+   * @return gtsam::Point2
+   */
+  gtsam::Point2 projectPlanar(const gtsam::Pose3& pose_world_camera, const gtsam::Point3& pt3d_world) const {
+    return std::visit(
+        [&](auto&& arg) -> gtsam::Point2 { return arg->projectPlanar(pose_world_camera, pt3d_world); },
+        camera_);
+  }
+
+  /**
+   * @brief Project a batch of points of the z = 0 plane of the world frame by the camera at the given pose
+   * through a single homography, NaN for points behind the camera. The camera pose isn't modified.
+   *
+   * @param pose_world_camera camera pose in the world frame.
+   * @param pts3d_world points to project, z is ignored.
+   * @param size number of points.
+   * @param uvs projections, one per point.
+   */
+  void projectPlanar(const gtsam::Pose3& pose_world_camera, const gtsam::Point3* pts3d_world,
+                     const size_t size, gtsam::Point2* uvs) const {
+    GTCAL_TRACE_ZONE("Camera::projectPlanarBatch");
+    std::visit([&](auto&& arg) -> void { arg->projectPlanar(pose_world_camera, pts3d_world, size, uvs); },
+               camera_);
+  }
+
   /**
    * @brief Set the camera's pose in the world frame.
    *
@@ -257,6 +450,22 @@ public:
    */
   const CameraVariant& cameraVariant() const { return camera_; }
 
+  /**
+   * @brief Return a deep copy of the camera. Copying a Camera shares the underlying camera model, so threads
+   * that update the pose (e.g. pose solvers) need their own clone.
+   *
+   * @return std::shared_ptr<Camera>
+   */
+  std::shared_ptr<Camera> clone() const {
+    auto camera = std::make_shared<Camera>();
+    std::visit(
+        [&](auto&& arg) -> void {
+          camera->setCameraModel(arg->width(), arg->height(), arg->calibration(), arg->pose());
+        },
+        camera_);
+    return camera;
+  }
+
   /**
    * @brief Return the camera's model type enum.
    *
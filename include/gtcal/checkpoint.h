@@ -0,0 +1,173 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtsam/inference/Key.h>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/binary_io.h"
+#include "gtcal/camera.h"
+
+namespace gtcal {
+
+/**
+ * Checkpoint file layout (native byte order):
+ *
+ *   header:  "GTCALCKP" | u32 version | u32 reserved
+ *   record:  u32 type (FULL or DELTA) | u64 payload size | u32 FNV-1a of payload | payload
+ *
+ * Each payload holds the camera models, counters and calibration convergence tracking, the factors added
+ * since the previous record and estimate values. DELTA records only hold the values of new keys, FULL
+ * records hold the whole estimate so the loaded linearization point doesn't drift from the solver's. A
+ * record that is truncated or fails its checksum (e.g. a crash mid-write) ends the checkpoint; everything
+ * before it is still loaded.
+ */
+static constexpr char kCheckpointMagic[8] = {'G', 'T', 'C', 'A', 'L', 'C', 'K', 'P'};
+static constexpr uint32_t kCheckpointVersion = 2;
+
+class CheckpointWriter {
+public:
+  struct Options {
+    // Write the whole estimate every this many records. Records in between only hold new values.
+    size_t full_snapshot_interval = 50;
+
+    // If true, records are serialized and written on a background thread and append() only copies the
+    // changes.
+    bool async = true;
+  };
+
+public:
+  /**
+   * @brief Construct a new Checkpoint Writer object. Creates (or truncates) the checkpoint file.
+   *
+   * @param path checkpoint file path.
+   * @param options writer options.
+   */
+  CheckpointWriter(const std::string& path, const Options& options);
+  explicit CheckpointWriter(const std::string& path);
+
+  /**
+   * @brief Destroy the Checkpoint Writer object. Writes pending records before closing the file.
+   *
+   */
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  /**
+   * @brief Return true if the checkpoint file was opened.
+   *
+   * @return true
+   * @return false
+   */
+  bool isOpen() const { return file_.is_open(); }
+
+  /**
+   * @brief Append a record with what changed in the state since the last call. Must be called from the
+   * thread that updates the state, between updates. Return false if the file isn't open or a previous record
+   * failed. A record fails if it can't be written or holds a factor or noise model type that can't be
+   * checkpointed; with async writes that is reported by the next append() or flush().
+   *
+   * @param state solver state.
+   * @return true
+   * @return false
+   */
+  bool append(const BatchSolver::State& state);
+
+  /**
+   * @brief Block until every appended record is on disk. Return false if a write failed.
+   *
+   * @return true
+   * @return false
+   */
+  bool flush();
+
+  /**
+   * @brief Return the number of records appended.
+   *
+   * @return size_t
+   */
+  size_t numRecords() const { return num_records_; }
+
+private:
+  struct Snapshot;
+
+  /**
+   * @brief Write a record to the file (or hand it to the writer thread). Return false if the record failed.
+   *
+   * @param snapshot record contents.
+   * @return true
+   * @return false
+   */
+  bool write(std::unique_ptr<Snapshot> snapshot);
+
+  /**
+   * @brief Serialize a record and write it to the file. Return false if either fails.
+   *
+   * @param snapshot record contents.
+   * @return true
+   * @return false
+   */
+  bool writeRecord(const Snapshot& snapshot);
+
+  /**
+   * @brief Writer thread loop.
+   *
+   */
+  void run();
+
+private:
+  const Options options_;
+  std::ofstream file_;
+
+  // What has been written so far.
+  size_t num_records_ = 0;
+  size_t num_factors_written_ = 0;
+  gtsam::KeySet keys_written_;
+
+  // Writer thread state.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Snapshot>> pending_;
+  bool writing_ = false;
+  bool stop_ = false;
+  bool failed_ = false;
+  std::thread writer_thread_;
+};
+
+/**
+ * @brief Return the solver state stored in a checkpoint, or nullptr if the file can't be read or holds no
+ * complete record. The graph is rebuilt and iSAM is updated once from the stored estimate instead of
+ * replaying every frame.
+ *
+ * @param path checkpoint file path.
+ * @param options solver options used to set up the restored iSAM2 instance.
+ * @return std::unique_ptr<BatchSolver::State>
+ */
+std::unique_ptr<BatchSolver::State> LoadCheckpoint(
+    const std::string& path, const BatchSolver::Options& options = BatchSolver::Options());
+
+/**
+ * @brief Serialize a camera model (type, image size, calibration and pose).
+ *
+ * @param camera camera to serialize.
+ * @param writer byte writer.
+ */
+void WriteCamera(const Camera& camera, io::ByteWriter& writer);
+
+/**
+ * @brief Return a camera deserialized with WriteCamera(), or nullptr if the bytes are invalid.
+ *
+ * @param reader byte reader.
+ * @return std::shared_ptr<Camera>
+ */
+std::shared_ptr<Camera> ReadCamera(io::ByteReader& reader);
+
+}  // namespace gtcal
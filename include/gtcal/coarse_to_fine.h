@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gtcal/measurement_block.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief Coarse-to-fine schedule of the pose solvers. On frames with many measurements (dense targets), the
+ * first iterations only use a well-spread subset of the measurements, which is enough to get close to the
+ * solution. Each level adds measurements to the previous ones, growth_factor times as many, and runs a few
+ * iterations, until the last level, which holds every measurement and runs to convergence. The problem of the
+ * last level is the one solved without the schedule, only from a better initial estimate.
+ */
+struct CoarseToFineOptions {
+  // If false, every iteration uses every measurement.
+  bool enabled = false;
+
+  // Frames with fewer measurements are solved in a single level.
+  size_t min_measurements = 400;
+
+  // Measurements of the first level, growth between levels and iterations of every level but the last.
+  size_t initial_measurements = 64;
+  double growth_factor = 4.0;
+  size_t iterations_per_level = 4;
+};
+
+/**
+ * @brief Return the number of measurements of each level, increasing and ending with num_measurements. A
+ * single level if the schedule is disabled or the frame is too small for it.
+ *
+ * @param num_measurements number of measurements of the frame.
+ * @param options schedule options.
+ * @return std::vector<size_t>
+ */
+std::vector<size_t> CoarseToFineLevels(const size_t num_measurements, const CoarseToFineOptions& options);
+
+/**
+ * @brief Return the measurement indices ordered so that every prefix is spread over the image. Measurements
+ * are binned into a grid of about two measurements per cell, and the cells are visited in bit-reversed Morton
+ * order, which alternates between far apart cells and refines the coverage as it goes, taking one measurement
+ * of every cell before taking a second one of any.
+ *
+ * @param measurements measurements of a frame.
+ * @return std::vector<uint32_t>
+ */
+std::vector<uint32_t> StratifiedOrder(const std::vector<Measurement>& measurements);
+
+/**
+ * @brief Same as above, with the measurements stored as a structure of arrays.
+ *
+ */
+std::vector<uint32_t> StratifiedOrder(const MeasurementSpan& measurements);
+
+}  // namespace gtcal
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <gtsam/geometry/Point2.h>
+
+#include "gtcal/calibration_target.h"
+#include "gtcal/image.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief Checkerboard corner detector for the CalibrationTarget grid.
+ *
+ * The target is a checkerboard whose inner corners are the target points: the square between points
+ * (col, row) and (col + 1, row + 1) is dark when col + row is even, and the board has one more row and column
+ * of squares on every side of the points.
+ *
+ * Detection runs in three steps:
+ *   1. ChESS corner response (Bennett and Lasenby, 2014) on a 16-pixel ring of radius 5, computed 8 pixels at
+ *      a time with SSE2 where available.
+ *   2. Non-maximum suppression, with the response centroid around each peak as sub-pixel candidate.
+ *   3. Grid growing from the candidate closest to the center of all candidates, following the local grid
+ *      directions. The grid is labelled with the target's point ids using its dimensions, the handedness of
+ *      a target seen from the front, and the square colors.
+ *
+ * The whole target must be visible. Boards with num_rows + num_cols even look the same after a half turn,
+ * so their labelling is only defined up to that rotation.
+ */
+class CornerDetector {
+public:
+  struct Options {
+    // Minimum corner response of a candidate.
+    int16_t min_response = 64;
+
+    // Minimum corner response of a candidate relative to the strongest response in the image.
+    double min_relative_response = 0.1;
+
+    // Candidates must be the maximum response in a window of this radius.
+    size_t nms_radius = 3;
+
+    // A grid neighbour must be within this fraction of the grid step from its predicted position.
+    double max_prediction_error = 0.3;
+
+    // Number of threads detecting images in parallel (0 for all cores).
+    size_t num_threads = 0;
+  };
+
+public:
+  CornerDetector(const utils::CalibrationTarget& target, const Options& options);
+  explicit CornerDetector(const utils::CalibrationTarget& target);
+
+  /**
+   * @brief Return true if the target was found in the image.
+   *
+   * @param image grayscale image.
+   * @param camera_id camera id of the measurements.
+   * @param measurements one measurement per detected target point, ordered by point id.
+   * @return true
+   * @return false
+   */
+  bool detect(const Image& image, const size_t camera_id, std::vector<Measurement>& measurements) const;
+
+  /**
+   * @brief Detect the target in several images in parallel.
+   *
+   * @param images grayscale images.
+   * @param camera_id camera id of the measurements.
+   * @param measurements measurements of each image, empty for images without the target.
+   * @return size_t number of images the target was found in.
+   */
+  size_t detect(const std::vector<Image>& images, const size_t camera_id,
+                std::vector<std::vector<Measurement>>& measurements) const;
+
+  /**
+   * @brief Return the sub-pixel corner candidates of an image, before grid fitting.
+   *
+   * @param image grayscale image.
+   * @return std::vector<gtsam::Point2>
+   */
+  std::vector<gtsam::Point2> findCandidates(const Image& image) const;
+
+  /**
+   * @brief Compute the ChESS corner response of every pixel. Pixels closer than the ring radius to the
+   * border have a response of 0.
+   *
+   * @param image grayscale image.
+   * @param response response per pixel, row by row.
+   */
+  static void CornerResponse(const Image& image, std::vector<int16_t>& response);
+
+private:
+  /**
+   * @brief Return true if the candidates form the target grid, and the measurements labelled with the
+   * target's point ids.
+   *
+   */
+  bool fitGrid(const Image& image, const std::vector<gtsam::Point2>& candidates, const size_t camera_id,
+               std::vector<Measurement>& measurements) const;
+
+private:
+  size_t num_rows_;
+  size_t num_cols_;
+  Options options_;
+};
+
+}  // namespace gtcal
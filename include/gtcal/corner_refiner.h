@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include <gtsam/base/Matrix.h>
+
+#include "gtcal/image.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief Sub-pixel corner refinement by gradient orthogonality (Förstner). At the corner q, the image
+ * gradient g at every pixel p of a window around it is orthogonal to p - q, so q solves the weighted least
+ * squares problem
+ *
+ *   min_q sum_p w_p (g_p^T (p - q))^2,   i.e.   (sum_p w_p g_p g_p^T) q = sum_p w_p g_p g_p^T p,
+ *
+ * with Gaussian weights w_p and normal matrix A = sum_p w_p g_p g_p^T. The covariance of q propagates the
+ * image noise through the gradients to first order,
+ *
+ *   cov(q) = sigma_g^2 A^-1 M A^-1,   M = sum_p w_p^2 J_p J_p^T,   J_p = (g_p^T d_p) I + g_p d_p^T,
+ *
+ * where d_p = p - q is the pixel offset in the window centered on q and J_p is the derivative of
+ * g_p g_p^T d_p with respect to g_p. The gradient noise sigma_g follows from the pixel noise, estimated in
+ * the window with Immerkaer's Laplacian difference operator, so cov(q) grows with image noise and blur and
+ * with a poorly conditioned window. The residuals of the least
+ * squares problem aren't used: at a blurred X-corner the gradients aren't exactly orthogonal to p - q and the
+ * residuals are dominated by that model error, not by noise.
+ *
+ * The window is resampled around the estimate with bilinear interpolation until it stops moving, so it stays
+ * symmetric about the corner. Corners are refined four at a time, one per SSE lane, from windows resampled
+ * into a lane-interleaved buffer.
+ */
+class CornerRefiner {
+public:
+  struct Options {
+    // Half size of the window, without the one pixel border used for the gradients.
+    size_t window_radius = 4;
+
+    // Standard deviation of the Gaussian window weights, in pixels.
+    double window_sigma = 3.0;
+
+    // Maximum number of window re-centerings.
+    size_t max_iterations = 10;
+
+    // Refinement stops when the estimate moves less than this, in pixels.
+    double min_step = 0.005;
+
+    // Corners that end up further than this from their initial estimate are dropped, in pixels.
+    double max_shift = 2.0;
+
+    // Corners whose normal matrix has a smaller ratio of eigenvalues (edges, flat areas) are dropped.
+    double min_eigenvalue_ratio = 0.05;
+
+    // Its square is added to the variances of every refined corner, in pixels, so perfect synthetic corners
+    // don't get an infinite weight.
+    double min_sigma = 0.01;
+  };
+
+public:
+  CornerRefiner();
+  explicit CornerRefiner(const Options& options);
+
+  /**
+   * @brief Refine the measurements in place. Measurements that can't be refined (too close to the border,
+   * not on a corner, moved too far) are removed.
+   *
+   * @param image grayscale image.
+   * @param measurements corner estimates, refined on return.
+   * @param covariances pixel covariance of each refined measurement.
+   * @return size_t number of refined measurements.
+   */
+  size_t refine(const Image& image, std::vector<Measurement>& measurements,
+                std::vector<gtsam::Matrix2>& covariances) const;
+
+private:
+  Options options_;
+  std::vector<float> weights_;  // Window weights, row by row.
+};
+
+}  // namespace gtcal
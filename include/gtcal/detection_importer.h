@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "gtcal/detection_log.h"
+#include "gtcal/measurement_block.h"
+
+namespace gtcal {
+
+/**
+ * @brief Parallel importer for text dumps of corner detections. Supported formats:
+ *
+ *   CSV:   one detection per line, "timestamp_ns,camera_id,point_id,u,v". Consecutive lines with the same
+ *          timestamp and camera form a frame. Lines that don't start with a number (e.g. a header) and lines
+ *          starting with '#' are skipped.
+ *   JSONL: one frame per line, {"timestamp_ns": 0, "camera_id": 0, "detections": [[point_id, u, v], ...]}.
+ *
+ * The input is memory-mapped and split on line boundaries into one range per thread. Each thread parses its
+ * range with std::from_chars into its own MeasurementBlock and the blocks are concatenated in order, joining
+ * a CSV frame that straddles two ranges.
+ */
+class DetectionImporter {
+public:
+  enum class Format { AUTO, CSV, JSONL };
+
+  struct Options {
+    // Input format. AUTO picks JSONL if the first non-blank character is '{' and CSV otherwise.
+    Format format = Format::AUTO;
+
+    // Number of parser threads (0 for all cores).
+    size_t num_threads = 0;
+
+    // Inputs are split in ranges of at least this many bytes, so small inputs don't pay for threads.
+    size_t min_bytes_per_thread = size_t{1} << 20;
+  };
+
+  struct Stats {
+    size_t num_bytes = 0;
+    size_t num_lines = 0;
+    size_t num_skipped_lines = 0;
+    size_t num_frames = 0;
+    size_t num_measurements = 0;
+    size_t num_threads = 0;
+  };
+
+public:
+  DetectionImporter();
+  explicit DetectionImporter(const Options& options);
+
+  /**
+   * @brief Return true if the file was mapped and parsed. Malformed lines are skipped and counted in the
+   * stats.
+   *
+   * @param path input file path.
+   * @param measurements block to append the imported frames to.
+   * @return true
+   * @return false
+   */
+  bool importFile(const std::string& path, MeasurementBlock& measurements);
+
+  /**
+   * @brief Same as importFile() for text already in memory.
+   *
+   * @param text input text.
+   * @param measurements block to append the imported frames to.
+   * @return true
+   * @return false
+   */
+  bool importText(std::string_view text, MeasurementBlock& measurements);
+
+  /**
+   * @brief Return true if the file was imported and every frame was appended to the detection log.
+   *
+   * @param path input file path.
+   * @param log detection log to append the imported frames to.
+   * @return true
+   * @return false
+   */
+  bool importFileToLog(const std::string& path, DetectionLogWriter& log);
+
+  /**
+   * @brief Return the stats of the last import.
+   *
+   * @return const Stats&
+   */
+  const Stats& stats() const { return stats_; }
+
+private:
+  const Options options_;
+  Stats stats_;
+};
+
+}  // namespace gtcal
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtcal/mapped_file.h"
+#include "gtcal/measurement_block.h"
+
+namespace gtcal {
+
+/**
+ * Detection log file layout (native byte order, every section 8-byte aligned):
+ *
+ *   header:   "GTCALLOG" | u32 version | u32 reserved
+ *   chunk:    ChunkHeader | payload (LZ4 compressed if the header says so) | padding
+ *   index:    u64 chunk offsets[num_chunks] | FrameIndexEntry[num_frames]
+ *   trailer:  u64 index offset | u64 num_chunks | u64 num_frames | u32 FNV-1a of index | u32 reserved |
+ *             "GTCALIDX"
+ *
+ * An uncompressed chunk payload is the chunk's frames as arrays that MeasurementSpans point straight into:
+ *
+ *   i64 timestamps[num_frames] | u64 frame offsets[num_frames + 1] | f32 u[n] | f32 v[n] |
+ *   u32 point ids[n] | u16 camera ids[n]
+ *
+ * If the trailer is missing or damaged (e.g. the writer crashed), readers rebuild the index by walking the
+ * chunks and stop at the first incomplete one.
+ */
+static constexpr char kDetectionLogMagic[8] = {'G', 'T', 'C', 'A', 'L', 'L', 'O', 'G'};
+static constexpr char kDetectionLogIndexMagic[8] = {'G', 'T', 'C', 'A', 'L', 'I', 'D', 'X'};
+static constexpr uint32_t kDetectionLogVersion = 1;
+
+class DetectionLogWriter {
+public:
+  enum class Compression : uint32_t { NONE = 0, LZ4 = 1 };
+
+  struct Options {
+    // Number of frames per chunk.
+    size_t frames_per_chunk = 256;
+
+    // Chunk compression. LZ4 needs gtcal built with GTCAL_WITH_LZ4, otherwise chunks are stored
+    // uncompressed. Chunks that don't shrink are stored uncompressed too.
+    Compression compression = Compression::NONE;
+  };
+
+public:
+  /**
+   * @brief Construct a new Detection Log Writer object. Creates (or truncates) the log file.
+   *
+   * @param path log file path.
+   * @param options writer options.
+   */
+  DetectionLogWriter(const std::string& path, const Options& options);
+  explicit DetectionLogWriter(const std::string& path);
+
+  /**
+   * @brief Destroy the Detection Log Writer object. Closes the log if close() wasn't called.
+   *
+   */
+  ~DetectionLogWriter();
+
+  DetectionLogWriter(const DetectionLogWriter&) = delete;
+  DetectionLogWriter& operator=(const DetectionLogWriter&) = delete;
+
+  /**
+   * @brief Return true if the log file was opened.
+   *
+   * @return true
+   * @return false
+   */
+  bool isOpen() const { return file_.is_open(); }
+
+  /**
+   * @brief Append a frame. Return false if the log isn't open or a write failed.
+   *
+   * @param timestamp_ns frame timestamp in nanoseconds.
+   * @param measurements measurements of the frame.
+   * @return true
+   * @return false
+   */
+  bool append(const int64_t timestamp_ns, const MeasurementSpan& measurements);
+  bool append(const int64_t timestamp_ns, const std::vector<Measurement>& measurements);
+
+  /**
+   * @brief Write the pending chunk and the index and close the file. Return false if a write failed.
+   *
+   * @return true
+   * @return false
+   */
+  bool close();
+
+  /**
+   * @brief Return the number of frames appended.
+   *
+   * @return size_t
+   */
+  size_t numFrames() const { return frame_index_.size(); }
+
+private:
+  // Location of a frame in the log.
+  struct FrameIndexEntry {
+    uint32_t chunk = 0;
+    uint32_t frame_in_chunk = 0;
+    int64_t timestamp_ns = 0;
+  };
+
+  /**
+   * @brief Reserve the chunk buffer for a full chunk of frames of the given size when a chunk is started.
+   * Does nothing while a chunk is being filled, where the buffer grows geometrically.
+   *
+   * @param num_measurements number of measurements of the frame being appended.
+   */
+  void reserveChunk(const size_t num_measurements);
+
+  /**
+   * @brief Close the frame appended to the chunk buffer, index it and write the chunk once it's full. Return
+   * false if a write failed.
+   *
+   * @param timestamp_ns frame timestamp in nanoseconds.
+   * @return true
+   * @return false
+   */
+  bool endFrame(const int64_t timestamp_ns);
+
+  /**
+   * @brief Write the buffered frames as a chunk. Return false if a write failed.
+   *
+   * @return true
+   * @return false
+   */
+  bool writeChunk();
+
+  friend class DetectionLogReader;
+
+private:
+  const Options options_;
+  std::ofstream file_;
+  uint64_t file_offset_ = 0;
+  bool failed_ = false;
+
+  // Frames of the chunk being filled.
+  MeasurementBlock chunk_;
+
+  // Index written at close().
+  std::vector<uint64_t> chunk_offsets_;
+  std::vector<FrameIndexEntry> frame_index_;
+};
+
+class DetectionLogReader {
+public:
+  struct Options {
+    // If true, a chunk's checksum is verified the first time one of its frames is read.
+    bool verify_checksums = true;
+  };
+
+public:
+  /**
+   * @brief Construct a new Detection Log Reader object and map the log file. Check isOpen() for failures.
+   *
+   * @param path log file path.
+   * @param options reader options.
+   */
+  DetectionLogReader(const std::string& path, const Options& options);
+  explicit DetectionLogReader(const std::string& path);
+
+  /**
+   * @brief Return true if the log was mapped and its index was read or rebuilt.
+   *
+   * @return true
+   * @return false
+   */
+  bool isOpen() const { return is_open_; }
+
+  /**
+   * @brief Return the number of frames in the log.
+   *
+   * @return size_t
+   */
+  size_t numFrames() const { return frame_index_.size(); }
+
+  /**
+   * @brief Return the number of chunks in the log.
+   *
+   * @return size_t
+   */
+  size_t numChunks() const { return chunk_offsets_.size(); }
+
+  /**
+   * @brief Return the timestamp of a frame in nanoseconds, read from the index.
+   *
+   * @param index frame index.
+   * @return int64_t
+   */
+  int64_t timestamp(const size_t index) const { return frame_index_.at(index).timestamp_ns; }
+
+  /**
+   * @brief Return true if the frame's measurements were found. Uncompressed frames point straight into the
+   * mapping and stay valid as long as the reader. Compressed frames point into the reader's decompression
+   * buffer and stay valid until a frame of another compressed chunk is read. Return false if the frame's
+   * chunk is corrupted or compressed without LZ4 support.
+   *
+   * @param index frame index.
+   * @param measurements view of the frame's measurements.
+   * @return true
+   * @return false
+   */
+  bool frame(const size_t index, MeasurementSpan& measurements);
+
+private:
+  using FrameIndexEntry = DetectionLogWriter::FrameIndexEntry;
+
+  /**
+   * @brief Return true if the trailer and index were read.
+   *
+   * @return true
+   * @return false
+   */
+  bool readIndex();
+
+  /**
+   * @brief Return true if at least the header was valid, rebuilding the index from the chunks.
+   *
+   * @return true
+   * @return false
+   */
+  bool scanChunks();
+
+  /**
+   * @brief Return a pointer to the uncompressed payload of a chunk, or nullptr on failure.
+   *
+   * @param chunk chunk index.
+   * @return const char*
+   */
+  const char* chunkPayload(const size_t chunk);
+
+private:
+  const Options options_;
+  io::MappedFile file_;
+  bool is_open_ = false;
+
+  std::vector<uint64_t> chunk_offsets_;
+  std::vector<FrameIndexEntry> frame_index_;
+  std::vector<bool> chunk_verified_;
+
+  // Decompression buffer (uint64_t keeps the arrays aligned) and the chunk it holds.
+  std::vector<uint64_t> decompressed_;
+  size_t decompressed_chunk_ = static_cast<size_t>(-1);
+};
+
+}  // namespace gtcal
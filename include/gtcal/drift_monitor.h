@@ -0,0 +1,238 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <gtsam/geometry/Point3.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include "gtcal/camera.h"
+#include "gtcal/measurement_block.h"
+#include "gtcal/p2_quantile.h"
+#include "gtcal/pose_solver.h"
+#include "gtcal/pose_solver_gtsam.h"
+
+namespace gtcal {
+
+/**
+ * @brief Exponentially weighted moving average and variance of a signal.
+ */
+class Ewma {
+public:
+  /**
+   * @brief Construct a new Ewma object.
+   *
+   * @param alpha weight of a new sample, in (0, 1]. The average roughly spans the last 2 / alpha samples.
+   */
+  explicit Ewma(const double alpha);
+
+  /**
+   * @brief Add a sample. The first sample initializes the average.
+   *
+   * @param x sample.
+   */
+  void add(const double x);
+
+  /**
+   * @brief Forget every sample.
+   *
+   */
+  void reset();
+
+  double mean() const { return mean_; }
+  double variance() const { return variance_; }
+  uint64_t count() const { return count_; }
+
+private:
+  double alpha_ = 1.0;
+  double mean_ = 0.0;
+  double variance_ = 0.0;
+  uint64_t count_ = 0;
+};
+
+/**
+ * @brief Watches the calibration of a deployed camera from a stream of target detections. Every frame, the
+ * target pose is solved with the intrinsics held fixed, warm-started from the previous frame's pose, and the
+ * reprojection errors of the frame feed constant memory estimators: an EWMA of the frame RMS and a P²
+ * estimate of a high quantile of the errors. The first frames set a baseline; afterwards, the monitor flags
+ * drift once the estimates have been too far above the baseline for a number of consecutive frames. Changes
+ * of the intrinsics that a pose change can absorb (e.g. the focal length against the target distance) can't
+ * be seen this way, but distortion and principal point drift show up as a larger error.
+ */
+class DriftMonitor {
+public:
+  enum class PoseSolverType { CERES, GTSAM };
+
+  enum class State {
+    WARMING_UP,  // Collecting the baseline.
+    OK,          // Errors are in line with the baseline.
+    DRIFT,       // Errors have been above the baseline for Options::consecutive_frames frames.
+  };
+
+  struct Options {
+    // Solver used for the target pose of each frame.
+    PoseSolverType pose_solver_type = PoseSolverType::CERES;
+
+    // Frames with fewer measurements, or whose RMS reprojection error after the pose solve is larger (in
+    // pixels), are rejected, e.g. misdetections. Keep the limit well above the errors of a drifted
+    // calibration, so that drift isn't mistaken for bad frames.
+    size_t min_measurements = 12;
+    double max_pose_rms_error = 20.0;
+
+    // Accepted frames that set the baseline.
+    size_t warmup_frames = 50;
+
+    // Weight of a new frame in the EWMA of the frame RMS.
+    double ewma_alpha = 0.05;
+
+    // Quantile of the errors tracked with P², and the number of accepted frames of each window it is
+    // estimated over after the warmup.
+    double quantile = 0.95;
+    size_t window_frames = 100;
+
+    // A frame raises an alarm if the EWMA of the frame RMS or the quantile of the last complete window is
+    // this many times its baseline value, and at least min_shift pixels larger.
+    double rms_ratio = 1.5;
+    double quantile_ratio = 1.5;
+    double min_shift = 0.2;
+
+    // Consecutive accepted frames raising an alarm before the state turns to DRIFT. The state then stays
+    // DRIFT until resetBaseline().
+    size_t consecutive_frames = 10;
+  };
+
+  // Outcome of a frame.
+  struct FrameResult {
+    bool accepted = false;
+    gtsam::Pose3 pose_target_cam;
+    double rms = 0.0;  // RMS reprojection error of the frame, in pixels.
+    bool alarm = false;
+  };
+
+  struct Status {
+    State state = State::WARMING_UP;
+    size_t num_frames = 0;    // Frames given to addFrame() since the last resetBaseline().
+    size_t num_rejected = 0;  // Frames rejected since the last resetBaseline().
+
+    // Baseline set by the warmup frames: mean frame RMS and error quantile, in pixels.
+    double baseline_rms = 0.0;
+    double baseline_quantile = 0.0;
+
+    // Current EWMA of the frame RMS and its standard deviation, and the error quantile of the last complete
+    // window (of the current one until a window completes), in pixels.
+    double current_rms = 0.0;
+    double current_rms_stddev = 0.0;
+    double current_quantile = 0.0;
+
+    size_t consecutive_alarms = 0;
+  };
+
+public:
+  /**
+   * @brief Construct a new Drift Monitor object.
+   *
+   * @param camera calibrated camera to watch. The monitor works on a clone, the camera isn't modified.
+   * @param pts3d_target target points in the target frame, indexed by the measurements' point ids.
+   * @param options monitor options.
+   */
+  DriftMonitor(const Camera& camera, const gtsam::Point3Vector& pts3d_target, const Options& options);
+  DriftMonitor(const Camera& camera, const gtsam::Point3Vector& pts3d_target);
+
+  DriftMonitor(const DriftMonitor&) = delete;
+  DriftMonitor& operator=(const DriftMonitor&) = delete;
+
+  /**
+   * @brief Solve the target pose of a frame and update the statistics with its reprojection errors.
+   *
+   * @param measurements measurements of the target in one frame of the camera.
+   * @return FrameResult
+   */
+  FrameResult addFrame(const std::vector<Measurement>& measurements);
+
+  /**
+   * @brief Same as above, with the measurements stored as a structure of arrays.
+   *
+   */
+  FrameResult addFrame(const MeasurementSpan& measurements);
+
+  /**
+   * @brief Return the current state and statistics.
+   *
+   * @return Status
+   */
+  Status status() const;
+
+  /**
+   * @brief Return true if the state is DRIFT.
+   *
+   * @return true
+   * @return false
+   */
+  bool drifted() const { return state_ == State::DRIFT; }
+
+  /**
+   * @brief Forget the baseline and every statistic and start a new warmup, e.g. after the camera was
+   * recalibrated or its drift accepted.
+   *
+   */
+  void resetBaseline();
+
+  const Options& options() const { return options_; }
+
+private:
+  /**
+   * @brief Implementation of addFrame() for both measurement containers.
+   *
+   */
+  template <typename MeasurementRange>
+  FrameResult addFrameImpl(const MeasurementRange& measurements);
+
+  /**
+   * @brief Return true if the pose was solved from the given initial estimate with an acceptable error, and
+   * set rms to its RMS error. Errors of the solved pose are added to the quantile estimators if accepted.
+   *
+   */
+  template <typename MeasurementRange>
+  bool solveFrame(const MeasurementRange& measurements, gtsam::Pose3& pose_target_cam, double& rms);
+
+  /**
+   * @brief Update the statistics with an accepted frame and return true if it raises an alarm.
+   *
+   */
+  bool updateStatistics(const double rms);
+
+private:
+  const Options options_;
+  const std::shared_ptr<Camera> camera_;
+  const gtsam::Point3Vector pts3d_target_;
+  const PoseSolver pose_solver_;
+  const PoseSolverGtsam pose_solver_gtsam_;
+
+  State state_ = State::WARMING_UP;
+  size_t num_frames_ = 0;
+  size_t num_rejected_ = 0;
+  size_t num_accepted_ = 0;
+  size_t consecutive_alarms_ = 0;
+
+  // Pose of the last accepted frame, the initial estimate of the next one.
+  bool has_last_pose_ = false;
+  gtsam::Pose3 last_pose_target_cam_;
+
+  // Baseline, accumulated over the warmup frames and then frozen.
+  double baseline_rms_sum_ = 0.0;
+  P2Quantile baseline_quantile_;
+
+  // Current estimates.
+  Ewma rms_ewma_;
+  P2Quantile window_quantile_;
+  size_t window_size_ = 0;
+  bool has_window_quantile_ = false;
+  double last_window_quantile_ = 0.0;
+
+  // Errors of the frame being solved, added to the quantile estimators once the frame is accepted.
+  std::vector<double> errors_;
+};
+
+}  // namespace gtcal
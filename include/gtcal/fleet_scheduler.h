@@ -0,0 +1,317 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include <gtsam/geometry/Point3.h>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/camera.h"
+#include "gtcal/latency_histogram.h"
+#include "gtcal/measurement_block.h"
+
+namespace gtcal {
+
+/**
+ * @brief Thread-safe registry of read-only resources shared between jobs, e.g. the target geometry of every
+ * camera calibrated against the same target. A resource is created once per key and kept until clear().
+ */
+class SharedResources {
+public:
+  /**
+   * @brief Return the resource stored under the key, creating it with make() if it doesn't exist yet. A key
+   * must always be used with the same type. make() runs under the registry lock, so it must not call back
+   * into the registry.
+   *
+   * @param key resource key.
+   * @param make returns the resource.
+   * @return std::shared_ptr<const T>
+   */
+  template <typename T>
+  std::shared_ptr<const T> getOrCreate(const std::string& key,
+                                       const std::function<std::shared_ptr<const T>()>& make) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto it = resources_.find(key);
+    if (it == resources_.end()) {
+      it = resources_.emplace(key, Entry{std::type_index(typeid(T)), make()}).first;
+    }
+    assert(it->second.type == std::type_index(typeid(T)) && "[SharedResources] Key used with another type.");
+    return std::static_pointer_cast<const T>(it->second.resource);
+  }
+
+  /**
+   * @brief Return the number of resources.
+   *
+   * @return size_t
+   */
+  size_t size() const {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return resources_.size();
+  }
+
+  /**
+   * @brief Drop the registry's references. Jobs holding a resource keep it alive.
+   *
+   */
+  void clear() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    resources_.clear();
+  }
+
+private:
+  struct Entry {
+    std::type_index type;
+    std::shared_ptr<const void> resource;
+  };
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> resources_;
+};
+
+/**
+ * @brief Runs many independent jobs, e.g. the calibrations of a fleet of cameras, over a pool of worker
+ * threads. A job is a sequence of steps (e.g. a few frames of a BatchSolver problem) and goes back to the
+ * queue after each step, so a large rig shares its worker with the jobs queued behind it instead of blocking
+ * them until it finishes.
+ *
+ * Each worker has its own queue, ordered by priority, then deadline, then submission or requeue order. A
+ * worker runs the best step of its own queue and keeps a job it stepped in its own queue, where its state is
+ * in cache; a worker whose queue is empty steals the best step of the other queues. Submitted jobs are spread
+ * over the queues round-robin. After every step, the job's memory use is compared to its limit and the job is
+ * stopped if it is over.
+ */
+class FleetScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Outcome of a step.
+  enum class StepResult { CONTINUE, DONE, FAILED };
+
+  enum class JobState { QUEUED, RUNNING, SUCCEEDED, FAILED, MEMORY_LIMIT_EXCEEDED, CANCELLED };
+
+  struct Job {
+    std::string name;
+
+    // Jobs with a higher priority run first, then those with the earlier deadline.
+    int priority = 0;
+    Clock::time_point deadline = Clock::time_point::max();
+
+    // Runs one step of the job. Called until it returns DONE or FAILED, by one thread at a time, possibly a
+    // different one for each step. Exceptions count as FAILED.
+    std::function<StepResult()> step;
+
+    // Returns the bytes held by the job, checked against memory_limit after every step. Optional.
+    std::function<size_t()> memory_usage;
+
+    // Largest memory use in bytes, 0 for no limit.
+    size_t memory_limit = 0;
+  };
+
+  struct Options {
+    // Number of worker threads (0 for all cores).
+    size_t num_threads = 0;
+  };
+
+  struct JobStatus {
+    JobState state = JobState::QUEUED;
+    size_t num_steps = 0;
+    size_t peak_memory = 0;        // Largest memory use reported after a step, in bytes.
+    bool missed_deadline = false;  // Finished after its deadline.
+    Clock::time_point submit_time;
+    Clock::time_point start_time;  // First step.
+    Clock::time_point finish_time;
+  };
+
+  // Counters over every job submitted to the scheduler.
+  struct Stats {
+    size_t num_submitted = 0;
+    size_t num_queued = 0;   // Jobs waiting for their first step.
+    size_t num_running = 0;  // Jobs that ran a step and haven't finished.
+    size_t num_succeeded = 0;
+    size_t num_failed = 0;
+    size_t num_memory_limit_exceeded = 0;
+    size_t num_cancelled = 0;
+    size_t num_missed_deadlines = 0;
+    uint64_t num_steps = 0;
+    uint64_t num_steals = 0;  // Steps taken from another worker's queue.
+  };
+
+public:
+  /**
+   * @brief Construct a new Fleet Scheduler object and start its workers.
+   *
+   * @param options scheduler options.
+   */
+  explicit FleetScheduler(const Options& options);
+  FleetScheduler();
+
+  /**
+   * @brief Stop the workers once their current steps are done. Jobs that didn't finish are cancelled.
+   *
+   */
+  ~FleetScheduler();
+
+  FleetScheduler(const FleetScheduler&) = delete;
+  FleetScheduler& operator=(const FleetScheduler&) = delete;
+
+  /**
+   * @brief Queue a job and return its id, which indexes the jobs in submission order.
+   *
+   * @param job job to run.
+   * @return size_t
+   */
+  size_t submit(Job job);
+
+  /**
+   * @brief Block until every job submitted so far has finished.
+   *
+   */
+  void wait();
+
+  /**
+   * @brief Return the status of a job.
+   *
+   * @param job_id id returned by submit().
+   * @return JobStatus
+   */
+  JobStatus jobStatus(const size_t job_id) const;
+
+  /**
+   * @brief Return the job counters.
+   *
+   * @return Stats
+   */
+  Stats stats() const;
+
+  // Time from submission to the first step, from submission to the end of the job, and of every step.
+  const LatencyHistogram& queueLatency() const { return queue_latency_; }
+  const LatencyHistogram& jobLatency() const { return job_latency_; }
+  const LatencyHistogram& stepTime() const { return step_time_; }
+
+  /**
+   * @brief Return the number of worker threads.
+   *
+   * @return size_t
+   */
+  size_t numThreads() const { return workers_.size(); }
+
+private:
+  // A queued step of a job.
+  struct Entry {
+    int priority = 0;
+    Clock::time_point deadline;
+    uint64_t sequence = 0;
+    size_t job_id = 0;
+
+    // Heap order: the best entry compares greatest.
+    bool operator<(const Entry& other) const;
+  };
+
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::vector<Entry> heap;
+  };
+
+  struct JobRecord {
+    Job job;  // Only touched by the thread running the job's step.
+    JobStatus status;
+  };
+
+  /**
+   * @brief Worker thread loop.
+   *
+   */
+  void work(const size_t worker);
+
+  /**
+   * @brief Return true if an entry was taken from the worker's queue, or else stolen from another one.
+   *
+   */
+  bool pop(const size_t worker, Entry& entry);
+
+  /**
+   * @brief Push an entry to a worker's queue and wake up an idle worker.
+   *
+   */
+  void push(const size_t worker, const Entry& entry);
+
+  /**
+   * @brief Run one step of a job and requeue it or record its outcome.
+   *
+   */
+  void runStep(const size_t worker, const Entry& entry);
+
+  /**
+   * @brief Record the end of a job and release its closures.
+   *
+   */
+  void finish(JobRecord& record, const JobState state);
+
+private:
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  // Job records, indexed by job id. The deque keeps references valid as jobs are added.
+  mutable std::mutex records_mutex_;
+  std::deque<JobRecord> records_;
+  std::condition_variable finished_cv_;
+  size_t num_finished_ = 0;
+  Stats stats_;
+
+  // Idle workers sleep until a step is queued or the scheduler stops.
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  std::atomic<size_t> num_queued_entries_{0};
+  bool stopping_ = false;
+
+  std::atomic<uint64_t> next_sequence_{0};
+  std::atomic<size_t> next_queue_{0};
+
+  LatencyHistogram queue_latency_;
+  LatencyHistogram job_latency_;
+  LatencyHistogram step_time_;
+};
+
+/**
+ * @brief Return a job calibrating a rig from its measurements with a BatchSolver. Each step initializes the
+ * pose of a few frames from the target homography and adds them to the solver; the last step optimizes the
+ * whole problem and calls on_done with the solver state. The job's memory use is estimated from the size of
+ * the solver state.
+ *
+ * @param pts3d_target target points in the target frame, shared between the jobs of the same target.
+ * @param cameras initial camera models, updated by the solver.
+ * @param measurements measurements of the rig, one camera per frame.
+ * @param solver_options batch solver options.
+ * @param frames_per_step number of frames added per step.
+ * @param on_done called with the final state if the optimization succeeded. Optional.
+ * @return FleetScheduler::Job
+ */
+FleetScheduler::Job MakeCalibrationJob(const std::shared_ptr<const gtsam::Point3Vector>& pts3d_target,
+                                       const std::vector<std::shared_ptr<Camera>>& cameras,
+                                       const std::shared_ptr<const MeasurementBlock>& measurements,
+                                       const BatchSolver::Options& solver_options,
+                                       const size_t frames_per_step,
+                                       const std::function<void(const BatchSolver::State&)>& on_done);
+
+/**
+ * @brief Return a rough estimate of the memory held by a solver state, in bytes, from its number of factors
+ * and variables.
+ *
+ * @param state solver state.
+ * @return size_t
+ */
+size_t EstimateStateMemory(const BatchSolver::State& state);
+
+}  // namespace gtcal
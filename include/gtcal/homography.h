@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include <gtsam/base/Matrix.h>
+#include <gtsam/geometry/Point3.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include "gtcal/camera.h"
+#include "gtcal/measurement_block.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief Return true if the homography mapping target plane coordinates (x, y, 1) to pixels was estimated
+ * from the measurements with the normalized DLT. The target points must lie in the z = 0 plane of the target
+ * frame. Return false for fewer than 4 measurements or degenerate (e.g. collinear) configurations.
+ *
+ * @param measurements measurements of a single frame.
+ * @param pts3d_target target points in the target frame, indexed by point id.
+ * @param H_image_target estimated homography, normalized so that H(2, 2) = 1.
+ * @return true
+ * @return false
+ */
+bool EstimateHomography(const std::vector<Measurement>& measurements, const gtsam::Point3Vector& pts3d_target,
+                        gtsam::Matrix3& H_image_target);
+
+/**
+ * @brief Same as above, with the measurements stored as a structure of arrays.
+ *
+ */
+bool EstimateHomography(const MeasurementSpan& measurements, const gtsam::Point3Vector& pts3d_target,
+                        gtsam::Matrix3& H_image_target);
+
+/**
+ * @brief Return true if the camera pose was recovered from a target to image homography. Lens distortion is
+ * ignored, so with fisheye cameras the pose is only a starting point for a pose solver.
+ *
+ * @param H_image_target homography mapping target plane coordinates to pixels.
+ * @param K pinhole camera matrix [fx, 0, cx; 0, fy, cy; 0, 0, 1].
+ * @param pose_target_cam camera pose in the target frame.
+ * @return true
+ * @return false
+ */
+bool PoseFromHomography(const gtsam::Matrix3& H_image_target, const gtsam::Matrix3& K,
+                        gtsam::Pose3& pose_target_cam);
+
+/**
+ * @brief Return the pinhole camera matrix [fx, 0, cx; 0, fy, cy; 0, 0, 1] of a camera for
+ * PoseFromHomography(), ignoring skew and distortion.
+ *
+ * @param camera camera model.
+ * @return gtsam::Matrix3
+ */
+gtsam::Matrix3 CameraMatrix(const Camera& camera);
+
+}  // namespace gtcal
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gtcal {
+
+/**
+ * @brief 8-bit grayscale image, stored row by row without padding.
+ */
+struct Image {
+  size_t width = 0;
+  size_t height = 0;
+  std::vector<uint8_t> pixels;
+
+  Image() = default;
+  Image(const size_t width, const size_t height, const uint8_t value = 0)
+    : width(width), height(height), pixels(width * height, value) {}
+
+  bool empty() const { return pixels.empty(); }
+
+  uint8_t at(const size_t x, const size_t y) const {
+    assert(x < width && y < height && "[Image::at] Pixel out of bounds.");
+    return pixels[y * width + x];
+  }
+
+  uint8_t& at(const size_t x, const size_t y) {
+    assert(x < width && y < height && "[Image::at] Pixel out of bounds.");
+    return pixels[y * width + x];
+  }
+
+  const uint8_t* row(const size_t y) const { return pixels.data() + y * width; }
+  uint8_t* row(const size_t y) { return pixels.data() + y * width; }
+};
+
+/**
+ * @brief Return true if the data is a binary (P5) PGM image with a maximum value of at most 255.
+ *
+ * @param data PGM file contents.
+ * @param image parsed image.
+ * @param error description of the first problem found if parsing fails.
+ * @return true
+ * @return false
+ */
+bool ParsePgm(std::string_view data, Image& image, std::string& error);
+
+/**
+ * @brief Return true if the PGM file was read and parsed. See ParsePgm().
+ *
+ * @param path PGM file path.
+ * @param image parsed image.
+ * @param error description of the problem if reading fails.
+ * @return true
+ * @return false
+ */
+bool ReadPgm(const std::string& path, Image& image, std::string& error);
+
+/**
+ * @brief Return true if the file holds exactly width * height 8-bit pixels and was read.
+ *
+ * @param path raw image file path.
+ * @param width image width.
+ * @param height image height.
+ * @param image read image.
+ * @param error description of the problem if reading fails.
+ * @return true
+ * @return false
+ */
+bool ReadRawImage(const std::string& path, const size_t width, const size_t height, Image& image,
+                  std::string& error);
+
+/**
+ * @brief Return true if the image was written as a binary PGM file.
+ *
+ * @param path PGM file path.
+ * @param image image to write.
+ * @return true
+ * @return false
+ */
+bool WritePgm(const std::string& path, const Image& image);
+
+}  // namespace gtcal
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace gtcal {
+
+/**
+ * @brief Lock-free latency histogram with log-linear buckets (4 sub-buckets per power of two, i.e. at most
+ * 25% relative error). Safe to record from any number of threads while others read.
+ */
+class LatencyHistogram {
+public:
+  static constexpr size_t kSubBucketBits = 2;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  /**
+   * @brief Record a duration.
+   *
+   * @param duration latency to record.
+   */
+  void record(const std::chrono::nanoseconds duration) {
+    const uint64_t ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+    buckets_[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max_ns && !max_ns_.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  /**
+   * @brief Return the number of recorded samples.
+   *
+   * @return uint64_t
+   */
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Return the mean latency.
+   *
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds mean() const {
+    const uint64_t n = count();
+    return std::chrono::nanoseconds(n == 0 ? 0 : sum_ns_.load(std::memory_order_relaxed) / n);
+  }
+
+  /**
+   * @brief Return the largest recorded latency.
+   *
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds max() const {
+    return std::chrono::nanoseconds(max_ns_.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * @brief Return the upper bound of the bucket holding the given percentile.
+   *
+   * @param percentile percentile in [0, 100].
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds percentile(const double percentile) const {
+    const uint64_t n = count();
+    if (n == 0) {
+      return std::chrono::nanoseconds(0);
+    }
+    const double clamped = percentile < 0.0 ? 0.0 : (percentile > 100.0 ? 100.0 : percentile);
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(clamped / 100.0 * n + 0.5));
+    uint64_t seen = 0;
+    for (size_t ii = 0; ii < kNumBuckets; ii++) {
+      seen += buckets_[ii].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        const uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+        return std::chrono::nanoseconds(std::min(bucketUpperBound(ii), max_ns));
+      }
+    }
+    return max();
+  }
+
+  /**
+   * @brief Clear all samples. Not atomic with respect to concurrent calls to record().
+   *
+   */
+  void reset() {
+    for (auto& bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_ns_.store(0, std::memory_order_relaxed);
+    max_ns_.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Return the bucket index for a value in nanoseconds.
+   *
+   * @param ns value.
+   * @return size_t
+   */
+  static size_t bucketIndex(const uint64_t ns) {
+    if (ns < kSubBuckets) {
+      return ns;
+    }
+    const size_t msb = std::bit_width(ns) - 1;
+    const size_t sub_bucket = (ns >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+    return (msb - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+  }
+
+  /**
+   * @brief Return the largest value in nanoseconds that falls in the given bucket.
+   *
+   * @param index bucket index.
+   * @return uint64_t
+   */
+  static uint64_t bucketUpperBound(const size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    const size_t group = index / kSubBuckets;
+    const uint64_t sub_bucket = index % kSubBuckets;
+    const uint64_t lower = (kSubBuckets + sub_bucket) << (group - 1);
+    return lower + ((uint64_t{1} << (group - 1)) - 1);
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_ns_{0};
+  std::atomic<uint64_t> max_ns_{0};
+};
+
+}  // namespace gtcal
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+namespace gtcal {
+namespace io {
+
+/**
+ * @brief Read-only memory mapping of a whole file. The mapping is released when the object is destroyed.
+ */
+class MappedFile {
+public:
+  MappedFile() = default;
+
+  /**
+   * @brief Construct a new Mapped File object and map the given file. Check isOpen() for failures.
+   *
+   * @param path file path.
+   */
+  explicit MappedFile(const std::string& path) { open(path); }
+
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept : data_(other.data_), size_(other.size_), is_open_(other.is_open_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.is_open_ = false;
+  }
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      close();
+      data_ = other.data_;
+      size_ = other.size_;
+      is_open_ = other.is_open_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+      other.is_open_ = false;
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Return true if the file was mapped. Empty files are open but have no data.
+   *
+   * @param path file path.
+   * @return true
+   * @return false
+   */
+  bool open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        size_ = 0;
+        return false;
+      }
+      data_ = static_cast<const char*>(data);
+    }
+    ::close(fd);
+    is_open_ = true;
+    return true;
+  }
+
+  /**
+   * @brief Release the mapping.
+   *
+   */
+  void close() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    is_open_ = false;
+  }
+
+  /**
+   * @brief Hint the kernel that the mapping will be read front to back.
+   *
+   */
+  void adviseSequential() const {
+    if (data_ != nullptr) {
+      ::madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+    }
+  }
+
+  bool isOpen() const { return is_open_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool is_open_ = false;
+};
+
+}  // namespace io
+}  // namespace gtcal
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+#include <gtsam/geometry/Point2.h>
+
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief Non-owning view of contiguous measurements stored as a structure of arrays. Iterating yields
+ * Measurement values assembled from the arrays, so code written against std::vector<Measurement> (e.g.
+ * range-for loops reading meas.uv, meas.camera_id and meas.point_id) works unchanged. Vectorized code reads
+ * the arrays directly through u(), v(), cameraIds() and pointIds().
+ *
+ */
+class MeasurementSpan {
+public:
+  // Measurements are returned by value, so the iterator only meets the C++17 input iterator requirements,
+  // which allow a prvalue reference. It is a C++20 random access iterator, like the iterators of
+  // std::views::iota, so that ranges algorithms can still jump around.
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type = Measurement;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Measurement;
+
+    Iterator() = default;
+    Iterator(const MeasurementSpan& span, const size_t index)
+      : u_(span.u_), v_(span.v_), camera_ids_(span.camera_ids_), point_ids_(span.point_ids_), index_(index) {}
+
+    Measurement operator*() const { return (*this)[0]; }
+    Measurement operator[](const difference_type offset) const {
+      const size_t index = index_ + offset;
+      return Measurement(gtsam::Point2(u_[index], v_[index]), camera_ids_[index], point_ids_[index]);
+    }
+
+    Iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator it = *this;
+      ++index_;
+      return it;
+    }
+    Iterator& operator--() {
+      --index_;
+      return *this;
+    }
+    Iterator operator--(int) {
+      Iterator it = *this;
+      --index_;
+      return it;
+    }
+    Iterator& operator+=(const difference_type offset) {
+      index_ += offset;
+      return *this;
+    }
+    Iterator& operator-=(const difference_type offset) {
+      index_ -= offset;
+      return *this;
+    }
+    Iterator operator+(const difference_type offset) const {
+      Iterator it = *this;
+      it.index_ += offset;
+      return it;
+    }
+    Iterator operator-(const difference_type offset) const {
+      Iterator it = *this;
+      it.index_ -= offset;
+      return it;
+    }
+    difference_type operator-(const Iterator& other) const {
+      return static_cast<difference_type>(index_) - static_cast<difference_type>(other.index_);
+    }
+
+    bool operator==(const Iterator& other) const { return index_ == other.index_; }
+    bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+    bool operator<(const Iterator& other) const { return index_ < other.index_; }
+    bool operator>(const Iterator& other) const { return index_ > other.index_; }
+    bool operator<=(const Iterator& other) const { return index_ <= other.index_; }
+    bool operator>=(const Iterator& other) const { return index_ >= other.index_; }
+
+    friend Iterator operator+(const difference_type offset, const Iterator& it) { return it + offset; }
+
+  private:
+    const float* u_ = nullptr;
+    const float* v_ = nullptr;
+    const uint16_t* camera_ids_ = nullptr;
+    const uint32_t* point_ids_ = nullptr;
+    size_t index_ = 0;
+  };
+
+public:
+  MeasurementSpan() = default;
+
+  /**
+   * @brief Construct a new Measurement Span object over the given arrays.
+   *
+   * @param u horizontal pixel coordinates.
+   * @param v vertical pixel coordinates.
+   * @param camera_ids camera ids.
+   * @param point_ids target point ids.
+   * @param size number of measurements.
+   */
+  MeasurementSpan(const float* u, const float* v, const uint16_t* camera_ids, const uint32_t* point_ids,
+                  const size_t size)
+    : u_(u), v_(v), camera_ids_(camera_ids), point_ids_(point_ids), size_(size) {}
+
+  /**
+   * @brief Return the measurement at the given index.
+   *
+   * @param index measurement index.
+   * @return Measurement
+   */
+  Measurement operator[](const size_t index) const {
+    return Measurement(gtsam::Point2(u_[index], v_[index]), camera_ids_[index], point_ids_[index]);
+  }
+
+  Measurement front() const { return (*this)[0]; }
+  Measurement back() const { return (*this)[size_ - 1]; }
+
+  Iterator begin() const { return Iterator(*this, 0); }
+  Iterator end() const { return Iterator(*this, size_); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * @brief Return a view of count measurements starting at offset.
+   *
+   * @param offset index of the first measurement.
+   * @param count number of measurements.
+   * @return MeasurementSpan
+   */
+  MeasurementSpan subspan(const size_t offset, const size_t count) const {
+    assert(offset + count <= size_ && "[MeasurementSpan::subspan] Out of range.");
+    return MeasurementSpan(u_ + offset, v_ + offset, camera_ids_ + offset, point_ids_ + offset, count);
+  }
+
+  const float* u() const { return u_; }
+  const float* v() const { return v_; }
+  const uint16_t* cameraIds() const { return camera_ids_; }
+  const uint32_t* pointIds() const { return point_ids_; }
+
+private:
+  const float* u_ = nullptr;
+  const float* v_ = nullptr;
+  const uint16_t* camera_ids_ = nullptr;
+  const uint32_t* point_ids_ = nullptr;
+  size_t size_ = 0;
+};
+
+/**
+ * @brief Measurements stored as a structure of arrays and grouped in frames. Pixel coordinates are stored as
+ * floats (below 1e-3 px of rounding for images up to 16k pixels wide), camera ids as 16 bit and point ids as
+ * 32 bit integers, which takes 14 bytes per measurement instead of the 32 of a Measurement.
+ *
+ * Measurements are appended with push_back() and grouped by endFrame(), which closes the frame holding every
+ * measurement added since the previous call.
+ */
+class MeasurementBlock {
+public:
+  MeasurementBlock() = default;
+
+  /**
+   * @brief Construct a new Measurement Block object holding the given measurements as a single frame.
+   *
+   * @param measurements measurements of the frame.
+   * @param timestamp_ns frame timestamp in nanoseconds.
+   */
+  explicit MeasurementBlock(const std::vector<Measurement>& measurements, const int64_t timestamp_ns = 0) {
+    appendFrame(measurements, timestamp_ns);
+  }
+
+  /**
+   * @brief Reserve space for the given number of measurements and frames.
+   *
+   * @param num_measurements number of measurements.
+   * @param num_frames number of frames.
+   */
+  void reserve(const size_t num_measurements, const size_t num_frames = 0) {
+    u_.reserve(num_measurements);
+    v_.reserve(num_measurements);
+    camera_ids_.reserve(num_measurements);
+    point_ids_.reserve(num_measurements);
+    frame_offsets_.reserve(num_frames + 1);
+    timestamps_.reserve(num_frames);
+  }
+
+  /**
+   * @brief Append a measurement to the current frame.
+   *
+   * @param uv measurement in pixel coordinates.
+   * @param camera_id camera id, must fit in 16 bits.
+   * @param point_id target point id, must fit in 32 bits.
+   */
+  void push_back(const gtsam::Point2& uv, const size_t camera_id, const size_t point_id) {
+    assert(camera_id <= std::numeric_limits<uint16_t>::max() &&
+           "[MeasurementBlock::push_back] Camera id doesn't fit in 16 bits.");
+    assert(point_id <= std::numeric_limits<uint32_t>::max() &&
+           "[MeasurementBlock::push_back] Point id doesn't fit in 32 bits.");
+    u_.push_back(static_cast<float>(uv.x()));
+    v_.push_back(static_cast<float>(uv.y()));
+    camera_ids_.push_back(static_cast<uint16_t>(camera_id));
+    point_ids_.push_back(static_cast<uint32_t>(point_id));
+  }
+
+  void push_back(const Measurement& meas) { push_back(meas.uv, meas.camera_id, meas.point_id); }
+
+  /**
+   * @brief Append a range of measurements to the current frame.
+   *
+   * @param measurements measurements to append.
+   */
+  void append(const MeasurementSpan& measurements) {
+    const size_t size = measurements.size();
+    u_.insert(u_.end(), measurements.u(), measurements.u() + size);
+    v_.insert(v_.end(), measurements.v(), measurements.v() + size);
+    camera_ids_.insert(camera_ids_.end(), measurements.cameraIds(), measurements.cameraIds() + size);
+    point_ids_.insert(point_ids_.end(), measurements.pointIds(), measurements.pointIds() + size);
+  }
+
+  /**
+   * @brief Close the current frame. Every measurement added since the previous call belongs to it.
+   *
+   * @param timestamp_ns frame timestamp in nanoseconds.
+   */
+  void endFrame(const int64_t timestamp_ns = 0) {
+    if (frame_offsets_.empty()) {
+      frame_offsets_.push_back(0);
+    }
+    frame_offsets_.push_back(size());
+    timestamps_.push_back(timestamp_ns);
+  }
+
+  /**
+   * @brief Append the given measurements as a new frame.
+   *
+   * @param measurements measurements of the frame.
+   * @param timestamp_ns frame timestamp in nanoseconds.
+   */
+  void appendFrame(const std::vector<Measurement>& measurements, const int64_t timestamp_ns = 0) {
+    // push_back() grows the arrays geometrically. Reserving the exact size here would reallocate them on
+    // every frame.
+    for (const auto& meas : measurements) {
+      push_back(meas);
+    }
+    endFrame(timestamp_ns);
+  }
+
+  /**
+   * @brief Drop the measurements past the given size. Only measurements of the frame that isn't closed yet
+   * may be dropped.
+   *
+   * @param size number of measurements to keep.
+   */
+  void truncate(const size_t size) {
+    assert(size >= (frame_offsets_.empty() ? 0 : frame_offsets_.back()) &&
+           "[MeasurementBlock::truncate] Can't drop measurements of closed frames.");
+    u_.resize(size);
+    v_.resize(size);
+    camera_ids_.resize(size);
+    point_ids_.resize(size);
+  }
+
+  /**
+   * @brief Remove every measurement and frame.
+   *
+   */
+  void clear() {
+    u_.clear();
+    v_.clear();
+    camera_ids_.clear();
+    point_ids_.clear();
+    frame_offsets_.clear();
+    timestamps_.clear();
+  }
+
+  Measurement operator[](const size_t index) const { return span()[index]; }
+
+  size_t size() const { return u_.size(); }
+  bool empty() const { return u_.empty(); }
+
+  /**
+   * @brief Return the number of closed frames.
+   *
+   * @return size_t
+   */
+  size_t numFrames() const { return timestamps_.size(); }
+
+  /**
+   * @brief Return a view of every measurement, including the ones of a frame that isn't closed yet.
+   *
+   * @return MeasurementSpan
+   */
+  MeasurementSpan span() const {
+    return MeasurementSpan(u_.data(), v_.data(), camera_ids_.data(), point_ids_.data(), size());
+  }
+
+  /**
+   * @brief Return a view of the measurements of a closed frame.
+   *
+   * @param index frame index.
+   * @return MeasurementSpan
+   */
+  MeasurementSpan frame(const size_t index) const {
+    assert(index < numFrames() && "[MeasurementBlock::frame] Frame index out of range.");
+    return span().subspan(frame_offsets_[index], frame_offsets_[index + 1] - frame_offsets_[index]);
+  }
+
+  /**
+   * @brief Return the timestamp of a closed frame in nanoseconds.
+   *
+   * @param index frame index.
+   * @return int64_t
+   */
+  int64_t timestamp(const size_t index) const { return timestamps_.at(index); }
+
+  /**
+   * @brief Return the measurements as a vector of Measurement.
+   *
+   * @return std::vector<Measurement>
+   */
+  std::vector<Measurement> toVector() const {
+    std::vector<Measurement> measurements;
+    measurements.reserve(size());
+    for (const Measurement& meas : span()) {
+      measurements.push_back(meas);
+    }
+    return measurements;
+  }
+
+  const std::vector<float>& u() const { return u_; }
+  const std::vector<float>& v() const { return v_; }
+  const std::vector<uint16_t>& cameraIds() const { return camera_ids_; }
+  const std::vector<uint32_t>& pointIds() const { return point_ids_; }
+
+private:
+  std::vector<float> u_;
+  std::vector<float> v_;
+  std::vector<uint16_t> camera_ids_;
+  std::vector<uint32_t> point_ids_;
+
+  // Frame i holds the measurements in [frame_offsets_[i], frame_offsets_[i + 1]).
+  std::vector<size_t> frame_offsets_;
+  std::vector<int64_t> timestamps_;
+};
+
+}  // namespace gtcal
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/latency_histogram.h"
+#include "gtcal/p2_quantile.h"
+#include "gtcal/rig.h"
+#include "gtcal/scenario_generator.h"
+
+namespace gtcal {
+
+class PoseSolver;
+class PoseSolverGtsam;
+
+/**
+ * @brief Streaming statistics of values recorded from any number of threads. The mean, standard deviation and
+ * maximum are exact, the percentiles in kPercentiles are tracked in the value domain with P² estimators, so
+ * their accuracy doesn't depend on the magnitude or sign of the values.
+ */
+class StreamingStatistics {
+public:
+  // Percentiles tracked by percentile().
+  static constexpr std::array<double, 3> kPercentiles = {50.0, 90.0, 99.0};
+
+  StreamingStatistics();
+
+  /**
+   * @brief Record a value.
+   *
+   * @param value value to record.
+   */
+  void record(const double value);
+
+  /**
+   * @brief Return the number of recorded values.
+   *
+   * @return uint64_t
+   */
+  uint64_t count() const;
+
+  /**
+   * @brief Return the mean of the recorded values.
+   *
+   * @return double
+   */
+  double mean() const;
+
+  /**
+   * @brief Return the standard deviation of the recorded values.
+   *
+   * @return double
+   */
+  double stdDev() const;
+
+  /**
+   * @brief Return the largest recorded value, or 0 without values.
+   *
+   * @return double
+   */
+  double max() const;
+
+  /**
+   * @brief Return the P² estimate of a percentile, or 0 without values. Only the percentiles in kPercentiles
+   * are tracked; others get the closest tracked one.
+   *
+   * @param percentile percentile in kPercentiles.
+   * @return double
+   */
+  double percentile(const double percentile) const;
+
+private:
+  mutable std::mutex mutex_;
+  uint64_t count_ = 0;
+  double sum_ = 0.0;
+  double sum2_ = 0.0;
+  double max_ = 0.0;
+  std::vector<P2Quantile> quantiles_;
+};
+
+/**
+ * @brief Monte Carlo harness for calibration accuracy. Each trial takes frames_per_trial frames of a
+ * scenario (see ScenarioGenerator), starts every frame pose from a perturbed ground truth and the cameras
+ * from perturbed intrinsics, then runs:
+ *
+ *   PoseSolver and PoseSolverGtsam on every frame, with the true intrinsics.
+ *   BatchSolver on all frames of the trial, from the perturbed intrinsics, followed by optimize().
+ *
+ * Trials run in parallel, one per thread at a time, and are fully determined by the seed and the trial
+ * index. Errors and timings are aggregated into lock-free statistics as trials finish.
+ */
+class MonteCarloHarness {
+public:
+  enum class Solver : size_t { POSE_SOLVER = 0, POSE_SOLVER_GTSAM = 1, BATCH_SOLVER = 2 };
+  static constexpr size_t kNumSolvers = 3;
+
+  struct Options {
+    // Number of trials and of frames per trial.
+    size_t num_trials = 1000;
+    size_t frames_per_trial = 20;
+
+    // Seed of the scenario and of the perturbations.
+    uint64_t seed = 0;
+
+    // Number of threads running trials (0 for all cores).
+    size_t num_threads = 0;
+
+    // Scenario of the trials. Trial tt uses frames [tt * frames_per_trial, (tt + 1) * frames_per_trial).
+    // The number of frames, seed and number of threads are set by the harness.
+    ScenarioGenerator::Options scenario_options;
+
+    // Standard deviations of the initial frame pose perturbation, applied in the camera frame.
+    double pose_rotation_sigma_deg = 2.0;
+    double pose_translation_sigma = 0.02;
+
+    // Standard deviations of the initial intrinsics perturbation: relative for the focal lengths, in pixels
+    // for the principal point.
+    double focal_length_sigma = 0.02;
+    double principal_point_sigma = 5.0;
+
+    // Frames with fewer measurements are skipped.
+    size_t min_measurements = 6;
+
+    // Solvers to run.
+    bool run_pose_solver = true;
+    bool run_pose_solver_gtsam = true;
+    bool run_batch_solver = true;
+
+    // Batch solver options. Levenberg-Marquardt by default, one thread per solver as the trials already use
+    // every core.
+    BatchSolver::Options batch_options;
+
+    Options() {
+      batch_options.optimizer_type = BatchSolver::OptimizerType::LEVENBERG_MARQUARDT;
+      batch_options.num_threads = 1;
+    }
+  };
+
+  // Errors and timings of a solver.
+  struct SolverStatistics {
+    StreamingStatistics translation_error;  // Frame pose translation error, in meters.
+    StreamingStatistics rotation_error_deg;  // Frame pose rotation error, in degrees.
+    StreamingStatistics intrinsics_error;    // Largest fx, fy, cx or cy error per camera, in pixels (batch).
+    LatencyHistogram solve_time;             // Per frame (pose solvers) or per trial (batch solver).
+    std::atomic<uint64_t> num_failures{0};   // Frames (pose solvers) or trials (batch solver) that failed.
+  };
+
+public:
+  /**
+   * @brief Construct a new Monte Carlo Harness object.
+   *
+   * @param rig target geometry and true intrinsics of the cameras.
+   * @param options harness options.
+   */
+  MonteCarloHarness(const Rig& rig, const Options& options);
+  explicit MonteCarloHarness(const Rig& rig);
+
+  /**
+   * @brief Run every trial. Meant to be called once per harness.
+   *
+   */
+  void run();
+
+  /**
+   * @brief Return the statistics of a solver.
+   *
+   * @param solver solver.
+   * @return const SolverStatistics&
+   */
+  const SolverStatistics& statistics(const Solver solver) const {
+    return statistics_[static_cast<size_t>(solver)];
+  }
+
+  /**
+   * @brief Return the number of trials that completed.
+   *
+   * @return size_t
+   */
+  size_t numTrialsCompleted() const { return num_trials_completed_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Return the number of threads used by the last run.
+   *
+   * @return size_t
+   */
+  size_t numThreads() const { return num_threads_; }
+
+  /**
+   * @brief Return the wall time of the last run.
+   *
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds runTime() const { return run_time_; }
+
+  /**
+   * @brief Write a JSON summary of the options and the statistics of each solver.
+   *
+   * @param os output stream.
+   */
+  void writeJson(std::ostream& os) const;
+
+private:
+  // Per-thread solvers and copies of the true cameras, whose poses the pose solvers update.
+  struct Worker {
+    std::unique_ptr<PoseSolver> pose_solver;
+    std::unique_ptr<PoseSolverGtsam> pose_solver_gtsam;
+    std::vector<std::shared_ptr<Camera>> cameras;
+  };
+
+  /**
+   * @brief Run a trial and record its statistics.
+   *
+   */
+  void runTrial(const size_t trial, Worker& worker);
+
+private:
+  const Options options_;
+  const Rig rig_;
+  const gtsam::Point3Vector pts3d_target_;
+  const ScenarioGenerator generator_;
+  const BatchSolver batch_solver_;
+
+  std::array<SolverStatistics, kNumSolvers> statistics_;
+  std::atomic<size_t> num_trials_completed_{0};
+  size_t num_threads_ = 0;
+  std::chrono::nanoseconds run_time_{0};
+};
+
+}  // namespace gtcal
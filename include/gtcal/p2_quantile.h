@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace gtcal {
+
+/**
+ * @brief Streaming estimate of a quantile with the P² algorithm (Jain and Chlamtac, 1985). Keeps five markers
+ * whose heights approximate the minimum, the p/2, p and (1+p)/2 quantiles and the maximum, and moves
+ * them with a piecewise parabolic fit as samples come in. Constant memory and time per sample.
+ */
+class P2Quantile {
+public:
+  /**
+   * @brief Construct a new P2Quantile object.
+   *
+   * @param p quantile to estimate, in (0, 1).
+   */
+  explicit P2Quantile(const double p);
+
+  /**
+   * @brief Add a sample.
+   *
+   * @param x sample.
+   */
+  void add(const double x);
+
+  /**
+   * @brief Return the estimated quantile, exact for up to five samples, or 0 without samples.
+   *
+   * @return double
+   */
+  double value() const;
+
+  /**
+   * @brief Forget every sample.
+   *
+   */
+  void reset();
+
+  uint64_t count() const { return count_; }
+  double p() const { return p_; }
+
+private:
+  /**
+   * @brief Return the parabolic prediction of the height of marker ii moved by d (+1 or -1) positions.
+   *
+   */
+  double parabolic(const size_t ii, const double d) const;
+
+private:
+  double p_ = 0.5;
+  uint64_t count_ = 0;
+  std::array<double, 5> heights_{};            // Marker heights.
+  std::array<double, 5> positions_{};          // Actual marker positions, 1-based.
+  std::array<double, 5> desired_{};            // Desired marker positions.
+  std::array<double, 5> desired_increment_{};  // Increment of the desired positions per sample.
+};
+
+}  // namespace gtcal
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace gtcal {
+
+/**
+ * @brief Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel Random Numbers: As
+ * Easy as 1, 2, 3", SC 2011). Each (counter, key) pair maps to four independent 32-bit words, so any number
+ * can be computed directly from its index without generating the ones before it.
+ */
+class Philox4x32 {
+public:
+  using Counter = std::array<uint32_t, 4>;
+  using Key = std::array<uint32_t, 2>;
+
+  static constexpr size_t kNumRounds = 10;
+
+  /**
+   * @brief Return the four random words of a counter under a key.
+   *
+   * @param counter block counter.
+   * @param key generator key.
+   * @return Counter
+   */
+  static Counter Generate(Counter counter, Key key) {
+    for (size_t round = 0; round < kNumRounds; round++) {
+      if (round > 0) {
+        key[0] += kWeyl0;
+        key[1] += kWeyl1;
+      }
+      const uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * counter[0];
+      const uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * counter[2];
+      counter = {static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+                 static_cast<uint32_t>(product1),
+                 static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+                 static_cast<uint32_t>(product0)};
+    }
+    return counter;
+  }
+
+private:
+  static constexpr uint32_t kMultiplier0 = 0xD2511F53;
+  static constexpr uint32_t kMultiplier1 = 0xCD9E8D57;
+  static constexpr uint32_t kWeyl0 = 0x9E3779B9;
+  static constexpr uint32_t kWeyl1 = 0xBB67AE85;
+};
+
+/**
+ * @brief Random number stream identified by (seed, stream, substream), backed by Philox4x32-10. Streams are
+ * independent of each other and of the order they are used in, e.g. stream = frame index makes a frame's
+ * noise the same whichever thread generates it. Meets the UniformRandomBitGenerator requirements, but
+ * uniform() and normal() are preferred as they give the same values on every standard library.
+ *
+ * Counter layout: [block, substream, stream low, stream high], key: [seed low, seed high]. A stream holds
+ * 2^32 blocks of four words.
+ */
+class CounterRng {
+public:
+  using result_type = uint32_t;
+
+  CounterRng(const uint64_t seed, const uint64_t stream, const uint32_t substream = 0)
+    : counter_{0, substream, static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)},
+      key_{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)} {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  /**
+   * @brief Return the next 32 random bits.
+   *
+   * @return result_type
+   */
+  result_type operator()() {
+    if (word_ == block_.size()) {
+      block_ = Philox4x32::Generate(counter_, key_);
+      counter_[0]++;
+      word_ = 0;
+    }
+    return block_[word_++];
+  }
+
+  /**
+   * @brief Return a uniform number in [0, 1) with 53 random bits.
+   *
+   * @return double
+   */
+  double uniform() {
+    const uint64_t high = (*this)() >> 6, low = (*this)() >> 5;
+    return static_cast<double>((high << 27) | low) * 0x1.0p-53;
+  }
+
+  /**
+   * @brief Return a uniform number in [low, high).
+   *
+   * @return double
+   */
+  double uniform(const double low, const double high) { return low + (high - low) * uniform(); }
+
+  /**
+   * @brief Return a standard normal number. The Box-Muller transform draws them in pairs.
+   *
+   * @return double
+   */
+  double normal() {
+    if (has_spare_) {
+      has_spare_ = false;
+      return spare_;
+    }
+    const double radius = std::sqrt(-2.0 * std::log(1.0 - uniform()));
+    const double angle = 2.0 * M_PI * uniform();
+    spare_ = radius * std::sin(angle);
+    has_spare_ = true;
+    return radius * std::cos(angle);
+  }
+
+  /**
+   * @brief Return a normal number with the given mean and standard deviation.
+   *
+   * @return double
+   */
+  double normal(const double mean, const double std_dev) { return mean + std_dev * normal(); }
+
+private:
+  Philox4x32::Counter counter_;
+  Philox4x32::Key key_;
+  Philox4x32::Counter block_ = {};
+  size_t word_ = 4;
+  double spare_ = 0.0;
+  bool has_spare_ = false;
+};
+
+}  // namespace gtcal
@@ -4,6 +4,8 @@
 #include <ceres/loss_function.h>
 
 #include "gtcal/camera.h"
+#include "gtcal/coarse_to_fine.h"
+#include "gtcal/measurement_block.h"
 #include "gtcal/utils.h"
 
 namespace gtcal {
@@ -51,14 +53,122 @@ private:
   const size_t height_ = 0;
 };
 
+/**
+ * @brief Projections of the target points of a planar target by the pose being solved, shared by the
+ * PlanarReprojectionErrorResidual blocks of a problem. Ceres calls PrepareForEvaluation() once per evaluation
+ * point, before evaluating the residual blocks: the plane homography is computed once there and every target
+ * point is mapped through it in one batched pass. The Jacobians are central differences of the whole batch,
+ * each of the 12 perturbed poses mapping the batch through its own homography, instead of one homography per
+ * point and numeric differentiation step.
+ *
+ */
+class PlanarTargetProjection : public ceres::EvaluationCallback {
+public:
+  /**
+   * @brief Construct a new Planar Target Projection object.
+   *
+   * @param cmod camera model, its pose isn't used nor modified.
+   * @param pose_target_cam_arr parameter block of the problem, (x, y, z, roll, pitch, yaw) of the camera pose
+   * in the target frame. Ceres writes the evaluation point to it before calling PrepareForEvaluation().
+   */
+  PlanarTargetProjection(const std::shared_ptr<Camera>& cmod, const double* pose_target_cam_arr);
+
+  /**
+   * @brief Add a target point to the batch and return its index.
+   *
+   * @param pt3d_target target point in the z = 0 plane of the target frame.
+   * @return size_t
+   */
+  size_t addPoint(const gtsam::Point3& pt3d_target);
+
+  /**
+   * @brief Project the batch at the evaluation point, and compute its Jacobians if requested.
+   *
+   * @param evaluate_jacobians true if the residual blocks will be asked for their Jacobians.
+   * @param new_evaluation_point true if the parameter block changed since the last call.
+   */
+  void PrepareForEvaluation(bool evaluate_jacobians, bool new_evaluation_point) override;
+
+  /**
+   * @brief Return true if the projection of the point is within the image bounds (and, once computed, its
+   * Jacobian is finite). Return false otherwise.
+   *
+   * @param index index of the point returned by addPoint().
+   * @return true
+   * @return false
+   */
+  bool valid(const size_t index) const { return valid_[index] != 0; }
+
+  /**
+   * @brief Return the projection of the point at the evaluation point.
+   *
+   * @param index index of the point returned by addPoint().
+   * @return const gtsam::Point2&
+   */
+  const gtsam::Point2& uv(const size_t index) const { return uvs_[index]; }
+
+  /**
+   * @brief Return the 2x6 row-major Jacobian of the projection of the point with respect to the parameter
+   * block.
+   *
+   * @param index index of the point returned by addPoint().
+   * @return const double*
+   */
+  const double* jacobian(const size_t index) const { return jacobians_.data() + 12 * index; }
+
+private:
+  const std::shared_ptr<Camera> cmod_ = nullptr;
+  const double* const pose_target_cam_arr_ = nullptr;
+  const size_t width_ = 0;
+  const size_t height_ = 0;
+  gtsam::Point3Vector pts3d_target_;
+  gtsam::Point2Vector uvs_, uvs_plus_, uvs_minus_;
+  std::vector<double> jacobians_;
+  std::vector<uint8_t> valid_;
+  double pose_target_cam_prepared_[6] = {};
+  bool projections_current_ = false;
+  bool jacobians_current_ = false;
+};
+
+class PlanarReprojectionErrorResidual : public ceres::SizedCostFunction<2, 6> {
+public:
+  /**
+   * @brief Construct a new Planar Reprojection Error Residual object.
+   *
+   * @param uv measurement taken at new camera pose (pose we're trying to solve for).
+   * @param projection batch holding the projection of the target point, must outlive the residual.
+   * @param index index of the target point in the batch.
+   */
+  PlanarReprojectionErrorResidual(const gtsam::Point2& uv, const PlanarTargetProjection& projection,
+                                  const size_t index);
+
+  /**
+   * @brief Read the residuals and Jacobian from the batch prepared for the evaluation point. Return false if
+   * the target point projects outside of the image.
+   *
+   * @param parameters pose parameter block, already consumed by the batch.
+   * @param residuals residuals of the measurement.
+   * @param jacobians Jacobian of the residuals, if not null.
+   * @return true
+   * @return false
+   */
+  bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override;
+
+private:
+  const gtsam::Point2 uv_ = gtsam::Point2::Constant(utils::NaN);
+  const PlanarTargetProjection& projection_;
+  const size_t index_ = 0;
+};
+
 class PoseSolver {
 public:
   /**
    * @brief Construct a new Pose Solver object
    *
    * @param verbose if true, will print the solver summary to stdout.
+   * @param coarse_to_fine coarse-to-fine schedule of the iterations, disabled by default.
    */
-  PoseSolver(const bool verbose = false);
+  PoseSolver(const bool verbose = false, const CoarseToFineOptions& coarse_to_fine = CoarseToFineOptions());
 
   /**
    * @brief Destroy the Pose Solver object.
@@ -66,6 +176,9 @@ public:
    */
   ~PoseSolver();
 
+  PoseSolver(const PoseSolver&) = delete;
+  PoseSolver& operator=(const PoseSolver&) = delete;
+
   /**
    * @brief Return true if the solver was able to solve for the camera pose in the target frame. Return false
    * otherwise.
@@ -80,8 +193,26 @@ public:
   bool solve(const std::vector<Measurement>& measurements, const gtsam::Point3Vector& pts3d_target,
              const std::shared_ptr<Camera>& camera, gtsam::Pose3& pose_target_cam) const;
 
+  /**
+   * @brief Same as above, with the measurements stored as a structure of arrays (e.g. a frame of a
+   * MeasurementBlock).
+   *
+   */
+  bool solve(const MeasurementSpan& measurements, const gtsam::Point3Vector& pts3d_target,
+             const std::shared_ptr<Camera>& camera, gtsam::Pose3& pose_target_cam) const;
+
+private:
+  /**
+   * @brief Implementation of solve() for both measurement containers.
+   *
+   */
+  template <typename MeasurementRange>
+  bool solvePose(const MeasurementRange& measurements, const gtsam::Point3Vector& pts3d_target,
+                 const std::shared_ptr<Camera>& camera, gtsam::Pose3& pose_target_cam) const;
+
 private:
   ceres::Solver::Options options_;
+  const CoarseToFineOptions coarse_to_fine_;
   ceres::LossFunction* loss_function_ = nullptr;
   const double loss_scaling_param_ = 1.0;
 };
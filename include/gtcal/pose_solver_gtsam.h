@@ -7,11 +7,11 @@
 #include <gtsam/geometry/Cal3Fisheye.h>
 
 #include "gtcal/camera.h"
+#include "gtcal/coarse_to_fine.h"
+#include "gtcal/measurement_block.h"
 
 namespace gtcal {
 
-class Measurement;
-
 class PoseSolverGtsam {
 public:
   // Contains the noise models used for the different factors in the factor graph.
@@ -27,14 +27,41 @@ public:
     // Default noise model for the pixel measurements.
     gtsam::noiseModel::Isotropic::shared_ptr pixel_meas_noise_model =
         gtsam::noiseModel::Isotropic::Sigma(2, 1.0);
+
+    // Coarse-to-fine schedule of the Levenberg-Marquardt iterations, disabled by default.
+    CoarseToFineOptions coarse_to_fine;
   };
 
 public:
   PoseSolverGtsam(const Options& options);
 
+  /**
+   * @brief Return true if the camera pose was solved from the measurements of a frame, and update the pose
+   * argument. Return false, leaving the pose unchanged, if Levenberg-Marquardt threw or ended with a
+   * non-finite error at any level of the coarse-to-fine schedule.
+   *
+   * @param measurements measurements of a frame, std::vector<Measurement> or MeasurementSpan.
+   * @param pts3d_target target points in the target frame.
+   * @param camera camera model.
+   * @param pose_initial_target_cam initial estimate of the camera pose in the target frame, and the solution.
+   * @return true
+   * @return false
+   */
   bool solve(const std::vector<Measurement>& measurements, const gtsam::Point3Vector& pts3d_target,
              const std::shared_ptr<Camera>& camera, gtsam::Pose3& pose_initial_target_cam) const;
 
+  bool solve(const MeasurementSpan& measurements, const gtsam::Point3Vector& pts3d_target,
+             const std::shared_ptr<Camera>& camera, gtsam::Pose3& pose_initial_target_cam) const;
+
+private:
+  /**
+   * @brief Implementation of solve() for both measurement containers.
+   *
+   */
+  template <typename MeasurementRange>
+  bool solvePose(const MeasurementRange& measurements, const gtsam::Point3Vector& pts3d_target,
+                 const std::shared_ptr<Camera>& camera, gtsam::Pose3& pose_initial_target_cam) const;
+
 private:
   const Options options_;
 };
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <gtsam/geometry/Point3.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include "gtcal/camera.h"
+#include "gtcal/measurement_block.h"
+
+namespace gtcal {
+
+/**
+ * @brief Histogram of reprojection error magnitudes with fixed-width bins, along with the exact count, mean,
+ * RMS, mean residual (bias) and maximum. Errors past the last bin are counted in the last bin. Percentiles
+ * interpolate linearly inside their bin, so they are within one bin width of the exact ones.
+ */
+class ResidualHistogram {
+public:
+  /**
+   * @brief Construct a new Residual Histogram object.
+   *
+   * @param bin_width width of the bins, in pixels.
+   * @param num_bins number of bins.
+   */
+  ResidualHistogram(const double bin_width, const size_t num_bins);
+
+  /**
+   * @brief Record a residual.
+   *
+   * @param du horizontal residual (projection - measurement), in pixels.
+   * @param dv vertical residual, in pixels.
+   */
+  void record(const double du, const double dv);
+
+  /**
+   * @brief Add the residuals of another histogram with the same bins.
+   *
+   * @param other histogram to merge.
+   */
+  void merge(const ResidualHistogram& other);
+
+  uint64_t count() const { return count_; }
+  double binWidth() const { return bin_width_; }
+  const std::vector<uint64_t>& bins() const { return bins_; }
+
+  /**
+   * @brief Return the root mean square of the error magnitudes, in pixels.
+   *
+   * @return double
+   */
+  double rms() const;
+
+  /**
+   * @brief Return the mean error magnitude, in pixels.
+   *
+   * @return double
+   */
+  double mean() const;
+
+  /**
+   * @brief Return the largest error magnitude, in pixels.
+   *
+   * @return double
+   */
+  double max() const { return max_; }
+
+  /**
+   * @brief Return the mean residual, in pixels. Far from zero when the calibration is biased.
+   *
+   * @return gtsam::Point2
+   */
+  gtsam::Point2 bias() const;
+
+  /**
+   * @brief Return the error magnitude below which the given percentage of the errors fall, in pixels.
+   *
+   * @param percentile percentile in [0, 100].
+   * @return double
+   */
+  double percentile(const double percentile) const;
+
+private:
+  double bin_width_ = 0.0;
+  std::vector<uint64_t> bins_;
+  uint64_t count_ = 0;
+  double sum_ = 0.0;
+  double sum_squares_ = 0.0;
+  double sum_du_ = 0.0;
+  double sum_dv_ = 0.0;
+  double max_ = 0.0;
+};
+
+/**
+ * @brief Computes the reprojection residuals of a whole dataset, e.g. after a calibration, and summarizes
+ * them per camera, per frame and per image region. Frames are spread over threads. Within a frame, target
+ * points are gathered in blocks and transformed, projected and compared to the measurements as a structure
+ * of arrays, two residuals at a time with SSE2 where available. The projections match Camera::project.
+ */
+class ReprojectionEvaluator {
+public:
+  struct Options {
+    // Bins of the error histograms.
+    double bin_width = 0.01;
+    size_t num_bins = 1000;
+
+    // Each camera image is split into region_cols x region_rows regions, by measured pixel location.
+    size_t region_cols = 4;
+    size_t region_rows = 3;
+
+    // Keep the residual of every measurement in Result::residual_u and residual_v.
+    bool keep_residuals = false;
+
+    // Number of threads evaluating frames in parallel (0 for all cores).
+    size_t num_threads = 0;
+  };
+
+  // Statistics of one frame, exact since a frame is small.
+  struct FrameStatistics {
+    size_t camera_id = 0;
+    size_t count = 0;        // Measurements with a valid projection.
+    size_t num_invalid = 0;  // Measurements of points behind the camera.
+    double rms = 0.0;
+    double median = 0.0;
+    double p95 = 0.0;
+    double max = 0.0;
+  };
+
+  struct Result {
+    // Every residual of the dataset.
+    ResidualHistogram total;
+
+    // One histogram per camera, indexed by camera id.
+    std::vector<ResidualHistogram> cameras;
+
+    // One histogram per camera region, row-major: regions[camera_id][row * region_cols + col].
+    std::vector<std::vector<ResidualHistogram>> regions;
+
+    // One entry per frame of the measurement block.
+    std::vector<FrameStatistics> frames;
+
+    // Residuals (projection - measurement) in measurement order if Options::keep_residuals, NaN for
+    // invalid projections.
+    std::vector<float> residual_u;
+    std::vector<float> residual_v;
+
+    // Measurements of points behind their camera, left out of every histogram.
+    size_t num_invalid = 0;
+  };
+
+public:
+  ReprojectionEvaluator();
+  explicit ReprojectionEvaluator(const Options& options);
+
+  /**
+   * @brief Return the residuals of every measurement of a block, summarized. Each frame of the block holds
+   * measurements of one camera at one pose. The cameras' own poses are ignored.
+   *
+   * @param cameras cameras, indexed by the measurements' camera ids.
+   * @param poses_target_cam camera pose in the target frame of each frame of the block.
+   * @param pts3d_target target points in the target frame, indexed by the measurements' point ids.
+   * @param measurements measurements, grouped in frames.
+   * @return Result
+   */
+  Result evaluate(const std::vector<std::shared_ptr<Camera>>& cameras,
+                  const std::vector<gtsam::Pose3>& poses_target_cam, const gtsam::Point3Vector& pts3d_target,
+                  const MeasurementBlock& measurements) const;
+
+  /**
+   * @brief Write a summary of a result: every camera, its regions as RMS grids, and the worst frames.
+   *
+   * @param result result returned by evaluate().
+   * @param os output stream.
+   * @param num_worst_frames number of frames with the highest RMS to list.
+   */
+  void writeReport(const Result& result, std::ostream& os, const size_t num_worst_frames = 5) const;
+
+  const Options& options() const { return options_; }
+
+private:
+  const Options options_;
+};
+
+}  // namespace gtcal
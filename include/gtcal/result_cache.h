@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gtsam/geometry/Point3.h>
+
+#include "gtcal/batch_solver.h"
+#include "gtcal/camera.h"
+#include "gtcal/mapped_file.h"
+#include "gtcal/measurement_block.h"
+
+namespace gtcal {
+
+/**
+ * Result cache entry file layout (native byte order), one file per entry named after its key in hex:
+ *
+ *   header:   "GTCALRES" | u32 version | u32 num_cameras | u64 key | u64 num_frames | u32 FNV-1a of the
+ *             camera records | u32 reserved
+ *   cameras:  ResultCacheCamera[num_cameras]
+ *
+ * Entries are written to a temporary file and renamed into place, so a crash never leaves a partial entry
+ * under a valid name. The modification time of an entry is its last use, which keeps the LRU order across
+ * processes.
+ */
+static constexpr char kResultCacheMagic[8] = {'G', 'T', 'C', 'A', 'L', 'R', 'E', 'S'};
+static constexpr uint32_t kResultCacheVersion = 1;
+
+// Camera record, read in place from the mapping.
+struct ResultCacheCamera {
+  uint32_t model_type = 0;  // Camera::ModelType.
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t num_intrinsics = 0;
+  double intrinsics[8] = {};  // Camera::intrinsicsParameters() order.
+  double pose[7] = {};        // Camera pose as x, y, z, qw, qx, qy, qz.
+};
+static_assert(sizeof(ResultCacheCamera) == 136, "Camera record layout changed.");
+
+// Calibration stored in the cache.
+struct CachedCalibration {
+  std::vector<std::shared_ptr<Camera>> cameras;
+  size_t num_frames = 0;
+};
+
+/**
+ * @brief Return the content key of a calibration problem: the XXH64 hash of the measurements (values, ids and
+ * frame boundaries), the target points, the model type, image size, intrinsics and pose of each initial
+ * camera, the pixel covariances of the measurements if any and every BatchSolver option that changes the
+ * solution. Options that only change the speed (num_threads) aren't part of the key. Two problems with the
+ * same key are solved to the same calibration.
+ *
+ * @param measurements measurements of the problem.
+ * @param pts3d_target target points in the target frame.
+ * @param cameras initial camera models.
+ * @param options batch solver options.
+ * @param covariances pixel covariance of each measurement, as passed to the BatchSolver::solve() overload
+ * with covariances, or nullptr for a solve with pixel_meas_noise_model.
+ * @return uint64_t
+ */
+uint64_t ComputeResultCacheKey(const MeasurementBlock& measurements, const gtsam::Point3Vector& pts3d_target,
+                               const std::vector<std::shared_ptr<Camera>>& cameras,
+                               const BatchSolver::Options& options,
+                               const std::vector<gtsam::Matrix2>* covariances = nullptr);
+
+/**
+ * @brief Content-addressed on-disk store of calibration results, so that a problem that was already solved
+ * (a retried or reprocessed detection set) isn't solved again. Entries are memory-mapped on first use and
+ * stay mapped while they're in the cache, so a hit costs a hash lookup and a copy of the camera records. The
+ * least recently used entries are evicted once the cache holds more than Options::max_entries entries or
+ * Options::max_bytes bytes. Thread-safe; several processes may share a directory, each keeping its own
+ * limits.
+ */
+class ResultCache {
+public:
+  struct Options {
+    // Largest number of entries and total size of the entry files, 0 for no limit.
+    size_t max_entries = 4096;
+    size_t max_bytes = size_t{64} << 20;
+  };
+
+  struct Stats {
+    uint64_t num_hits = 0;
+    uint64_t num_misses = 0;
+    uint64_t num_stores = 0;
+    uint64_t num_evictions = 0;
+  };
+
+public:
+  /**
+   * @brief Construct a new Result Cache object over a directory, creating it if needed. Existing entries are
+   * indexed in their LRU order and evicted down to the limits. Check isOpen() for failures.
+   *
+   * @param directory cache directory.
+   * @param options cache options.
+   */
+  ResultCache(const std::string& directory, const Options& options);
+  explicit ResultCache(const std::string& directory);
+
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  /**
+   * @brief Return true if the cache directory exists and was indexed.
+   *
+   * @return true
+   * @return false
+   */
+  bool isOpen() const { return is_open_; }
+
+  /**
+   * @brief Return true if the cache holds a valid entry for the key, and set result to a copy of it. The
+   * entry becomes the most recently used. Corrupted entries are removed and count as misses.
+   *
+   * @param key key from ComputeResultCacheKey().
+   * @param result cached calibration.
+   * @return true
+   * @return false
+   */
+  bool lookup(const uint64_t key, CachedCalibration& result);
+
+  /**
+   * @brief Return true if the calibration was written under the key, replacing any previous entry, and
+   * evict the least recently used entries over the limits.
+   *
+   * @param key key from ComputeResultCacheKey().
+   * @param result calibration to store.
+   * @return true
+   * @return false
+   */
+  bool store(const uint64_t key, const CachedCalibration& result);
+
+  /**
+   * @brief Same as above with the cameras and number of frames of a solver state.
+   *
+   */
+  bool store(const uint64_t key, const BatchSolver::State& state);
+
+  /**
+   * @brief Remove every entry of the cache.
+   *
+   */
+  void clear();
+
+  /**
+   * @brief Return the number of entries and their total size in bytes.
+   *
+   */
+  size_t size() const;
+  size_t sizeBytes() const;
+
+  /**
+   * @brief Return the hit, miss, store and eviction counters.
+   *
+   * @return Stats
+   */
+  Stats stats() const;
+
+  const std::string& directory() const { return directory_; }
+
+private:
+  struct Entry {
+    uint64_t key = 0;
+    size_t file_size = 0;
+    io::MappedFile file;  // Mapped on the first lookup.
+  };
+  using EntryList = std::list<Entry>;
+
+  /**
+   * @brief Return the path of the entry file of a key.
+   *
+   */
+  std::string entryPath(const uint64_t key) const;
+
+  /**
+   * @brief Remove an entry from the index and its file from the directory. Caller holds the lock.
+   *
+   */
+  void remove(EntryList::iterator it);
+
+  /**
+   * @brief Evict the least recently used entries until the cache is within its limits. Caller holds the lock.
+   *
+   */
+  void evict();
+
+private:
+  const Options options_;
+  const std::string directory_;
+  bool is_open_ = false;
+
+  // Entries from the most to the least recently used, and their index by key.
+  mutable std::mutex mutex_;
+  EntryList entries_;
+  std::unordered_map<uint64_t, EntryList::iterator> index_;
+  size_t size_bytes_ = 0;
+  Stats stats_;
+};
+
+}  // namespace gtcal
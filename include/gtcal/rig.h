@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gtcal/calibration_target.h"
+#include "gtcal/camera.h"
+
+namespace gtcal {
+
+/**
+ * Rig description text format, one record per line. Blank lines and everything after '#' are ignored.
+ *
+ *   target <grid_spacing> <num_rows> <num_cols>
+ *   camera <camera_id> pinhole <width> <height> <fx> <fy> <cx> <cy>
+ *   camera <camera_id> fisheye <width> <height> <fx> <fy> <cx> <cy> <k1> <k2> <k3> <k4>
+ *   frame <camera_id> <timestamp_ns> <x> <y> <z> <qw> <qx> <qy> <qz>
+ *
+ * Camera ids must be 0, 1, ..., n - 1 and the intrinsics are the initial estimates. frame records hold the
+ * frame poses (camera pose in the target frame) written with a calibration result. They are skipped when a
+ * rig is parsed, so a calibration result can be used as the rig of the next calibration.
+ */
+struct Rig {
+  // Target geometry.
+  double grid_spacing = 0.0;
+  size_t num_rows = 0;
+  size_t num_cols = 0;
+
+  // Cameras indexed by camera id.
+  std::vector<std::shared_ptr<Camera>> cameras;
+
+  /**
+   * @brief Return the calibration target.
+   *
+   * @return utils::CalibrationTarget
+   */
+  utils::CalibrationTarget target() const { return {grid_spacing, num_rows, num_cols}; }
+
+  /**
+   * @brief Return deep copies of the cameras.
+   *
+   * @return std::vector<std::shared_ptr<Camera>>
+   */
+  std::vector<std::shared_ptr<Camera>> cloneCameras() const;
+};
+
+/**
+ * @brief Return true if the text was a valid rig description with a target and at least one camera.
+ *
+ * @param text rig description.
+ * @param rig parsed rig.
+ * @param error description of the first error, if any.
+ * @return true
+ * @return false
+ */
+bool ParseRig(std::string_view text, Rig& rig, std::string& error);
+
+/**
+ * @brief Return true if the file was read and parsed. See ParseRig().
+ *
+ * @param path rig description file path.
+ * @param rig parsed rig.
+ * @param error description of the first error, if any.
+ * @return true
+ * @return false
+ */
+bool LoadRig(const std::string& path, Rig& rig, std::string& error);
+
+/**
+ * @brief Write the target and camera records of a rig.
+ *
+ * @param rig rig to write.
+ * @param os output stream.
+ */
+void WriteRig(const Rig& rig, std::ostream& os);
+
+}  // namespace gtcal
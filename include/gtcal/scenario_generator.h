@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <gtsam/geometry/Pose3.h>
+
+#include "gtcal/detection_log.h"
+#include "gtcal/measurement_block.h"
+#include "gtcal/rig.h"
+#include "gtcal/utils.h"
+
+namespace gtcal {
+
+/**
+ * @brief Generates synthetic calibration scenarios: the target seen by the cameras of a rig along a
+ * trajectory, with Gaussian pixel noise.
+ *
+ * Frame ii is seen by camera ii % num_cameras. Its pose and noise only depend on the seed and ii (see
+ * CounterRng), so any frame can be generated on its own and batches don't depend on the number of threads.
+ * Points behind the camera or outside its image are left out of the frame's measurements.
+ */
+class ScenarioGenerator {
+public:
+  enum class Trajectory {
+    ARC,     // The camera swings back and forth on a horizontal arc in front of the target.
+    SPHERE,  // Random views from a spherical cap in front of the target.
+  };
+
+  struct Options {
+    // Number of frames of the scenario.
+    size_t num_frames = 1000;
+
+    Trajectory trajectory = Trajectory::SPHERE;
+
+    // Distance from the camera to the target center, in meters. ARC uses the middle of the range.
+    double min_distance = 0.6;
+    double max_distance = 1.2;
+
+    // Largest angle between the target normal and the direction from the target center to the camera.
+    double max_view_angle_deg = 35.0;
+
+    // Largest rotation of the camera about its optical axis (SPHERE only).
+    double max_roll_deg = 15.0;
+
+    // Number of frames of a full swing back and forth (ARC only).
+    size_t arc_period = 120;
+
+    // Standard deviation of the pixel noise.
+    double pixel_sigma = 0.2;
+
+    // Time between consecutive frames.
+    int64_t frame_period_ns = 33'333'333;
+
+    // Seed of the poses and noise.
+    uint64_t seed = 0;
+
+    // Number of threads generating frames (0 for all cores).
+    size_t num_threads = 0;
+
+    // Number of frames generated in parallel before they are written to a log.
+    size_t frames_per_batch = 4096;
+  };
+
+  // Ground truth of a generated frame.
+  struct Frame {
+    size_t camera_id = 0;
+    int64_t timestamp_ns = 0;
+    gtsam::Pose3 pose_target_cam;
+  };
+
+public:
+  /**
+   * @brief Construct a new Scenario Generator object.
+   *
+   * @param rig target geometry and cameras. The camera poses are ignored.
+   * @param options generator options.
+   */
+  ScenarioGenerator(const Rig& rig, const Options& options);
+  explicit ScenarioGenerator(const Rig& rig);
+
+  /**
+   * @brief Return the number of frames of the scenario.
+   *
+   * @return size_t
+   */
+  size_t numFrames() const { return options_.num_frames; }
+
+  /**
+   * @brief Generate one frame. Thread-safe.
+   *
+   * @param index frame index.
+   * @param measurements noisy measurements of the frame.
+   * @return Frame
+   */
+  Frame frame(const size_t index, std::vector<Measurement>& measurements) const;
+
+  /**
+   * @brief Generate frames [first, first + count) in parallel and append them to a block in order.
+   *
+   * @param first index of the first frame.
+   * @param count number of frames.
+   * @param block block the frames are appended to.
+   * @param frames if not null, the ground truth of the frames is appended to it.
+   */
+  void generate(const size_t first, const size_t count, MeasurementBlock& block,
+                std::vector<Frame>* frames = nullptr) const;
+
+  /**
+   * @brief Generate every frame of the scenario into a log, frames_per_batch frames at a time. Return false
+   * if a write failed.
+   *
+   * @param writer open log writer.
+   * @param frames if not null, the ground truth of the frames is appended to it.
+   * @return true
+   * @return false
+   */
+  bool generate(DetectionLogWriter& writer, std::vector<Frame>* frames = nullptr) const;
+
+private:
+  /**
+   * @brief Return the camera pose in the target frame of a frame.
+   *
+   */
+  gtsam::Pose3 framePose(const size_t index) const;
+
+  /**
+   * @brief Generate frames [first, first + count) in parallel, one vector of measurements per frame.
+   *
+   */
+  void generateBatch(const size_t first, const size_t count, std::vector<std::vector<Measurement>>& batch,
+                     std::vector<Frame>& frames) const;
+
+private:
+  Options options_;
+  std::vector<std::shared_ptr<Camera>> cameras_;
+  gtsam::Point3Vector pts3d_target_;
+  gtsam::Point3 target_center_;
+};
+
+}  // namespace gtcal
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <gtsam/geometry/PinholeCamera.h>
+#include <gtsam/geometry/Point2.h>
+#include <gtsam/geometry/Point3.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/nonlinear/NonlinearFactor.h>
+
+#include "gtcal/trace.h"
+
+namespace gtcal {
+
+/**
+ * @brief Reprojection factor between a frame pose and the camera intrinsics with the target point baked in.
+ * Target corners are known constants, so unlike GeneralSFMFactor2 there is no landmark variable (and no
+ * tight landmark prior) for the elimination to carry around.
+ *
+ * @tparam CALIBRATION gtsam calibration type.
+ */
+template <typename CALIBRATION>
+class TargetProjectionFactor : public gtsam::NoiseModelFactorN<gtsam::Pose3, CALIBRATION> {
+public:
+  using Base = gtsam::NoiseModelFactorN<gtsam::Pose3, CALIBRATION>;
+  using shared_ptr = std::shared_ptr<TargetProjectionFactor<CALIBRATION>>;
+  using Base::evaluateError;
+
+  TargetProjectionFactor() = default;
+
+  /**
+   * @brief Construct a new Target Projection Factor object.
+   *
+   * @param measured pixel measurement of the target point.
+   * @param pt3d_target target point in the target frame.
+   * @param noise_model pixel measurement noise model.
+   * @param pose_key key of the camera pose in the target frame.
+   * @param calibration_key key of the camera calibration.
+   */
+  TargetProjectionFactor(const gtsam::Point2& measured, const gtsam::Point3& pt3d_target,
+                         const gtsam::SharedNoiseModel& noise_model, const gtsam::Key pose_key,
+                         const gtsam::Key calibration_key)
+    : Base(noise_model, pose_key, calibration_key), measured_(measured), pt3d_target_(pt3d_target) {}
+
+  gtsam::NonlinearFactor::shared_ptr clone() const override {
+    return std::make_shared<TargetProjectionFactor<CALIBRATION>>(*this);
+  }
+
+  /**
+   * @brief Return the reprojection error of the target point and its Jacobians with respect to the pose and
+   * the calibration. Points behind the camera get a large constant error and zero Jacobians.
+   *
+   */
+  gtsam::Vector evaluateError(const gtsam::Pose3& pose_target_cam, const CALIBRATION& K,
+                              gtsam::OptionalMatrixType H_pose,
+                              gtsam::OptionalMatrixType H_calibration) const override {
+    GTCAL_TRACE_ZONE("TargetProjectionFactor::evaluateError");
+    try {
+      const gtsam::PinholeCamera<CALIBRATION> camera(pose_target_cam, K);
+      return camera.project(pt3d_target_, H_pose, {}, H_calibration) - measured_;
+    } catch (const gtsam::CheiralityException&) {
+      if (H_pose) {
+        *H_pose = gtsam::Matrix::Zero(2, 6);
+      }
+      if (H_calibration) {
+        *H_calibration = gtsam::Matrix::Zero(2, gtsam::traits<CALIBRATION>::dimension);
+      }
+      return gtsam::Vector2::Constant(2.0 * K.fx());
+    }
+  }
+
+  /**
+   * @brief Return the pixel measurement.
+   *
+   * @return const gtsam::Point2&
+   */
+  const gtsam::Point2& measured() const { return measured_; }
+
+  /**
+   * @brief Return the target point in the target frame.
+   *
+   * @return const gtsam::Point3&
+   */
+  const gtsam::Point3& targetPoint() const { return pt3d_target_; }
+
+private:
+  gtsam::Point2 measured_ = gtsam::Point2::Zero();
+  gtsam::Point3 pt3d_target_ = gtsam::Point3::Zero();
+};
+
+}  // namespace gtcal
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <gtsam/geometry/Pose3.h>
+
+#include "gtcal/calibration_target.h"
+#include "gtcal/camera.h"
+#include "gtcal/image.h"
+
+namespace gtcal {
+
+/**
+ * @brief Renders the checkerboard of a CalibrationTarget seen by a Camera into grayscale images, to benchmark
+ * the image path and test detection on reproducible synthetic corpora.
+ *
+ * The board follows the CornerDetector convention: the square between points (col, row) and
+ * (col + 1, row + 1) is dark when col + row is even, with one more row and column of squares on every side
+ * of the points, and a light margin around the squares.
+ *
+ * Rendering uses inverse mapping. The bearing of every sample in the camera frame is computed once, when the
+ * renderer is constructed, which is where fisheye distortion costs its iterative undistortion. Each image
+ * then intersects the bearings of a sample row with the target plane and shades them, four samples at a
+ * time with SSE2 where available. Pixels average samples_per_axis^2 samples, followed by optional Gaussian
+ * blur, vignetting and Gaussian noise.
+ */
+class TargetRenderer {
+public:
+  struct Options {
+    // Intensities of the dark and light squares, and of everything off the board.
+    uint8_t dark = 40;
+    uint8_t light = 210;
+    uint8_t background = 128;
+
+    // Width of the light margin around the squares, in squares.
+    double margin = 0.5;
+
+    // Each pixel averages samples_per_axis x samples_per_axis samples.
+    size_t samples_per_axis = 2;
+
+    // Standard deviation of the Gaussian blur, in pixels (0 for none).
+    double blur_sigma = 0.0;
+
+    // Fraction of the intensity lost in the image corners, falling off with the squared distance to the image
+    // center (0 for none).
+    double vignetting = 0.0;
+
+    // Standard deviation of the Gaussian pixel noise, in gray levels (0 for none).
+    double noise_sigma = 0.0;
+
+    // Seed of the pixel noise. The noise of an image only depends on the seed and the image index.
+    uint64_t seed = 0;
+
+    // Number of threads rendering images in parallel (0 for all cores).
+    size_t num_threads = 0;
+  };
+
+public:
+  TargetRenderer(const utils::CalibrationTarget& target, const Camera& camera, const Options& options);
+  TargetRenderer(const utils::CalibrationTarget& target, const Camera& camera);
+
+  /**
+   * @brief Render the target seen from a pose. The camera's own pose is ignored.
+   *
+   * @param pose_target_cam camera pose in the target frame.
+   * @param index image index, selects the pixel noise.
+   * @return Image
+   */
+  Image render(const gtsam::Pose3& pose_target_cam, const uint64_t index = 0) const;
+
+  /**
+   * @brief Render the target seen from several poses in parallel. Image ii gets index ii, so the images don't
+   * depend on the number of threads.
+   *
+   * @param poses_target_cam camera poses in the target frame.
+   * @param images rendered images, one per pose.
+   */
+  void render(const std::vector<gtsam::Pose3>& poses_target_cam, std::vector<Image>& images) const;
+
+  /**
+   * @brief Return the image width.
+   *
+   * @return size_t
+   */
+  size_t width() const { return width_; }
+
+  /**
+   * @brief Return the image height.
+   *
+   * @return size_t
+   */
+  size_t height() const { return height_; }
+
+private:
+  /**
+   * @brief Return the number of threads to use for a number of work items.
+   *
+   */
+  size_t numThreads(const size_t num_items) const;
+
+private:
+  utils::CalibrationTarget target_;
+  Options options_;
+  size_t width_;
+  size_t height_;
+
+  // Bearings (x, y, 1) of the samples in the camera frame, one array per coordinate, (height *
+  // samples_per_axis) rows of (width * samples_per_axis) samples. Samples without a bearing (outside the
+  // fisheye's field of view) are NaN.
+  std::vector<float> rays_x_;
+  std::vector<float> rays_y_;
+};
+
+}  // namespace gtcal
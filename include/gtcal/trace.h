@@ -0,0 +1,245 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scoped trace zones. Compiled in with -DGTCAL_ENABLE_TRACING (CMake option GTCAL_ENABLE_TRACING), compiled
+// out otherwise. Zones only record while tracing is started, see gtcal::trace::Start().
+#ifdef GTCAL_ENABLE_TRACING
+#define GTCAL_TRACE_CONCAT_IMPL(a, b) a##b
+#define GTCAL_TRACE_CONCAT(a, b) GTCAL_TRACE_CONCAT_IMPL(a, b)
+#define GTCAL_TRACE_ZONE(name) \
+  const ::gtcal::trace::Zone GTCAL_TRACE_CONCAT(gtcal_trace_zone_, __LINE__)(name)
+#else
+#define GTCAL_TRACE_ZONE(name) static_cast<void>(0)
+#endif
+
+namespace gtcal {
+namespace trace {
+
+// Capacity of each thread's ring buffer. Older events are overwritten (and counted as dropped) once full.
+static constexpr size_t kEventsPerThread = size_t{1} << 16;
+
+// A closed zone. Names must outlive the trace, e.g. string literals.
+struct Event {
+  const char* name = nullptr;
+  int64_t begin_ns = 0;
+  int64_t end_ns = 0;
+};
+
+// A closed zone and the thread that recorded it, as returned by Collect().
+struct CollectedEvent {
+  const char* name = nullptr;
+  uint32_t thread_id = 0;
+  int64_t begin_ns = 0;
+  int64_t end_ns = 0;
+};
+
+/**
+ * @brief Return the current time of the trace clock, in nanoseconds.
+ *
+ * @return int64_t
+ */
+inline int64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Single-producer ring buffer of the events of a thread. Only the owning thread writes, with a release
+ * store of the number of written events after each event, so readers never take a lock on the hot path.
+ */
+class ThreadBuffer {
+public:
+  explicit ThreadBuffer(const uint32_t thread_id)
+    : thread_id_(thread_id), events_(std::make_unique<Event[]>(kEventsPerThread)) {}
+
+  /**
+   * @brief Record a closed zone. Must only be called by the thread owning the buffer.
+   *
+   */
+  void record(const char* name, const int64_t begin_ns, const int64_t end_ns) {
+    const uint64_t index = num_written_.load(std::memory_order_relaxed);
+    events_[index & (kEventsPerThread - 1)] = {name, begin_ns, end_ns};
+    num_written_.store(index + 1, std::memory_order_release);
+  }
+
+  uint32_t threadId() const { return thread_id_; }
+  uint64_t numWritten() const { return num_written_.load(std::memory_order_acquire); }
+  const Event& event(const uint64_t index) const { return events_[index & (kEventsPerThread - 1)]; }
+
+  // Events before this index were cleared.
+  std::atomic<uint64_t> num_cleared{0};
+
+  // Thread name shown by trace viewers, guarded by the registry mutex.
+  std::string name;
+
+private:
+  const uint32_t thread_id_;
+  const std::unique_ptr<Event[]> events_;
+  std::atomic<uint64_t> num_written_{0};
+};
+
+/**
+ * @brief Process-wide list of thread buffers. A thread takes a buffer on its first event and gives it back
+ * when it exits, so short-lived threads (e.g. of a parallel loop) reuse buffers and thread ids instead of
+ * growing the registry. Buffers outlive their threads until the process exits.
+ */
+class Registry {
+public:
+  static Registry& Instance() {
+    static Registry registry;
+    return registry;
+  }
+
+  /**
+   * @brief Return the buffer of the calling thread, taking one on the first call.
+   *
+   */
+  ThreadBuffer& threadBuffer() {
+    thread_local Lease lease;
+    if (lease.buffer == nullptr) {
+      lease.buffer = acquire();
+    }
+    return *lease.buffer;
+  }
+
+  /**
+   * @brief Call the visitor on every buffer, under the registry mutex.
+   *
+   */
+  template <typename Visitor>
+  void forEachBuffer(const Visitor& visitor) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& buffer : buffers_) {
+      visitor(*buffer);
+    }
+  }
+
+private:
+  // Gives the buffer of an exiting thread back to the registry.
+  struct Lease {
+    ThreadBuffer* buffer = nullptr;
+    ~Lease() {
+      if (buffer != nullptr) {
+        Registry::Instance().release(buffer);
+      }
+    }
+  };
+
+  ThreadBuffer* acquire() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_buffers_.empty()) {
+      ThreadBuffer* buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+      return buffer;
+    }
+    buffers_.push_back(std::make_unique<ThreadBuffer>(static_cast<uint32_t>(buffers_.size())));
+    return buffers_.back().get();
+  }
+
+  void release(ThreadBuffer* buffer) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    free_buffers_.push_back(buffer);
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  std::vector<ThreadBuffer*> free_buffers_;
+};
+
+// Whether zones record. A plain inline variable, so checking it costs one relaxed load.
+inline std::atomic<bool> enabled{false};
+
+/**
+ * @brief Return true if zones are recording.
+ *
+ * @return true
+ * @return false
+ */
+inline bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Scoped zone: records its name and lifetime on the calling thread if tracing was started when it was
+ * opened. Prefer the GTCAL_TRACE_ZONE macro, which compiles out without GTCAL_ENABLE_TRACING.
+ */
+class Zone {
+public:
+  explicit Zone(const char* name) : name_(name), begin_ns_(IsEnabled() ? Now() : -1) {}
+
+  ~Zone() {
+    if (begin_ns_ >= 0) {
+      Registry::Instance().threadBuffer().record(name_, begin_ns_, Now());
+    }
+  }
+
+  Zone(const Zone&) = delete;
+  Zone& operator=(const Zone&) = delete;
+
+private:
+  const char* const name_;
+  const int64_t begin_ns_;
+};
+
+/**
+ * @brief Start recording zones.
+ *
+ */
+void Start();
+
+/**
+ * @brief Stop recording zones. Zones already open still record when they close.
+ *
+ */
+void Stop();
+
+/**
+ * @brief Forget every event recorded so far.
+ *
+ */
+void Clear();
+
+/**
+ * @brief Name the calling thread in exported traces.
+ *
+ * @param name thread name.
+ */
+void SetThreadName(const std::string& name);
+
+/**
+ * @brief Return the events of every thread, sorted by begin time. Meant to be called once the traced work is
+ * done: events being overwritten by a thread that wraps around its buffer meanwhile may be torn.
+ *
+ * @param num_dropped if not null, set to the number of events overwritten before they were collected.
+ * @return std::vector<CollectedEvent>
+ */
+std::vector<CollectedEvent> Collect(uint64_t* num_dropped = nullptr);
+
+/**
+ * @brief Write the collected events in the Chrome trace event JSON format, which chrome://tracing and the
+ * Perfetto UI (ui.perfetto.dev) open directly. Zones are complete ("X") events in microseconds, with one
+ * track per thread.
+ *
+ * @param os output stream.
+ */
+void WriteChromeTrace(std::ostream& os);
+
+/**
+ * @brief Same as above, to a file. Return false if the file couldn't be written.
+ *
+ * @param path output file path.
+ * @return true
+ * @return false
+ */
+bool WriteChromeTrace(const std::string& path);
+
+}  // namespace trace
+}  // namespace gtcal
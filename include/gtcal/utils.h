@@ -6,10 +6,11 @@
 namespace gtcal {
 
 struct Measurement {
-  const gtsam::Point2 uv;  // Measurement in pixel coordinates.
-  const size_t camera_id;  // Camera id.
-  const size_t point_id;   // Target point id.
+  gtsam::Point2 uv = gtsam::Point2::Zero();  // Measurement in pixel coordinates.
+  size_t camera_id = 0;                      // Camera id.
+  size_t point_id = 0;                       // Target point id.
 
+  Measurement() = default;
   Measurement(const gtsam::Point2& uv, const size_t camera_id, const size_t point_id)
     : uv(uv), camera_id(camera_id), point_id(point_id) {}
 };
@@ -0,0 +1,188 @@
+#include "gtcal/alloc_tracker.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace gtcal {
+namespace alloc {
+namespace {
+
+// Counters of the calling thread. Constant-initialized and trivially destructible, so operator new can use
+// them at any point of a thread's life, including before main() and during thread exit.
+constinit thread_local AllocationStats thread_stats;
+
+// Totals of one scope name. The last slot collects the names that didn't fit.
+struct Slot {
+  std::atomic<const char*> name{nullptr};
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> deallocations{0};
+  std::atomic<uint64_t> bytes{0};
+};
+Slot slots[kMaxScopes + 1];
+constexpr const char* kOtherName = "(other)";
+
+/**
+ * @brief Return the slot of a scope name, claiming a free one on its first use.
+ *
+ */
+Slot& FindSlot(const char* name) {
+  for (size_t ii = 0; ii < kMaxScopes; ii++) {
+    const char* slot_name = slots[ii].name.load(std::memory_order_acquire);
+    if (slot_name == nullptr &&
+        slots[ii].name.compare_exchange_strong(slot_name, name, std::memory_order_acq_rel)) {
+      return slots[ii];
+    }
+    // Either the slot was taken meanwhile (slot_name now holds its name) or it already was.
+    if (slot_name == name || std::strcmp(slot_name, name) == 0) {
+      return slots[ii];
+    }
+  }
+  slots[kMaxScopes].name.store(kOtherName, std::memory_order_relaxed);
+  return slots[kMaxScopes];
+}
+
+/**
+ * @brief Count an allocation and return the memory, calling the new handler until it succeeds or throwing
+ * std::bad_alloc.
+ *
+ */
+void* Allocate(std::size_t size, const std::size_t alignment) {
+  thread_stats.allocations++;
+  thread_stats.bytes += size;
+  size = size == 0 ? 1 : size;
+  while (true) {
+    // aligned_alloc() needs a size multiple of the alignment.
+    void* ptr = alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                    ? std::malloc(size)
+                    : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (ptr != nullptr) {
+      return ptr;
+    }
+    const std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void* AllocateNoThrow(const std::size_t size, const std::size_t alignment) noexcept {
+  try {
+    return Allocate(size, alignment);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void Deallocate(void* ptr) noexcept {
+  if (ptr != nullptr) {
+    thread_stats.deallocations++;
+    std::free(ptr);
+  }
+}
+
+}  // namespace
+
+AllocationStats ThreadStats() { return thread_stats; }
+
+bool IsCounting() {
+  // Calls to operator new itself can't be elided, unlike new-expressions.
+  const uint64_t allocations = thread_stats.allocations;
+  ::operator delete(::operator new(1));
+  return thread_stats.allocations != allocations;
+}
+
+void RecordScope(const char* name, const AllocationStats& stats) {
+  Slot& slot = FindSlot(name);
+  slot.calls.fetch_add(1, std::memory_order_relaxed);
+  slot.allocations.fetch_add(stats.allocations, std::memory_order_relaxed);
+  slot.deallocations.fetch_add(stats.deallocations, std::memory_order_relaxed);
+  slot.bytes.fetch_add(stats.bytes, std::memory_order_relaxed);
+}
+
+std::vector<ScopeTotal> ScopeTotals() {
+  std::vector<ScopeTotal> totals;
+  for (const Slot& slot : slots) {
+    const char* name = slot.name.load(std::memory_order_acquire);
+    if (name != nullptr) {
+      totals.push_back({name, slot.calls.load(std::memory_order_relaxed),
+                        {slot.allocations.load(std::memory_order_relaxed),
+                         slot.deallocations.load(std::memory_order_relaxed),
+                         slot.bytes.load(std::memory_order_relaxed)}});
+    }
+  }
+  return totals;
+}
+
+void ResetScopeTotals() {
+  for (Slot& slot : slots) {
+    slot.calls.store(0, std::memory_order_relaxed);
+    slot.allocations.store(0, std::memory_order_relaxed);
+    slot.deallocations.store(0, std::memory_order_relaxed);
+    slot.bytes.store(0, std::memory_order_relaxed);
+    slot.name.store(nullptr, std::memory_order_release);
+  }
+}
+
+void WriteScopeReport(std::ostream& os) {
+  char line[256];
+  std::snprintf(line, sizeof(line), "  %-34s %10s %12s %12s %14s\n", "scope", "calls", "allocs/call",
+                "frees/call", "bytes/call");
+  os << line;
+  for (const ScopeTotal& total : ScopeTotals()) {
+    const double calls = static_cast<double>(total.calls > 0 ? total.calls : 1);
+    std::snprintf(line, sizeof(line), "  %-34s %10llu %12.1f %12.1f %14.1f\n", total.name,
+                  static_cast<unsigned long long>(total.calls),
+                  static_cast<double>(total.stats.allocations) / calls,
+                  static_cast<double>(total.stats.deallocations) / calls,
+                  static_cast<double>(total.stats.bytes) / calls);
+    os << line;
+  }
+}
+
+}  // namespace alloc
+}  // namespace gtcal
+
+// Replacements of the global allocation functions, see [new.delete]. The sized and aligned deletes all free
+// through the same path.
+void* operator new(std::size_t size) { return gtcal::alloc::Allocate(size, 0); }
+void* operator new[](std::size_t size) { return gtcal::alloc::Allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return gtcal::alloc::Allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return gtcal::alloc::Allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return gtcal::alloc::AllocateNoThrow(size, 0);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return gtcal::alloc::AllocateNoThrow(size, 0);
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return gtcal::alloc::AllocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return gtcal::alloc::AllocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { gtcal::alloc::Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+  gtcal::alloc::Deallocate(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+  gtcal::alloc::Deallocate(ptr);
+}
@@ -0,0 +1,151 @@
+#include "gtcal/async_batch_solver.h"
+
+#include <cassert>
+#include <exception>
+
+namespace gtcal {
+
+AsyncBatchSolver::AsyncBatchSolver(const BatchSolver& solver, std::unique_ptr<BatchSolver::State> state,
+                                   const Options& options)
+  : solver_(solver), options_(options), state_(std::move(state)), queue_(options.queue_capacity) {
+  assert(state_ && "[AsyncBatchSolver::AsyncBatchSolver] State must not be null.");
+  optimizer_thread_ = std::thread(&AsyncBatchSolver::run, this);
+}
+
+AsyncBatchSolver::AsyncBatchSolver(const BatchSolver& solver, std::unique_ptr<BatchSolver::State> state)
+  : AsyncBatchSolver(solver, std::move(state), Options()) {}
+
+AsyncBatchSolver::~AsyncBatchSolver() {
+  if (optimizer_thread_.joinable()) {
+    stop();
+  }
+}
+
+bool AsyncBatchSolver::push(std::vector<Measurement>&& measurements) {
+  if (measurements.empty() || stop_requested_.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  Frame frame{std::move(measurements), Clock::now()};
+  const Clock::time_point deadline = frame.enqueue_time + options_.block_timeout;
+  size_t num_attempts = 0;
+  while (!queue_.tryPush(frame)) {
+    if (options_.drop_policy == DropPolicy::DROP_NEWEST) {
+      num_dropped_.fetch_add(1, std::memory_order_relaxed);
+      measurements = std::move(frame.measurements);
+      return false;
+    }
+
+    if (options_.drop_policy == DropPolicy::DROP_OLDEST) {
+      // Evict the oldest frame and retry. Another producer may have taken the slot, hence the loop.
+      Frame oldest;
+      if (queue_.tryPop(oldest)) {
+        num_dropped_.fetch_add(1, std::memory_order_relaxed);
+        retire();
+      }
+      continue;
+    }
+
+    // DropPolicy::BLOCK: back off until the optimizer thread frees a slot.
+    if (stop_requested_.load(std::memory_order_acquire) || Clock::now() > deadline) {
+      num_dropped_.fetch_add(1, std::memory_order_relaxed);
+      measurements = std::move(frame.measurements);
+      return false;
+    }
+    if (++num_attempts < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  num_pushed_.fetch_add(1, std::memory_order_relaxed);
+  notifyWork();
+  return true;
+}
+
+void AsyncBatchSolver::flush() {
+  const size_t target = num_pushed_.load(std::memory_order_acquire);
+  size_t num_retired = num_retired_.load(std::memory_order_acquire);
+  while (num_retired < target && !stopped_.load(std::memory_order_acquire)) {
+    num_retired_.wait(num_retired, std::memory_order_acquire);
+    num_retired = num_retired_.load(std::memory_order_acquire);
+  }
+}
+
+std::unique_ptr<BatchSolver::State> AsyncBatchSolver::stop() {
+  if (!optimizer_thread_.joinable()) {
+    return nullptr;
+  }
+
+  stop_requested_.store(true, std::memory_order_release);
+  notifyWork();
+  optimizer_thread_.join();
+
+  // Frames pushed concurrently with the stop request can't be processed anymore.
+  Frame frame;
+  while (queue_.tryPop(frame)) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    retire();
+  }
+
+  stopped_.store(true, std::memory_order_release);
+  num_retired_.notify_all();
+  return std::move(state_);
+}
+
+AsyncBatchSolver::Stats AsyncBatchSolver::stats() const {
+  Stats stats;
+  stats.num_pushed = num_pushed_.load(std::memory_order_relaxed);
+  stats.num_dropped = num_dropped_.load(std::memory_order_relaxed);
+  stats.num_processed = num_processed_.load(std::memory_order_relaxed);
+  stats.num_failed = num_failed_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void AsyncBatchSolver::run() {
+  Frame frame;
+  for (;;) {
+    // Read the epoch before checking the queue so a push between the check and the wait isn't missed.
+    const uint64_t epoch = work_epoch_.load(std::memory_order_acquire);
+    if (!queue_.tryPop(frame)) {
+      if (stop_requested_.load(std::memory_order_acquire)) {
+        break;
+      }
+      work_epoch_.wait(epoch, std::memory_order_acquire);
+      continue;
+    }
+
+    // Build the factors and update iSAM.
+    const Clock::time_point start_time = Clock::now();
+    queue_wait_histogram_.record(start_time - frame.enqueue_time);
+    try {
+      solver_.solve(frame.measurements, *state_);
+      num_processed_.fetch_add(1, std::memory_order_relaxed);
+    } catch (const std::exception&) {
+      num_failed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    update_histogram_.record(Clock::now() - start_time);
+
+    // Publish the new estimate. Readers holding the previous snapshot keep it alive.
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->estimate = state_->current_estimate;
+    snapshot->num_frames = state_->num_frames;
+    snapshot_.store(std::move(snapshot), std::memory_order_release);
+
+    frame.measurements.clear();
+    retire();
+  }
+}
+
+void AsyncBatchSolver::retire() {
+  num_retired_.fetch_add(1, std::memory_order_release);
+  num_retired_.notify_all();
+}
+
+void AsyncBatchSolver::notifyWork() {
+  work_epoch_.fetch_add(1, std::memory_order_release);
+  work_epoch_.notify_one();
+}
+
+}  // namespace gtcal
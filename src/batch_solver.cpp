@@ -1,34 +1,228 @@
 #include "gtcal/batch_solver.h"
+#include "gtcal/alloc_tracker.h"
+#include "gtcal/target_projection_factor.h"
+#include "gtcal/trace.h"
 #include "gtcal/utils.h"
 
+#include <gtsam/config.h>
 #include <gtsam/slam/ProjectionFactor.h>
 #include <gtsam/slam/GeneralSFMFactor.h>
 #include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/DoglegOptimizer.h>
+#include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
+
+#ifdef GTSAM_USE_TBB
+#include <tbb/task_arena.h>
+#endif
+
+#include <algorithm>
+#include <optional>
+#include <utility>
 
 using gtsam::symbol_shorthand::K;
 using gtsam::symbol_shorthand::L;
 using gtsam::symbol_shorthand::X;
 
 namespace gtcal {
+namespace {
+
+/**
+ * @brief Return the gtsam ordering type for the given solver ordering type.
+ *
+ */
+gtsam::Ordering::OrderingType ToGtsamOrdering(const BatchSolver::OrderingType ordering_type) {
+  switch (ordering_type) {
+    case BatchSolver::OrderingType::METIS:
+      return gtsam::Ordering::METIS;
+    case BatchSolver::OrderingType::NATURAL:
+      return gtsam::Ordering::NATURAL;
+    default:
+      return gtsam::Ordering::COLAMD;
+  }
+}
+
+/**
+ * @brief Write the calibration estimate back to the camera model.
+ *
+ */
+void UpdateCalibration(const size_t camera_index, const gtsam::Values& estimate, Camera& camera) {
+  std::visit(
+      [&](auto&& arg) -> void {
+        using CalibrationType = std::decay_t<decltype(arg->calibration())>;
+        arg->updateCalibration(estimate.at<CalibrationType>(K(camera_index)));
+      },
+      camera.cameraVariant());
+}
+
+/**
+ * @brief Return the iSAM2 relinearization thresholds for the given options. Thresholds per variable type
+ * need a single calibration dimension, so cameras with different models fall back to the smallest threshold
+ * for every variable.
+ *
+ */
+gtsam::ISAM2Params::RelinearizationThreshold RelinearizationThresholds(
+    const std::vector<std::shared_ptr<Camera>>& cameras, const BatchSolver::Options& options) {
+  const double pose_threshold = options.pose_relinearize_threshold;
+  const double landmark_threshold = options.landmark_relinearize_threshold;
+  const double calibration_threshold = options.calibration_relinearize_threshold;
+  if (pose_threshold == landmark_threshold && pose_threshold == calibration_threshold) {
+    return pose_threshold;
+  }
+
+  // Get the calibration dimension shared by every camera.
+  std::optional<size_t> calibration_dim;
+  for (const auto& camera : cameras) {
+    const size_t dim = std::visit(
+        [](auto&& arg) -> size_t {
+          using CalibrationType = std::decay_t<decltype(arg->calibration())>;
+          return gtsam::traits<CalibrationType>::dimension;
+        },
+        camera->cameraVariant());
+    if (calibration_dim && *calibration_dim != dim) {
+      return std::min({pose_threshold, landmark_threshold, calibration_threshold});
+    }
+    calibration_dim = dim;
+  }
+
+  gtsam::FastMap<char, gtsam::Vector> thresholds;
+  thresholds['x'] = gtsam::Vector::Constant(6, pose_threshold);
+  thresholds['l'] = gtsam::Vector::Constant(3, landmark_threshold);
+  thresholds['k'] = gtsam::Vector::Constant(calibration_dim.value_or(5), calibration_threshold);
+  return thresholds;
+}
+
+/**
+ * @brief Compare the camera's calibration marginal sigmas against the previous check and freeze the
+ * intrinsics once they have converged for enough consecutive checks.
+ *
+ */
+void CheckCalibrationConvergence(const size_t camera_index, const BatchSolver::Options& options,
+                                 BatchSolver::State& state) {
+  if (state.calibration_frozen.at(camera_index)) {
+    return;
+  }
+
+  const gtsam::Vector sigmas = state.isam.marginalCovariance(K(camera_index)).diagonal().cwiseSqrt();
+  gtsam::Vector& previous_sigmas = state.calibration_sigmas.at(camera_index);
+  size_t& converged_checks = state.calibration_converged_checks.at(camera_index);
+  if (previous_sigmas.size() == sigmas.size()) {
+    const double max_relative_change =
+        ((sigmas - previous_sigmas).array().abs() / previous_sigmas.array().max(1e-12)).maxCoeff();
+    converged_checks = max_relative_change < options.calibration_freeze_tolerance ? converged_checks + 1 : 0;
+  }
+  previous_sigmas = sigmas;
+
+  if (converged_checks >= options.calibration_freeze_checks) {
+    state.calibration_frozen.at(camera_index) = true;
+  }
+}
 
-BatchSolver::State::State(const std::vector<std::shared_ptr<Camera>>& camera_models)
+/**
+ * @brief Replace the state's iSAM2 instance with one updated once from the state's graph and estimate.
+ *
+ */
+void ResetIsam(BatchSolver::State& state) {
+  gtsam::ISAM2 isam(state.isam.params());
+  if (!state.graph.empty()) {
+    isam.update(state.graph, state.current_estimate);
+  }
+  state.isam = std::move(isam);
+}
+
+}  // namespace
+
+BatchSolver::State::State(const std::vector<std::shared_ptr<Camera>>& camera_models, const Options& options)
   : cameras(camera_models) {
   // Update the number of camera updates.
   num_camera_updates.resize(camera_models.size(), 0);
 
+  // Calibration convergence tracking.
+  calibration_sigmas.resize(camera_models.size());
+  calibration_converged_checks.resize(camera_models.size(), 0);
+  calibration_frozen.resize(camera_models.size(), false);
+
   // Set the ISAM2 parameters.
   gtsam::ISAM2Params params;
-  params.relinearizeThreshold = 0.01;
-  params.relinearizeSkip = 1;
+  params.relinearizeThreshold = RelinearizationThresholds(camera_models, options);
+  params.relinearizeSkip = static_cast<int>(options.relinearize_skip);
   isam = gtsam::ISAM2(params);
 }
 
+class BatchSolver::ThreadArena {
+public:
+  /**
+   * @brief Construct a new Thread Arena object. Without a limit (0) or without TBB, execute() runs its
+   * argument directly in the caller's arena.
+   *
+   * @param num_threads maximum number of threads.
+   */
+  explicit ThreadArena(const size_t num_threads) {
+#ifdef GTSAM_USE_TBB
+    if (num_threads > 0) {
+      arena_.emplace(static_cast<int>(num_threads));
+    }
+#else
+    (void)num_threads;
+#endif
+  }
+
+  /**
+   * @brief Run fn in the arena. The parallel loops and task groups gtsam starts from fn stay in the arena,
+   * unlike a tbb::global_control, which would limit every thread of the process while in scope.
+   *
+   */
+  template <typename Function>
+  void execute(Function&& fn) {
+#ifdef GTSAM_USE_TBB
+    if (arena_) {
+      arena_->execute(std::forward<Function>(fn));
+      return;
+    }
+#endif
+    fn();
+  }
+
+private:
+#ifdef GTSAM_USE_TBB
+  std::optional<tbb::task_arena> arena_;
+#endif
+};
+
 BatchSolver::BatchSolver(const gtsam::Point3Vector& pts3d_target, const Options& options)
-  : pts3d_target_(pts3d_target), options_(options) {}
+  : pts3d_target_(pts3d_target), options_(options),
+    thread_arena_(std::make_shared<ThreadArena>(options.num_threads)) {}
 
 void BatchSolver::solve(const std::vector<Measurement>& measurements, State& state) const {
+  solveFrame(measurements, state);
+}
+
+void BatchSolver::solve(const MeasurementSpan& measurements, State& state) const {
+  solveFrame(measurements, state);
+}
+
+void BatchSolver::solve(const std::vector<Measurement>& measurements,
+                        const std::vector<gtsam::Matrix2>& covariances, State& state) const {
+  assert(covariances.size() == measurements.size() &&
+         "[BatchSolver::solve] One covariance per measurement is required.");
+  solveFrame(measurements, state, &covariances);
+}
+
+gtsam::SharedNoiseModel BatchSolver::pixelNoiseModel(const std::vector<gtsam::Matrix2>* covariances,
+                                                     const size_t index) const {
+  if (covariances == nullptr) {
+    return options_.pixel_meas_noise_model;
+  }
+  return gtsam::noiseModel::Gaussian::Covariance(covariances->at(index));
+}
+
+template <typename MeasurementRange>
+void BatchSolver::solveFrame(const MeasurementRange& measurements, State& state,
+                             const std::vector<gtsam::Matrix2>* covariances) const {
+  GTCAL_TRACE_ZONE("BatchSolver::solve");
+  GTCAL_ALLOC_SCOPE("BatchSolver::solve");
+
   // Check that all measurements are from the same camera.
-  const size_t& camera_index = measurements.front().camera_id;
+  const size_t camera_index = measurements.front().camera_id;
   const bool all_same_camera =
       std::all_of(measurements.begin(), measurements.end(),
                   [&camera_index](const Measurement& meas) { return meas.camera_id == camera_index; });
@@ -38,28 +232,151 @@ void BatchSolver::solve(const std::vector<Measurement>& measurements, State& sta
   gtsam::NonlinearFactorGraph graph;
   gtsam::Values initial_values;
 
-  // Add camera calibration prior to initial values and graph.
-  addCalibrationPriors(camera_index, state.cameras.at(camera_index), graph, initial_values);
+  // Every frame gets its own pose variable.
+  const std::shared_ptr<Camera>& camera = state.cameras.at(camera_index);
+  const size_t pose_index = state.num_frames;
 
-  // Get the number of times the camera has been updated and add landmark factors.
-  const size_t& num_camera_updates = state.num_camera_updates.at(camera_index);
+  // Get the number of times the camera has been updated.
+  size_t& num_camera_updates = state.num_camera_updates.at(camera_index);
   if (num_camera_updates == 0) {
-    // If it's the first time the camera has been updated, add a pose prior on the graph.
-    addPosePrior(camera_index, state.cameras.at(camera_index)->pose(), graph);
-    // Also add landmark priors.
-    addLandmarkPriors(measurements, pts3d_target_, graph);
-    return;
+    // If it's the first time the camera has been updated, add the camera calibration prior and a pose prior
+    // on the graph.
+    addCalibrationPriors(camera_index, camera, graph, initial_values);
+    addPosePrior(pose_index, camera->pose(), graph);
+  }
+
+  if (options_.use_target_factors) {
+    // Target points are constants of the factors, no landmarks needed.
+    addTargetFactors(camera_index, camera, pose_index, measurements, graph, covariances);
+  } else {
+    // Add landmark priors and initial values for the landmarks that haven't been seen yet.
+    std::vector<Measurement> new_landmark_measurements;
+    for (const auto& meas : measurements) {
+      if (!state.current_estimate.exists(L(meas.point_id)) && !initial_values.exists(L(meas.point_id))) {
+        initial_values.insert<gtsam::Point3>(L(meas.point_id), pts3d_target_.at(meas.point_id));
+        new_landmark_measurements.push_back(meas);
+      }
+    }
+    addLandmarkPriors(new_landmark_measurements, pts3d_target_, graph);
+
+    // Add landmark factors.
+    addLandmarkFactors(camera_index, camera, pose_index, measurements, graph, covariances);
+  }
+
+  // The camera's current pose is used as the initial estimate for the frame pose.
+  initial_values.insert(X(pose_index), camera->pose());
+
+  // The state only takes the frame once the update succeeded, so a throwing update (e.g. an indeterminant
+  // system) leaves it as it was and the next frame doesn't reuse the pose index or skip the priors.
+  if (options_.optimizer_type == OptimizerType::ISAM2) {
+    // Frozen intrinsics keep their linearization point.
+    gtsam::ISAM2UpdateParams update_params;
+    for (size_t ii = 0; ii < state.calibration_frozen.size(); ii++) {
+      if (state.calibration_frozen.at(ii)) {
+        if (!update_params.noRelinKeys) {
+          update_params.noRelinKeys.emplace();
+        }
+        update_params.noRelinKeys->push_back(K(ii));
+      }
+    }
+
+    // Update iSAM with the new factors.
+    size_t num_variables_relinearized = 0;
+    gtsam::Values estimate;
+    try {
+      thread_arena_->execute([&] {
+        {
+          // Linearization of the new and relinearized factors, and elimination of the affected cliques.
+          GTCAL_TRACE_ZONE("BatchSolver::isam2Update");
+          GTCAL_ALLOC_SCOPE("BatchSolver::isam2Update");
+          const gtsam::ISAM2Result result = state.isam.update(graph, initial_values, update_params);
+          num_variables_relinearized = result.variablesRelinearized;
+        }
+        {
+          // Back-substitution.
+          GTCAL_TRACE_ZONE("BatchSolver::calculateEstimate");
+          GTCAL_ALLOC_SCOPE("BatchSolver::calculateEstimate");
+          estimate = state.isam.calculateEstimate();
+        }
+      });
+    } catch (...) {
+      // iSAM may already hold part of the frame, rebuild it from the graph and estimate without it.
+      thread_arena_->execute([&] { ResetIsam(state); });
+      throw;
+    }
+    state.graph.add(graph);
+    state.current_estimate = std::move(estimate);
+    state.num_variables_relinearized += num_variables_relinearized;
+  } else {
+    // The batch optimizers only run in optimize(), keep the initial values as the estimate until then.
+    state.current_estimate.insert(initial_values);
+    state.graph.add(graph);
   }
 
-  // Add landmark factors.
-  addLandmarkFactors(camera_index, state.cameras.at(camera_index), num_camera_updates, measurements, graph);
+  state.camera_indices.emplace(camera_index, state.camera_indices.size());
+  num_camera_updates++;
+  state.num_frames++;
+
+  if (options_.optimizer_type == OptimizerType::ISAM2) {
+    // Write the latest estimate back to the camera model.
+    camera->setCameraPose(state.current_estimate.at<gtsam::Pose3>(X(pose_index)));
+    UpdateCalibration(camera_index, state.current_estimate, *camera);
 
-  // Update iSAM with the new factors.
+    // Check whether the intrinsics have converged.
+    if (options_.freeze_converged_calibration && options_.calibration_check_interval > 0 &&
+        num_camera_updates % options_.calibration_check_interval == 0) {
+      CheckCalibrationConvergence(camera_index, options_, state);
+    }
+  }
+}
+
+bool BatchSolver::optimize(State& state) const {
+  GTCAL_TRACE_ZONE("BatchSolver::optimize");
+  GTCAL_ALLOC_SCOPE("BatchSolver::optimize");
+  if (state.graph.empty()) {
+    return false;
+  }
+
+  bool success = true;
+  thread_arena_->execute([&] {
+    try {
+      if (options_.optimizer_type == OptimizerType::ISAM2) {
+        // Each call to update() performs one more iteration of the nonlinear solver.
+        state.isam.update();
+        state.current_estimate = state.isam.calculateEstimate();
+      } else if (options_.optimizer_type == OptimizerType::LEVENBERG_MARQUARDT) {
+        gtsam::LevenbergMarquardtParams params;
+        params.orderingType = ToGtsamOrdering(options_.ordering_type);
+        params.maxIterations = options_.max_iterations;
+        gtsam::LevenbergMarquardtOptimizer optimizer(state.graph, state.current_estimate, params);
+        state.current_estimate = optimizer.optimize();
+      } else {
+        gtsam::DoglegParams params;
+        params.orderingType = ToGtsamOrdering(options_.ordering_type);
+        params.maxIterations = options_.max_iterations;
+        gtsam::DoglegOptimizer optimizer(state.graph, state.current_estimate, params);
+        state.current_estimate = optimizer.optimize();
+      }
+    } catch (const std::exception&) {
+      success = false;
+    }
+  });
+  if (!success) {
+    return false;
+  }
+
+  // Write the calibrations back to the camera models.
+  for (const auto& [camera_index, order] : state.camera_indices) {
+    UpdateCalibration(camera_index, state.current_estimate, *state.cameras.at(camera_index));
+  }
+  return true;
 }
 
 void BatchSolver::addCalibrationPriors(const size_t camera_index,
                                        const std::shared_ptr<gtcal::Camera>& camera,
                                        gtsam::NonlinearFactorGraph& graph, gtsam::Values& values) const {
+  GTCAL_TRACE_ZONE("BatchSolver::addCalibrationPriors");
+
   // Add camera calibration prior to initial values and graph according to type of model.
   // TODO: Add support for other camera models and clean up noise model vectors.
   const auto model_type = camera->modelType();
@@ -89,16 +406,22 @@ void BatchSolver::addCalibrationPriors(const size_t camera_index,
 void BatchSolver::addLandmarkPriors(const std::vector<Measurement>& measurements,
                                     const gtsam::Point3Vector& pts3d_target,
                                     gtsam::NonlinearFactorGraph& graph) const {
+  GTCAL_TRACE_ZONE("BatchSolver::addLandmarkPriors");
+
   // Add landmark priors to graph.
   for (const auto& meas : measurements) {
     graph.addPrior(L(meas.point_id), pts3d_target.at(meas.point_id), options_.landmark_prior_noise_model);
   }
 }
 
+template <typename MeasurementRange>
 void BatchSolver::addLandmarkFactors(const size_t camera_index, const std::shared_ptr<gtcal::Camera>& camera,
-                                     const size_t num_camera_update,
-                                     const std::vector<Measurement>& measurements,
-                                     gtsam::NonlinearFactorGraph& graph) const {
+                                     const size_t pose_index, const MeasurementRange& measurements,
+                                     gtsam::NonlinearFactorGraph& graph,
+                                     const std::vector<gtsam::Matrix2>* covariances) const {
+  GTCAL_TRACE_ZONE("BatchSolver::addLandmarkFactors");
+  GTCAL_ALLOC_SCOPE("BatchSolver::addLandmarkFactors");
+
   // Get camera model.
   const auto model_type = camera->modelType();
   if (model_type == Camera::ModelType::CAL3_S2) {
@@ -106,20 +429,73 @@ void BatchSolver::addLandmarkFactors(const size_t camera_index, const std::share
     assert(cmod && "[BatchSolver::addLandmarkFactors] Camera model is not of type Cal3_S2.");
 
     // Add landmark factors to graph.
+    size_t index = 0;
     for (const auto& meas : measurements) {
       // Landmark measurement.
       const gtsam::Point2& uv = meas.uv;
       // Add to graph.
       graph.emplace_shared<gtsam::GeneralSFMFactor2<gtsam::Cal3_S2>>(
-          uv, options_.pixel_meas_noise_model, X(num_camera_update), L(meas.point_id), K(camera_index));
+          uv, pixelNoiseModel(covariances, index++), X(pose_index), L(meas.point_id), K(camera_index));
+    }
+  } else if (model_type == Camera::ModelType::CAL3_FISHEYE) {
+    const auto cmod = std::get<std::shared_ptr<CameraWrapper<gtsam::Cal3Fisheye>>>(camera->cameraVariant());
+    assert(cmod && "[BatchSolver::addLandmarkFactors] Camera model is not of type Cal3Fisheye.");
+
+    // Add landmark factors to graph.
+    size_t index = 0;
+    for (const auto& meas : measurements) {
+      graph.emplace_shared<gtsam::GeneralSFMFactor2<gtsam::Cal3Fisheye>>(
+          meas.uv, pixelNoiseModel(covariances, index++), X(pose_index), L(meas.point_id), K(camera_index));
     }
   }
 }
 
-void BatchSolver::addPosePrior(const size_t camera_index, const gtsam::Pose3& pose_target_cam,
+template <typename MeasurementRange>
+void BatchSolver::addTargetFactors(const size_t camera_index, const std::shared_ptr<gtcal::Camera>& camera,
+                                   const size_t pose_index, const MeasurementRange& measurements,
+                                   gtsam::NonlinearFactorGraph& graph,
+                                   const std::vector<gtsam::Matrix2>* covariances) const {
+  GTCAL_TRACE_ZONE("BatchSolver::addTargetFactors");
+  GTCAL_ALLOC_SCOPE("BatchSolver::addTargetFactors");
+
+  // Add target factors to graph according to type of model.
+  const auto model_type = camera->modelType();
+  size_t index = 0;
+  if (model_type == Camera::ModelType::CAL3_S2) {
+    for (const auto& meas : measurements) {
+      graph.emplace_shared<TargetProjectionFactor<gtsam::Cal3_S2>>(
+          meas.uv, pts3d_target_.at(meas.point_id), pixelNoiseModel(covariances, index++), X(pose_index),
+          K(camera_index));
+    }
+  } else if (model_type == Camera::ModelType::CAL3_FISHEYE) {
+    for (const auto& meas : measurements) {
+      graph.emplace_shared<TargetProjectionFactor<gtsam::Cal3Fisheye>>(
+          meas.uv, pts3d_target_.at(meas.point_id), pixelNoiseModel(covariances, index++), X(pose_index),
+          K(camera_index));
+    }
+  }
+}
+
+// Instantiate the factor helpers for both measurement containers.
+template void BatchSolver::addLandmarkFactors(const size_t, const std::shared_ptr<gtcal::Camera>&,
+                                              const size_t, const std::vector<Measurement>&,
+                                              gtsam::NonlinearFactorGraph&,
+                                              const std::vector<gtsam::Matrix2>*) const;
+template void BatchSolver::addLandmarkFactors(const size_t, const std::shared_ptr<gtcal::Camera>&,
+                                              const size_t, const MeasurementSpan&,
+                                              gtsam::NonlinearFactorGraph&,
+                                              const std::vector<gtsam::Matrix2>*) const;
+template void BatchSolver::addTargetFactors(const size_t, const std::shared_ptr<gtcal::Camera>&, const size_t,
+                                            const std::vector<Measurement>&, gtsam::NonlinearFactorGraph&,
+                                            const std::vector<gtsam::Matrix2>*) const;
+template void BatchSolver::addTargetFactors(const size_t, const std::shared_ptr<gtcal::Camera>&, const size_t,
+                                            const MeasurementSpan&, gtsam::NonlinearFactorGraph&,
+                                            const std::vector<gtsam::Matrix2>*) const;
+
+void BatchSolver::addPosePrior(const size_t pose_index, const gtsam::Pose3& pose_target_cam,
                                gtsam::NonlinearFactorGraph& graph) const {
   // Add pose prior to graph.
-  graph.addPrior(X(0), pose_target_cam, options_.pose_prior_noise_model);
+  graph.addPrior(X(pose_index), pose_target_cam, options_.pose_prior_noise_model);
 }
 
 }  // namespace gtcal
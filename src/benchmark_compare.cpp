@@ -0,0 +1,652 @@
+#include "gtcal/benchmark_compare.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+namespace gtcal {
+namespace {
+
+// Fields of a benchmark entry used by the comparator. Other fields (counters, labels, ...) are skipped.
+struct Entry {
+  std::string name;
+  std::string run_name;
+  std::string run_type;
+  std::string aggregate_name;
+  std::string time_unit = "ns";
+  double real_time = std::numeric_limits<double>::quiet_NaN();
+  double cpu_time = std::numeric_limits<double>::quiet_NaN();
+  bool error_occurred = false;
+};
+
+/**
+ * @brief Minimal parser of the JSON written by Google Benchmark: the "benchmarks" array holds flat objects
+ * whose values are strings, numbers, booleans or null. Nested values are skipped.
+ *
+ */
+class JsonCursor {
+public:
+  JsonCursor(std::string_view text) : p_(text.data()), end_(text.data() + text.size()) {}
+
+  // Return true if the next non-blank character is c, and consume it.
+  bool consume(const char c) {
+    skipBlanks();
+    if (p_ < end_ && *p_ == c) {
+      ++p_;
+      return true;
+    }
+    return false;
+  }
+
+  // Return true if a string was parsed. Escapes other than \" and \\ are kept as the escaped character.
+  bool parseString(std::string& value) {
+    if (!consume('"')) {
+      return false;
+    }
+    value.clear();
+    while (p_ < end_ && *p_ != '"') {
+      if (*p_ == '\\' && p_ + 1 < end_) {
+        ++p_;
+      }
+      value.push_back(*p_++);
+    }
+    return p_ < end_ && *p_++ == '"';
+  }
+
+  // Return true if a number was parsed.
+  bool parseNumber(double& value) {
+    skipBlanks();
+    const auto result = std::from_chars(p_, end_, value);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+    p_ = result.ptr;
+    return true;
+  }
+
+  // Return true if a literal (true, false, null) was parsed.
+  bool parseLiteral(bool& value) {
+    skipBlanks();
+    for (const std::string_view literal : {"true", "false", "null"}) {
+      if (static_cast<size_t>(end_ - p_) >= literal.size() &&
+          std::string_view(p_, literal.size()) == literal) {
+        value = literal == "true";
+        p_ += literal.size();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Return true if any value was skipped.
+  bool skipValue() {
+    skipBlanks();
+    if (p_ >= end_) {
+      return false;
+    }
+    if (*p_ == '"') {
+      std::string value;
+      return parseString(value);
+    }
+    if (*p_ == '{' || *p_ == '[') {
+      size_t depth = 0;
+      while (p_ < end_) {
+        const char c = *p_;
+        if (c == '"') {
+          std::string value;
+          if (!parseString(value)) {
+            return false;
+          }
+          continue;
+        }
+        ++p_;
+        if (c == '{' || c == '[') {
+          depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+    bool literal = false;
+    double number = 0.0;
+    return parseLiteral(literal) || parseNumber(number);
+  }
+
+  // Move right after the given top-level key of the current object and its colon. Return false if absent.
+  bool findKey(std::string_view key) {
+    if (!consume('{')) {
+      return false;
+    }
+    std::string name;
+    while (parseString(name)) {
+      if (!consume(':')) {
+        return false;
+      }
+      if (name == key) {
+        return true;
+      }
+      if (!skipValue()) {
+        return false;
+      }
+      consume(',');
+    }
+    return false;
+  }
+
+  // Return true if a flat benchmark object was parsed.
+  bool parseEntry(Entry& entry) {
+    if (!consume('{')) {
+      return false;
+    }
+    std::string key;
+    while (!consume('}')) {
+      if (!parseString(key) || !consume(':')) {
+        return false;
+      }
+      bool valid = true;
+      if (key == "name") {
+        valid = parseString(entry.name);
+      } else if (key == "run_name") {
+        valid = parseString(entry.run_name);
+      } else if (key == "run_type") {
+        valid = parseString(entry.run_type);
+      } else if (key == "aggregate_name") {
+        valid = parseString(entry.aggregate_name);
+      } else if (key == "time_unit") {
+        valid = parseString(entry.time_unit);
+      } else if (key == "real_time") {
+        valid = parseNumber(entry.real_time);
+      } else if (key == "cpu_time") {
+        valid = parseNumber(entry.cpu_time);
+      } else if (key == "error_occurred") {
+        valid = parseLiteral(entry.error_occurred);
+      } else {
+        valid = skipValue();
+      }
+      if (!valid) {
+        return false;
+      }
+      consume(',');
+    }
+    return true;
+  }
+
+  size_t offset(std::string_view text) const { return p_ - text.data(); }
+
+private:
+  void skipBlanks() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+      ++p_;
+    }
+  }
+
+private:
+  const char* p_;
+  const char* end_;
+};
+
+/**
+ * @brief Return the number of nanoseconds in a Google Benchmark time unit, or NaN if unknown.
+ *
+ */
+double NanosecondsPerUnit(const std::string& unit) {
+  if (unit == "ns") {
+    return 1.0;
+  } else if (unit == "us") {
+    return 1e3;
+  } else if (unit == "ms") {
+    return 1e6;
+  } else if (unit == "s") {
+    return 1e9;
+  }
+  return std::numeric_limits<double>::quiet_NaN();
+}
+
+/**
+ * @brief Return the median of the values, or NaN if there are none.
+ *
+ */
+double Median(std::vector<double> values) {
+  if (values.empty()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  const size_t half = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + half, values.end());
+  const double upper = values[half];
+  if (values.size() % 2 == 1) {
+    return upper;
+  }
+  return 0.5 * (upper + *std::max_element(values.begin(), values.begin() + half));
+}
+
+/**
+ * @brief Return the probabilities of U = 0, ..., n * m under the null hypothesis, where U counts the pairs in
+ * which the value of the first sample (size n) is larger than the value of the second one (size m). Built
+ * from p(i, j, u) = i / (i + j) * p(i - 1, j, u - j) + j / (i + j) * p(i, j - 1, u): the largest of the i + j
+ * values either belongs to the first sample and beats all j values of the second, or to the second one.
+ *
+ */
+std::vector<double> ExactUDistribution(const size_t n, const size_t m) {
+  // previous[j] holds p(i - 1, j, .), current[j] holds p(i, j, .).
+  std::vector<std::vector<double>> previous(m + 1), current(m + 1);
+  for (size_t jj = 0; jj <= m; jj++) {
+    previous[jj] = {1.0};
+  }
+  for (size_t ii = 1; ii <= n; ii++) {
+    current[0] = {1.0};
+    for (size_t jj = 1; jj <= m; jj++) {
+      const double total = static_cast<double>(ii + jj);
+      std::vector<double>& p = current[jj];
+      p.assign(ii * jj + 1, 0.0);
+      for (size_t uu = 0; uu < previous[jj].size(); uu++) {
+        p[uu + jj] += ii / total * previous[jj][uu];
+      }
+      for (size_t uu = 0; uu < current[jj - 1].size(); uu++) {
+        p[uu] += jj / total * current[jj - 1][uu];
+      }
+    }
+    std::swap(previous, current);
+  }
+  return previous[m];
+}
+
+/**
+ * @brief Return the smallest two-sided p-value the test can produce for the sample sizes.
+ *
+ */
+double MinimumPValue(const size_t n, const size_t m) {
+  if (n == 0 || m == 0) {
+    return 1.0;
+  }
+  if (n > BenchmarkComparator::kMaxExactSize || m > BenchmarkComparator::kMaxExactSize) {
+    return 0.0;
+  }
+  return std::min(1.0, 2.0 * ExactUDistribution(n, m).front());
+}
+
+/**
+ * @brief Format a duration in nanoseconds with a unit that keeps 3 to 4 significant digits.
+ *
+ */
+std::string FormatTime(const double ns) {
+  char buffer[32];
+  if (!std::isfinite(ns)) {
+    return "-";
+  } else if (ns < 1e4) {
+    std::snprintf(buffer, sizeof(buffer), "%.1f ns", ns);
+  } else if (ns < 1e7) {
+    std::snprintf(buffer, sizeof(buffer), "%.1f us", 1e-3 * ns);
+  } else if (ns < 1e10) {
+    std::snprintf(buffer, sizeof(buffer), "%.1f ms", 1e-6 * ns);
+  } else {
+    std::snprintf(buffer, sizeof(buffer), "%.2f s", 1e-9 * ns);
+  }
+  return buffer;
+}
+
+/**
+ * @brief Return the family of a benchmark, i.e. its name up to the first '/'.
+ *
+ */
+std::string Family(const std::string& name) { return name.substr(0, name.find('/')); }
+
+/**
+ * @brief Write a JSON number, or null if it isn't finite.
+ *
+ */
+void WriteJsonNumber(std::ostream& os, const double value) {
+  if (std::isfinite(value)) {
+    os << value;
+  } else {
+    os << "null";
+  }
+}
+
+}  // namespace
+
+bool ParseBenchmarkJson(std::string_view text, std::vector<BenchmarkSamples>& benchmarks,
+                        std::string& error) {
+  JsonCursor cursor(text);
+  if (!cursor.findKey("benchmarks") || !cursor.consume('[')) {
+    error = "no \"benchmarks\" array";
+    return false;
+  }
+
+  // Gather the repetitions of each benchmark, and the median aggregates for the benchmarks without any.
+  std::vector<BenchmarkSamples> parsed, medians;
+  std::unordered_map<std::string, size_t> indices, median_indices;
+  while (!cursor.consume(']')) {
+    Entry entry;
+    if (!cursor.parseEntry(entry)) {
+      error = "malformed benchmark entry at offset " + std::to_string(cursor.offset(text));
+      return false;
+    }
+    cursor.consume(',');
+
+    const double scale = NanosecondsPerUnit(entry.time_unit);
+    if (entry.error_occurred || !std::isfinite(scale)) {
+      continue;
+    }
+    const bool aggregate = entry.run_type == "aggregate";
+    if (aggregate && entry.aggregate_name != "median") {
+      continue;
+    }
+    const std::string& name = entry.run_name.empty() ? entry.name : entry.run_name;
+    auto& samples = aggregate ? medians : parsed;
+    auto& sample_indices = aggregate ? median_indices : indices;
+    const auto [it, inserted] = sample_indices.emplace(name, samples.size());
+    if (inserted) {
+      samples.push_back({name, {}, {}});
+    }
+    samples[it->second].real_time_ns.push_back(scale * entry.real_time);
+    samples[it->second].cpu_time_ns.push_back(scale * entry.cpu_time);
+  }
+
+  for (auto& median : medians) {
+    if (indices.count(median.name) == 0) {
+      indices.emplace(median.name, parsed.size());
+      parsed.push_back(std::move(median));
+    }
+  }
+  if (parsed.empty()) {
+    error = "no benchmark results";
+    return false;
+  }
+  benchmarks = std::move(parsed);
+  return true;
+}
+
+bool LoadBenchmarkJson(const std::string& path, std::vector<BenchmarkSamples>& benchmarks,
+                       std::string& error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "can't open " + path;
+    return false;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ParseBenchmarkJson(ss.str(), benchmarks, error);
+}
+
+double MannWhitneyPValue(const std::vector<double>& a, const std::vector<double>& b) {
+  const size_t n = a.size(), m = b.size();
+  if (n == 0 || m == 0) {
+    return 1.0;
+  }
+
+  // Rank the pooled values, ties getting the mean of their ranks.
+  std::vector<std::pair<double, bool>> pooled;
+  pooled.reserve(n + m);
+  for (const double value : a) {
+    pooled.emplace_back(value, true);
+  }
+  for (const double value : b) {
+    pooled.emplace_back(value, false);
+  }
+  std::sort(pooled.begin(), pooled.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+  double rank_sum = 0.0, tie_term = 0.0;
+  for (size_t begin = 0; begin < pooled.size();) {
+    size_t end = begin + 1;
+    while (end < pooled.size() && pooled[end].first == pooled[begin].first) {
+      end++;
+    }
+    const double rank = 0.5 * static_cast<double>(begin + end + 1);
+    const double ties = static_cast<double>(end - begin);
+    tie_term += ties * ties * ties - ties;
+    for (size_t ii = begin; ii < end; ii++) {
+      rank_sum += pooled[ii].second ? rank : 0.0;
+    }
+    begin = end;
+  }
+  const double u = rank_sum - 0.5 * static_cast<double>(n * (n + 1));
+
+  if (n <= BenchmarkComparator::kMaxExactSize && m <= BenchmarkComparator::kMaxExactSize) {
+    // U is a half-integer with ties between the samples: P(U <= u) = P(U <= floor(u)) and
+    // P(U >= u) = P(U >= ceil(u)).
+    const std::vector<double> distribution = ExactUDistribution(n, m);
+    const size_t lower = static_cast<size_t>(std::floor(u)), upper = static_cast<size_t>(std::ceil(u));
+    double p_lower = 0.0, p_upper = 0.0;
+    for (size_t uu = 0; uu < distribution.size(); uu++) {
+      p_lower += uu <= lower ? distribution[uu] : 0.0;
+      p_upper += uu >= upper ? distribution[uu] : 0.0;
+    }
+    return std::min(1.0, 2.0 * std::min(p_lower, p_upper));
+  }
+
+  const double size = static_cast<double>(n + m);
+  const double mean = 0.5 * static_cast<double>(n * m);
+  const double variance =
+      static_cast<double>(n * m) / 12.0 * ((size + 1.0) - tie_term / (size * (size - 1.0)));
+  if (variance <= 0.0) {
+    return 1.0;
+  }
+  const double z = std::max(0.0, std::abs(u - mean) - 0.5) / std::sqrt(variance);
+  return std::min(1.0, std::erfc(z / std::sqrt(2.0)));
+}
+
+BenchmarkComparator::BenchmarkComparator() : BenchmarkComparator(Options()) {}
+
+BenchmarkComparator::BenchmarkComparator(const Options& options) : options_(options) {}
+
+std::vector<BenchmarkComparator::Comparison> BenchmarkComparator::compare(
+    const std::vector<BenchmarkSamples>& baseline, const std::vector<BenchmarkSamples>& contender) const {
+  const auto times = [this](const BenchmarkSamples& samples) -> const std::vector<double>& {
+    return options_.use_cpu_time ? samples.cpu_time_ns : samples.real_time_ns;
+  };
+  std::unordered_map<std::string, size_t> contender_indices;
+  for (size_t ii = 0; ii < contender.size(); ii++) {
+    contender_indices.emplace(contender[ii].name, ii);
+  }
+
+  // Smallest p-value per pair of repetition counts, to tell whether the test can reject at all.
+  std::map<std::pair<size_t, size_t>, double> minimum_p_values;
+  std::vector<Comparison> comparisons;
+  for (const auto& base : baseline) {
+    Comparison comparison;
+    comparison.name = base.name;
+    comparison.baseline_repetitions = times(base).size();
+    comparison.baseline_median_ns = Median(times(base));
+    const auto it = contender_indices.find(base.name);
+    if (it == contender_indices.end()) {
+      comparison.verdict = Verdict::MISSING;
+      comparison.contender_median_ns = std::numeric_limits<double>::quiet_NaN();
+      comparison.change = std::numeric_limits<double>::quiet_NaN();
+      comparison.p_value = std::numeric_limits<double>::quiet_NaN();
+      comparisons.push_back(std::move(comparison));
+      continue;
+    }
+    const auto& other = contender[it->second];
+    contender_indices.erase(it);
+    comparison.contender_repetitions = times(other).size();
+    comparison.contender_median_ns = Median(times(other));
+    comparison.change = comparison.contender_median_ns / comparison.baseline_median_ns - 1.0;
+
+    // Without enough repetitions for the test to reach the significance level, only the threshold applies.
+    const auto sizes = std::make_pair(comparison.baseline_repetitions, comparison.contender_repetitions);
+    auto minimum = minimum_p_values.find(sizes);
+    if (minimum == minimum_p_values.end()) {
+      minimum = minimum_p_values.emplace(sizes, MinimumPValue(sizes.first, sizes.second)).first;
+    }
+    bool significant = true;
+    if (minimum->second < options_.alpha) {
+      comparison.p_value = MannWhitneyPValue(times(base), times(other));
+      significant = comparison.p_value < options_.alpha;
+    } else {
+      comparison.p_value = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    if (significant && comparison.change > options_.threshold) {
+      comparison.verdict = Verdict::REGRESSION;
+    } else if (significant && comparison.change < -options_.threshold) {
+      comparison.verdict = Verdict::IMPROVEMENT;
+    }
+    comparisons.push_back(std::move(comparison));
+  }
+
+  // Benchmarks only in the contender, in its order.
+  for (const auto& other : contender) {
+    if (contender_indices.count(other.name) == 0) {
+      continue;
+    }
+    Comparison comparison;
+    comparison.name = other.name;
+    comparison.verdict = Verdict::NEW;
+    comparison.contender_repetitions = times(other).size();
+    comparison.baseline_median_ns = std::numeric_limits<double>::quiet_NaN();
+    comparison.contender_median_ns = Median(times(other));
+    comparison.change = std::numeric_limits<double>::quiet_NaN();
+    comparison.p_value = std::numeric_limits<double>::quiet_NaN();
+    comparisons.push_back(std::move(comparison));
+  }
+  return comparisons;
+}
+
+void BenchmarkComparator::writeReport(const std::vector<Comparison>& comparisons, std::ostream& os,
+                                      const bool verbose) const {
+  char line[512];
+  std::snprintf(line, sizeof(line), "Comparing %s times: threshold %.1f%%, alpha %.3g.\n",
+                options_.use_cpu_time ? "CPU" : "real", 100.0 * options_.threshold, options_.alpha);
+  os << line;
+
+  // Flagged benchmarks.
+  int name_width = 9;
+  for (const auto& comparison : comparisons) {
+    if (verbose || comparison.verdict != Verdict::UNCHANGED) {
+      name_width = std::max(name_width, static_cast<int>(comparison.name.size()));
+    }
+  }
+  size_t num_listed = 0;
+  for (const auto& comparison : comparisons) {
+    if (!verbose && comparison.verdict == Verdict::UNCHANGED) {
+      continue;
+    }
+    if (num_listed++ == 0) {
+      std::snprintf(line, sizeof(line), "%-*s %12s %12s %8s %8s  %s\n", name_width, "benchmark", "baseline",
+                    "contender", "change", "p-value", "verdict");
+      os << line;
+    }
+    char change[16] = "-", p_value[16] = "-";
+    if (std::isfinite(comparison.change)) {
+      std::snprintf(change, sizeof(change), "%+.1f%%", 100.0 * comparison.change);
+    }
+    if (std::isfinite(comparison.p_value)) {
+      std::snprintf(p_value, sizeof(p_value), "%.4f", comparison.p_value);
+    }
+    std::snprintf(line, sizeof(line), "%-*s %12s %12s %8s %8s  %s\n", name_width, comparison.name.c_str(),
+                  FormatTime(comparison.baseline_median_ns).c_str(),
+                  FormatTime(comparison.contender_median_ns).c_str(), change, p_value,
+                  VerdictName(comparison.verdict));
+    os << line;
+  }
+
+  // Worst change per family, in order of first appearance.
+  struct FamilySummary {
+    std::string name;
+    size_t num_benchmarks = 0;
+    size_t num_regressions = 0;
+    double worst_change = -std::numeric_limits<double>::infinity();
+  };
+  std::vector<FamilySummary> families;
+  for (const auto& comparison : comparisons) {
+    const std::string family = Family(comparison.name);
+    auto it = std::find_if(families.begin(), families.end(),
+                           [&family](const FamilySummary& summary) { return summary.name == family; });
+    if (it == families.end()) {
+      it = families.insert(families.end(), FamilySummary{family});
+    }
+    it->num_benchmarks++;
+    it->num_regressions += comparison.verdict == Verdict::REGRESSION ? 1 : 0;
+    if (std::isfinite(comparison.change)) {
+      it->worst_change = std::max(it->worst_change, comparison.change);
+    }
+  }
+  os << "Families:\n";
+  for (const auto& family : families) {
+    char worst[16] = "-";
+    if (std::isfinite(family.worst_change)) {
+      std::snprintf(worst, sizeof(worst), "%+.1f%%", 100.0 * family.worst_change);
+    }
+    std::snprintf(line, sizeof(line), "  %-40s %4zu benchmarks, %4zu regressions, worst %s\n",
+                  family.name.c_str(), family.num_benchmarks, family.num_regressions, worst);
+    os << line;
+  }
+
+  size_t counts[5] = {};
+  for (const auto& comparison : comparisons) {
+    counts[static_cast<size_t>(comparison.verdict)]++;
+  }
+  std::snprintf(line, sizeof(line),
+                "Summary: %zu benchmarks, %zu regressions, %zu improvements, %zu unchanged, %zu missing, "
+                "%zu new.\n",
+                comparisons.size(), counts[static_cast<size_t>(Verdict::REGRESSION)],
+                counts[static_cast<size_t>(Verdict::IMPROVEMENT)],
+                counts[static_cast<size_t>(Verdict::UNCHANGED)],
+                counts[static_cast<size_t>(Verdict::MISSING)], counts[static_cast<size_t>(Verdict::NEW)]);
+  os << line;
+}
+
+void BenchmarkComparator::writeJson(const std::vector<Comparison>& comparisons, std::ostream& os) const {
+  const std::ios::fmtflags flags = os.flags();
+  const std::streamsize precision = os.precision();
+  os << std::setprecision(6);
+  os << "{\n"
+     << "  \"threshold\": " << options_.threshold << ",\n"
+     << "  \"alpha\": " << options_.alpha << ",\n"
+     << "  \"time\": \"" << (options_.use_cpu_time ? "cpu" : "real") << "\",\n"
+     << "  \"num_regressions\": " << NumRegressions(comparisons) << ",\n"
+     << "  \"comparisons\": [";
+  for (size_t ii = 0; ii < comparisons.size(); ii++) {
+    const Comparison& comparison = comparisons[ii];
+    os << (ii == 0 ? "\n" : ",\n") << "    {\"name\": \"";
+    for (const char c : comparison.name) {
+      os << (c == '"' || c == '\\' ? "\\" : "") << c;
+    }
+    os << "\", \"verdict\": \"" << VerdictName(comparison.verdict)
+       << "\", \"baseline_repetitions\": " << comparison.baseline_repetitions
+       << ", \"contender_repetitions\": " << comparison.contender_repetitions << ", \"baseline_median_ns\": ";
+    WriteJsonNumber(os, comparison.baseline_median_ns);
+    os << ", \"contender_median_ns\": ";
+    WriteJsonNumber(os, comparison.contender_median_ns);
+    os << ", \"change\": ";
+    WriteJsonNumber(os, comparison.change);
+    os << ", \"p_value\": ";
+    WriteJsonNumber(os, comparison.p_value);
+    os << "}";
+  }
+  os << "\n  ]\n}\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+size_t BenchmarkComparator::NumRegressions(const std::vector<Comparison>& comparisons) {
+  return std::count_if(comparisons.begin(), comparisons.end(), [](const Comparison& comparison) {
+    return comparison.verdict == Verdict::REGRESSION;
+  });
+}
+
+const char* BenchmarkComparator::VerdictName(const Verdict verdict) {
+  switch (verdict) {
+    case Verdict::UNCHANGED:
+      return "UNCHANGED";
+    case Verdict::IMPROVEMENT:
+      return "IMPROVEMENT";
+    case Verdict::REGRESSION:
+      return "REGRESSION";
+    case Verdict::MISSING:
+      return "MISSING";
+    case Verdict::NEW:
+      return "NEW";
+  }
+  return "UNKNOWN";
+}
+
+}  // namespace gtcal
@@ -0,0 +1,343 @@
+#include "gtcal/calibration_bundle.h"
+#include "gtcal/binary_io.h"
+
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/Marginals.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <thread>
+
+using gtsam::symbol_shorthand::K;
+
+namespace gtcal {
+namespace {
+
+struct Header {
+  char magic[8] = {};
+  uint32_t version = 0;
+  uint32_t num_cameras = 0;
+  uint64_t file_size = 0;
+  uint32_t checksum = 0;
+  uint32_t reserved = 0;
+};
+static_assert(sizeof(Header) == 32, "Header must be 32 bytes.");
+
+/**
+ * @brief Return the offset rounded up to the map alignment.
+ *
+ */
+uint64_t AlignMap(const uint64_t offset) {
+  return (offset + kCalibrationBundleMapAlignment - 1) & ~(kCalibrationBundleMapAlignment - 1);
+}
+
+/**
+ * @brief Return the size of a map entry, 0 for no map.
+ *
+ */
+size_t MapEntrySize(const MapFormat format) {
+  switch (format) {
+    case MapFormat::FLOAT32:
+      return 2 * sizeof(float);
+    case MapFormat::FLOAT16:
+    case MapFormat::FIXED16:
+      return 2 * sizeof(uint16_t);
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Encode a pixel offset, or an invalid entry if the offset isn't set.
+ *
+ */
+void EncodeMapEntry(const std::optional<Eigen::Vector2f>& offset, const MapFormat format, char* entry) {
+  if (format == MapFormat::FLOAT32) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float values[2] = {offset ? offset->x() : nan, offset ? offset->y() : nan};
+    std::memcpy(entry, values, sizeof(values));
+  } else if (format == MapFormat::FLOAT16) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const uint16_t values[2] = {io::FloatToHalf(offset ? offset->x() : nan),
+                                io::FloatToHalf(offset ? offset->y() : nan)};
+    std::memcpy(entry, values, sizeof(values));
+  } else {
+    // Offsets out of the fixed point range are marked invalid rather than clamped.
+    constexpr float scale = 1 << kFixedPointMapFractionBits;
+    int16_t values[2] = {kFixedPointMapInvalid, kFixedPointMapInvalid};
+    if (offset && std::abs(offset->x()) * scale < INT16_MAX && std::abs(offset->y()) * scale < INT16_MAX) {
+      values[0] = static_cast<int16_t>(std::lround(offset->x() * scale));
+      values[1] = static_cast<int16_t>(std::lround(offset->y() * scale));
+    }
+    std::memcpy(entry, values, sizeof(values));
+  }
+}
+
+/**
+ * @brief Fill the rows [row_begin, row_end) of a camera's map.
+ *
+ */
+void ComputeMapRows(const Camera& camera, const CalibrationBundleCamera& record, const MapFormat format,
+                    const size_t row_begin, const size_t row_end, char* map) {
+  const gtsam::Rot3 R_rect_cam = gtsam::Rot3::Quaternion(record.map_rotation[0], record.map_rotation[1],
+                                                         record.map_rotation[2], record.map_rotation[3]);
+  const gtsam::Matrix3 R_cam_rect = R_rect_cam.matrix().transpose();
+  const double fx = record.map_intrinsics[0], fy = record.map_intrinsics[1];
+  const double cx = record.map_intrinsics[2], cy = record.map_intrinsics[3];
+  const size_t entry_size = MapEntrySize(format);
+
+  std::visit(
+      [&](auto&& arg) -> void {
+        const auto calibration = arg->calibration();
+        for (size_t y = row_begin; y < row_end; y++) {
+          char* entry = map + y * record.width * entry_size;
+          for (size_t x = 0; x < record.width; x++, entry += entry_size) {
+            // Ray of the undistorted pixel in the camera frame, then its pixel in the original image.
+            const gtsam::Vector3 ray = R_cam_rect * gtsam::Vector3((x - cx) / fx, (y - cy) / fy, 1.0);
+            std::optional<Eigen::Vector2f> offset;
+            if (ray.z() > 0.0) {
+              const gtsam::Point2 xy(ray.x() / ray.z(), ray.y() / ray.z());
+              const gtsam::Point2 uv = calibration.uncalibrate(xy);
+              if (uv.x() >= 0.0 && uv.y() >= 0.0 && uv.x() <= record.width - 1.0 &&
+                  uv.y() <= record.height - 1.0) {
+                offset = Eigen::Vector2f(static_cast<float>(uv.x() - x), static_cast<float>(uv.y() - y));
+              }
+            }
+            EncodeMapEntry(offset, format, entry);
+          }
+        }
+      },
+      camera.cameraVariant());
+}
+
+/**
+ * @brief Return the camera record of a camera, without the map location.
+ *
+ */
+CalibrationBundleCamera MakeRecord(const Camera& camera, const gtsam::Matrix& covariance,
+                                   const gtsam::Rot3& R_rect_cam, const MapFormat format) {
+  CalibrationBundleCamera record;
+  record.model_type = static_cast<uint32_t>(camera.modelType());
+  record.width = static_cast<uint32_t>(camera.width());
+  record.height = static_cast<uint32_t>(camera.height());
+
+  const std::vector<double> intrinsics = camera.intrinsicsParameters();
+  record.num_intrinsics = static_cast<uint32_t>(intrinsics.size());
+  std::copy(intrinsics.begin(), intrinsics.end(), record.intrinsics);
+
+  const gtsam::Pose3 pose = camera.pose();
+  const gtsam::Quaternion q = pose.rotation().toQuaternion();
+  const double pose_values[7] = {pose.x(), pose.y(), pose.z(), q.w(), q.x(), q.y(), q.z()};
+  std::copy(std::begin(pose_values), std::end(pose_values), record.pose);
+
+  // Calibration dimension: Cal3_S2 has 5 parameters, Cal3Fisheye 9.
+  record.covariance_dim = camera.modelType() == Camera::ModelType::CAL3_FISHEYE ? 9 : 5;
+  const auto dim = static_cast<Eigen::Index>(record.covariance_dim);
+  if (covariance.rows() == dim && covariance.cols() == dim) {
+    for (uint32_t row = 0; row < record.covariance_dim; row++) {
+      for (uint32_t col = 0; col < record.covariance_dim; col++) {
+        record.covariance[row * record.covariance_dim + col] = covariance(row, col);
+      }
+    }
+  }
+
+  record.map_format = static_cast<uint32_t>(format);
+  std::copy(intrinsics.begin(), intrinsics.begin() + 4, record.map_intrinsics);
+  const gtsam::Quaternion q_rect = R_rect_cam.toQuaternion();
+  const double rotation_values[4] = {q_rect.w(), q_rect.x(), q_rect.y(), q_rect.z()};
+  std::copy(std::begin(rotation_values), std::end(rotation_values), record.map_rotation);
+  return record;
+}
+
+}  // namespace
+
+bool WriteCalibrationBundle(const std::string& path, const std::vector<std::shared_ptr<Camera>>& cameras,
+                            const std::vector<gtsam::Matrix>& covariances,
+                            const CalibrationBundleOptions& options) {
+  // Lay out the records and the maps.
+  std::vector<CalibrationBundleCamera> records;
+  records.reserve(cameras.size());
+  const uint64_t records_end = sizeof(Header) + cameras.size() * sizeof(CalibrationBundleCamera);
+  uint64_t offset = records_end;
+  const size_t entry_size = MapEntrySize(options.map_format);
+  for (size_t ii = 0; ii < cameras.size(); ii++) {
+    const gtsam::Matrix covariance = ii < covariances.size() ? covariances.at(ii) : gtsam::Matrix();
+    const gtsam::Rot3 R_rect_cam = ii < options.rectification_rotations.size()
+                                       ? options.rectification_rotations.at(ii)
+                                       : gtsam::Rot3();
+    records.push_back(MakeRecord(*cameras.at(ii), covariance, R_rect_cam, options.map_format));
+    if (entry_size > 0) {
+      records.back().map_offset = AlignMap(offset);
+      records.back().map_size = uint64_t{records.back().width} * records.back().height * entry_size;
+      offset = records.back().map_offset + records.back().map_size;
+    }
+  }
+
+  // Compute the maps in memory, splitting every camera's rows between the threads. The buffer starts right
+  // after the records so the alignment padding is written with it.
+  std::vector<char> maps(offset - records_end, 0);
+  if (entry_size > 0) {
+    const size_t num_threads =
+        options.num_threads > 0 ? options.num_threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (size_t tt = 0; tt < num_threads; tt++) {
+      threads.emplace_back([&, tt]() {
+        for (size_t ii = 0; ii < records.size(); ii++) {
+          const size_t height = records.at(ii).height;
+          char* map = maps.data() + (records.at(ii).map_offset - records_end);
+          ComputeMapRows(*cameras.at(ii), records.at(ii), options.map_format, tt * height / num_threads,
+                         (tt + 1) * height / num_threads, map);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  Header header;
+  std::memcpy(header.magic, kCalibrationBundleMagic, sizeof(header.magic));
+  header.version = kCalibrationBundleVersion;
+  header.num_cameras = static_cast<uint32_t>(records.size());
+  header.file_size = offset;
+  header.checksum = io::Fnv1a32(records.data(), records.size() * sizeof(CalibrationBundleCamera));
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CalibrationBundleCamera));
+  file.write(maps.data(), maps.size());
+  return file.good();
+}
+
+bool WriteCalibrationBundle(const std::string& path, const BatchSolver::State& state,
+                            const CalibrationBundleOptions& options) {
+  // iSAM2 keeps the factorization around. The batch optimizers need the marginals of the whole graph.
+  std::vector<gtsam::Matrix> covariances(state.cameras.size());
+  std::unique_ptr<gtsam::Marginals> marginals;
+  for (size_t ii = 0; ii < state.cameras.size(); ii++) {
+    if (!state.current_estimate.exists(K(ii))) {
+      continue;
+    }
+    try {
+      if (state.isam.valueExists(K(ii))) {
+        covariances.at(ii) = state.isam.marginalCovariance(K(ii));
+      } else {
+        if (!marginals) {
+          marginals = std::make_unique<gtsam::Marginals>(state.graph, state.current_estimate);
+        }
+        covariances.at(ii) = marginals->marginalCovariance(K(ii));
+      }
+    } catch (const std::exception&) {
+      // E.g. an underconstrained camera. The covariance is left unknown.
+    }
+  }
+  return WriteCalibrationBundle(path, state.cameras, covariances, options);
+}
+
+CalibrationBundleReader::CalibrationBundleReader(const std::string& path) : file_(path) {
+  Header header;
+  if (!file_.isOpen() || file_.size() < sizeof(Header)) {
+    return;
+  }
+  std::memcpy(&header, file_.data(), sizeof(Header));
+  if (std::memcmp(header.magic, kCalibrationBundleMagic, sizeof(header.magic)) != 0 ||
+      header.version != kCalibrationBundleVersion || header.file_size != file_.size() ||
+      header.num_cameras > (file_.size() - sizeof(Header)) / sizeof(CalibrationBundleCamera)) {
+    return;
+  }
+  const char* records = file_.data() + sizeof(Header);
+  if (io::Fnv1a32(records, header.num_cameras * sizeof(CalibrationBundleCamera)) != header.checksum) {
+    return;
+  }
+
+  // The records are used in place, the mapping is page aligned.
+  const auto* cameras = reinterpret_cast<const CalibrationBundleCamera*>(records);
+  for (size_t ii = 0; ii < header.num_cameras; ii++) {
+    const CalibrationBundleCamera& record = cameras[ii];
+    const size_t entry_size = MapEntrySize(static_cast<MapFormat>(record.map_format));
+    if (record.num_intrinsics > 8 || record.covariance_dim > 9) {
+      return;
+    }
+    if (entry_size > 0 &&
+        (record.map_offset % kCalibrationBundleMapAlignment != 0 ||
+         record.map_size != uint64_t{record.width} * record.height * entry_size ||
+         record.map_offset > file_.size() || record.map_size > file_.size() - record.map_offset)) {
+      return;
+    }
+  }
+  cameras_ = cameras;
+  num_cameras_ = header.num_cameras;
+  is_open_ = true;
+}
+
+const CalibrationBundleCamera& CalibrationBundleReader::camera(const size_t index) const {
+  assert(index < num_cameras_ && "[CalibrationBundleReader::camera] Camera index out of range.");
+  return cameras_[index];
+}
+
+const void* CalibrationBundleReader::mapData(const size_t index) const {
+  const CalibrationBundleCamera& record = camera(index);
+  return MapEntrySize(static_cast<MapFormat>(record.map_format)) > 0 ? file_.data() + record.map_offset
+                                                                      : nullptr;
+}
+
+bool CalibrationBundleReader::sourcePixel(const size_t index, const size_t x, const size_t y,
+                                          gtsam::Point2& uv) const {
+  const CalibrationBundleCamera& record = camera(index);
+  const auto format = static_cast<MapFormat>(record.map_format);
+  const char* map = static_cast<const char*>(mapData(index));
+  if (map == nullptr || x >= record.width || y >= record.height) {
+    return false;
+  }
+
+  const char* entry = map + (y * record.width + x) * MapEntrySize(format);
+  float offset[2] = {0.f, 0.f};
+  if (format == MapFormat::FLOAT32) {
+    std::memcpy(offset, entry, sizeof(offset));
+  } else if (format == MapFormat::FLOAT16) {
+    uint16_t values[2];
+    std::memcpy(values, entry, sizeof(values));
+    offset[0] = io::HalfToFloat(values[0]);
+    offset[1] = io::HalfToFloat(values[1]);
+  } else {
+    int16_t values[2];
+    std::memcpy(values, entry, sizeof(values));
+    if (values[0] == kFixedPointMapInvalid) {
+      return false;
+    }
+    offset[0] = static_cast<float>(values[0]) / (1 << kFixedPointMapFractionBits);
+    offset[1] = static_cast<float>(values[1]) / (1 << kFixedPointMapFractionBits);
+  }
+  if (std::isnan(offset[0])) {
+    return false;
+  }
+  uv = gtsam::Point2(x + offset[0], y + offset[1]);
+  return true;
+}
+
+std::shared_ptr<Camera> CalibrationBundleReader::makeCamera(const size_t index) const {
+  const CalibrationBundleCamera& record = camera(index);
+  const double* k = record.intrinsics;
+  const double* p = record.pose;
+  const gtsam::Pose3 pose(gtsam::Rot3::Quaternion(p[3], p[4], p[5], p[6]), gtsam::Point3(p[0], p[1], p[2]));
+  auto camera = std::make_shared<Camera>();
+  if (static_cast<Camera::ModelType>(record.model_type) == Camera::ModelType::CAL3_FISHEYE) {
+    camera->setCameraModel<gtsam::Cal3Fisheye>(
+        record.width, record.height, gtsam::Cal3Fisheye(k[0], k[1], 0., k[2], k[3], k[4], k[5], k[6], k[7]),
+        pose);
+  } else {
+    camera->setCameraModel<gtsam::Cal3_S2>(record.width, record.height,
+                                           gtsam::Cal3_S2(k[0], k[1], 0., k[2], k[3]), pose);
+  }
+  return camera;
+}
+
+}  // namespace gtcal
@@ -0,0 +1,285 @@
+#include "gtcal/calibration_pipeline.h"
+#include "gtcal/detection_log.h"
+#include "gtcal/homography.h"
+#include "gtcal/pose_solver.h"
+#include "gtcal/pose_solver_gtsam.h"
+
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <thread>
+
+using gtsam::symbol_shorthand::X;
+
+namespace gtcal {
+namespace {
+
+/**
+ * @brief Yield for the first attempts, then sleep, while waiting on a queue.
+ *
+ */
+void Backoff(const size_t num_attempts) {
+  if (num_attempts < 64) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+/**
+ * @brief Push an item, waiting for a free slot if the queue is full.
+ *
+ */
+template <typename T>
+void PushWait(BoundedQueue<T>& queue, T& item) {
+  size_t num_attempts = 0;
+  while (!queue.tryPush(item)) {
+    Backoff(num_attempts++);
+  }
+}
+
+/**
+ * @brief Return the RMS reprojection error of the measurements with the camera at the given pose.
+ *
+ */
+double ReprojectionRms(const std::vector<Measurement>& measurements, const gtsam::Point3Vector& pts3d_target,
+                       const gtsam::Pose3& pose_target_cam, Camera& camera) {
+  camera.setCameraPose(pose_target_cam);
+  double sum_squared_error = 0.0;
+  for (const auto& meas : measurements) {
+    sum_squared_error += (camera.project(pts3d_target.at(meas.point_id)) - meas.uv).squaredNorm();
+  }
+  return std::sqrt(sum_squared_error / static_cast<double>(measurements.size()));
+}
+
+}  // namespace
+
+CalibrationPipeline::CalibrationPipeline(const Rig& rig, const BatchSolver::Options& solver_options,
+                                         const Options& options)
+  : rig_(rig), pts3d_target_(rig.target().pointsTarget()), solver_(pts3d_target_, solver_options),
+    options_(options),
+    state_(std::make_unique<BatchSolver::State>(rig.cloneCameras(), solver_options)),
+    last_keyframe_poses_(rig.cameras.size()) {}
+
+CalibrationPipeline::CalibrationPipeline(const Rig& rig, const BatchSolver::Options& solver_options)
+  : CalibrationPipeline(rig, solver_options, Options()) {}
+
+bool CalibrationPipeline::run(const std::vector<std::string>& log_paths) {
+  const Clock::time_point run_start = Clock::now();
+
+  // One thread reads, the calling thread runs the batch stage and the rest solve poses.
+  const size_t num_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  num_pose_threads_ = num_threads > 3 ? num_threads - 2 : 1;
+
+  BoundedQueue<Frame> pose_queue(options_.queue_capacity);
+  BoundedQueue<Frame> batch_queue(options_.queue_capacity);
+  std::thread reader(&CalibrationPipeline::readFrames, this, std::cref(log_paths), std::ref(pose_queue));
+  std::vector<std::thread> pose_workers;
+  for (size_t ii = 0; ii < num_pose_threads_; ii++) {
+    pose_workers.emplace_back(&CalibrationPipeline::solvePoses, this, std::ref(pose_queue),
+                              std::ref(batch_queue));
+  }
+
+  // Batch stage. The pose workers finish frames out of order, so frames wait here until their turn to keep
+  // the keyframe selection and the solver input independent of the number of threads.
+  std::map<size_t, Frame> pending_frames;
+  size_t next_sequence = 0;
+  size_t num_attempts = 0;
+  Frame frame;
+  for (;;) {
+    // Read the flag before checking the queue so the frame count is final when it is set.
+    const bool reading_done = reading_done_.load(std::memory_order_acquire);
+    if (batch_queue.tryPop(frame)) {
+      const size_t sequence = frame.sequence;
+      pending_frames.emplace(sequence, std::move(frame));
+      num_attempts = 0;
+    } else if (reading_done && next_sequence == num_frames_.load(std::memory_order_acquire)) {
+      break;
+    } else if (pending_frames.empty() || pending_frames.begin()->first != next_sequence) {
+      Backoff(num_attempts++);
+    }
+
+    while (!pending_frames.empty() && pending_frames.begin()->first == next_sequence) {
+      const Frame& next_frame = pending_frames.begin()->second;
+      if (next_frame.accepted && isKeyframe(next_frame)) {
+        addKeyframe(next_frame);
+      }
+      pending_frames.erase(pending_frames.begin());
+      next_sequence++;
+    }
+  }
+
+  reader.join();
+  for (auto& worker : pose_workers) {
+    worker.join();
+  }
+
+  // Final joint optimization.
+  const Clock::time_point optimize_start = Clock::now();
+  const bool optimized = !keyframes_.empty() && solver_.optimize(*state_);
+  optimize_time_ = Clock::now() - optimize_start;
+  run_time_ = Clock::now() - run_start;
+
+  return optimized && !read_failed_.load(std::memory_order_acquire);
+}
+
+void CalibrationPipeline::readFrames(const std::vector<std::string>& log_paths,
+                                     BoundedQueue<Frame>& pose_queue) {
+  size_t sequence = 0;
+  for (const auto& path : log_paths) {
+    DetectionLogReader log(path);
+    if (!log.isOpen()) {
+      read_failed_.store(true, std::memory_order_release);
+      continue;
+    }
+
+    MeasurementSpan measurements;
+    for (size_t ii = 0; ii < log.numFrames(); ii++) {
+      const Clock::time_point start_time = Clock::now();
+      if (!log.frame(ii, measurements)) {
+        read_failed_.store(true, std::memory_order_release);
+        continue;
+      }
+
+      // Frames are copied out of the log, whose views only stay valid until the next chunk is read.
+      Frame frame;
+      frame.sequence = sequence++;
+      frame.timestamp_ns = log.timestamp(ii);
+      frame.measurements.reserve(measurements.size());
+      frame.measurements.assign(measurements.begin(), measurements.end());
+      read_histogram_.record(Clock::now() - start_time);
+
+      PushWait(pose_queue, frame);
+      num_frames_.fetch_add(1, std::memory_order_release);
+    }
+  }
+  reading_done_.store(true, std::memory_order_release);
+}
+
+void CalibrationPipeline::solvePoses(BoundedQueue<Frame>& pose_queue, BoundedQueue<Frame>& batch_queue) {
+  // The pose solvers move the camera they're given, so each worker uses its own copies.
+  const std::vector<std::shared_ptr<Camera>> cameras = rig_.cloneCameras();
+  const PoseSolver pose_solver;
+  const PoseSolverGtsam pose_solver_gtsam{PoseSolverGtsam::Options()};
+
+  Frame frame;
+  size_t num_attempts = 0;
+  for (;;) {
+    const bool reading_done = reading_done_.load(std::memory_order_acquire);
+    if (!pose_queue.tryPop(frame)) {
+      if (reading_done) {
+        break;
+      }
+      Backoff(num_attempts++);
+      continue;
+    }
+    num_attempts = 0;
+
+    const Clock::time_point start_time = Clock::now();
+    const auto& measurements = frame.measurements;
+    frame.accepted = false;
+    try {
+      // A frame must come from a single camera of the rig and only see target points.
+      const size_t camera_id = measurements.empty() ? 0 : measurements.front().camera_id;
+      const bool valid =
+          measurements.size() >= std::max<size_t>(options_.min_measurements, 4) &&
+          camera_id < cameras.size() &&
+          std::all_of(measurements.begin(), measurements.end(), [&](const Measurement& meas) {
+            return meas.camera_id == camera_id && meas.point_id < pts3d_target_.size();
+          });
+
+      // Initialize the pose from the target homography and refine it with the full camera model.
+      gtsam::Matrix3 H_image_target;
+      if (valid && EstimateHomography(measurements, pts3d_target_, H_image_target) &&
+          PoseFromHomography(H_image_target, CameraMatrix(*cameras.at(camera_id)), frame.pose_target_cam)) {
+        const std::shared_ptr<Camera>& camera = cameras.at(camera_id);
+        const bool solved =
+            options_.pose_solver_type == PoseSolverType::CERES
+                ? pose_solver.solve(measurements, pts3d_target_, camera, frame.pose_target_cam)
+                : pose_solver_gtsam.solve(measurements, pts3d_target_, camera, frame.pose_target_cam);
+        frame.accepted =
+            solved && ReprojectionRms(measurements, pts3d_target_, frame.pose_target_cam, *camera) <=
+                          options_.max_pose_rms_error;
+      }
+    } catch (const std::exception&) {
+      // E.g. a target point behind the camera.
+      frame.accepted = false;
+    }
+    pose_histogram_.record(Clock::now() - start_time);
+    if (!frame.accepted) {
+      num_rejected_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    PushWait(batch_queue, frame);
+  }
+}
+
+bool CalibrationPipeline::isKeyframe(const Frame& frame) {
+  std::optional<gtsam::Pose3>& last_pose = last_keyframe_poses_.at(frame.measurements.front().camera_id);
+  if (last_pose) {
+    const gtsam::Pose3 delta = last_pose->between(frame.pose_target_cam);
+    const double rotation_deg = utils::RadToDeg(gtsam::Rot3::Logmap(delta.rotation()).norm());
+    if (delta.translation().norm() < options_.keyframe_min_translation &&
+        rotation_deg < options_.keyframe_min_rotation_deg) {
+      return false;
+    }
+  }
+  last_pose = frame.pose_target_cam;
+  return true;
+}
+
+void CalibrationPipeline::addKeyframe(const Frame& frame) {
+  const Clock::time_point start_time = Clock::now();
+  const size_t camera_id = frame.measurements.front().camera_id;
+  const size_t pose_index = state_->num_frames;
+  try {
+    // The solver uses the camera's pose as the initial estimate of the frame pose.
+    state_->cameras.at(camera_id)->setCameraPose(frame.pose_target_cam);
+    solver_.solve(frame.measurements, *state_);
+    keyframes_.push_back({camera_id, frame.timestamp_ns, pose_index});
+  } catch (const std::exception&) {
+    num_batch_failures_++;
+  }
+  batch_histogram_.record(Clock::now() - start_time);
+}
+
+bool CalibrationPipeline::writeResult(const std::string& path) const {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  // The calibrated rig, followed by the frame poses.
+  Rig rig = rig_;
+  rig.cameras = state_->cameras;
+  WriteRig(rig, file);
+  for (const auto& keyframe : keyframes_) {
+    if (!state_->current_estimate.exists(X(keyframe.pose_index))) {
+      continue;
+    }
+    const gtsam::Pose3 pose = state_->current_estimate.at<gtsam::Pose3>(X(keyframe.pose_index));
+    const gtsam::Quaternion q = pose.rotation().toQuaternion();
+    file << "frame " << keyframe.camera_id << " " << keyframe.timestamp_ns << " " << pose.x() << " "
+         << pose.y() << " " << pose.z() << " " << q.w() << " " << q.x() << " " << q.y() << " " << q.z()
+         << "\n";
+  }
+  return file.good();
+}
+
+CalibrationPipeline::Stats CalibrationPipeline::stats() const {
+  Stats stats;
+  stats.num_frames = num_frames_.load(std::memory_order_relaxed);
+  stats.num_rejected = num_rejected_.load(std::memory_order_relaxed);
+  stats.num_keyframes = keyframes_.size();
+  stats.num_batch_failures = num_batch_failures_;
+  return stats;
+}
+
+}  // namespace gtcal
@@ -0,0 +1,757 @@
+#include "gtcal/checkpoint.h"
+#include "gtcal/target_projection_factor.h"
+
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/slam/GeneralSFMFactor.h>
+#include <gtsam/nonlinear/PriorFactor.h>
+
+#include <cmath>
+#include <sstream>
+
+namespace gtcal {
+namespace {
+
+enum class RecordType : uint32_t { FULL = 1, DELTA = 2 };
+
+enum class FactorType : uint8_t {
+  NONE = 0,
+  PRIOR_POSE3 = 1,
+  PRIOR_POINT3 = 2,
+  PRIOR_CAL3_S2 = 3,
+  PRIOR_CAL3_FISHEYE = 4,
+  SFM_CAL3_S2 = 5,
+  SFM_CAL3_FISHEYE = 6,
+  TARGET_CAL3_S2 = 7,
+  TARGET_CAL3_FISHEYE = 8
+};
+
+enum class NoiseModelType : uint8_t { DIAGONAL = 0, SQRT_INFORMATION = 1 };
+
+// Solver states hold everything below a few GB; anything larger is a corrupted size field.
+static constexpr uint64_t kMaxRecordSize = uint64_t{1} << 34;
+
+std::vector<double> PoseToVector(const gtsam::Pose3& pose) {
+  const gtsam::Matrix3 R = pose.rotation().matrix();
+  const gtsam::Point3& t = pose.translation();
+  return {R(0, 0), R(0, 1), R(0, 2), R(1, 0), R(1, 1), R(1, 2),
+          R(2, 0), R(2, 1), R(2, 2), t.x(), t.y(), t.z()};
+}
+
+bool VectorToPose(const std::vector<double>& vec, gtsam::Pose3& pose) {
+  if (vec.size() != 12) {
+    return false;
+  }
+  gtsam::Matrix3 R;
+  R << vec[0], vec[1], vec[2], vec[3], vec[4], vec[5], vec[6], vec[7], vec[8];
+  pose = gtsam::Pose3(gtsam::Rot3(R), gtsam::Point3(vec[9], vec[10], vec[11]));
+  return true;
+}
+
+template <typename CALIBRATION>
+std::vector<double> CalibrationToVector(const CALIBRATION& K) {
+  const gtsam::Vector vec = K.vector();
+  return std::vector<double>(vec.data(), vec.data() + vec.size());
+}
+
+bool VectorToCalibration(const std::vector<double>& vec, gtsam::Cal3_S2& K) {
+  if (vec.size() != 5) {
+    return false;
+  }
+  K = gtsam::Cal3_S2(vec[0], vec[1], vec[2], vec[3], vec[4]);
+  return true;
+}
+
+bool VectorToCalibration(const std::vector<double>& vec, gtsam::Cal3Fisheye& K) {
+  if (vec.size() != 9) {
+    return false;
+  }
+  K = gtsam::Cal3Fisheye(vec[0], vec[1], vec[2], vec[3], vec[4], vec[5], vec[6], vec[7], vec[8]);
+  return true;
+}
+
+/**
+ * @brief Return true if the noise model was serialized. Return false for non-Gaussian (e.g. robust) models.
+ *
+ */
+bool WriteNoiseModel(const gtsam::SharedNoiseModel& noise_model, io::ByteWriter& writer) {
+  if (const auto diagonal = std::dynamic_pointer_cast<gtsam::noiseModel::Diagonal>(noise_model)) {
+    const gtsam::Vector sigmas = diagonal->sigmas();
+    writer.write(NoiseModelType::DIAGONAL);
+    writer.writeVector(std::vector<double>(sigmas.data(), sigmas.data() + sigmas.size()));
+    return true;
+  }
+
+  // Full covariance models are stored as their square root information matrix (row major).
+  const auto gaussian = std::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(noise_model);
+  if (!gaussian) {
+    return false;
+  }
+  const gtsam::Matrix R = gaussian->R();
+  std::vector<double> values;
+  values.reserve(R.size());
+  for (int rr = 0; rr < R.rows(); rr++) {
+    for (int cc = 0; cc < R.cols(); cc++) {
+      values.push_back(R(rr, cc));
+    }
+  }
+  writer.write(NoiseModelType::SQRT_INFORMATION);
+  writer.writeVector(values);
+  return true;
+}
+
+gtsam::SharedNoiseModel ReadNoiseModel(io::ByteReader& reader) {
+  NoiseModelType type;
+  std::vector<double> values;
+  if (!reader.read(type) || !reader.readVector(values) || values.empty()) {
+    return nullptr;
+  }
+
+  if (type == NoiseModelType::DIAGONAL) {
+    return gtsam::noiseModel::Diagonal::Sigmas(Eigen::Map<const gtsam::Vector>(values.data(), values.size()));
+  }
+  if (type == NoiseModelType::SQRT_INFORMATION) {
+    const auto dim = static_cast<int>(std::lround(std::sqrt(values.size())));
+    if (static_cast<size_t>(dim * dim) != values.size()) {
+      return nullptr;
+    }
+    gtsam::Matrix R(dim, dim);
+    for (int rr = 0; rr < dim; rr++) {
+      for (int cc = 0; cc < dim; cc++) {
+        R(rr, cc) = values[rr * dim + cc];
+      }
+    }
+    return gtsam::noiseModel::Gaussian::SqrtInformation(R);
+  }
+  return nullptr;
+}
+
+template <typename VALUE>
+bool WritePrior(const FactorType type, const gtsam::PriorFactor<VALUE>& factor,
+                const std::vector<double>& prior, io::ByteWriter& writer) {
+  writer.write(type);
+  writer.write<uint64_t>(factor.keys().front());
+  writer.writeVector(prior);
+  return WriteNoiseModel(factor.noiseModel(), writer);
+}
+
+template <typename CALIBRATION>
+bool WriteSfmFactor(const FactorType type, const gtsam::GeneralSFMFactor2<CALIBRATION>& factor,
+                    io::ByteWriter& writer) {
+  writer.write(type);
+  for (const gtsam::Key key : factor.keys()) {
+    writer.write<uint64_t>(key);
+  }
+  const gtsam::Point2 measured = factor.measured();
+  writer.write(measured.x());
+  writer.write(measured.y());
+  return WriteNoiseModel(factor.noiseModel(), writer);
+}
+
+template <typename CALIBRATION>
+bool WriteTargetFactor(const FactorType type, const TargetProjectionFactor<CALIBRATION>& factor,
+                       io::ByteWriter& writer) {
+  writer.write(type);
+  for (const gtsam::Key key : factor.keys()) {
+    writer.write<uint64_t>(key);
+  }
+  const gtsam::Point2& measured = factor.measured();
+  const gtsam::Point3& pt3d_target = factor.targetPoint();
+  for (const double value : {measured.x(), measured.y(), pt3d_target.x(), pt3d_target.y(), pt3d_target.z()}) {
+    writer.write(value);
+  }
+  return WriteNoiseModel(factor.noiseModel(), writer);
+}
+
+/**
+ * @brief Return true if the factor was serialized. Return false for factor types the solver doesn't create
+ * and for noise models that can't be serialized.
+ *
+ */
+bool WriteFactor(const gtsam::NonlinearFactor::shared_ptr& factor, io::ByteWriter& writer) {
+  if (!factor) {
+    writer.write(FactorType::NONE);
+    return true;
+  }
+
+  if (const auto prior = std::dynamic_pointer_cast<gtsam::PriorFactor<gtsam::Pose3>>(factor)) {
+    return WritePrior(FactorType::PRIOR_POSE3, *prior, PoseToVector(prior->prior()), writer);
+  }
+  if (const auto prior = std::dynamic_pointer_cast<gtsam::PriorFactor<gtsam::Point3>>(factor)) {
+    const gtsam::Point3& pt3d = prior->prior();
+    return WritePrior(FactorType::PRIOR_POINT3, *prior, {pt3d.x(), pt3d.y(), pt3d.z()}, writer);
+  }
+  if (const auto prior = std::dynamic_pointer_cast<gtsam::PriorFactor<gtsam::Cal3_S2>>(factor)) {
+    return WritePrior(FactorType::PRIOR_CAL3_S2, *prior, CalibrationToVector(prior->prior()), writer);
+  }
+  if (const auto prior = std::dynamic_pointer_cast<gtsam::PriorFactor<gtsam::Cal3Fisheye>>(factor)) {
+    return WritePrior(FactorType::PRIOR_CAL3_FISHEYE, *prior, CalibrationToVector(prior->prior()), writer);
+  }
+  if (const auto sfm = std::dynamic_pointer_cast<gtsam::GeneralSFMFactor2<gtsam::Cal3_S2>>(factor)) {
+    return WriteSfmFactor(FactorType::SFM_CAL3_S2, *sfm, writer);
+  }
+  if (const auto sfm = std::dynamic_pointer_cast<gtsam::GeneralSFMFactor2<gtsam::Cal3Fisheye>>(factor)) {
+    return WriteSfmFactor(FactorType::SFM_CAL3_FISHEYE, *sfm, writer);
+  }
+  if (const auto target = std::dynamic_pointer_cast<TargetProjectionFactor<gtsam::Cal3_S2>>(factor)) {
+    return WriteTargetFactor(FactorType::TARGET_CAL3_S2, *target, writer);
+  }
+  if (const auto target = std::dynamic_pointer_cast<TargetProjectionFactor<gtsam::Cal3Fisheye>>(factor)) {
+    return WriteTargetFactor(FactorType::TARGET_CAL3_FISHEYE, *target, writer);
+  }
+  return false;
+}
+
+template <typename CALIBRATION>
+gtsam::NonlinearFactor::shared_ptr ReadSfmFactor(io::ByteReader& reader) {
+  uint64_t pose_key = 0, landmark_key = 0, calibration_key = 0;
+  double u = 0., v = 0.;
+  if (!reader.read(pose_key) || !reader.read(landmark_key) || !reader.read(calibration_key) ||
+      !reader.read(u) || !reader.read(v)) {
+    return nullptr;
+  }
+  const auto noise_model = ReadNoiseModel(reader);
+  if (!noise_model) {
+    return nullptr;
+  }
+  return std::make_shared<gtsam::GeneralSFMFactor2<CALIBRATION>>(gtsam::Point2(u, v), noise_model, pose_key,
+                                                                 landmark_key, calibration_key);
+}
+
+template <typename CALIBRATION>
+gtsam::NonlinearFactor::shared_ptr ReadTargetFactor(io::ByteReader& reader) {
+  uint64_t pose_key = 0, calibration_key = 0;
+  double values[5];
+  if (!reader.read(pose_key) || !reader.read(calibration_key) || !reader.readBytes(values, sizeof(values))) {
+    return nullptr;
+  }
+  const auto noise_model = ReadNoiseModel(reader);
+  if (!noise_model) {
+    return nullptr;
+  }
+  return std::make_shared<TargetProjectionFactor<CALIBRATION>>(
+      gtsam::Point2(values[0], values[1]), gtsam::Point3(values[2], values[3], values[4]), noise_model,
+      pose_key, calibration_key);
+}
+
+/**
+ * @brief Return true if a factor was read. The factor is null for FactorType::NONE.
+ *
+ */
+bool ReadFactor(io::ByteReader& reader, gtsam::NonlinearFactor::shared_ptr& factor) {
+  FactorType type;
+  if (!reader.read(type)) {
+    return false;
+  }
+  if (type == FactorType::NONE) {
+    factor = nullptr;
+    return true;
+  }
+  if (type == FactorType::SFM_CAL3_S2) {
+    factor = ReadSfmFactor<gtsam::Cal3_S2>(reader);
+    return factor != nullptr;
+  }
+  if (type == FactorType::SFM_CAL3_FISHEYE) {
+    factor = ReadSfmFactor<gtsam::Cal3Fisheye>(reader);
+    return factor != nullptr;
+  }
+  if (type == FactorType::TARGET_CAL3_S2) {
+    factor = ReadTargetFactor<gtsam::Cal3_S2>(reader);
+    return factor != nullptr;
+  }
+  if (type == FactorType::TARGET_CAL3_FISHEYE) {
+    factor = ReadTargetFactor<gtsam::Cal3Fisheye>(reader);
+    return factor != nullptr;
+  }
+
+  // Priors.
+  uint64_t key = 0;
+  std::vector<double> prior;
+  if (!reader.read(key) || !reader.readVector(prior)) {
+    return false;
+  }
+  const auto noise_model = ReadNoiseModel(reader);
+  if (!noise_model) {
+    return false;
+  }
+
+  if (type == FactorType::PRIOR_POSE3) {
+    gtsam::Pose3 pose;
+    if (!VectorToPose(prior, pose)) {
+      return false;
+    }
+    factor = std::make_shared<gtsam::PriorFactor<gtsam::Pose3>>(key, pose, noise_model);
+  } else if (type == FactorType::PRIOR_POINT3) {
+    if (prior.size() != 3) {
+      return false;
+    }
+    factor = std::make_shared<gtsam::PriorFactor<gtsam::Point3>>(
+        key, gtsam::Point3(prior[0], prior[1], prior[2]), noise_model);
+  } else if (type == FactorType::PRIOR_CAL3_S2) {
+    gtsam::Cal3_S2 K;
+    if (!VectorToCalibration(prior, K)) {
+      return false;
+    }
+    factor = std::make_shared<gtsam::PriorFactor<gtsam::Cal3_S2>>(key, K, noise_model);
+  } else if (type == FactorType::PRIOR_CAL3_FISHEYE) {
+    gtsam::Cal3Fisheye K;
+    if (!VectorToCalibration(prior, K)) {
+      return false;
+    }
+    factor = std::make_shared<gtsam::PriorFactor<gtsam::Cal3Fisheye>>(key, K, noise_model);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Return true if the estimate value for the key was serialized. Keys follow the solver's symbol
+ * convention: X(i) poses, L(i) landmarks and K(i) calibration of camera i.
+ *
+ */
+bool WriteValue(const gtsam::Key key, const gtsam::Values& values,
+                const std::vector<std::shared_ptr<Camera>>& cameras, io::ByteWriter& writer) {
+  const gtsam::Symbol symbol(key);
+  std::vector<double> vec;
+  if (symbol.chr() == 'x') {
+    vec = PoseToVector(values.at<gtsam::Pose3>(key));
+  } else if (symbol.chr() == 'l') {
+    const gtsam::Point3 pt3d = values.at<gtsam::Point3>(key);
+    vec = {pt3d.x(), pt3d.y(), pt3d.z()};
+  } else if (symbol.chr() == 'k' && symbol.index() < cameras.size()) {
+    const auto model_type = cameras.at(symbol.index())->modelType();
+    if (model_type == Camera::ModelType::CAL3_S2) {
+      vec = CalibrationToVector(values.at<gtsam::Cal3_S2>(key));
+    } else if (model_type == Camera::ModelType::CAL3_FISHEYE) {
+      vec = CalibrationToVector(values.at<gtsam::Cal3Fisheye>(key));
+    }
+  }
+  if (vec.empty()) {
+    return false;
+  }
+  writer.write<uint64_t>(key);
+  writer.writeVector(vec);
+  return true;
+}
+
+bool ReadValue(io::ByteReader& reader, const std::vector<std::shared_ptr<Camera>>& cameras,
+               gtsam::Values& values) {
+  uint64_t key = 0;
+  std::vector<double> vec;
+  if (!reader.read(key) || !reader.readVector(vec)) {
+    return false;
+  }
+
+  const gtsam::Symbol symbol(key);
+  if (symbol.chr() == 'x') {
+    gtsam::Pose3 pose;
+    if (!VectorToPose(vec, pose)) {
+      return false;
+    }
+    values.insert(key, pose);
+  } else if (symbol.chr() == 'l' && vec.size() == 3) {
+    values.insert(key, gtsam::Point3(vec[0], vec[1], vec[2]));
+  } else if (symbol.chr() == 'k' && symbol.index() < cameras.size()) {
+    const auto model_type = cameras.at(symbol.index())->modelType();
+    if (model_type == Camera::ModelType::CAL3_S2) {
+      gtsam::Cal3_S2 K;
+      if (!VectorToCalibration(vec, K)) {
+        return false;
+      }
+      values.insert(key, K);
+    } else {
+      gtsam::Cal3Fisheye K;
+      if (!VectorToCalibration(vec, K)) {
+        return false;
+      }
+      values.insert(key, K);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Contents of a single record.
+struct Record {
+  std::vector<std::shared_ptr<Camera>> cameras;
+  std::vector<size_t> num_camera_updates;
+  std::unordered_map<size_t, size_t> camera_indices;
+  size_t num_frames = 0;
+  std::vector<gtsam::Vector> calibration_sigmas;
+  std::vector<size_t> calibration_converged_checks;
+  std::vector<bool> calibration_frozen;
+  size_t num_variables_relinearized = 0;
+  gtsam::NonlinearFactorGraph factors;
+  gtsam::Values values;
+};
+
+/**
+ * @brief Return true if the record was serialized and framed. Return false if it holds a factor, noise
+ * model or value that can't be checkpointed.
+ *
+ */
+bool WriteRecord(const RecordType type, const Record& record, io::ByteWriter& writer) {
+  io::ByteWriter payload;
+
+  // Cameras, counters and calibration convergence tracking.
+  payload.write<uint64_t>(record.num_frames);
+  payload.write<uint64_t>(record.num_variables_relinearized);
+  payload.write<uint32_t>(static_cast<uint32_t>(record.cameras.size()));
+  for (size_t ii = 0; ii < record.cameras.size(); ii++) {
+    WriteCamera(*record.cameras.at(ii), payload);
+    payload.write<uint64_t>(record.num_camera_updates.at(ii));
+    const gtsam::Vector& sigmas = record.calibration_sigmas.at(ii);
+    payload.writeVector(std::vector<double>(sigmas.data(), sigmas.data() + sigmas.size()));
+    payload.write<uint64_t>(record.calibration_converged_checks.at(ii));
+    payload.write<uint8_t>(record.calibration_frozen.at(ii) ? 1 : 0);
+  }
+  payload.write<uint32_t>(static_cast<uint32_t>(record.camera_indices.size()));
+  for (const auto& [camera_id, camera_index] : record.camera_indices) {
+    payload.write<uint64_t>(camera_id);
+    payload.write<uint64_t>(camera_index);
+  }
+
+  // New factors.
+  payload.write<uint64_t>(record.factors.size());
+  for (const auto& factor : record.factors) {
+    if (!WriteFactor(factor, payload)) {
+      return false;
+    }
+  }
+
+  // Estimate values.
+  payload.write<uint64_t>(record.values.size());
+  for (const gtsam::Key key : record.values.keys()) {
+    if (!WriteValue(key, record.values, record.cameras, payload)) {
+      return false;
+    }
+  }
+
+  // Frame the payload.
+  writer.write(type);
+  writer.write<uint64_t>(payload.size());
+  writer.write(io::Fnv1a32(payload.buffer().data(), payload.size()));
+  writer.writeBytes(payload.buffer().data(), payload.size());
+  return true;
+}
+
+bool ReadRecord(io::ByteReader& reader, Record& record) {
+  // Cameras, counters and calibration convergence tracking.
+  uint64_t num_frames = 0, num_variables_relinearized = 0;
+  uint32_t num_cameras = 0;
+  if (!reader.read(num_frames) || !reader.read(num_variables_relinearized) || !reader.read(num_cameras)) {
+    return false;
+  }
+  record.num_frames = num_frames;
+  record.num_variables_relinearized = num_variables_relinearized;
+  for (uint32_t ii = 0; ii < num_cameras; ii++) {
+    auto camera = ReadCamera(reader);
+    uint64_t num_updates = 0, converged_checks = 0;
+    std::vector<double> sigmas;
+    uint8_t frozen = 0;
+    if (!camera || !reader.read(num_updates) || !reader.readVector(sigmas) ||
+        !reader.read(converged_checks) || !reader.read(frozen)) {
+      return false;
+    }
+    record.cameras.push_back(std::move(camera));
+    record.num_camera_updates.push_back(num_updates);
+    record.calibration_sigmas.push_back(Eigen::Map<const gtsam::Vector>(sigmas.data(), sigmas.size()));
+    record.calibration_converged_checks.push_back(converged_checks);
+    record.calibration_frozen.push_back(frozen != 0);
+  }
+  uint32_t num_camera_indices = 0;
+  if (!reader.read(num_camera_indices)) {
+    return false;
+  }
+  for (uint32_t ii = 0; ii < num_camera_indices; ii++) {
+    uint64_t camera_id = 0, camera_index = 0;
+    if (!reader.read(camera_id) || !reader.read(camera_index)) {
+      return false;
+    }
+    record.camera_indices.emplace(camera_id, camera_index);
+  }
+
+  // New factors.
+  uint64_t num_factors = 0;
+  if (!reader.read(num_factors)) {
+    return false;
+  }
+  for (uint64_t ii = 0; ii < num_factors; ii++) {
+    gtsam::NonlinearFactor::shared_ptr factor;
+    if (!ReadFactor(reader, factor)) {
+      return false;
+    }
+    record.factors.push_back(factor);
+  }
+
+  // Estimate values.
+  uint64_t num_values = 0;
+  if (!reader.read(num_values)) {
+    return false;
+  }
+  for (uint64_t ii = 0; ii < num_values; ii++) {
+    if (!ReadValue(reader, record.cameras, record.values)) {
+      return false;
+    }
+  }
+  return reader.remaining() == 0;
+}
+
+}  // namespace
+
+// Copy of what changed in the state, taken by append() so the solver can keep updating it while the
+// record is serialized.
+struct CheckpointWriter::Snapshot {
+  RecordType type = RecordType::DELTA;
+  Record record;
+};
+
+CheckpointWriter::CheckpointWriter(const std::string& path) : CheckpointWriter(path, Options()) {}
+
+CheckpointWriter::CheckpointWriter(const std::string& path, const Options& options)
+  : options_(options), file_(path, std::ios::binary | std::ios::trunc) {
+  if (!file_.is_open()) {
+    return;
+  }
+
+  // Write the file header.
+  io::ByteWriter writer;
+  writer.writeBytes(kCheckpointMagic, sizeof(kCheckpointMagic));
+  writer.write(kCheckpointVersion);
+  writer.write<uint32_t>(0);
+  file_.write(writer.buffer().data(), writer.size());
+  file_.flush();
+
+  if (options_.async) {
+    writer_thread_ = std::thread(&CheckpointWriter::run, this);
+  }
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  if (writer_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    writer_thread_.join();
+  }
+}
+
+bool CheckpointWriter::append(const BatchSolver::State& state) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open() || failed_) {
+      return false;
+    }
+  }
+
+  const bool full =
+      options_.full_snapshot_interval <= 1 || num_records_ % options_.full_snapshot_interval == 0;
+  auto snapshot = std::make_unique<Snapshot>();
+  snapshot->type = full ? RecordType::FULL : RecordType::DELTA;
+  Record& record = snapshot->record;
+
+  // Cameras, counters and calibration convergence tracking. The cameras are cloned since the solver keeps
+  // updating their poses.
+  record.cameras.reserve(state.numCameras());
+  for (const auto& camera : state.cameras) {
+    record.cameras.push_back(camera->clone());
+  }
+  record.num_camera_updates = state.num_camera_updates;
+  record.camera_indices = state.camera_indices;
+  record.num_frames = state.num_frames;
+  record.calibration_sigmas = state.calibration_sigmas;
+  record.calibration_converged_checks = state.calibration_converged_checks;
+  record.calibration_frozen = state.calibration_frozen;
+  record.num_variables_relinearized = state.num_variables_relinearized;
+
+  // Factors added since the last record. Factors are immutable once added, so sharing them is enough.
+  for (size_t ii = num_factors_written_; ii < state.graph.size(); ii++) {
+    record.factors.push_back(state.graph.at(ii));
+  }
+
+  // Estimate values. DELTA records only hold keys that weren't written before.
+  if (full) {
+    record.values = state.current_estimate;
+  } else {
+    for (const gtsam::Key key : state.current_estimate.keys()) {
+      if (keys_written_.count(key) == 0) {
+        record.values.insert(key, state.current_estimate.at(key));
+      }
+    }
+  }
+
+  num_factors_written_ = state.graph.size();
+  const gtsam::KeyVector keys = record.values.keys();
+  keys_written_.insert(keys.begin(), keys.end());
+  num_records_++;
+  return write(std::move(snapshot));
+}
+
+bool CheckpointWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return (pending_.empty() && !writing_) || !writer_thread_.joinable(); });
+  return file_.is_open() && !failed_;
+}
+
+bool CheckpointWriter::write(std::unique_ptr<Snapshot> snapshot) {
+  if (!options_.async) {
+    failed_ = !writeRecord(*snapshot);
+    return !failed_;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(snapshot));
+  }
+  cv_.notify_all();
+  return true;
+}
+
+bool CheckpointWriter::writeRecord(const Snapshot& snapshot) {
+  io::ByteWriter record;
+  if (!WriteRecord(snapshot.type, snapshot.record, record)) {
+    return false;
+  }
+  file_.write(record.buffer().data(), record.size());
+  file_.flush();
+  return file_.good();
+}
+
+void CheckpointWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cv_.wait(lock, [this]() { return !pending_.empty() || stop_; });
+    if (pending_.empty() && stop_) {
+      break;
+    }
+
+    // Serialize and write without holding the lock so append() never waits on either. Records after a
+    // failed one are dropped since their deltas would build on a record that isn't in the file.
+    std::unique_ptr<Snapshot> snapshot = std::move(pending_.front());
+    pending_.pop_front();
+    const bool skip = failed_;
+    writing_ = true;
+    lock.unlock();
+    const bool good = !skip && writeRecord(*snapshot);
+    snapshot.reset();
+    lock.lock();
+    writing_ = false;
+    failed_ = failed_ || !good;
+    cv_.notify_all();
+  }
+}
+
+std::unique_ptr<BatchSolver::State> LoadCheckpoint(const std::string& path,
+                                                    const BatchSolver::Options& options) {
+  // Read the whole file at once.
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return nullptr;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  const std::string contents = ss.str();
+  io::ByteReader reader(contents);
+
+  // Check the header.
+  char magic[sizeof(kCheckpointMagic)];
+  uint32_t version = 0, reserved = 0;
+  if (!reader.readBytes(magic, sizeof(magic)) || std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0 ||
+      !reader.read(version) || version != kCheckpointVersion || !reader.read(reserved)) {
+    return nullptr;
+  }
+
+  // Read records until the end of the file or the first incomplete one.
+  Record latest;
+  gtsam::NonlinearFactorGraph graph;
+  gtsam::Values values;
+  bool has_record = false;
+  while (reader.remaining() > 0) {
+    RecordType type;
+    uint64_t size = 0;
+    uint32_t checksum = 0;
+    if (!reader.read(type) || !reader.read(size) || !reader.read(checksum) || size > kMaxRecordSize ||
+        size > reader.remaining() || io::Fnv1a32(reader.current(), size) != checksum) {
+      break;
+    }
+    io::ByteReader payload(reader.current(), size);
+    reader.skip(size);
+
+    Record record;
+    if (!ReadRecord(payload, record)) {
+      break;
+    }
+
+    // Apply the record.
+    graph.push_back(record.factors.begin(), record.factors.end());
+    for (const gtsam::Key key : record.values.keys()) {
+      if (values.exists(key)) {
+        values.update(key, record.values.at(key));
+      } else {
+        values.insert(key, record.values.at(key));
+      }
+    }
+    latest = std::move(record);
+    has_record = true;
+  }
+  if (!has_record || latest.cameras.empty()) {
+    return nullptr;
+  }
+
+  // Rebuild the state and update iSAM once from the stored estimate.
+  auto state = std::make_unique<BatchSolver::State>(latest.cameras, options);
+  state->num_camera_updates = latest.num_camera_updates;
+  state->camera_indices = latest.camera_indices;
+  state->num_frames = latest.num_frames;
+  state->calibration_sigmas = latest.calibration_sigmas;
+  state->calibration_converged_checks = latest.calibration_converged_checks;
+  state->calibration_frozen = latest.calibration_frozen;
+  state->num_variables_relinearized = latest.num_variables_relinearized;
+  state->graph = graph;
+  state->isam.update(graph, values);
+  state->current_estimate = state->isam.calculateEstimate();
+  return state;
+}
+
+void WriteCamera(const Camera& camera, io::ByteWriter& writer) {
+  writer.write(static_cast<uint8_t>(camera.modelType()));
+  writer.write<uint64_t>(camera.width());
+  writer.write<uint64_t>(camera.height());
+  std::visit([&writer](auto&& arg) -> void { writer.writeVector(CalibrationToVector(arg->calibration())); },
+             camera.cameraVariant());
+  writer.writeVector(PoseToVector(camera.pose()));
+}
+
+std::shared_ptr<Camera> ReadCamera(io::ByteReader& reader) {
+  uint8_t model_type = 0;
+  uint64_t width = 0, height = 0;
+  std::vector<double> calibration, pose_vec;
+  gtsam::Pose3 pose;
+  if (!reader.read(model_type) || !reader.read(width) || !reader.read(height) ||
+      !reader.readVector(calibration) || !reader.readVector(pose_vec) || !VectorToPose(pose_vec, pose)) {
+    return nullptr;
+  }
+
+  auto camera = std::make_shared<Camera>();
+  if (model_type == static_cast<uint8_t>(Camera::ModelType::CAL3_S2)) {
+    gtsam::Cal3_S2 K;
+    if (!VectorToCalibration(calibration, K)) {
+      return nullptr;
+    }
+    camera->setCameraModel<gtsam::Cal3_S2>(width, height, K, pose);
+  } else if (model_type == static_cast<uint8_t>(Camera::ModelType::CAL3_FISHEYE)) {
+    gtsam::Cal3Fisheye K;
+    if (!VectorToCalibration(calibration, K)) {
+      return nullptr;
+    }
+    camera->setCameraModel<gtsam::Cal3Fisheye>(width, height, K, pose);
+  } else {
+    return nullptr;
+  }
+  return camera;
+}
+
+}  // namespace gtcal
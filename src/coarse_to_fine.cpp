@@ -0,0 +1,138 @@
+#include "gtcal/coarse_to_fine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace gtcal {
+namespace {
+
+// Largest grid is 2^kMaxGridBits cells on a side.
+static constexpr uint32_t kMaxGridBits = 8;
+
+/**
+ * @brief Return the Morton code of a cell, the bits of x and y interleaved with x in the even bits.
+ *
+ */
+uint32_t Morton(const uint32_t x, const uint32_t y, const uint32_t bits) {
+  uint32_t code = 0;
+  for (uint32_t bb = 0; bb < bits; bb++) {
+    code |= ((x >> bb) & 1u) << (2 * bb);
+    code |= ((y >> bb) & 1u) << (2 * bb + 1);
+  }
+  return code;
+}
+
+/**
+ * @brief Return the lowest num_bits bits of value in reverse order.
+ *
+ */
+uint32_t ReverseBits(const uint32_t value, const uint32_t num_bits) {
+  uint32_t reversed = 0;
+  for (uint32_t bb = 0; bb < num_bits; bb++) {
+    reversed |= ((value >> bb) & 1u) << (num_bits - 1 - bb);
+  }
+  return reversed;
+}
+
+/**
+ * @brief Return the index of the grid cell of a coordinate.
+ *
+ */
+uint32_t Cell(const float value, const float min, const float scale, const uint32_t grid) {
+  const auto cell = static_cast<int64_t>((value - min) * scale);
+  return static_cast<uint32_t>(std::clamp<int64_t>(cell, 0, grid - 1));
+}
+
+/**
+ * @brief Implementation of StratifiedOrder() over pixel coordinate arrays.
+ *
+ */
+std::vector<uint32_t> StratifiedOrderImpl(const float* u, const float* v, const size_t size) {
+  std::vector<uint32_t> order;
+  if (size == 0) {
+    return order;
+  }
+
+  // Grid of 2^bits x 2^bits cells over the bounding box of the measurements, about two measurements per cell.
+  uint32_t bits = 0;
+  while (bits < kMaxGridBits && (size_t{1} << (2 * (bits + 1))) <= size / 2) {
+    bits++;
+  }
+  const uint32_t grid = 1u << bits;
+  const auto [u_min, u_max] = std::minmax_element(u, u + size);
+  const auto [v_min, v_max] = std::minmax_element(v, v + size);
+  const float u_scale = *u_max > *u_min ? static_cast<float>(grid) / (*u_max - *u_min) : 0.f;
+  const float v_scale = *v_max > *v_min ? static_cast<float>(grid) / (*v_max - *v_min) : 0.f;
+
+  // Bucket the measurements by the rank of their cell, keeping their order within a cell.
+  std::vector<uint32_t> ranks(size);
+  std::vector<uint32_t> bucket_begin(grid * grid + 1, 0);
+  for (size_t ii = 0; ii < size; ii++) {
+    const uint32_t x = Cell(u[ii], *u_min, u_scale, grid);
+    const uint32_t y = Cell(v[ii], *v_min, v_scale, grid);
+    ranks[ii] = ReverseBits(Morton(x, y, bits), 2 * bits);
+    bucket_begin[ranks[ii] + 1]++;
+  }
+  for (size_t rr = 0; rr < grid * grid; rr++) {
+    bucket_begin[rr + 1] += bucket_begin[rr];
+  }
+  std::vector<uint32_t> buckets(size);
+  std::vector<uint32_t> bucket_end(bucket_begin.begin(), bucket_begin.end() - 1);
+  for (size_t ii = 0; ii < size; ii++) {
+    buckets[bucket_end[ranks[ii]]++] = static_cast<uint32_t>(ii);
+  }
+
+  // Take the next measurement of every non-empty cell in rank order, dropping the cells that run out.
+  std::vector<uint32_t> cells;
+  for (uint32_t rr = 0; rr < grid * grid; rr++) {
+    if (bucket_end[rr] > bucket_begin[rr]) {
+      cells.push_back(rr);
+    }
+  }
+  order.reserve(size);
+  while (!cells.empty()) {
+    size_t num_left = 0;
+    for (const uint32_t rr : cells) {
+      order.push_back(buckets[bucket_begin[rr]++]);
+      if (bucket_begin[rr] < bucket_end[rr]) {
+        cells[num_left++] = rr;
+      }
+    }
+    cells.resize(num_left);
+  }
+  assert(order.size() == size);
+  return order;
+}
+
+}  // namespace
+
+std::vector<size_t> CoarseToFineLevels(const size_t num_measurements, const CoarseToFineOptions& options) {
+  assert(options.growth_factor > 1.0 && options.initial_measurements > 0);
+  std::vector<size_t> levels;
+  if (options.enabled && num_measurements >= options.min_measurements) {
+    for (double size = static_cast<double>(options.initial_measurements);
+         size < static_cast<double>(num_measurements); size *= options.growth_factor) {
+      levels.push_back(static_cast<size_t>(size));
+    }
+  }
+  levels.push_back(num_measurements);
+  return levels;
+}
+
+std::vector<uint32_t> StratifiedOrder(const std::vector<Measurement>& measurements) {
+  std::vector<float> u, v;
+  u.reserve(measurements.size());
+  v.reserve(measurements.size());
+  for (const Measurement& meas : measurements) {
+    u.push_back(static_cast<float>(meas.uv.x()));
+    v.push_back(static_cast<float>(meas.uv.y()));
+  }
+  return StratifiedOrderImpl(u.data(), v.data(), measurements.size());
+}
+
+std::vector<uint32_t> StratifiedOrder(const MeasurementSpan& measurements) {
+  return StratifiedOrderImpl(measurements.u(), measurements.v(), measurements.size());
+}
+
+}  // namespace gtcal
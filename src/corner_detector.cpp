@@ -0,0 +1,406 @@
+#include "gtcal/corner_detector.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <thread>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gtcal {
+namespace {
+
+// ChESS sampling ring: 16 pixels on a circle of radius 5, ordered by angle so that sample n + 8 is opposite
+// sample n and sample n + 4 is a quarter turn away.
+static constexpr int kRingRadius = 5;
+static constexpr std::array<std::array<int, 2>, 16> kRing = {{{5, 0}, {5, 2}, {4, 4}, {2, 5}, {0, 5}, {-2, 5},
+                                                               {-4, 4}, {-5, 2}, {-5, 0}, {-5, -2}, {-4, -4},
+                                                               {-2, -5}, {0, -5}, {2, -5}, {4, -4}, {5, -2}}};
+
+// Radius of the window whose response centroid is the sub-pixel candidate.
+static constexpr int kPeakRadius = 2;
+
+/**
+ * @brief Return the ChESS response of a pixel at least kRingRadius pixels from the border:
+ *
+ *   sum response:  sum_{n < 4} |I_n + I_{n+8} - I_{n+4} - I_{n+12}|, high at the X of a corner.
+ *   diff response: sum_{n < 8} |I_n - I_{n+8}|, high on edges.
+ *   mean response: |ring sum - 4 * sum of the 4 neighbours|, high on blobs and off-center corners.
+ *
+ * The response is sum - diff - mean and fits in an int16_t.
+ */
+int16_t ResponseAt(const uint8_t* center, const ptrdiff_t stride) {
+  int ring[16];
+  int ring_sum = 0;
+  for (size_t n = 0; n < 16; n++) {
+    ring[n] = center[kRing[n][1] * stride + kRing[n][0]];
+    ring_sum += ring[n];
+  }
+  int sum_response = 0;
+  for (size_t n = 0; n < 4; n++) {
+    sum_response += std::abs(ring[n] + ring[n + 8] - ring[n + 4] - ring[n + 12]);
+  }
+  int diff_response = 0;
+  for (size_t n = 0; n < 8; n++) {
+    diff_response += std::abs(ring[n] - ring[n + 8]);
+  }
+  const int local_sum = center[-1] + center[1] + center[-stride] + center[stride];
+  const int mean_response = std::abs(ring_sum - 4 * local_sum);
+  return static_cast<int16_t>(sum_response - diff_response - mean_response);
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Compute the response of the pixels [x_begin, x_end) of a row, 8 at a time. Return the first pixel
+ * left for the scalar code.
+ *
+ */
+size_t ResponseRowSse2(const uint8_t* row, const ptrdiff_t stride, const size_t x_begin, const size_t x_end,
+                       int16_t* response) {
+  const __m128i zero = _mm_setzero_si128();
+  const auto load = [&](const uint8_t* pixels) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels)), zero);
+  };
+  // SSE2 has no 16-bit absolute value.
+  const auto abs = [&](const __m128i value) { return _mm_max_epi16(value, _mm_sub_epi16(zero, value)); };
+
+  size_t x = x_begin;
+  for (; x + 8 <= x_end; x += 8) {
+    const uint8_t* center = row + x;
+    __m128i ring[16];
+    __m128i ring_sum = zero;
+    for (size_t n = 0; n < 16; n++) {
+      ring[n] = load(center + kRing[n][1] * stride + kRing[n][0]);
+      ring_sum = _mm_add_epi16(ring_sum, ring[n]);
+    }
+    __m128i result = zero;
+    for (size_t n = 0; n < 4; n++) {
+      const __m128i sum =
+          _mm_sub_epi16(_mm_add_epi16(ring[n], ring[n + 8]), _mm_add_epi16(ring[n + 4], ring[n + 12]));
+      result = _mm_add_epi16(result, abs(sum));
+    }
+    for (size_t n = 0; n < 8; n++) {
+      result = _mm_sub_epi16(result, abs(_mm_sub_epi16(ring[n], ring[n + 8])));
+    }
+    const __m128i local_sum = _mm_add_epi16(_mm_add_epi16(load(center - 1), load(center + 1)),
+                                            _mm_add_epi16(load(center - stride), load(center + stride)));
+    result = _mm_sub_epi16(result, abs(_mm_sub_epi16(ring_sum, _mm_slli_epi16(local_sum, 2))));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(response + x), result);
+  }
+  return x;
+}
+#endif
+
+/**
+ * @brief Return the bilinearly interpolated intensity at a point inside the image.
+ *
+ */
+double Sample(const Image& image, const gtsam::Point2& uv) {
+  const double x = std::clamp(uv.x(), 0.0, image.width - 1.001);
+  const double y = std::clamp(uv.y(), 0.0, image.height - 1.001);
+  const size_t x0 = static_cast<size_t>(x), y0 = static_cast<size_t>(y);
+  const double fx = x - x0, fy = y - y0;
+  return (1.0 - fy) * ((1.0 - fx) * image.at(x0, y0) + fx * image.at(x0 + 1, y0)) +
+         fy * ((1.0 - fx) * image.at(x0, y0 + 1) + fx * image.at(x0 + 1, y0 + 1));
+}
+
+double Cross(const gtsam::Point2& a, const gtsam::Point2& b) { return a.x() * b.y() - a.y() * b.x(); }
+
+// Grid node: grid coordinates, candidate and the local grid steps along a and b.
+struct GridNode {
+  int a = 0;
+  int b = 0;
+  size_t candidate = 0;
+  gtsam::Point2 step_a;
+  gtsam::Point2 step_b;
+};
+
+// Map from grid coordinates (a, b) to target (col, row).
+using Labelling = std::function<std::pair<int, int>(int, int)>;
+
+}  // namespace
+
+CornerDetector::CornerDetector(const utils::CalibrationTarget& target, const Options& options)
+  : num_rows_(target.numRows()), num_cols_(target.numCols()), options_(options) {}
+
+CornerDetector::CornerDetector(const utils::CalibrationTarget& target) : CornerDetector(target, Options()) {}
+
+void CornerDetector::CornerResponse(const Image& image, std::vector<int16_t>& response) {
+  response.assign(image.width * image.height, 0);
+  if (image.width <= 2 * kRingRadius || image.height <= 2 * kRingRadius) {
+    return;
+  }
+
+  const auto stride = static_cast<ptrdiff_t>(image.width);
+  const size_t x_begin = kRingRadius, x_end = image.width - kRingRadius;
+  for (size_t y = kRingRadius; y < image.height - kRingRadius; y++) {
+    const uint8_t* row = image.row(y);
+    int16_t* response_row = response.data() + y * image.width;
+    size_t x = x_begin;
+#if defined(__SSE2__)
+    x = ResponseRowSse2(row, stride, x_begin, x_end, response_row);
+#endif
+    for (; x < x_end; x++) {
+      response_row[x] = ResponseAt(row + x, stride);
+    }
+  }
+}
+
+std::vector<gtsam::Point2> CornerDetector::findCandidates(const Image& image) const {
+  std::vector<int16_t> response;
+  CornerResponse(image, response);
+  std::vector<gtsam::Point2> candidates;
+  const int16_t max_response = response.empty() ? 0 : *std::max_element(response.begin(), response.end());
+  const double threshold =
+      std::max(static_cast<double>(options_.min_response), options_.min_relative_response * max_response);
+  if (max_response <= 0 || max_response < threshold) {
+    return candidates;
+  }
+
+  // Keep the local maxima, the first one in scan order on ties.
+  const size_t width = image.width, height = image.height;
+  const size_t radius = std::max<size_t>(options_.nms_radius, 1);
+  const auto at = [&](const size_t x, const size_t y) { return response[y * width + x]; };
+  for (size_t y = kRingRadius; y < height - kRingRadius; y++) {
+    for (size_t x = kRingRadius; x < width - kRingRadius; x++) {
+      const int16_t value = at(x, y);
+      if (value < threshold) {
+        continue;
+      }
+      bool is_max = true;
+      for (size_t yy = y - std::min(y, radius); yy <= std::min(y + radius, height - 1) && is_max; yy++) {
+        for (size_t xx = x - std::min(x, radius); xx <= std::min(x + radius, width - 1); xx++) {
+          const int16_t other = at(xx, yy);
+          if (other > value || (other == value && (yy < y || (yy == y && xx < x)))) {
+            is_max = false;
+            break;
+          }
+        }
+      }
+      if (is_max) {
+        // Centroid of the positive response around the peak, which lies within the ring radius of the border.
+        double sum = 0.0, sum_x = 0.0, sum_y = 0.0;
+        for (int dy = -kPeakRadius; dy <= kPeakRadius; dy++) {
+          for (int dx = -kPeakRadius; dx <= kPeakRadius; dx++) {
+            const double weight = std::max<int16_t>(at(x + dx, y + dy), 0);
+            sum += weight;
+            sum_x += weight * dx;
+            sum_y += weight * dy;
+          }
+        }
+        candidates.emplace_back(x + sum_x / sum, y + sum_y / sum);
+      }
+    }
+  }
+  return candidates;
+}
+
+bool CornerDetector::detect(const Image& image, const size_t camera_id,
+                            std::vector<Measurement>& measurements) const {
+  measurements.clear();
+  const std::vector<gtsam::Point2> candidates = findCandidates(image);
+  if (candidates.size() < num_rows_ * num_cols_) {
+    return false;
+  }
+  return fitGrid(image, candidates, camera_id, measurements);
+}
+
+size_t CornerDetector::detect(const std::vector<Image>& images, const size_t camera_id,
+                              std::vector<std::vector<Measurement>>& measurements) const {
+  measurements.assign(images.size(), {});
+  const size_t max_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  const size_t num_threads = std::clamp<size_t>(images.size(), 1, max_threads);
+
+  // Images are handed out one at a time, so slow images don't hold up a fixed share of the work.
+  std::atomic<size_t> next_image{0};
+  std::atomic<size_t> num_detected{0};
+  const auto worker = [&]() {
+    for (size_t ii = next_image.fetch_add(1); ii < images.size(); ii = next_image.fetch_add(1)) {
+      if (detect(images.at(ii), camera_id, measurements.at(ii))) {
+        num_detected.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t tt = 0; tt < num_threads; tt++) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return num_detected.load();
+}
+
+bool CornerDetector::fitGrid(const Image& image, const std::vector<gtsam::Point2>& candidates,
+                             const size_t camera_id, std::vector<Measurement>& measurements) const {
+  // Candidates sorted by x, to find the ones close to a point.
+  std::vector<size_t> by_x(candidates.size());
+  std::iota(by_x.begin(), by_x.end(), 0);
+  std::sort(by_x.begin(), by_x.end(),
+            [&](const size_t lhs, const size_t rhs) { return candidates[lhs].x() < candidates[rhs].x(); });
+  const auto nearest = [&](const gtsam::Point2& point, const double radius, const std::vector<bool>& used) {
+    auto it = std::lower_bound(by_x.begin(), by_x.end(), point.x() - radius,
+                               [&](const size_t index, const double x) { return candidates[index].x() < x; });
+    size_t best = candidates.size();
+    double best_distance = radius;
+    for (; it != by_x.end() && candidates[*it].x() <= point.x() + radius; it++) {
+      const double distance = (candidates[*it] - point).norm();
+      if (!used[*it] && distance < best_distance) {
+        best = *it;
+        best_distance = distance;
+      }
+    }
+    return best;
+  };
+
+  // Seeds are tried from the center of the candidates outwards, in case the first ones are spurious.
+  const gtsam::Point2 centroid =
+      std::accumulate(candidates.begin(), candidates.end(), gtsam::Point2(0.0, 0.0)) / candidates.size();
+  std::vector<size_t> seeds(candidates.size());
+  std::iota(seeds.begin(), seeds.end(), 0);
+  std::sort(seeds.begin(), seeds.end(), [&](const size_t lhs, const size_t rhs) {
+    return (candidates[lhs] - centroid).squaredNorm() < (candidates[rhs] - centroid).squaredNorm();
+  });
+  seeds.resize(std::min<size_t>(seeds.size(), 5));
+
+  const size_t num_points = num_rows_ * num_cols_;
+  for (const size_t seed : seeds) {
+    // Grid directions at the seed: its nearest neighbour, and the nearest one in another direction.
+    std::vector<size_t> neighbours(candidates.size());
+    std::iota(neighbours.begin(), neighbours.end(), 0);
+    std::sort(neighbours.begin(), neighbours.end(), [&](const size_t lhs, const size_t rhs) {
+      return (candidates[lhs] - candidates[seed]).squaredNorm() <
+             (candidates[rhs] - candidates[seed]).squaredNorm();
+    });
+    const gtsam::Point2 step_a = candidates[neighbours.at(1)] - candidates[seed];
+    gtsam::Point2 step_b(0.0, 0.0);
+    for (size_t ii = 2; ii < std::min<size_t>(neighbours.size(), 9); ii++) {
+      const gtsam::Point2 step = candidates[neighbours[ii]] - candidates[seed];
+      const double ratio = step.norm() / step_a.norm();
+      if (std::abs(step.dot(step_a)) < 0.5 * step.norm() * step_a.norm() && ratio > 0.5 && ratio < 2.0) {
+        step_b = Cross(step_a, step) > 0.0 ? step : gtsam::Point2(-step);
+        break;
+      }
+    }
+    if (step_b.isZero()) {
+      continue;
+    }
+
+    // Grow the grid breadth-first, predicting each neighbour from the local grid steps.
+    std::vector<GridNode> nodes = {{0, 0, seed, step_a, step_b}};
+    std::map<std::pair<int, int>, size_t> grid = {{{0, 0}, 0}};
+    std::vector<bool> used(candidates.size(), false);
+    used[seed] = true;
+    static constexpr std::array<std::array<int, 2>, 4> kDirections = {{{1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+    for (size_t head = 0; head < nodes.size() && nodes.size() <= num_points; head++) {
+      const GridNode node = nodes[head];
+      for (const auto& [da, db] : kDirections) {
+        if (grid.count({node.a + da, node.b + db}) > 0) {
+          continue;
+        }
+        const gtsam::Point2 step = da * node.step_a + db * node.step_b;
+        const size_t next = nearest(candidates[node.candidate] + step,
+                                    options_.max_prediction_error * step.norm(), used);
+        if (next == candidates.size()) {
+          continue;
+        }
+        GridNode next_node{node.a + da, node.b + db, next, node.step_a, node.step_b};
+        const gtsam::Point2 actual_step = candidates[next] - candidates[node.candidate];
+        (da != 0 ? next_node.step_a : next_node.step_b) = (da != 0 ? da : db) * actual_step;
+        grid[{next_node.a, next_node.b}] = nodes.size();
+        used[next] = true;
+        nodes.push_back(next_node);
+      }
+    }
+    if (nodes.size() > num_points) {
+      continue;
+    }
+
+    // Labellings that match the target's dimensions and keep the handedness of the grid.
+    int a_min = 0, a_max = 0, b_min = 0, b_max = 0;
+    for (const auto& node : nodes) {
+      a_min = std::min(a_min, node.a), a_max = std::max(a_max, node.a);
+      b_min = std::min(b_min, node.b), b_max = std::max(b_max, node.b);
+    }
+    const auto size_a = static_cast<size_t>(a_max - a_min + 1);
+    const auto size_b = static_cast<size_t>(b_max - b_min + 1);
+    std::vector<Labelling> labellings;
+    if (size_a == num_cols_ && size_b == num_rows_) {
+      labellings.push_back([=](int a, int b) { return std::make_pair(a - a_min, b - b_min); });
+      labellings.push_back([=](int a, int b) { return std::make_pair(a_max - a, b_max - b); });
+    }
+    if (size_a == num_rows_ && size_b == num_cols_) {
+      labellings.push_back([=](int a, int b) { return std::make_pair(b - b_min, a_max - a); });
+      labellings.push_back([=](int a, int b) { return std::make_pair(b_max - b, a - a_min); });
+    }
+    if (labellings.empty()) {
+      continue;
+    }
+
+    // Pick the labelling that agrees best with the square colors. Squares are dark or light relative to the
+    // median intensity of the square centers.
+    std::vector<std::pair<std::array<int, 2>, double>> squares;
+    for (const auto& node : nodes) {
+      const std::array<std::pair<int, int>, 3> corners = {
+          {{node.a + 1, node.b}, {node.a, node.b + 1}, {node.a + 1, node.b + 1}}};
+      gtsam::Point2 center = candidates[node.candidate];
+      bool complete = true;
+      for (const auto& corner : corners) {
+        const auto it = grid.find(corner);
+        if (it == grid.end()) {
+          complete = false;
+          break;
+        }
+        center += candidates[nodes[it->second].candidate];
+      }
+      if (complete) {
+        squares.push_back({{node.a, node.b}, Sample(image, center / 4.0)});
+      }
+    }
+    if (squares.empty()) {
+      continue;
+    }
+    std::vector<double> intensities;
+    for (const auto& square : squares) {
+      intensities.push_back(square.second);
+    }
+    std::nth_element(intensities.begin(), intensities.begin() + intensities.size() / 2, intensities.end());
+    const double median = intensities[intensities.size() / 2];
+
+    size_t best_labelling = 0, best_score = 0;
+    for (size_t ii = 0; ii < labellings.size(); ii++) {
+      size_t score = 0;
+      for (const auto& [ab, intensity] : squares) {
+        // The square's first corner in target coordinates.
+        const auto [col0, row0] = labellings[ii](ab[0], ab[1]);
+        const auto [col1, row1] = labellings[ii](ab[0] + 1, ab[1] + 1);
+        const bool dark = (std::min(col0, col1) + std::min(row0, row1)) % 2 == 0;
+        score += dark == (intensity < median) ? 1 : 0;
+      }
+      if (score > best_score) {
+        best_labelling = ii;
+        best_score = score;
+      }
+    }
+
+    for (const auto& node : nodes) {
+      const auto [col, row] = labellings[best_labelling](node.a, node.b);
+      measurements.emplace_back(candidates[node.candidate], camera_id, col * num_rows_ + row);
+    }
+    std::sort(measurements.begin(), measurements.end(),
+              [](const Measurement& lhs, const Measurement& rhs) { return lhs.point_id < rhs.point_id; });
+    return true;
+  }
+  return false;
+}
+
+}  // namespace gtcal
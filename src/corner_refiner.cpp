@@ -0,0 +1,268 @@
+#include "gtcal/corner_refiner.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gtcal {
+namespace {
+
+// Corners refined together, one per lane.
+static constexpr size_t kLanes = 4;
+
+// Window sums of a batch, per lane, with pixel positions p relative to the window center:
+// A = [sxx sxy; sxy syy] = sum w g g^T, b = (bx, by) = sum w g g^T p and M = [mxx mxy; mxy myy] =
+// sum w^2 J J^T with J = (g^T p) I + g p^T, the derivative of the normal equations w.r.t. the gradient.
+struct BatchSums {
+  alignas(16) float sxx[kLanes];
+  alignas(16) float sxy[kLanes];
+  alignas(16) float syy[kLanes];
+  alignas(16) float bx[kLanes];
+  alignas(16) float by[kLanes];
+  alignas(16) float mxx[kLanes];
+  alignas(16) float mxy[kLanes];
+  alignas(16) float myy[kLanes];
+};
+
+#if defined(__SSE2__)
+/**
+ * @brief Accumulate the window sums of a batch. The patch holds (2 * radius + 3)^2 pixels, row by row, with
+ * the kLanes corners interleaved at each pixel, so each SSE lane holds one corner.
+ *
+ */
+void Accumulate(const float* patch, const size_t radius, const std::vector<float>& weights, BatchSums& sums) {
+  static_assert(kLanes == 4, "One corner per SSE lane.");
+  const size_t window = 2 * radius + 1, side = window + 2;
+  const __m128 half = _mm_set1_ps(0.5f);
+  __m128 sxx = _mm_setzero_ps(), sxy = _mm_setzero_ps(), syy = _mm_setzero_ps();
+  __m128 bx = _mm_setzero_ps(), by = _mm_setzero_ps();
+  __m128 mxx = _mm_setzero_ps(), mxy = _mm_setzero_ps(), myy = _mm_setzero_ps();
+  for (size_t ii = 0; ii < window; ii++) {
+    const float py = static_cast<float>(ii) - radius;
+    for (size_t jj = 0; jj < window; jj++) {
+      const float px = static_cast<float>(jj) - radius;
+      const float* pixel = patch + ((ii + 1) * side + jj + 1) * kLanes;
+      const __m128 left = _mm_loadu_ps(pixel - kLanes), right = _mm_loadu_ps(pixel + kLanes);
+      const __m128 top = _mm_loadu_ps(pixel - side * kLanes), bottom = _mm_loadu_ps(pixel + side * kLanes);
+      const __m128 gx = _mm_mul_ps(half, _mm_sub_ps(right, left));
+      const __m128 gy = _mm_mul_ps(half, _mm_sub_ps(bottom, top));
+      const float weight = weights[ii * window + jj];
+      const __m128 w = _mm_set1_ps(weight), w2 = _mm_set1_ps(weight * weight);
+      const __m128 px2 = _mm_set1_ps(2.f * px), py2 = _mm_set1_ps(2.f * py);
+      const __m128 p2 = _mm_set1_ps(px * px + py * py);
+      const __m128 wgx = _mm_mul_ps(w, gx), wgy = _mm_mul_ps(w, gy);
+      const __m128 gp = _mm_add_ps(_mm_mul_ps(gx, _mm_set1_ps(px)), _mm_mul_ps(gy, _mm_set1_ps(py)));
+      const __m128 gxx = _mm_mul_ps(gx, gx), gxy = _mm_mul_ps(gx, gy), gyy = _mm_mul_ps(gy, gy);
+      sxx = _mm_add_ps(sxx, _mm_mul_ps(w, gxx));
+      sxy = _mm_add_ps(sxy, _mm_mul_ps(w, gxy));
+      syy = _mm_add_ps(syy, _mm_mul_ps(w, gyy));
+      bx = _mm_add_ps(bx, _mm_mul_ps(wgx, gp));
+      by = _mm_add_ps(by, _mm_mul_ps(wgy, gp));
+      const __m128 cross = _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(gx, py2), _mm_mul_ps(gy, px2)));
+      const __m128 jxx = _mm_add_ps(_mm_mul_ps(gp, _mm_add_ps(gp, _mm_mul_ps(gx, px2))), _mm_mul_ps(p2, gxx));
+      const __m128 jxy = _mm_add_ps(_mm_mul_ps(gp, cross), _mm_mul_ps(p2, gxy));
+      const __m128 jyy = _mm_add_ps(_mm_mul_ps(gp, _mm_add_ps(gp, _mm_mul_ps(gy, py2))), _mm_mul_ps(p2, gyy));
+      mxx = _mm_add_ps(mxx, _mm_mul_ps(w2, jxx));
+      mxy = _mm_add_ps(mxy, _mm_mul_ps(w2, jxy));
+      myy = _mm_add_ps(myy, _mm_mul_ps(w2, jyy));
+    }
+  }
+  _mm_store_ps(sums.sxx, sxx);
+  _mm_store_ps(sums.sxy, sxy);
+  _mm_store_ps(sums.syy, syy);
+  _mm_store_ps(sums.bx, bx);
+  _mm_store_ps(sums.by, by);
+  _mm_store_ps(sums.mxx, mxx);
+  _mm_store_ps(sums.mxy, mxy);
+  _mm_store_ps(sums.myy, myy);
+}
+#else
+/**
+ * @brief Accumulate the window sums of a batch. The patch holds (2 * radius + 3)^2 pixels, row by row, with
+ * the kLanes corners interleaved at each pixel.
+ *
+ */
+void Accumulate(const float* patch, const size_t radius, const std::vector<float>& weights,
+                BatchSums& sums) {
+  const size_t window = 2 * radius + 1, side = window + 2;
+  for (size_t lane = 0; lane < kLanes; lane++) {
+    float sxx = 0.f, sxy = 0.f, syy = 0.f, bx = 0.f, by = 0.f, mxx = 0.f, mxy = 0.f, myy = 0.f;
+    for (size_t ii = 0; ii < window; ii++) {
+      const float py = static_cast<float>(ii) - radius;
+      for (size_t jj = 0; jj < window; jj++) {
+        const float px = static_cast<float>(jj) - radius;
+        const float* pixel = patch + ((ii + 1) * side + jj + 1) * kLanes + lane;
+        const float gx = 0.5f * (pixel[kLanes] - pixel[-static_cast<ptrdiff_t>(kLanes)]);
+        const float gy = 0.5f * (pixel[side * kLanes] - pixel[-static_cast<ptrdiff_t>(side * kLanes)]);
+        const float w = weights[ii * window + jj];
+        const float gp = gx * px + gy * py;
+        const float w2 = w * w, p2 = px * px + py * py;
+        sxx += w * gx * gx;
+        sxy += w * gx * gy;
+        syy += w * gy * gy;
+        bx += w * gx * gp;
+        by += w * gy * gp;
+        mxx += w2 * (gp * (gp + 2.f * gx * px) + p2 * gx * gx);
+        mxy += w2 * (gp * (gx * py + gy * px) + p2 * gx * gy);
+        myy += w2 * (gp * (gp + 2.f * gy * py) + p2 * gy * gy);
+      }
+    }
+    sums.sxx[lane] = sxx, sums.sxy[lane] = sxy, sums.syy[lane] = syy;
+    sums.bx[lane] = bx, sums.by[lane] = by;
+    sums.mxx[lane] = mxx, sums.mxy[lane] = mxy, sums.myy[lane] = myy;
+  }
+}
+#endif
+
+/**
+ * @brief Return the standard deviation of the pixel noise in a window, with Immerkaer's estimate from the
+ * mean absolute Laplacian difference. The Laplacian difference cancels intensities linear in x or y, so
+ * edges and corners only add a little to the estimate.
+ *
+ */
+double EstimateNoise(const Image& image, const size_t x, const size_t y, const size_t radius) {
+  double sum = 0.0;
+  for (size_t yy = y - radius; yy <= y + radius; yy++) {
+    const uint8_t* up = image.row(yy - 1);
+    const uint8_t* row = image.row(yy);
+    const uint8_t* down = image.row(yy + 1);
+    for (size_t xx = x - radius; xx <= x + radius; xx++) {
+      const int corners = up[xx - 1] + up[xx + 1] + down[xx - 1] + down[xx + 1];
+      const int cross = up[xx] + down[xx] + row[xx - 1] + row[xx + 1];
+      sum += std::abs(corners - 2 * cross + 4 * row[xx]);
+    }
+  }
+  const auto window = static_cast<double>(2 * radius + 1);
+  return std::sqrt(M_PI / 2.0) * sum / (6.0 * window * window);
+}
+
+}  // namespace
+
+CornerRefiner::CornerRefiner() : CornerRefiner(Options()) {}
+
+CornerRefiner::CornerRefiner(const Options& options) : options_(options) {
+  const size_t radius = options_.window_radius, window = 2 * radius + 1;
+  weights_.resize(window * window);
+  for (size_t ii = 0; ii < window; ii++) {
+    for (size_t jj = 0; jj < window; jj++) {
+      const double dx = static_cast<double>(jj) - radius, dy = static_cast<double>(ii) - radius;
+      const double sigma = options_.window_sigma;
+      weights_[ii * window + jj] = static_cast<float>(std::exp(-0.5 * (dx * dx + dy * dy) / (sigma * sigma)));
+    }
+  }
+}
+
+size_t CornerRefiner::refine(const Image& image, std::vector<Measurement>& measurements,
+                             std::vector<gtsam::Matrix2>& covariances) const {
+  const size_t radius = options_.window_radius;
+  const size_t side = 2 * options_.window_radius + 3;
+  const double min_variance = options_.min_sigma * options_.min_sigma;
+  std::vector<float> patch(side * side * kLanes);
+  BatchSums sums;
+
+  // A window and its gradient border, plus a pixel for the interpolation, must be inside the image.
+  const auto in_bounds = [&](const gtsam::Point2& center) {
+    return center.x() - radius - 1 >= 0.0 && center.y() - radius - 1 >= 0.0 &&
+           center.x() + radius + 2 < static_cast<double>(image.width) &&
+           center.y() + radius + 2 < static_cast<double>(image.height);
+  };
+
+  covariances.clear();
+  size_t num_refined = 0;
+  for (size_t begin = 0; begin < measurements.size(); begin += kLanes) {
+    const size_t num_lanes = std::min(kLanes, measurements.size() - begin);
+    std::array<gtsam::Point2, kLanes> center;
+    std::array<bool, kLanes> active{}, refined{};
+    std::array<gtsam::Matrix2, kLanes> gradient_covariance;
+    std::array<double, kLanes> interpolation_gain{};
+    for (size_t lane = 0; lane < num_lanes; lane++) {
+      center[lane] = measurements[begin + lane].uv;
+      active[lane] = in_bounds(center[lane]);
+    }
+
+    for (size_t iteration = 0; iteration < options_.max_iterations; iteration++) {
+      // Resample the windows around their centers into the lane-interleaved patch, with bilinear
+      // interpolation. Inactive lanes are left with stale pixels and ignored.
+      for (size_t lane = 0; lane < num_lanes; lane++) {
+        if (!active[lane]) {
+          continue;
+        }
+        const double x0 = std::floor(center[lane].x()), y0 = std::floor(center[lane].y());
+        const auto fx = static_cast<float>(center[lane].x() - x0);
+        const auto fy = static_cast<float>(center[lane].y() - y0);
+        const float w00 = (1.f - fx) * (1.f - fy), w01 = fx * (1.f - fy);
+        const float w10 = (1.f - fx) * fy, w11 = fx * fy;
+        interpolation_gain[lane] = w00 * w00 + w01 * w01 + w10 * w10 + w11 * w11;
+        for (size_t ii = 0; ii < side; ii++) {
+          const uint8_t* row = image.row(static_cast<size_t>(y0) - radius - 1 + ii) +
+                               static_cast<size_t>(x0) - radius - 1;
+          const uint8_t* next_row = row + image.width;
+          float* patch_row = patch.data() + ii * side * kLanes + lane;
+          for (size_t jj = 0; jj < side; jj++) {
+            patch_row[jj * kLanes] =
+                w00 * row[jj] + w01 * row[jj + 1] + w10 * next_row[jj] + w11 * next_row[jj + 1];
+          }
+        }
+      }
+
+      Accumulate(patch.data(), options_.window_radius, weights_, sums);
+
+      for (size_t lane = 0; lane < num_lanes; lane++) {
+        if (!active[lane]) {
+          continue;
+        }
+        // Reject edges and flat areas, then solve the 2x2 system.
+        gtsam::Matrix2 A;
+        A << sums.sxx[lane], sums.sxy[lane], sums.sxy[lane], sums.syy[lane];
+        const gtsam::Vector2 b(sums.bx[lane], sums.by[lane]);
+        const double half_trace = 0.5 * A.trace();
+        const double root = std::sqrt(std::max(half_trace * half_trace - A.determinant(), 0.0));
+        if (half_trace - root <= options_.min_eigenvalue_ratio * (half_trace + root)) {
+          active[lane] = refined[lane] = false;
+          continue;
+        }
+        const gtsam::Matrix2 A_inv = A.inverse();
+        const gtsam::Vector2 offset = A_inv * b;
+        center[lane] += offset;
+        gtsam::Matrix2 M;
+        M << sums.mxx[lane], sums.mxy[lane], sums.mxy[lane], sums.myy[lane];
+        // Central differences of the interpolated pixels halve the pixel noise variance, the interpolation
+        // scales it by the sum of its squared weights.
+        const gtsam::Matrix2 sandwich = A_inv * M * A_inv;
+        gradient_covariance[lane] = 0.25 * interpolation_gain[lane] * (sandwich + sandwich.transpose());
+        refined[lane] = true;
+
+        // Re-center the window on the estimate until it stops moving.
+        if (offset.norm() < options_.min_step) {
+          active[lane] = false;
+        } else if (!in_bounds(center[lane])) {
+          active[lane] = refined[lane] = false;
+        }
+      }
+      if (std::none_of(active.begin(), active.end(), [](const bool value) { return value; })) {
+        break;
+      }
+    }
+
+    // Keep the refined measurements, compacting them in place.
+    for (size_t lane = 0; lane < num_lanes; lane++) {
+      const Measurement& meas = measurements[begin + lane];
+      if (refined[lane] && (center[lane] - meas.uv).norm() <= options_.max_shift) {
+        const double sigma =
+            EstimateNoise(image, std::lround(center[lane].x()), std::lround(center[lane].y()), radius);
+        measurements[num_refined] = Measurement(center[lane], meas.camera_id, meas.point_id);
+        covariances.push_back(sigma * sigma * gradient_covariance[lane] +
+                              min_variance * gtsam::Matrix2::Identity());
+        num_refined++;
+      }
+    }
+  }
+  measurements.resize(num_refined);
+  return num_refined;
+}
+
+}  // namespace gtcal
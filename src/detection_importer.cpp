@@ -0,0 +1,305 @@
+#include "gtcal/detection_importer.h"
+#include "gtcal/mapped_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace gtcal {
+namespace {
+
+// Camera ids are stored as 16 bit integers.
+static constexpr uint32_t kMaxCameraId = std::numeric_limits<uint16_t>::max();
+
+// Frames parsed from one range of the input.
+struct ParsedRange {
+  MeasurementBlock block;
+  size_t num_lines = 0;
+  size_t num_skipped_lines = 0;
+};
+
+/**
+ * @brief Skip spaces and tabs.
+ *
+ */
+const char* SkipBlanks(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+/**
+ * @brief Return true if a number was parsed at p, skipping surrounding blanks and a trailing separator.
+ *
+ */
+template <typename T>
+bool ParseNumber(const char*& p, const char* end, T& value, const char separator = ',') {
+  p = SkipBlanks(p, end);
+  const auto [next, ec] = std::from_chars(p, end, value);
+  if (ec != std::errc()) {
+    return false;
+  }
+  p = SkipBlanks(next, end);
+  if (p < end && *p == separator) {
+    ++p;
+  }
+  return true;
+}
+
+/**
+ * @brief Return true if the character may start an integer.
+ *
+ */
+bool IsIntegerStart(const char c) { return (c >= '0' && c <= '9') || c == '-'; }
+
+/**
+ * @brief Return true if a CSV detection line was parsed.
+ *
+ */
+bool ParseCsvLine(const char* p, const char* end, int64_t& timestamp_ns, uint32_t& camera_id,
+                  uint32_t& point_id, float& u, float& v) {
+  return ParseNumber(p, end, timestamp_ns) && ParseNumber(p, end, camera_id) &&
+         camera_id <= kMaxCameraId && ParseNumber(p, end, point_id) && ParseNumber(p, end, u) &&
+         ParseNumber(p, end, v);
+}
+
+/**
+ * @brief Return a pointer right after the value separator of the given JSON key in the line, or nullptr.
+ *
+ */
+const char* FindJsonValue(std::string_view line, std::string_view key) {
+  size_t pos = 0;
+  while ((pos = line.find(key, pos)) != std::string_view::npos) {
+    // The key must be quoted.
+    const size_t key_end = pos + key.size();
+    if (pos > 0 && line[pos - 1] == '"' && key_end < line.size() && line[key_end] == '"') {
+      const size_t colon = line.find(':', key_end);
+      return colon == std::string_view::npos ? nullptr : line.data() + colon + 1;
+    }
+    pos = key_end;
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Return true if a JSONL frame line was parsed and appended to the block as a frame.
+ *
+ */
+bool ParseJsonLine(const char* begin, const char* end, MeasurementBlock& block) {
+  const std::string_view line(begin, end - begin);
+  const char* timestamp_value = FindJsonValue(line, "timestamp_ns");
+  const char* camera_value = FindJsonValue(line, "camera_id");
+  const char* detections_value = FindJsonValue(line, "detections");
+  int64_t timestamp_ns = 0;
+  uint32_t camera_id = 0;
+  if (timestamp_value == nullptr || camera_value == nullptr || detections_value == nullptr ||
+      !ParseNumber(timestamp_value, end, timestamp_ns) || !ParseNumber(camera_value, end, camera_id) ||
+      camera_id > kMaxCameraId) {
+    return false;
+  }
+
+  // Parse the [[point_id, u, v], ...] array, dropping the partial frame on errors.
+  const size_t frame_begin = block.size();
+  const char* p = SkipBlanks(detections_value, end);
+  bool valid = p < end && *p++ == '[';
+  while (valid) {
+    p = SkipBlanks(p, end);
+    if (p < end && *p == ']') {
+      break;
+    }
+    uint32_t point_id = 0;
+    float u = 0.f, v = 0.f;
+    valid = p < end && *p++ == '[' && ParseNumber(p, end, point_id) && ParseNumber(p, end, u) &&
+            ParseNumber(p, end, v, ']');
+    if (valid) {
+      block.push_back(gtsam::Point2(u, v), camera_id, point_id);
+      p = SkipBlanks(p, end);
+      if (p < end && *p == ',') {
+        ++p;
+      }
+    }
+  }
+
+  if (!valid) {
+    block.truncate(frame_begin);
+    return false;
+  }
+  block.endFrame(timestamp_ns);
+  return true;
+}
+
+/**
+ * @brief Parse the lines of [begin, end) into frames.
+ *
+ */
+void ParseRange(const char* begin, const char* end, const DetectionImporter::Format format,
+                ParsedRange& result) {
+  // Guess the output size from the input size to avoid regrowing the arrays.
+  const size_t bytes_per_measurement = format == DetectionImporter::Format::CSV ? 32 : 24;
+  result.block.reserve(static_cast<size_t>(end - begin) / bytes_per_measurement);
+
+  bool frame_open = false;
+  int64_t frame_timestamp_ns = 0;
+  uint32_t frame_camera_id = 0;
+  const char* line_begin = begin;
+  while (line_begin < end) {
+    const char* line_end = static_cast<const char*>(std::memchr(line_begin, '\n', end - line_begin));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    const char* next_line = line_end < end ? line_end + 1 : end;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+      --line_end;
+    }
+
+    // Skip blank lines, comments and headers.
+    const char* p = SkipBlanks(line_begin, line_end);
+    if (p == line_end) {
+      line_begin = next_line;
+      continue;
+    }
+    result.num_lines++;
+
+    if (format == DetectionImporter::Format::JSONL) {
+      if (*p != '{' || !ParseJsonLine(p, line_end, result.block)) {
+        result.num_skipped_lines++;
+      }
+    } else {
+      int64_t timestamp_ns = 0;
+      uint32_t camera_id = 0, point_id = 0;
+      float u = 0.f, v = 0.f;
+      if (!IsIntegerStart(*p) || !ParseCsvLine(p, line_end, timestamp_ns, camera_id, point_id, u, v)) {
+        result.num_skipped_lines++;
+      } else {
+        // A new timestamp or camera starts a new frame.
+        if (frame_open && (timestamp_ns != frame_timestamp_ns || camera_id != frame_camera_id)) {
+          result.block.endFrame(frame_timestamp_ns);
+        }
+        frame_open = true;
+        frame_timestamp_ns = timestamp_ns;
+        frame_camera_id = camera_id;
+        result.block.push_back(gtsam::Point2(u, v), camera_id, point_id);
+      }
+    }
+    line_begin = next_line;
+  }
+  if (frame_open) {
+    result.block.endFrame(frame_timestamp_ns);
+  }
+}
+
+}  // namespace
+
+DetectionImporter::DetectionImporter() : DetectionImporter(Options()) {}
+
+DetectionImporter::DetectionImporter(const Options& options) : options_(options) {}
+
+bool DetectionImporter::importFile(const std::string& path, MeasurementBlock& measurements) {
+  const io::MappedFile file(path);
+  if (!file.isOpen()) {
+    return false;
+  }
+  file.adviseSequential();
+  return importText(std::string_view(file.data(), file.size()), measurements);
+}
+
+bool DetectionImporter::importText(std::string_view text, MeasurementBlock& measurements) {
+  stats_ = Stats();
+  stats_.num_bytes = text.size();
+
+  // Pick the format.
+  Format format = options_.format;
+  if (format == Format::AUTO) {
+    const size_t first = text.find_first_not_of(" \t\r\n");
+    format = first != std::string_view::npos && text[first] == '{' ? Format::JSONL : Format::CSV;
+  }
+
+  // Split the input on line boundaries, one range per thread.
+  const size_t max_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  const size_t num_ranges =
+      std::clamp<size_t>(text.size() / std::max<size_t>(options_.min_bytes_per_thread, 1), 1, max_threads);
+  std::vector<const char*> bounds = {text.data()};
+  for (size_t ii = 1; ii < num_ranges; ii++) {
+    const char* split = std::max(text.data() + ii * text.size() / num_ranges, bounds.back());
+    const char* newline =
+        static_cast<const char*>(std::memchr(split, '\n', text.data() + text.size() - split));
+    bounds.push_back(newline == nullptr ? text.data() + text.size() : newline + 1);
+  }
+  bounds.push_back(text.data() + text.size());
+
+  // Parse the ranges in parallel.
+  std::vector<ParsedRange> ranges(num_ranges);
+  std::vector<std::thread> threads;
+  for (size_t ii = 1; ii < num_ranges; ii++) {
+    threads.emplace_back(ParseRange, bounds[ii], bounds[ii + 1], format, std::ref(ranges[ii]));
+  }
+  ParseRange(bounds[0], bounds[1], format, ranges[0]);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  stats_.num_threads = num_ranges;
+
+  // Concatenate the ranges. A CSV frame cut by a range boundary continues in the next range.
+  const size_t size_before = measurements.size();
+  const size_t num_frames_before = measurements.numFrames();
+  size_t total_size = size_before, total_frames = num_frames_before;
+  for (const auto& range : ranges) {
+    total_size += range.block.size();
+    total_frames += range.block.numFrames();
+  }
+  measurements.reserve(total_size, total_frames);
+  bool frame_open = false;
+  int64_t open_timestamp_ns = 0;
+  size_t open_camera_id = 0;
+  for (const auto& range : ranges) {
+    stats_.num_lines += range.num_lines;
+    stats_.num_skipped_lines += range.num_skipped_lines;
+    for (size_t ii = 0; ii < range.block.numFrames(); ii++) {
+      const MeasurementSpan frame = range.block.frame(ii);
+      const int64_t timestamp_ns = range.block.timestamp(ii);
+      const bool continues_open_frame = format == Format::CSV && frame_open && !frame.empty() &&
+                                        timestamp_ns == open_timestamp_ns &&
+                                        frame.front().camera_id == open_camera_id;
+      if (frame_open && !continues_open_frame) {
+        measurements.endFrame(open_timestamp_ns);
+        frame_open = false;
+      }
+      measurements.append(frame);
+      if (frame.empty()) {
+        measurements.endFrame(timestamp_ns);
+        continue;
+      }
+      frame_open = true;
+      open_timestamp_ns = timestamp_ns;
+      open_camera_id = frame.front().camera_id;
+    }
+  }
+  if (frame_open) {
+    measurements.endFrame(open_timestamp_ns);
+  }
+
+  stats_.num_frames = measurements.numFrames() - num_frames_before;
+  stats_.num_measurements = measurements.size() - size_before;
+  return true;
+}
+
+bool DetectionImporter::importFileToLog(const std::string& path, DetectionLogWriter& log) {
+  MeasurementBlock measurements;
+  if (!importFile(path, measurements)) {
+    return false;
+  }
+  for (size_t ii = 0; ii < measurements.numFrames(); ii++) {
+    if (!log.append(measurements.timestamp(ii), measurements.frame(ii))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace gtcal
@@ -0,0 +1,371 @@
+#include "gtcal/detection_log.h"
+#include "gtcal/binary_io.h"
+
+#ifdef GTCAL_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#include <cstring>
+
+namespace gtcal {
+namespace {
+
+struct ChunkHeader {
+  uint32_t compression = 0;
+  uint32_t num_frames = 0;
+  uint64_t num_measurements = 0;
+  uint64_t stored_size = 0;
+  uint32_t checksum = 0;
+  uint32_t reserved = 0;
+};
+static_assert(sizeof(ChunkHeader) == 32, "Chunk header must be 32 bytes.");
+
+struct Trailer {
+  uint64_t index_offset = 0;
+  uint64_t num_chunks = 0;
+  uint64_t num_frames = 0;
+  uint32_t checksum = 0;
+  uint32_t reserved = 0;
+  char magic[8] = {};
+};
+static_assert(sizeof(Trailer) == 40, "Trailer must be 40 bytes.");
+
+static constexpr size_t kHeaderSize = sizeof(kDetectionLogMagic) + 2 * sizeof(uint32_t);
+
+// Upper bound on the measurements of a chunk, to keep the payload size computations from overflowing.
+static constexpr uint64_t kMaxChunkMeasurements = uint64_t{1} << 40;
+
+/**
+ * @brief Return the size rounded up to a multiple of 8 bytes.
+ *
+ */
+uint64_t Align8(const uint64_t size) { return (size + 7) & ~uint64_t{7}; }
+
+/**
+ * @brief Return the size of an uncompressed chunk payload.
+ *
+ */
+uint64_t RawPayloadSize(const uint64_t num_frames, const uint64_t num_measurements) {
+  return 8 * num_frames + 8 * (num_frames + 1) +
+         num_measurements * (2 * sizeof(float) + sizeof(uint32_t) + sizeof(uint16_t));
+}
+
+/**
+ * @brief Return true if a valid chunk header was read at the given file offset.
+ *
+ */
+bool ReadChunkHeader(const io::MappedFile& file, const uint64_t offset, ChunkHeader& header) {
+  if (offset > file.size() || file.size() - offset < sizeof(ChunkHeader)) {
+    return false;
+  }
+  std::memcpy(&header, file.data() + offset, sizeof(ChunkHeader));
+  const auto compression = static_cast<DetectionLogWriter::Compression>(header.compression);
+  if (compression != DetectionLogWriter::Compression::NONE &&
+      compression != DetectionLogWriter::Compression::LZ4) {
+    return false;
+  }
+  if (header.num_measurements > kMaxChunkMeasurements ||
+      header.stored_size > file.size() - offset - sizeof(ChunkHeader)) {
+    return false;
+  }
+  return compression != DetectionLogWriter::Compression::NONE ||
+         header.stored_size == RawPayloadSize(header.num_frames, header.num_measurements);
+}
+
+}  // namespace
+
+DetectionLogWriter::DetectionLogWriter(const std::string& path) : DetectionLogWriter(path, Options()) {}
+
+DetectionLogWriter::DetectionLogWriter(const std::string& path, const Options& options)
+  : options_(options), file_(path, std::ios::binary | std::ios::trunc) {
+  if (!file_.is_open()) {
+    return;
+  }
+  const uint32_t version = kDetectionLogVersion;
+  const uint32_t reserved = 0;
+  file_.write(kDetectionLogMagic, sizeof(kDetectionLogMagic));
+  file_.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  file_.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+  file_offset_ = kHeaderSize;
+  failed_ = !file_.good();
+}
+
+DetectionLogWriter::~DetectionLogWriter() { close(); }
+
+bool DetectionLogWriter::append(const int64_t timestamp_ns, const MeasurementSpan& measurements) {
+  if (!file_.is_open() || failed_) {
+    return false;
+  }
+  reserveChunk(measurements.size());
+  chunk_.append(measurements);
+  return endFrame(timestamp_ns);
+}
+
+bool DetectionLogWriter::append(const int64_t timestamp_ns, const std::vector<Measurement>& measurements) {
+  if (!file_.is_open() || failed_) {
+    return false;
+  }
+  reserveChunk(measurements.size());
+  for (const auto& meas : measurements) {
+    chunk_.push_back(meas);
+  }
+  return endFrame(timestamp_ns);
+}
+
+void DetectionLogWriter::reserveChunk(const size_t num_measurements) {
+  // The buffer keeps its capacity across chunks, so this only allocates for the first chunk or larger frames.
+  if (chunk_.numFrames() == 0) {
+    chunk_.reserve(num_measurements * options_.frames_per_chunk, options_.frames_per_chunk);
+  }
+}
+
+bool DetectionLogWriter::endFrame(const int64_t timestamp_ns) {
+  chunk_.endFrame(timestamp_ns);
+  frame_index_.push_back({static_cast<uint32_t>(chunk_offsets_.size()),
+                          static_cast<uint32_t>(chunk_.numFrames() - 1), timestamp_ns});
+
+  if (chunk_.numFrames() >= options_.frames_per_chunk) {
+    return writeChunk();
+  }
+  return true;
+}
+
+bool DetectionLogWriter::writeChunk() {
+  if (chunk_.numFrames() == 0) {
+    return !failed_;
+  }
+
+  // Lay the frames out as arrays.
+  io::ByteWriter writer;
+  for (size_t ii = 0; ii < chunk_.numFrames(); ii++) {
+    writer.write<int64_t>(chunk_.timestamp(ii));
+  }
+  uint64_t frame_offset = 0;
+  writer.write<uint64_t>(frame_offset);
+  for (size_t ii = 0; ii < chunk_.numFrames(); ii++) {
+    frame_offset += chunk_.frame(ii).size();
+    writer.write<uint64_t>(frame_offset);
+  }
+  writer.writeBytes(chunk_.u().data(), chunk_.size() * sizeof(float));
+  writer.writeBytes(chunk_.v().data(), chunk_.size() * sizeof(float));
+  writer.writeBytes(chunk_.pointIds().data(), chunk_.size() * sizeof(uint32_t));
+  writer.writeBytes(chunk_.cameraIds().data(), chunk_.size() * sizeof(uint16_t));
+  std::string payload = writer.release();
+
+  ChunkHeader header;
+  header.compression = static_cast<uint32_t>(Compression::NONE);
+  header.num_frames = static_cast<uint32_t>(chunk_.numFrames());
+  header.num_measurements = chunk_.size();
+
+#ifdef GTCAL_WITH_LZ4
+  if (options_.compression == Compression::LZ4) {
+    std::string compressed(LZ4_compressBound(static_cast<int>(payload.size())), '\0');
+    const int compressed_size = LZ4_compress_default(payload.data(), compressed.data(),
+                                                     static_cast<int>(payload.size()),
+                                                     static_cast<int>(compressed.size()));
+    if (compressed_size > 0 && static_cast<size_t>(compressed_size) < payload.size()) {
+      compressed.resize(compressed_size);
+      payload = std::move(compressed);
+      header.compression = static_cast<uint32_t>(Compression::LZ4);
+    }
+  }
+#endif
+
+  header.stored_size = payload.size();
+  header.checksum = io::Fnv1a32(payload.data(), payload.size());
+
+  // Write the chunk, padded so the next one stays aligned.
+  static constexpr char kPadding[8] = {};
+  const uint64_t padding = Align8(payload.size()) - payload.size();
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file_.write(payload.data(), payload.size());
+  file_.write(kPadding, padding);
+  failed_ = failed_ || !file_.good();
+
+  chunk_offsets_.push_back(file_offset_);
+  file_offset_ += sizeof(header) + payload.size() + padding;
+  chunk_.clear();
+  return !failed_;
+}
+
+bool DetectionLogWriter::close() {
+  if (!file_.is_open()) {
+    return !failed_;
+  }
+  writeChunk();
+
+  // Write the index and the trailer pointing at it.
+  io::ByteWriter index;
+  index.writeBytes(chunk_offsets_.data(), chunk_offsets_.size() * sizeof(uint64_t));
+  index.writeBytes(frame_index_.data(), frame_index_.size() * sizeof(FrameIndexEntry));
+  Trailer trailer;
+  trailer.index_offset = file_offset_;
+  trailer.num_chunks = chunk_offsets_.size();
+  trailer.num_frames = frame_index_.size();
+  trailer.checksum = io::Fnv1a32(index.buffer().data(), index.size());
+  std::memcpy(trailer.magic, kDetectionLogIndexMagic, sizeof(trailer.magic));
+  file_.write(index.buffer().data(), index.size());
+  file_.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+
+  file_.close();
+  failed_ = failed_ || file_.fail();
+  return !failed_;
+}
+
+DetectionLogReader::DetectionLogReader(const std::string& path) : DetectionLogReader(path, Options()) {}
+
+DetectionLogReader::DetectionLogReader(const std::string& path, const Options& options)
+  : options_(options), file_(path) {
+  // Check the header.
+  if (!file_.isOpen() || file_.size() < kHeaderSize ||
+      std::memcmp(file_.data(), kDetectionLogMagic, sizeof(kDetectionLogMagic)) != 0) {
+    return;
+  }
+  uint32_t version = 0;
+  std::memcpy(&version, file_.data() + sizeof(kDetectionLogMagic), sizeof(version));
+  if (version != kDetectionLogVersion) {
+    return;
+  }
+
+  is_open_ = readIndex() || scanChunks();
+}
+
+bool DetectionLogReader::readIndex() {
+  if (file_.size() < kHeaderSize + sizeof(Trailer)) {
+    return false;
+  }
+  Trailer trailer;
+  std::memcpy(&trailer, file_.data() + file_.size() - sizeof(Trailer), sizeof(Trailer));
+  if (std::memcmp(trailer.magic, kDetectionLogIndexMagic, sizeof(trailer.magic)) != 0) {
+    return false;
+  }
+
+  // The index must sit right before the trailer.
+  const uint64_t index_end = file_.size() - sizeof(Trailer);
+  if (trailer.index_offset < kHeaderSize || trailer.index_offset > index_end ||
+      trailer.num_chunks > (index_end - trailer.index_offset) / sizeof(uint64_t)) {
+    return false;
+  }
+  const uint64_t chunks_size = trailer.num_chunks * sizeof(uint64_t);
+  if (trailer.num_frames != (index_end - trailer.index_offset - chunks_size) / sizeof(FrameIndexEntry) ||
+      trailer.index_offset + chunks_size + trailer.num_frames * sizeof(FrameIndexEntry) != index_end) {
+    return false;
+  }
+  const char* index = file_.data() + trailer.index_offset;
+  if (io::Fnv1a32(index, index_end - trailer.index_offset) != trailer.checksum) {
+    return false;
+  }
+
+  chunk_offsets_.resize(trailer.num_chunks);
+  std::memcpy(chunk_offsets_.data(), index, chunks_size);
+  frame_index_.resize(trailer.num_frames);
+  std::memcpy(frame_index_.data(), index + chunks_size, trailer.num_frames * sizeof(FrameIndexEntry));
+  chunk_verified_.assign(chunk_offsets_.size(), false);
+  return true;
+}
+
+bool DetectionLogReader::scanChunks() {
+  chunk_offsets_.clear();
+  frame_index_.clear();
+  chunk_verified_.clear();
+
+  // Walk the chunks until the first one that is incomplete or fails its checksum.
+  uint64_t offset = kHeaderSize;
+  ChunkHeader header;
+  while (ReadChunkHeader(file_, offset, header)) {
+    const char* stored = file_.data() + offset + sizeof(ChunkHeader);
+    if (io::Fnv1a32(stored, header.stored_size) != header.checksum) {
+      break;
+    }
+    const size_t chunk = chunk_offsets_.size();
+    chunk_offsets_.push_back(offset);
+    chunk_verified_.push_back(true);
+    const char* payload = chunkPayload(chunk);
+    if (payload == nullptr) {
+      chunk_offsets_.pop_back();
+      chunk_verified_.pop_back();
+      break;
+    }
+
+    const auto* timestamps = reinterpret_cast<const int64_t*>(payload);
+    for (uint32_t ii = 0; ii < header.num_frames; ii++) {
+      frame_index_.push_back({static_cast<uint32_t>(chunk), ii, timestamps[ii]});
+    }
+    offset += sizeof(ChunkHeader) + Align8(header.stored_size);
+  }
+  return true;
+}
+
+const char* DetectionLogReader::chunkPayload(const size_t chunk) {
+  ChunkHeader header;
+  const uint64_t offset = chunk_offsets_.at(chunk);
+  if (!ReadChunkHeader(file_, offset, header)) {
+    return nullptr;
+  }
+  const char* stored = file_.data() + offset + sizeof(ChunkHeader);
+  if (options_.verify_checksums && !chunk_verified_.at(chunk)) {
+    if (io::Fnv1a32(stored, header.stored_size) != header.checksum) {
+      return nullptr;
+    }
+    chunk_verified_.at(chunk) = true;
+  }
+
+  const auto compression = static_cast<DetectionLogWriter::Compression>(header.compression);
+  if (compression == DetectionLogWriter::Compression::NONE) {
+    return stored;
+  }
+  if (decompressed_chunk_ == chunk) {
+    return reinterpret_cast<const char*>(decompressed_.data());
+  }
+
+#ifdef GTCAL_WITH_LZ4
+  const uint64_t raw_size = RawPayloadSize(header.num_frames, header.num_measurements);
+  decompressed_.resize(Align8(raw_size) / sizeof(uint64_t));
+  const int decompressed_size =
+      LZ4_decompress_safe(stored, reinterpret_cast<char*>(decompressed_.data()),
+                          static_cast<int>(header.stored_size), static_cast<int>(raw_size));
+  if (decompressed_size < 0 || static_cast<uint64_t>(decompressed_size) != raw_size) {
+    decompressed_chunk_ = static_cast<size_t>(-1);
+    return nullptr;
+  }
+  decompressed_chunk_ = chunk;
+  return reinterpret_cast<const char*>(decompressed_.data());
+#else
+  return nullptr;
+#endif
+}
+
+bool DetectionLogReader::frame(const size_t index, MeasurementSpan& measurements) {
+  if (index >= frame_index_.size() || frame_index_[index].chunk >= chunk_offsets_.size()) {
+    return false;
+  }
+  const FrameIndexEntry& entry = frame_index_[index];
+  const char* payload = chunkPayload(entry.chunk);
+  if (payload == nullptr) {
+    return false;
+  }
+
+  // Find the arrays in the payload.
+  ChunkHeader header;
+  std::memcpy(&header, file_.data() + chunk_offsets_[entry.chunk], sizeof(ChunkHeader));
+  const uint64_t num_frames = header.num_frames;
+  const uint64_t num_measurements = header.num_measurements;
+  if (entry.frame_in_chunk >= num_frames) {
+    return false;
+  }
+  const auto* frame_offsets = reinterpret_cast<const uint64_t*>(payload + 8 * num_frames);
+  const auto* u = reinterpret_cast<const float*>(payload + 8 * num_frames + 8 * (num_frames + 1));
+  const auto* v = u + num_measurements;
+  const auto* point_ids = reinterpret_cast<const uint32_t*>(v + num_measurements);
+  const auto* camera_ids = reinterpret_cast<const uint16_t*>(point_ids + num_measurements);
+
+  const uint64_t begin = frame_offsets[entry.frame_in_chunk];
+  const uint64_t end = frame_offsets[entry.frame_in_chunk + 1];
+  if (begin > end || end > num_measurements) {
+    return false;
+  }
+  measurements = MeasurementSpan(u + begin, v + begin, camera_ids + begin, point_ids + begin, end - begin);
+  return true;
+}
+
+}  // namespace gtcal
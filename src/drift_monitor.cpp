@@ -0,0 +1,197 @@
+#include "gtcal/drift_monitor.h"
+#include "gtcal/homography.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <exception>
+
+namespace gtcal {
+namespace {
+
+/**
+ * @brief Return true if value is at least ratio times the baseline and at least min_shift above it.
+ *
+ */
+bool Exceeds(const double value, const double baseline, const double ratio, const double min_shift) {
+  return value >= ratio * baseline && value - baseline >= min_shift;
+}
+
+}  // namespace
+
+Ewma::Ewma(const double alpha) : alpha_(alpha) { assert(alpha > 0.0 && alpha <= 1.0); }
+
+void Ewma::add(const double x) {
+  if (count_++ == 0) {
+    mean_ = x;
+    variance_ = 0.0;
+    return;
+  }
+  const double diff = x - mean_;
+  const double increment = alpha_ * diff;
+  mean_ += increment;
+  variance_ = (1.0 - alpha_) * (variance_ + diff * increment);
+}
+
+void Ewma::reset() {
+  mean_ = 0.0;
+  variance_ = 0.0;
+  count_ = 0;
+}
+
+DriftMonitor::DriftMonitor(const Camera& camera, const gtsam::Point3Vector& pts3d_target,
+                           const Options& options)
+  : options_(options), camera_(camera.clone()), pts3d_target_(pts3d_target),
+    pose_solver_gtsam_(PoseSolverGtsam::Options()), baseline_quantile_(options.quantile),
+    rms_ewma_(options.ewma_alpha), window_quantile_(options.quantile) {
+  assert(options_.warmup_frames > 0 && options_.window_frames > 0);
+  errors_.reserve(pts3d_target_.size());
+}
+
+DriftMonitor::DriftMonitor(const Camera& camera, const gtsam::Point3Vector& pts3d_target)
+  : DriftMonitor(camera, pts3d_target, Options()) {}
+
+DriftMonitor::FrameResult DriftMonitor::addFrame(const std::vector<Measurement>& measurements) {
+  return addFrameImpl(measurements);
+}
+
+DriftMonitor::FrameResult DriftMonitor::addFrame(const MeasurementSpan& measurements) {
+  return addFrameImpl(measurements);
+}
+
+template <typename MeasurementRange>
+DriftMonitor::FrameResult DriftMonitor::addFrameImpl(const MeasurementRange& measurements) {
+  num_frames_++;
+  FrameResult result;
+  const bool valid = measurements.size() >= std::max<size_t>(options_.min_measurements, 4) &&
+                     std::all_of(measurements.begin(), measurements.end(), [&](const Measurement& meas) {
+                       return meas.point_id < pts3d_target_.size();
+                     });
+
+  // Start from the previous pose, which is close at frame rate. Fall back on the target homography for the
+  // first frame, after a rejected frame, or if the previous pose didn't converge.
+  double rms = 0.0;
+  if (valid && has_last_pose_) {
+    result.pose_target_cam = last_pose_target_cam_;
+    result.accepted = solveFrame(measurements, result.pose_target_cam, rms);
+  }
+  gtsam::Matrix3 H_image_target;
+  if (valid && !result.accepted && EstimateHomography(measurements, pts3d_target_, H_image_target) &&
+      PoseFromHomography(H_image_target, CameraMatrix(*camera_), result.pose_target_cam)) {
+    result.accepted = solveFrame(measurements, result.pose_target_cam, rms);
+  }
+
+  has_last_pose_ = result.accepted;
+  if (!result.accepted) {
+    num_rejected_++;
+    return result;
+  }
+  last_pose_target_cam_ = result.pose_target_cam;
+  result.rms = rms;
+  result.alarm = updateStatistics(rms);
+  return result;
+}
+
+template <typename MeasurementRange>
+bool DriftMonitor::solveFrame(const MeasurementRange& measurements, gtsam::Pose3& pose_target_cam,
+                              double& rms) {
+  try {
+    const bool solved = options_.pose_solver_type == PoseSolverType::CERES
+                            ? pose_solver_.solve(measurements, pts3d_target_, camera_, pose_target_cam)
+                            : pose_solver_gtsam_.solve(measurements, pts3d_target_, camera_, pose_target_cam);
+    if (!solved) {
+      return false;
+    }
+
+    camera_->setCameraPose(pose_target_cam);
+    errors_.clear();
+    double sum_squared_error = 0.0;
+    for (const Measurement& meas : measurements) {
+      const double error = (camera_->project(pts3d_target_[meas.point_id]) - meas.uv).norm();
+      errors_.push_back(error);
+      sum_squared_error += error * error;
+    }
+    rms = std::sqrt(sum_squared_error / static_cast<double>(measurements.size()));
+    return rms <= options_.max_pose_rms_error;
+  } catch (const std::exception&) {
+    // E.g. a target point behind the camera.
+    return false;
+  }
+}
+
+bool DriftMonitor::updateStatistics(const double rms) {
+  num_accepted_++;
+  rms_ewma_.add(rms);
+
+  if (state_ == State::WARMING_UP) {
+    baseline_rms_sum_ += rms;
+    for (const double error : errors_) {
+      baseline_quantile_.add(error);
+    }
+    if (num_accepted_ >= options_.warmup_frames) {
+      state_ = State::OK;
+    }
+    return false;
+  }
+
+  // The quantile is estimated over windows of frames so that it follows the current calibration rather than
+  // the whole history.
+  for (const double error : errors_) {
+    window_quantile_.add(error);
+  }
+  if (++window_size_ >= options_.window_frames) {
+    last_window_quantile_ = window_quantile_.value();
+    has_window_quantile_ = true;
+    window_quantile_.reset();
+    window_size_ = 0;
+  }
+
+  const double baseline_rms = baseline_rms_sum_ / static_cast<double>(options_.warmup_frames);
+  const bool rms_alarm = Exceeds(rms_ewma_.mean(), baseline_rms, options_.rms_ratio, options_.min_shift);
+  const bool quantile_alarm =
+      has_window_quantile_ && Exceeds(last_window_quantile_, baseline_quantile_.value(),
+                                      options_.quantile_ratio, options_.min_shift);
+  const bool alarm = rms_alarm || quantile_alarm;
+  consecutive_alarms_ = alarm ? consecutive_alarms_ + 1 : 0;
+  if (consecutive_alarms_ >= options_.consecutive_frames) {
+    state_ = State::DRIFT;
+  }
+  return alarm;
+}
+
+DriftMonitor::Status DriftMonitor::status() const {
+  Status status;
+  status.state = state_;
+  status.num_frames = num_frames_;
+  status.num_rejected = num_rejected_;
+  const size_t num_baseline_frames = std::min(num_accepted_, options_.warmup_frames);
+  status.baseline_rms =
+      num_baseline_frames > 0 ? baseline_rms_sum_ / static_cast<double>(num_baseline_frames) : 0.0;
+  status.baseline_quantile = baseline_quantile_.value();
+  status.current_rms = rms_ewma_.mean();
+  status.current_rms_stddev = std::sqrt(rms_ewma_.variance());
+  if (state_ == State::WARMING_UP) {
+    status.current_quantile = status.baseline_quantile;
+  } else {
+    status.current_quantile = has_window_quantile_ ? last_window_quantile_ : window_quantile_.value();
+  }
+  status.consecutive_alarms = consecutive_alarms_;
+  return status;
+}
+
+void DriftMonitor::resetBaseline() {
+  state_ = State::WARMING_UP;
+  num_frames_ = 0;
+  num_rejected_ = 0;
+  num_accepted_ = 0;
+  consecutive_alarms_ = 0;
+  baseline_rms_sum_ = 0.0;
+  baseline_quantile_.reset();
+  rms_ewma_.reset();
+  window_quantile_.reset();
+  window_size_ = 0;
+  has_window_quantile_ = false;
+  last_window_quantile_ = 0.0;
+}
+
+}  // namespace gtcal
@@ -0,0 +1,321 @@
+#include "gtcal/fleet_scheduler.h"
+#include "gtcal/homography.h"
+#include "gtcal/pose_solver.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace gtcal {
+namespace {
+
+// Rough memory held by a factor (the factor, its linearization and the iSAM2 bookkeeping) and by a
+// variable (its value, delta and share of the Bayes tree), in bytes.
+static constexpr size_t kBytesPerFactor = 1024;
+static constexpr size_t kBytesPerVariable = 2048;
+
+// Solver and progress of a calibration job, shared by the job's closures.
+struct CalibrationContext {
+  CalibrationContext(const std::shared_ptr<const gtsam::Point3Vector>& pts3d_target,
+                     const std::vector<std::shared_ptr<Camera>>& cameras,
+                     const std::shared_ptr<const MeasurementBlock>& measurements,
+                     const BatchSolver::Options& solver_options)
+    : pts3d_target(pts3d_target), measurements(measurements), solver(*pts3d_target, solver_options),
+      state(cameras, solver_options) {}
+
+  const std::shared_ptr<const gtsam::Point3Vector> pts3d_target;
+  const std::shared_ptr<const MeasurementBlock> measurements;
+  const BatchSolver solver;
+  BatchSolver::State state;
+  const PoseSolver pose_solver;
+  size_t next_frame = 0;
+};
+
+}  // namespace
+
+bool FleetScheduler::Entry::operator<(const Entry& other) const {
+  if (priority != other.priority) {
+    return priority < other.priority;
+  }
+  if (deadline != other.deadline) {
+    return deadline > other.deadline;
+  }
+  return sequence > other.sequence;
+}
+
+FleetScheduler::FleetScheduler(const Options& options) {
+  const size_t num_threads =
+      options.num_threads > 0 ? options.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  for (size_t tt = 0; tt < num_threads; tt++) {
+    queues_.push_back(std::make_unique<WorkerQueue>());
+  }
+  for (size_t tt = 0; tt < num_threads; tt++) {
+    workers_.emplace_back(&FleetScheduler::work, this, tt);
+  }
+}
+
+FleetScheduler::FleetScheduler() : FleetScheduler(Options()) {}
+
+FleetScheduler::~FleetScheduler() {
+  {
+    const std::lock_guard<std::mutex> lock(idle_mutex_);
+    stopping_ = true;
+  }
+  idle_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+
+  // Only the records are left, the workers are gone.
+  for (auto& record : records_) {
+    if (record.status.state == JobState::QUEUED || record.status.state == JobState::RUNNING) {
+      finish(record, JobState::CANCELLED);
+    }
+  }
+}
+
+size_t FleetScheduler::submit(Job job) {
+  Entry entry;
+  entry.priority = job.priority;
+  entry.deadline = job.deadline;
+  entry.sequence = next_sequence_.fetch_add(1, std::memory_order_relaxed);
+  {
+    const std::lock_guard<std::mutex> lock(records_mutex_);
+    entry.job_id = records_.size();
+    records_.push_back({std::move(job), JobStatus()});
+    records_.back().status.submit_time = Clock::now();
+    stats_.num_submitted++;
+    stats_.num_queued++;
+  }
+  push(next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size(), entry);
+  return entry.job_id;
+}
+
+void FleetScheduler::wait() {
+  std::unique_lock<std::mutex> lock(records_mutex_);
+  finished_cv_.wait(lock, [this]() { return num_finished_ == records_.size(); });
+}
+
+FleetScheduler::JobStatus FleetScheduler::jobStatus(const size_t job_id) const {
+  const std::lock_guard<std::mutex> lock(records_mutex_);
+  assert(job_id < records_.size() && "[FleetScheduler::jobStatus] Job id out of range.");
+  return records_[job_id].status;
+}
+
+FleetScheduler::Stats FleetScheduler::stats() const {
+  const std::lock_guard<std::mutex> lock(records_mutex_);
+  return stats_;
+}
+
+void FleetScheduler::work(const size_t worker) {
+  Entry entry;
+  for (;;) {
+    if (pop(worker, entry)) {
+      runStep(worker, entry);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this]() { return stopping_ || num_queued_entries_.load() > 0; });
+    if (stopping_) {
+      return;
+    }
+  }
+}
+
+bool FleetScheduler::pop(const size_t worker, Entry& entry) {
+  const auto take = [&](WorkerQueue& queue) {
+    std::pop_heap(queue.heap.begin(), queue.heap.end());
+    entry = queue.heap.back();
+    queue.heap.pop_back();
+    num_queued_entries_.fetch_sub(1);
+  };
+
+  {
+    WorkerQueue& queue = *queues_[worker];
+    const std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.heap.empty()) {
+      take(queue);
+      return true;
+    }
+  }
+
+  // Steal the best entry of the other queues. Another worker may take it first, in which case look again.
+  for (;;) {
+    size_t victim = worker;
+    Entry best;
+    for (size_t ii = 1; ii < queues_.size(); ii++) {
+      const size_t other = (worker + ii) % queues_.size();
+      const std::lock_guard<std::mutex> lock(queues_[other]->mutex);
+      if (!queues_[other]->heap.empty() && (victim == worker || best < queues_[other]->heap.front())) {
+        best = queues_[other]->heap.front();
+        victim = other;
+      }
+    }
+    if (victim == worker) {
+      return false;
+    }
+
+    const std::lock_guard<std::mutex> lock(queues_[victim]->mutex);
+    if (!queues_[victim]->heap.empty()) {
+      take(*queues_[victim]);
+      const std::lock_guard<std::mutex> records_lock(records_mutex_);
+      stats_.num_steals++;
+      return true;
+    }
+  }
+}
+
+void FleetScheduler::push(const size_t worker, const Entry& entry) {
+  {
+    WorkerQueue& queue = *queues_[worker];
+    const std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.heap.push_back(entry);
+    std::push_heap(queue.heap.begin(), queue.heap.end());
+  }
+  num_queued_entries_.fetch_add(1);
+
+  // Taking the lock orders the notification after a worker's check of the predicate.
+  { const std::lock_guard<std::mutex> lock(idle_mutex_); }
+  idle_cv_.notify_one();
+}
+
+void FleetScheduler::runStep(const size_t worker, const Entry& entry) {
+  JobRecord* record = nullptr;
+  const Clock::time_point start_time = Clock::now();
+  {
+    const std::lock_guard<std::mutex> lock(records_mutex_);
+    record = &records_[entry.job_id];
+    if (record->status.state == JobState::QUEUED) {
+      record->status.state = JobState::RUNNING;
+      record->status.start_time = start_time;
+      stats_.num_queued--;
+      stats_.num_running++;
+      queue_latency_.record(start_time - record->status.submit_time);
+    }
+  }
+
+  StepResult result = StepResult::FAILED;
+  size_t memory = 0;
+  try {
+    result = record->job.step();
+    memory = record->job.memory_usage ? record->job.memory_usage() : 0;
+  } catch (const std::exception&) {
+    result = StepResult::FAILED;
+  }
+  step_time_.record(Clock::now() - start_time);
+
+  {
+    const std::lock_guard<std::mutex> lock(records_mutex_);
+    record->status.num_steps++;
+    record->status.peak_memory = std::max(record->status.peak_memory, memory);
+    stats_.num_steps++;
+  }
+
+  if (record->job.memory_limit > 0 && memory > record->job.memory_limit) {
+    finish(*record, JobState::MEMORY_LIMIT_EXCEEDED);
+  } else if (result == StepResult::DONE) {
+    finish(*record, JobState::SUCCEEDED);
+  } else if (result == StepResult::FAILED) {
+    finish(*record, JobState::FAILED);
+  } else {
+    // Requeue behind the entries with the same priority and deadline, so that jobs take turns.
+    Entry next = entry;
+    next.sequence = next_sequence_.fetch_add(1, std::memory_order_relaxed);
+    push(worker, next);
+  }
+}
+
+void FleetScheduler::finish(JobRecord& record, const JobState state) {
+  const Clock::time_point finish_time = Clock::now();
+  const Clock::time_point deadline = record.job.deadline;
+
+  // Release the job's closures, and the solver state they hold, before taking the lock.
+  record.job = Job();
+
+  {
+    const std::lock_guard<std::mutex> lock(records_mutex_);
+    JobStatus& status = record.status;
+    if (status.state == JobState::QUEUED) {
+      stats_.num_queued--;
+    } else {
+      stats_.num_running--;
+    }
+    status.state = state;
+    status.finish_time = finish_time;
+    status.missed_deadline = state != JobState::CANCELLED && finish_time > deadline;
+    stats_.num_missed_deadlines += status.missed_deadline ? 1 : 0;
+    switch (state) {
+      case JobState::SUCCEEDED:
+        stats_.num_succeeded++;
+        break;
+      case JobState::MEMORY_LIMIT_EXCEEDED:
+        stats_.num_memory_limit_exceeded++;
+        break;
+      case JobState::CANCELLED:
+        stats_.num_cancelled++;
+        break;
+      default:
+        stats_.num_failed++;
+        break;
+    }
+    if (state != JobState::CANCELLED) {
+      job_latency_.record(finish_time - status.submit_time);
+    }
+    num_finished_++;
+  }
+  finished_cv_.notify_all();
+}
+
+FleetScheduler::Job MakeCalibrationJob(const std::shared_ptr<const gtsam::Point3Vector>& pts3d_target,
+                                       const std::vector<std::shared_ptr<Camera>>& cameras,
+                                       const std::shared_ptr<const MeasurementBlock>& measurements,
+                                       const BatchSolver::Options& solver_options,
+                                       const size_t frames_per_step,
+                                       const std::function<void(const BatchSolver::State&)>& on_done) {
+  assert(frames_per_step > 0);
+  const auto context =
+      std::make_shared<CalibrationContext>(pts3d_target, cameras, measurements, solver_options);
+
+  FleetScheduler::Job job;
+  job.step = [context, frames_per_step, on_done]() {
+    const MeasurementBlock& block = *context->measurements;
+    const gtsam::Point3Vector& pts3d_target = *context->pts3d_target;
+    const size_t end = std::min(context->next_frame + frames_per_step, block.numFrames());
+    for (; context->next_frame < end; context->next_frame++) {
+      // Frames of unknown cameras, or whose pose can't be initialized, are skipped.
+      const MeasurementSpan frame = block.frame(context->next_frame);
+      if (frame.size() < 4 || frame.cameraIds()[0] >= context->state.cameras.size()) {
+        continue;
+      }
+      const std::shared_ptr<Camera>& camera = context->state.cameras.at(frame.cameraIds()[0]);
+      gtsam::Matrix3 H_image_target;
+      gtsam::Pose3 pose_target_cam;
+      if (!EstimateHomography(frame, pts3d_target, H_image_target) ||
+          !PoseFromHomography(H_image_target, CameraMatrix(*camera), pose_target_cam) ||
+          !context->pose_solver.solve(frame, pts3d_target, camera, pose_target_cam)) {
+        continue;
+      }
+      camera->setCameraPose(pose_target_cam);
+      context->solver.solve(frame, context->state);
+    }
+    if (context->next_frame < block.numFrames()) {
+      return FleetScheduler::StepResult::CONTINUE;
+    }
+
+    if (context->state.num_frames == 0 || !context->solver.optimize(context->state)) {
+      return FleetScheduler::StepResult::FAILED;
+    }
+    if (on_done) {
+      on_done(context->state);
+    }
+    return FleetScheduler::StepResult::DONE;
+  };
+  job.memory_usage = [context]() { return EstimateStateMemory(context->state); };
+  return job;
+}
+
+size_t EstimateStateMemory(const BatchSolver::State& state) {
+  const size_t num_factors = std::max(state.graph.size(), state.isam.getFactorsUnsafe().size());
+  return num_factors * kBytesPerFactor + state.current_estimate.size() * kBytesPerVariable;
+}
+
+}  // namespace gtcal
@@ -1,7 +1,197 @@
+#include "gtcal/alloc_tracker.h"
+#include "gtcal/calibration_bundle.h"
+#include "gtcal/calibration_pipeline.h"
+#include "gtcal/rig.h"
+#include "gtcal/trace.h"
+
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " --rig <rig.txt> --output <result.txt> [options] <log> [<log> ...]\n"
+            << "\n"
+            << "Calibrates the cameras of a rig from detection logs.\n"
+            << "\n"
+            << "Options:\n"
+            << "  --threads <n>                  total number of threads (default: all cores)\n"
+            << "  --pose-solver <ceres|gtsam>    per-frame pose solver (default: ceres)\n"
+            << "  --optimizer <isam2|lm|dogleg>  joint optimizer (default: isam2)\n"
+            << "  --target-factors               use target projection factors instead of landmarks\n"
+            << "  --keyframe-translation <m>     minimum keyframe translation (default: 0.05)\n"
+            << "  --keyframe-rotation <deg>      minimum keyframe rotation (default: 5)\n"
+            << "  --max-pose-error <px>          maximum per-frame RMS reprojection error (default: 5)\n"
+            << "  --bundle <path>                also write a binary calibration bundle\n"
+            << "  --map-format <format>          bundle undistortion maps: float32, float16, fixed16 or\n"
+            << "                                 none (default: float32)\n"
+            << "  --trace <path>                 write a Chrome trace (JSON) of the solver stages, for\n"
+            << "                                 builds with GTCAL_ENABLE_TRACING\n";
+}
+
+void PrintStage(const char* name, const gtcal::LatencyHistogram& histogram) {
+  using Ms = std::chrono::duration<double, std::milli>;
+  using Us = std::chrono::duration<double, std::micro>;
+  const double total_ms = Ms(histogram.mean()).count() * static_cast<double>(histogram.count());
+  std::printf("  %-10s %10zu %12.1f %12.1f %12.1f %12.1f\n", name, static_cast<size_t>(histogram.count()),
+              total_ms, Us(histogram.mean()).count(), Us(histogram.percentile(50.0)).count(),
+              Us(histogram.percentile(99.0)).count());
+}
+
+}  // namespace
 
 int main(int argc, char** argv) {
-  std::cout << "Send help\n";
+  std::string rig_path, output_path, bundle_path, trace_path;
+  std::vector<std::string> log_paths;
+  gtcal::BatchSolver::Options solver_options;
+  gtcal::CalibrationPipeline::Options options;
+  gtcal::CalibrationBundleOptions bundle_options;
+
+  // Parse the command line.
+  for (int ii = 1; ii < argc; ii++) {
+    const std::string arg = argv[ii];
+    const bool has_value = ii + 1 < argc;
+    try {
+      if (arg == "--help" || arg == "-h") {
+        PrintUsage(argv[0]);
+        return 0;
+      } else if (arg == "--rig" && has_value) {
+        rig_path = argv[++ii];
+      } else if (arg == "--output" && has_value) {
+        output_path = argv[++ii];
+      } else if (arg == "--threads" && has_value) {
+        options.num_threads = std::stoul(argv[++ii]);
+      } else if (arg == "--pose-solver" && has_value) {
+        const std::string value = argv[++ii];
+        if (value != "ceres" && value != "gtsam") {
+          throw std::invalid_argument(value);
+        }
+        options.pose_solver_type = value == "ceres" ? gtcal::CalibrationPipeline::PoseSolverType::CERES
+                                                    : gtcal::CalibrationPipeline::PoseSolverType::GTSAM;
+      } else if (arg == "--optimizer" && has_value) {
+        const std::string value = argv[++ii];
+        if (value == "isam2") {
+          solver_options.optimizer_type = gtcal::BatchSolver::OptimizerType::ISAM2;
+        } else if (value == "lm") {
+          solver_options.optimizer_type = gtcal::BatchSolver::OptimizerType::LEVENBERG_MARQUARDT;
+        } else if (value == "dogleg") {
+          solver_options.optimizer_type = gtcal::BatchSolver::OptimizerType::DOGLEG;
+        } else {
+          throw std::invalid_argument(value);
+        }
+      } else if (arg == "--target-factors") {
+        solver_options.use_target_factors = true;
+      } else if (arg == "--keyframe-translation" && has_value) {
+        options.keyframe_min_translation = std::stod(argv[++ii]);
+      } else if (arg == "--keyframe-rotation" && has_value) {
+        options.keyframe_min_rotation_deg = std::stod(argv[++ii]);
+      } else if (arg == "--max-pose-error" && has_value) {
+        options.max_pose_rms_error = std::stod(argv[++ii]);
+      } else if (arg == "--bundle" && has_value) {
+        bundle_path = argv[++ii];
+      } else if (arg == "--map-format" && has_value) {
+        const std::string value = argv[++ii];
+        if (value == "float32") {
+          bundle_options.map_format = gtcal::MapFormat::FLOAT32;
+        } else if (value == "float16") {
+          bundle_options.map_format = gtcal::MapFormat::FLOAT16;
+        } else if (value == "fixed16") {
+          bundle_options.map_format = gtcal::MapFormat::FIXED16;
+        } else if (value == "none") {
+          bundle_options.map_format = gtcal::MapFormat::NONE;
+        } else {
+          throw std::invalid_argument(value);
+        }
+      } else if (arg == "--trace" && has_value) {
+        trace_path = argv[++ii];
+      } else if (arg.rfind("--", 0) == 0) {
+        throw std::invalid_argument(arg);
+      } else {
+        log_paths.push_back(arg);
+      }
+    } catch (const std::exception&) {
+      std::cerr << "Invalid argument: " << arg << "\n\n";
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (rig_path.empty() || output_path.empty() || log_paths.empty()) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  solver_options.num_threads = options.num_threads;
+  bundle_options.num_threads = options.num_threads;
+
+  // Load the rig.
+  gtcal::Rig rig;
+  std::string error;
+  if (!gtcal::LoadRig(rig_path, rig, error)) {
+    std::cerr << "Invalid rig " << rig_path << ": " << error << "\n";
+    return 1;
+  }
+
+  if (!trace_path.empty()) {
+#ifndef GTCAL_ENABLE_TRACING
+    std::cerr << "Built without GTCAL_ENABLE_TRACING, the trace will be empty.\n";
+#endif
+    gtcal::trace::Start();
+  }
+
+  // Calibrate and write the result.
+  gtcal::CalibrationPipeline pipeline(rig, solver_options, options);
+  const bool calibrated = pipeline.run(log_paths);
+  const auto write_start = std::chrono::steady_clock::now();
+  const bool written = calibrated && pipeline.writeResult(output_path);
+  const auto write_time = std::chrono::steady_clock::now() - write_start;
+  const auto bundle_start = std::chrono::steady_clock::now();
+  const bool bundle_written = !written || bundle_path.empty() ||
+                              gtcal::WriteCalibrationBundle(bundle_path, pipeline.state(), bundle_options);
+  const auto bundle_time = std::chrono::steady_clock::now() - bundle_start;
+  gtcal::trace::Stop();
+  const bool trace_written = trace_path.empty() || gtcal::trace::WriteChromeTrace(trace_path);
+
+  // Timing summary.
+  using Ms = std::chrono::duration<double, std::milli>;
+  const gtcal::CalibrationPipeline::Stats stats = pipeline.stats();
+  std::printf("Frames: %zu read, %zu rejected, %zu keyframes, %zu solver failures (%zu pose threads)\n",
+              stats.num_frames, stats.num_rejected, stats.num_keyframes, stats.num_batch_failures,
+              pipeline.numPoseThreads());
+  std::printf("  %-10s %10s %12s %12s %12s %12s\n", "stage", "frames", "total [ms]", "mean [us]", "p50 [us]",
+              "p99 [us]");
+  PrintStage("read", pipeline.readHistogram());
+  PrintStage("pose", pipeline.poseHistogram());
+  PrintStage("batch", pipeline.batchHistogram());
+  std::printf("  %-10s %10s %12.1f\n", "optimize", "", Ms(pipeline.optimizeTime()).count());
+  std::printf("  %-10s %10s %12.1f\n", "write", "", Ms(write_time).count());
+  if (!bundle_path.empty()) {
+    std::printf("  %-10s %10s %12.1f\n", "bundle", "", Ms(bundle_time).count());
+  }
+  std::printf("  %-10s %10s %12.1f\n", "wall", "", Ms(pipeline.runTime() + write_time + bundle_time).count());
+#ifdef GTCAL_ENABLE_ALLOC_TRACKING
+  std::printf("Allocations:\n");
+  std::fflush(stdout);
+  gtcal::alloc::WriteScopeReport(std::cout);
+#endif
 
+  if (!calibrated) {
+    std::cerr << "Calibration failed.\n";
+    return 1;
+  }
+  if (!written) {
+    std::cerr << "Can't write " << output_path << ".\n";
+    return 1;
+  }
+  if (!bundle_written) {
+    std::cerr << "Can't write " << bundle_path << ".\n";
+    return 1;
+  }
+  if (!trace_written) {
+    std::cerr << "Can't write " << trace_path << ".\n";
+    return 1;
+  }
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,101 @@
+#include "gtcal/benchmark_compare.h"
+
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [options] <baseline.json> <contender.json>\n"
+            << "\n"
+            << "Compares two JSON runs of gtcal_benchmarks (--benchmark_out_format=json, ideally with\n"
+            << "--benchmark_repetitions of 5 or more) and flags the benchmarks whose median time changed by\n"
+            << "more than the threshold with a significant Mann-Whitney U test over the repetitions. Exits\n"
+            << "with 2 if any benchmark regressed.\n"
+            << "\n"
+            << "Options:\n"
+            << "  --threshold <percent>  relative change of the median to flag (default: 5)\n"
+            << "  --alpha <p>            significance level of the test (default: 0.05)\n"
+            << "  --cpu-time             compare CPU times instead of real times\n"
+            << "  --filter <regex>       only compare the benchmarks matching the regex\n"
+            << "  --verbose              list unchanged benchmarks too\n"
+            << "  --json <path>          also write every comparison as JSON\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  gtcal::BenchmarkComparator::Options options;
+  std::string filter, json_path;
+  std::vector<std::string> paths;
+  bool verbose = false;
+
+  // Parse the command line.
+  for (int ii = 1; ii < argc; ii++) {
+    const std::string arg = argv[ii];
+    const bool has_value = ii + 1 < argc;
+    try {
+      if (arg == "--help" || arg == "-h") {
+        PrintUsage(argv[0]);
+        return 0;
+      } else if (arg == "--threshold" && has_value) {
+        options.threshold = 0.01 * std::stod(argv[++ii]);
+      } else if (arg == "--alpha" && has_value) {
+        options.alpha = std::stod(argv[++ii]);
+      } else if (arg == "--cpu-time") {
+        options.use_cpu_time = true;
+      } else if (arg == "--filter" && has_value) {
+        filter = argv[++ii];
+        const std::regex check(filter);
+      } else if (arg == "--verbose") {
+        verbose = true;
+      } else if (arg == "--json" && has_value) {
+        json_path = argv[++ii];
+      } else if (!arg.empty() && arg.front() != '-') {
+        paths.push_back(arg);
+      } else {
+        throw std::invalid_argument(arg);
+      }
+    } catch (const std::exception&) {
+      std::cerr << "Invalid argument: " << arg << "\n\n";
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (paths.size() != 2) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // Load both runs, keeping the benchmarks that match the filter.
+  std::vector<gtcal::BenchmarkSamples> runs[2];
+  for (size_t ii = 0; ii < 2; ii++) {
+    std::string error;
+    if (!gtcal::LoadBenchmarkJson(paths[ii], runs[ii], error)) {
+      std::cerr << "Invalid benchmark run " << paths[ii] << ": " << error << "\n";
+      return 1;
+    }
+    if (!filter.empty()) {
+      const std::regex regex(filter);
+      std::erase_if(runs[ii], [&regex](const gtcal::BenchmarkSamples& samples) {
+        return !std::regex_search(samples.name, regex);
+      });
+    }
+  }
+
+  const gtcal::BenchmarkComparator comparator(options);
+  const auto comparisons = comparator.compare(runs[0], runs[1]);
+  comparator.writeReport(comparisons, std::cout, verbose);
+  if (!json_path.empty()) {
+    std::ofstream file(json_path);
+    comparator.writeJson(comparisons, file);
+    if (!file) {
+      std::cerr << "Can't write " << json_path << ".\n";
+      return 1;
+    }
+  }
+  return gtcal::BenchmarkComparator::NumRegressions(comparisons) > 0 ? 2 : 0;
+}
@@ -0,0 +1,152 @@
+#include "gtcal/monte_carlo.h"
+#include "gtcal/rig.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " --rig <rig.txt> [options]\n"
+            << "\n"
+            << "Runs seeded calibration trials on synthetic scenarios of a rig and summarizes the errors\n"
+            << "and timings of the pose and batch solvers.\n"
+            << "\n"
+            << "Options:\n"
+            << "  --trials <n>                   number of trials (default: 1000)\n"
+            << "  --frames <n>                   frames per trial (default: 20)\n"
+            << "  --threads <n>                  number of threads (default: all cores)\n"
+            << "  --seed <n>                     seed of the scenarios and perturbations (default: 0)\n"
+            << "  --trajectory <sphere|arc>      camera trajectory (default: sphere)\n"
+            << "  --pixel-sigma <px>             pixel noise standard deviation (default: 0.2)\n"
+            << "  --pose-sigma <deg> <m>         initial pose perturbation (default: 2 0.02)\n"
+            << "  --intrinsics-sigma <rel> <px>  initial focal length and principal point perturbation\n"
+            << "                                 (default: 0.02 5)\n"
+            << "  --optimizer <isam2|lm|dogleg>  batch optimizer (default: lm)\n"
+            << "  --target-factors               use target projection factors instead of landmarks\n"
+            << "  --no-pose-solver               skip the Ceres pose solver\n"
+            << "  --no-pose-solver-gtsam         skip the gtsam pose solver\n"
+            << "  --no-batch-solver              skip the batch solver\n"
+            << "  --json <path>                  write the JSON summary to a file instead of stdout\n";
+}
+
+void PrintSolver(const char* name, const gtcal::MonteCarloHarness::SolverStatistics& statistics) {
+  using Us = std::chrono::duration<double, std::micro>;
+  std::fprintf(stderr, "  %-18s %8zu %12.3e %12.3e %12.3e %12.3e %12.1f %12.1f\n", name,
+               static_cast<size_t>(statistics.num_failures.load()), statistics.translation_error.mean(),
+               statistics.translation_error.percentile(99.0), statistics.rotation_error_deg.mean(),
+               statistics.intrinsics_error.mean(), Us(statistics.solve_time.mean()).count(),
+               Us(statistics.solve_time.percentile(99.0)).count());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string rig_path, json_path;
+  gtcal::MonteCarloHarness::Options options;
+
+  // Parse the command line.
+  for (int ii = 1; ii < argc; ii++) {
+    const std::string arg = argv[ii];
+    const bool has_value = ii + 1 < argc;
+    const bool has_two_values = ii + 2 < argc;
+    try {
+      if (arg == "--help" || arg == "-h") {
+        PrintUsage(argv[0]);
+        return 0;
+      } else if (arg == "--rig" && has_value) {
+        rig_path = argv[++ii];
+      } else if (arg == "--trials" && has_value) {
+        options.num_trials = std::stoul(argv[++ii]);
+      } else if (arg == "--frames" && has_value) {
+        options.frames_per_trial = std::stoul(argv[++ii]);
+      } else if (arg == "--threads" && has_value) {
+        options.num_threads = std::stoul(argv[++ii]);
+      } else if (arg == "--seed" && has_value) {
+        options.seed = std::stoull(argv[++ii]);
+      } else if (arg == "--trajectory" && has_value) {
+        const std::string value = argv[++ii];
+        if (value != "sphere" && value != "arc") {
+          throw std::invalid_argument(value);
+        }
+        options.scenario_options.trajectory = value == "sphere" ? gtcal::ScenarioGenerator::Trajectory::SPHERE
+                                                                : gtcal::ScenarioGenerator::Trajectory::ARC;
+      } else if (arg == "--pixel-sigma" && has_value) {
+        options.scenario_options.pixel_sigma = std::stod(argv[++ii]);
+      } else if (arg == "--pose-sigma" && has_two_values) {
+        options.pose_rotation_sigma_deg = std::stod(argv[++ii]);
+        options.pose_translation_sigma = std::stod(argv[++ii]);
+      } else if (arg == "--intrinsics-sigma" && has_two_values) {
+        options.focal_length_sigma = std::stod(argv[++ii]);
+        options.principal_point_sigma = std::stod(argv[++ii]);
+      } else if (arg == "--optimizer" && has_value) {
+        const std::string value = argv[++ii];
+        if (value == "isam2") {
+          options.batch_options.optimizer_type = gtcal::BatchSolver::OptimizerType::ISAM2;
+        } else if (value == "lm") {
+          options.batch_options.optimizer_type = gtcal::BatchSolver::OptimizerType::LEVENBERG_MARQUARDT;
+        } else if (value == "dogleg") {
+          options.batch_options.optimizer_type = gtcal::BatchSolver::OptimizerType::DOGLEG;
+        } else {
+          throw std::invalid_argument(value);
+        }
+      } else if (arg == "--target-factors") {
+        options.batch_options.use_target_factors = true;
+      } else if (arg == "--no-pose-solver") {
+        options.run_pose_solver = false;
+      } else if (arg == "--no-pose-solver-gtsam") {
+        options.run_pose_solver_gtsam = false;
+      } else if (arg == "--no-batch-solver") {
+        options.run_batch_solver = false;
+      } else if (arg == "--json" && has_value) {
+        json_path = argv[++ii];
+      } else {
+        throw std::invalid_argument(arg);
+      }
+    } catch (const std::exception&) {
+      std::cerr << "Invalid argument: " << arg << "\n\n";
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (rig_path.empty() || options.frames_per_trial == 0) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // Load the rig.
+  gtcal::Rig rig;
+  std::string error;
+  if (!gtcal::LoadRig(rig_path, rig, error)) {
+    std::cerr << "Invalid rig " << rig_path << ": " << error << "\n";
+    return 1;
+  }
+
+  gtcal::MonteCarloHarness harness(rig, options);
+  harness.run();
+
+  // Human-readable summary on stderr, JSON on stdout or in a file.
+  using Seconds = std::chrono::duration<double>;
+  std::fprintf(stderr, "Trials: %zu in %.1f s (%zu threads)\n", harness.numTrialsCompleted(),
+               Seconds(harness.runTime()).count(), harness.numThreads());
+  std::fprintf(stderr, "  %-18s %8s %12s %12s %12s %12s %12s %12s\n", "solver", "failures", "mean t [m]",
+               "p99 t [m]", "mean r [deg]", "mean K [px]", "mean [us]", "p99 [us]");
+  PrintSolver("pose_solver", harness.statistics(gtcal::MonteCarloHarness::Solver::POSE_SOLVER));
+  PrintSolver("pose_solver_gtsam", harness.statistics(gtcal::MonteCarloHarness::Solver::POSE_SOLVER_GTSAM));
+  PrintSolver("batch_solver", harness.statistics(gtcal::MonteCarloHarness::Solver::BATCH_SOLVER));
+  if (json_path.empty()) {
+    harness.writeJson(std::cout);
+  } else {
+    std::ofstream file(json_path);
+    harness.writeJson(file);
+    if (!file) {
+      std::cerr << "Can't write " << json_path << ".\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "gtcal/homography.h"
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/SVD>
+
+#include <cmath>
+
+namespace gtcal {
+namespace {
+
+/**
+ * @brief Return the similarity transform that moves the points' centroid to the origin and scales their mean
+ * distance to it to sqrt(2) (Hartley normalization).
+ *
+ */
+gtsam::Matrix3 NormalizingTransform(const std::vector<Eigen::Vector2d>& points) {
+  Eigen::Vector2d centroid = Eigen::Vector2d::Zero();
+  for (const auto& point : points) {
+    centroid += point;
+  }
+  centroid /= static_cast<double>(points.size());
+
+  double mean_distance = 0.0;
+  for (const auto& point : points) {
+    mean_distance += (point - centroid).norm();
+  }
+  mean_distance /= static_cast<double>(points.size());
+  const double scale = mean_distance > 0.0 ? std::sqrt(2.0) / mean_distance : 1.0;
+
+  gtsam::Matrix3 T;
+  T << scale, 0.0, -scale * centroid.x(), 0.0, scale, -scale * centroid.y(), 0.0, 0.0, 1.0;
+  return T;
+}
+
+template <typename MeasurementRange>
+bool EstimateHomographyImpl(const MeasurementRange& measurements, const gtsam::Point3Vector& pts3d_target,
+                            gtsam::Matrix3& H_image_target) {
+  if (measurements.size() < 4) {
+    return false;
+  }
+
+  std::vector<Eigen::Vector2d> pts_image, pts_target;
+  pts_image.reserve(measurements.size());
+  pts_target.reserve(measurements.size());
+  for (const auto& meas : measurements) {
+    const gtsam::Point3& pt3d_target = pts3d_target.at(meas.point_id);
+    pts_image.emplace_back(meas.uv.x(), meas.uv.y());
+    pts_target.emplace_back(pt3d_target.x(), pt3d_target.y());
+  }
+  const gtsam::Matrix3 T_image = NormalizingTransform(pts_image);
+  const gtsam::Matrix3 T_target = NormalizingTransform(pts_target);
+
+  // Accumulate A^T A of the DLT system A h = 0 instead of A itself, which keeps the memory constant.
+  Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
+  for (size_t ii = 0; ii < pts_image.size(); ii++) {
+    const Eigen::Vector3d p = T_target * pts_target[ii].homogeneous();
+    const Eigen::Vector3d q = T_image * pts_image[ii].homogeneous();
+    Eigen::Matrix<double, 9, 1> row_u, row_v;
+    row_u << -p.x(), -p.y(), -1.0, 0.0, 0.0, 0.0, q.x() * p.x(), q.x() * p.y(), q.x();
+    row_v << 0.0, 0.0, 0.0, -p.x(), -p.y(), -1.0, q.y() * p.x(), q.y() * p.y(), q.y();
+    AtA.noalias() += row_u * row_u.transpose() + row_v * row_v.transpose();
+  }
+
+  // The solution is the eigenvector of the smallest eigenvalue. A second (near) zero eigenvalue means the
+  // points don't constrain the homography.
+  const Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> solver(AtA);
+  if (solver.info() != Eigen::Success || solver.eigenvalues()(1) <= 1e-12 * solver.eigenvalues()(8)) {
+    return false;
+  }
+  const Eigen::Matrix<double, 9, 1> h = solver.eigenvectors().col(0);
+  gtsam::Matrix3 H_normalized;
+  H_normalized << h(0), h(1), h(2), h(3), h(4), h(5), h(6), h(7), h(8);
+
+  // Undo the normalization.
+  H_image_target = T_image.inverse() * H_normalized * T_target;
+  if (std::abs(H_image_target(2, 2)) < 1e-12 || !H_image_target.allFinite()) {
+    return false;
+  }
+  H_image_target /= H_image_target(2, 2);
+  return true;
+}
+
+}  // namespace
+
+bool EstimateHomography(const std::vector<Measurement>& measurements, const gtsam::Point3Vector& pts3d_target,
+                        gtsam::Matrix3& H_image_target) {
+  return EstimateHomographyImpl(measurements, pts3d_target, H_image_target);
+}
+
+bool EstimateHomography(const MeasurementSpan& measurements, const gtsam::Point3Vector& pts3d_target,
+                        gtsam::Matrix3& H_image_target) {
+  return EstimateHomographyImpl(measurements, pts3d_target, H_image_target);
+}
+
+bool PoseFromHomography(const gtsam::Matrix3& H_image_target, const gtsam::Matrix3& K,
+                        gtsam::Pose3& pose_target_cam) {
+  // K^-1 H = lambda [r1 r2 t] for a target in the z = 0 plane.
+  const gtsam::Matrix3 M = K.inverse() * H_image_target;
+  const double norm1 = M.col(0).norm();
+  const double norm2 = M.col(1).norm();
+  if (norm1 < 1e-12 || norm2 < 1e-12) {
+    return false;
+  }
+  double lambda = 2.0 / (norm1 + norm2);
+
+  // The target must be in front of the camera.
+  if (M(2, 2) < 0.0) {
+    lambda = -lambda;
+  }
+  const gtsam::Vector3 r1 = lambda * M.col(0);
+  const gtsam::Vector3 r2 = lambda * M.col(1);
+  const gtsam::Vector3 t = lambda * M.col(2);
+
+  // Project onto the closest rotation, since r1 and r2 are only orthonormal without noise.
+  gtsam::Matrix3 R;
+  R << r1, r2, r1.cross(r2);
+  const Eigen::JacobiSVD<gtsam::Matrix3> svd(R, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  gtsam::Matrix3 U = svd.matrixU();
+  if ((U * svd.matrixV().transpose()).determinant() < 0.0) {
+    U.col(2) *= -1.0;
+  }
+  R = U * svd.matrixV().transpose();
+
+  const gtsam::Pose3 pose_cam_target(gtsam::Rot3(R), t);
+  pose_target_cam = pose_cam_target.inverse();
+  return true;
+}
+
+gtsam::Matrix3 CameraMatrix(const Camera& camera) {
+  const std::vector<double> intrinsics = camera.intrinsicsParameters();
+  gtsam::Matrix3 K;
+  K << intrinsics.at(0), 0.0, intrinsics.at(2), 0.0, intrinsics.at(1), intrinsics.at(3), 0.0, 0.0, 1.0;
+  return K;
+}
+
+}  // namespace gtcal
@@ -0,0 +1,130 @@
+#include "gtcal/image.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace gtcal {
+namespace {
+
+/**
+ * @brief Skip whitespace and '#' comments in a PGM header.
+ *
+ */
+void SkipPgmWhitespace(std::string_view data, size_t& pos) {
+  while (pos < data.size()) {
+    if (data[pos] == '#') {
+      while (pos < data.size() && data[pos] != '\n') {
+        pos++;
+      }
+    } else if (std::isspace(static_cast<unsigned char>(data[pos]))) {
+      pos++;
+    } else {
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Return true if a positive integer of the PGM header was parsed.
+ *
+ */
+bool ParsePgmValue(std::string_view data, size_t& pos, size_t& value) {
+  SkipPgmWhitespace(data, pos);
+  const auto [end, ec] = std::from_chars(data.data() + pos, data.data() + data.size(), value);
+  if (ec != std::errc() || value == 0) {
+    return false;
+  }
+  pos = end - data.data();
+  return true;
+}
+
+/**
+ * @brief Return the contents of a file, or false if it can't be read.
+ *
+ */
+bool ReadFile(const std::string& path, std::string& contents, std::string& error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    error = "can't open " + path + ".";
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  contents = buffer.str();
+  return true;
+}
+
+}  // namespace
+
+bool ParsePgm(std::string_view data, Image& image, std::string& error) {
+  image = Image();
+  if (data.substr(0, 2) != "P5") {
+    error = "not a binary PGM image (expected 'P5').";
+    return false;
+  }
+
+  size_t pos = 2;
+  size_t width = 0, height = 0, max_value = 0;
+  if (!ParsePgmValue(data, pos, width) || !ParsePgmValue(data, pos, height) ||
+      !ParsePgmValue(data, pos, max_value)) {
+    error = "invalid PGM header.";
+    return false;
+  }
+  if (max_value > 255) {
+    error = "only 8-bit PGM images are supported.";
+    return false;
+  }
+
+  // A single whitespace character separates the header from the pixels.
+  if (pos >= data.size() || !std::isspace(static_cast<unsigned char>(data[pos]))) {
+    error = "invalid PGM header.";
+    return false;
+  }
+  pos++;
+  if (data.size() - pos < width * height) {
+    error = "PGM image is truncated.";
+    return false;
+  }
+
+  image = Image(width, height);
+  std::memcpy(image.pixels.data(), data.data() + pos, width * height);
+  return true;
+}
+
+bool ReadPgm(const std::string& path, Image& image, std::string& error) {
+  std::string contents;
+  return ReadFile(path, contents, error) && ParsePgm(contents, image, error);
+}
+
+bool ReadRawImage(const std::string& path, const size_t width, const size_t height, Image& image,
+                  std::string& error) {
+  image = Image();
+  std::string contents;
+  if (!ReadFile(path, contents, error)) {
+    return false;
+  }
+  if (width == 0 || height == 0 || contents.size() != width * height) {
+    error = "expected " + std::to_string(width * height) + " bytes in " + path + ", got " +
+            std::to_string(contents.size()) + ".";
+    return false;
+  }
+
+  image = Image(width, height);
+  std::memcpy(image.pixels.data(), contents.data(), contents.size());
+  return true;
+}
+
+bool WritePgm(const std::string& path, const Image& image) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+  file << "P5\n" << image.width << " " << image.height << "\n255\n";
+  file.write(reinterpret_cast<const char*>(image.pixels.data()), image.pixels.size());
+  return file.good();
+}
+
+}  // namespace gtcal
@@ -0,0 +1,324 @@
+#include "gtcal/monte_carlo.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+#include <gtsam/geometry/Cal3Fisheye.h>
+#include <gtsam/geometry/Cal3_S2.h>
+#include <gtsam/inference/Symbol.h>
+
+#include "gtcal/philox.h"
+#include "gtcal/pose_solver.h"
+#include "gtcal/pose_solver_gtsam.h"
+
+using gtsam::symbol_shorthand::X;
+
+namespace gtcal {
+namespace {
+
+// Substream of the trial's CounterRng stream drawing the perturbations.
+static constexpr uint32_t kPerturbationSubstream = 0;
+
+/**
+ * @brief Return the scenario options of the harness: one frame range per trial, generated by the trials'
+ * own threads.
+ *
+ */
+ScenarioGenerator::Options MakeScenarioOptions(const MonteCarloHarness::Options& options) {
+  ScenarioGenerator::Options scenario_options = options.scenario_options;
+  scenario_options.num_frames = options.num_trials * options.frames_per_trial;
+  scenario_options.seed = options.seed;
+  scenario_options.num_threads = 1;
+  return scenario_options;
+}
+
+/**
+ * @brief Return a copy of a camera with perturbed focal lengths and principal point.
+ *
+ */
+std::shared_ptr<Camera> PerturbIntrinsics(const Camera& camera, const MonteCarloHarness::Options& options,
+                                          CounterRng& rng) {
+  auto perturbed = std::make_shared<Camera>();
+  std::visit(
+      [&](auto&& model) {
+        const auto K = model->calibration();
+        const double fx = K.fx() * (1.0 + rng.normal(0.0, options.focal_length_sigma));
+        const double fy = K.fy() * (1.0 + rng.normal(0.0, options.focal_length_sigma));
+        const double cx = K.px() + rng.normal(0.0, options.principal_point_sigma);
+        const double cy = K.py() + rng.normal(0.0, options.principal_point_sigma);
+        if constexpr (std::is_same_v<std::decay_t<decltype(K)>, gtsam::Cal3_S2>) {
+          perturbed->setCameraModel<gtsam::Cal3_S2>(model->width(), model->height(),
+                                                    gtsam::Cal3_S2(fx, fy, K.skew(), cx, cy));
+        } else {
+          perturbed->setCameraModel<gtsam::Cal3Fisheye>(
+              model->width(), model->height(),
+              gtsam::Cal3Fisheye(fx, fy, K.skew(), cx, cy, K.k1(), K.k2(), K.k3(), K.k4()));
+        }
+      },
+      camera.cameraVariant());
+  return perturbed;
+}
+
+/**
+ * @brief Record the translation and rotation errors of an estimated pose.
+ *
+ */
+void RecordPoseError(const gtsam::Pose3& estimate, const gtsam::Pose3& truth,
+                     MonteCarloHarness::SolverStatistics& statistics) {
+  statistics.translation_error.record((estimate.translation() - truth.translation()).norm());
+  const gtsam::Rot3 delta = truth.rotation().between(estimate.rotation());
+  statistics.rotation_error_deg.record(utils::RadToDeg(gtsam::Rot3::Logmap(delta).norm()));
+}
+
+/**
+ * @brief Write the summary of a statistic as a JSON object.
+ *
+ */
+void WriteStatistics(std::ostream& os, const char* name, const StreamingStatistics& statistics) {
+  os << "      \"" << name << "\": {\"count\": " << statistics.count() << ", \"mean\": " << statistics.mean()
+     << ", \"std\": " << statistics.stdDev() << ", \"p50\": " << statistics.percentile(50.0)
+     << ", \"p90\": " << statistics.percentile(90.0) << ", \"p99\": " << statistics.percentile(99.0)
+     << ", \"max\": " << statistics.max() << "}";
+}
+
+/**
+ * @brief Write the summary of a latency histogram in microseconds as a JSON object.
+ *
+ */
+void WriteLatency(std::ostream& os, const char* name, const LatencyHistogram& histogram) {
+  const auto us = [](const std::chrono::nanoseconds duration) { return 1e-3 * duration.count(); };
+  os << "      \"" << name << "\": {\"count\": " << histogram.count()
+     << ", \"mean\": " << us(histogram.mean()) << ", \"p50\": " << us(histogram.percentile(50.0))
+     << ", \"p90\": " << us(histogram.percentile(90.0)) << ", \"p99\": " << us(histogram.percentile(99.0))
+     << ", \"max\": " << us(histogram.max()) << "}";
+}
+
+}  // namespace
+
+StreamingStatistics::StreamingStatistics() {
+  quantiles_.reserve(kPercentiles.size());
+  for (const double percentile : kPercentiles) {
+    quantiles_.emplace_back(0.01 * percentile);
+  }
+}
+
+void StreamingStatistics::record(const double value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_ = count_ == 0 ? value : std::max(max_, value);
+  count_++;
+  sum_ += value;
+  sum2_ += value * value;
+  for (auto& quantile : quantiles_) {
+    quantile.add(value);
+  }
+}
+
+uint64_t StreamingStatistics::count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return count_;
+}
+
+double StreamingStatistics::mean() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return count_ == 0 ? 0.0 : sum_ / static_cast<double>(count_);
+}
+
+double StreamingStatistics::stdDev() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (count_ < 2) {
+    return 0.0;
+  }
+  const double n = static_cast<double>(count_);
+  const double mean = sum_ / n;
+  const double variance = (sum2_ - n * mean * mean) / (n - 1.0);
+  return std::sqrt(std::max(variance, 0.0));
+}
+
+double StreamingStatistics::max() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return max_;
+}
+
+double StreamingStatistics::percentile(const double percentile) const {
+  assert(std::find(kPercentiles.begin(), kPercentiles.end(), percentile) != kPercentiles.end() &&
+         "[StreamingStatistics::percentile] Percentile isn't tracked.");
+  size_t closest = 0;
+  for (size_t ii = 1; ii < kPercentiles.size(); ii++) {
+    if (std::abs(kPercentiles[ii] - percentile) < std::abs(kPercentiles[closest] - percentile)) {
+      closest = ii;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return quantiles_.at(closest).value();
+}
+
+MonteCarloHarness::MonteCarloHarness(const Rig& rig) : MonteCarloHarness(rig, Options()) {}
+
+MonteCarloHarness::MonteCarloHarness(const Rig& rig, const Options& options)
+  : options_(options),
+    rig_(rig),
+    pts3d_target_(rig.target().pointsTarget()),
+    generator_(rig, MakeScenarioOptions(options)),
+    batch_solver_(pts3d_target_, options.batch_options) {
+  assert(options_.frames_per_trial > 0 && "[MonteCarloHarness] Trials need at least one frame.");
+}
+
+void MonteCarloHarness::run() {
+  const size_t max_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  num_threads_ = std::clamp<size_t>(options_.num_trials, 1, max_threads);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> next_trial{0};
+  const auto worker = [&]() {
+    Worker state;
+    state.pose_solver = std::make_unique<PoseSolver>();
+    state.pose_solver_gtsam = std::make_unique<PoseSolverGtsam>(PoseSolverGtsam::Options());
+    state.cameras = rig_.cloneCameras();
+    for (size_t tt = next_trial.fetch_add(1); tt < options_.num_trials; tt = next_trial.fetch_add(1)) {
+      runTrial(tt, state);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t tt = 0; tt < num_threads_; tt++) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  run_time_ = std::chrono::steady_clock::now() - start;
+}
+
+void MonteCarloHarness::runTrial(const size_t trial, Worker& worker) {
+  CounterRng rng(options_.seed, trial, kPerturbationSubstream);
+  std::vector<std::shared_ptr<Camera>> perturbed_cameras;
+  for (const auto& camera : rig_.cameras) {
+    perturbed_cameras.push_back(PerturbIntrinsics(*camera, options_, rng));
+  }
+
+  // Generate the frames and their perturbed initial poses.
+  const double rotation_sigma = utils::DegToRad(options_.pose_rotation_sigma_deg);
+  std::vector<std::vector<Measurement>> frames;
+  std::vector<ScenarioGenerator::Frame> truths;
+  std::vector<gtsam::Pose3> initial_poses;
+  for (size_t ii = 0; ii < options_.frames_per_trial; ii++) {
+    std::vector<Measurement> measurements;
+    const ScenarioGenerator::Frame truth =
+        generator_.frame(trial * options_.frames_per_trial + ii, measurements);
+    const gtsam::Vector3 rotation_noise(rng.normal(), rng.normal(), rng.normal());
+    const gtsam::Vector3 translation_noise(rng.normal(), rng.normal(), rng.normal());
+    if (measurements.size() < options_.min_measurements) {
+      continue;
+    }
+    frames.push_back(std::move(measurements));
+    truths.push_back(truth);
+    initial_poses.push_back(
+        truth.pose_target_cam.compose(gtsam::Pose3(gtsam::Rot3::Expmap(rotation_sigma * rotation_noise),
+                                                   options_.pose_translation_sigma * translation_noise)));
+  }
+
+  // Pose solvers, from the true intrinsics.
+  for (size_t ii = 0; ii < frames.size(); ii++) {
+    const std::shared_ptr<Camera>& camera = worker.cameras.at(truths[ii].camera_id);
+    for (const Solver solver : {Solver::POSE_SOLVER, Solver::POSE_SOLVER_GTSAM}) {
+      if ((solver == Solver::POSE_SOLVER && !options_.run_pose_solver) ||
+          (solver == Solver::POSE_SOLVER_GTSAM && !options_.run_pose_solver_gtsam)) {
+        continue;
+      }
+      SolverStatistics& statistics = statistics_[static_cast<size_t>(solver)];
+      gtsam::Pose3 pose_target_cam = initial_poses[ii];
+      const auto start = std::chrono::steady_clock::now();
+      bool solved = false;
+      try {
+        solved = solver == Solver::POSE_SOLVER
+                     ? worker.pose_solver->solve(frames[ii], pts3d_target_, camera, pose_target_cam)
+                     : worker.pose_solver_gtsam->solve(frames[ii], pts3d_target_, camera, pose_target_cam);
+      } catch (const std::exception&) {
+        solved = false;
+      }
+      statistics.solve_time.record(std::chrono::steady_clock::now() - start);
+      if (solved) {
+        RecordPoseError(pose_target_cam, truths[ii].pose_target_cam, statistics);
+      } else {
+        statistics.num_failures.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Batch solver, from the perturbed intrinsics.
+  if (options_.run_batch_solver && !frames.empty()) {
+    SolverStatistics& statistics = statistics_[static_cast<size_t>(Solver::BATCH_SOLVER)];
+    const auto start = std::chrono::steady_clock::now();
+    BatchSolver::State state(perturbed_cameras, options_.batch_options);
+    bool solved = true;
+    try {
+      for (size_t ii = 0; ii < frames.size(); ii++) {
+        state.cameras.at(truths[ii].camera_id)->setCameraPose(initial_poses[ii]);
+        batch_solver_.solve(frames[ii], state);
+      }
+      solved = batch_solver_.optimize(state);
+    } catch (const std::exception&) {
+      solved = false;
+    }
+    statistics.solve_time.record(std::chrono::steady_clock::now() - start);
+    if (solved) {
+      for (size_t ii = 0; ii < frames.size(); ii++) {
+        RecordPoseError(state.current_estimate.at<gtsam::Pose3>(X(ii)), truths[ii].pose_target_cam,
+                        statistics);
+      }
+      for (size_t cc = 0; cc < rig_.cameras.size(); cc++) {
+        if (state.num_camera_updates.at(cc) == 0) {
+          continue;
+        }
+        const std::vector<double> estimate = state.cameras.at(cc)->intrinsicsParameters();
+        const std::vector<double> truth = rig_.cameras.at(cc)->intrinsicsParameters();
+        double error = 0.0;
+        for (size_t pp = 0; pp < 4; pp++) {
+          error = std::max(error, std::abs(estimate.at(pp) - truth.at(pp)));
+        }
+        statistics.intrinsics_error.record(error);
+      }
+    } else {
+      statistics.num_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  num_trials_completed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MonteCarloHarness::writeJson(std::ostream& os) const {
+  static constexpr const char* kSolverNames[kNumSolvers] = {"pose_solver", "pose_solver_gtsam",
+                                                            "batch_solver"};
+  const std::ios::fmtflags flags = os.flags();
+  const std::streamsize precision = os.precision();
+  os << std::setprecision(9);
+  os << "{\n"
+     << "  \"num_trials\": " << options_.num_trials << ",\n"
+     << "  \"num_trials_completed\": " << numTrialsCompleted() << ",\n"
+     << "  \"frames_per_trial\": " << options_.frames_per_trial << ",\n"
+     << "  \"seed\": " << options_.seed << ",\n"
+     << "  \"num_threads\": " << num_threads_ << ",\n"
+     << "  \"pixel_sigma\": " << options_.scenario_options.pixel_sigma << ",\n"
+     << "  \"run_time_s\": " << 1e-9 * run_time_.count() << ",\n"
+     << "  \"solvers\": {\n";
+  for (size_t ss = 0; ss < kNumSolvers; ss++) {
+    const SolverStatistics& statistics = statistics_[ss];
+    os << "    \"" << kSolverNames[ss] << "\": {\n"
+       << "      \"num_failures\": " << statistics.num_failures.load(std::memory_order_relaxed) << ",\n";
+    WriteStatistics(os, "translation_error_m", statistics.translation_error);
+    os << ",\n";
+    WriteStatistics(os, "rotation_error_deg", statistics.rotation_error_deg);
+    os << ",\n";
+    WriteStatistics(os, "intrinsics_error_px", statistics.intrinsics_error);
+    os << ",\n";
+    WriteLatency(os, "solve_time_us", statistics.solve_time);
+    os << "\n    }" << (ss + 1 < kNumSolvers ? "," : "") << "\n";
+  }
+  os << "  }\n}\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+}  // namespace gtcal
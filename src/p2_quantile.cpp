@@ -0,0 +1,92 @@
+#include "gtcal/p2_quantile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace gtcal {
+
+P2Quantile::P2Quantile(const double p) : p_(p) {
+  assert(p > 0.0 && p < 1.0);
+  reset();
+}
+
+void P2Quantile::reset() {
+  count_ = 0;
+  heights_.fill(0.0);
+  positions_ = {1.0, 2.0, 3.0, 4.0, 5.0};
+  desired_ = {1.0, 1.0 + 2.0 * p_, 1.0 + 4.0 * p_, 3.0 + 2.0 * p_, 5.0};
+  desired_increment_ = {0.0, 0.5 * p_, p_, 0.5 * (1.0 + p_), 1.0};
+}
+
+void P2Quantile::add(const double x) {
+  // The first five samples are the initial marker heights.
+  if (count_ < 5) {
+    heights_[count_++] = x;
+    if (count_ == 5) {
+      std::sort(heights_.begin(), heights_.end());
+    }
+    return;
+  }
+
+  // Find the cell of the sample, extending the extreme markers if needed, and shift the markers above it.
+  size_t cell = 0;
+  if (x < heights_[0]) {
+    heights_[0] = x;
+  } else if (x >= heights_[4]) {
+    heights_[4] = x;
+    cell = 3;
+  } else {
+    while (cell < 3 && x >= heights_[cell + 1]) {
+      cell++;
+    }
+  }
+  for (size_t ii = cell + 1; ii < 5; ii++) {
+    positions_[ii] += 1.0;
+  }
+  for (size_t ii = 0; ii < 5; ii++) {
+    desired_[ii] += desired_increment_[ii];
+  }
+  count_++;
+
+  // Move the middle markers that are off their desired position by a position or more.
+  for (size_t ii = 1; ii < 4; ii++) {
+    const double offset = desired_[ii] - positions_[ii];
+    if ((offset >= 1.0 && positions_[ii + 1] - positions_[ii] > 1.0) ||
+        (offset <= -1.0 && positions_[ii - 1] - positions_[ii] < -1.0)) {
+      const double d = offset > 0.0 ? 1.0 : -1.0;
+      const double height = parabolic(ii, d);
+      if (heights_[ii - 1] < height && height < heights_[ii + 1]) {
+        heights_[ii] = height;
+      } else {
+        // The parabola would break the ordering of the markers, move linearly instead.
+        const size_t neighbor = d > 0.0 ? ii + 1 : ii - 1;
+        heights_[ii] += d * (heights_[neighbor] - heights_[ii]) / (positions_[neighbor] - positions_[ii]);
+      }
+      positions_[ii] += d;
+    }
+  }
+}
+
+double P2Quantile::parabolic(const size_t ii, const double d) const {
+  const double* n = positions_.data();
+  const double* q = heights_.data();
+  return q[ii] + d / (n[ii + 1] - n[ii - 1]) *
+                     ((n[ii] - n[ii - 1] + d) * (q[ii + 1] - q[ii]) / (n[ii + 1] - n[ii]) +
+                      (n[ii + 1] - n[ii] - d) * (q[ii] - q[ii - 1]) / (n[ii] - n[ii - 1]));
+}
+
+double P2Quantile::value() const {
+  if (count_ == 0) {
+    return 0.0;
+  }
+  if (count_ > 5) {
+    return heights_[2];
+  }
+  // The first samples are kept as they are.
+  std::array<double, 5> samples = heights_;
+  std::sort(samples.begin(), samples.begin() + count_);
+  return samples[static_cast<size_t>(std::round(p_ * static_cast<double>(count_ - 1)))];
+}
+
+}  // namespace gtcal
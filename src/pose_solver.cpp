@@ -1,8 +1,32 @@
 #include "gtcal/pose_solver.h"
+#include "gtcal/alloc_tracker.h"
+#include "gtcal/trace.h"
 #include <gtsam/geometry/PinholeCamera.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace gtcal {
 
+namespace {
+
+// Relative step of the central differences of PlanarTargetProjection, the default of
+// ceres::NumericDiffOptions used by ReprojectionErrorResidual.
+constexpr double kRelativeStepSize = 1e-6;
+
+/**
+ * @brief Return the camera pose in the target frame held by a parameter block (x, y, z, roll, pitch, yaw).
+ *
+ */
+gtsam::Pose3 PoseFromArray(const double* pose_target_cam_arr) {
+  const gtsam::Rot3 rot =
+      gtsam::Rot3::RzRyRx(pose_target_cam_arr[3], pose_target_cam_arr[4], pose_target_cam_arr[5]);
+  const gtsam::Point3 xyz = {pose_target_cam_arr[0], pose_target_cam_arr[1], pose_target_cam_arr[2]};
+  return gtsam::Pose3(rot, xyz);
+}
+
+}  // namespace
+
 ReprojectionErrorResidual::ReprojectionErrorResidual(const gtsam::Point2& uv,
                                                      const gtsam::Point3& pt3d_target,
                                                      const std::shared_ptr<Camera>& cmod)
@@ -10,10 +34,7 @@ ReprojectionErrorResidual::ReprojectionErrorResidual(const gtsam::Point2& uv,
 
 bool ReprojectionErrorResidual::operator()(const double* const pose_target_cam_arr, double* residuals) const {
   // Get pose vector using current pose estimate.
-  const gtsam::Rot3 rot =
-      gtsam::Rot3::RzRyRx(pose_target_cam_arr[3], pose_target_cam_arr[4], pose_target_cam_arr[5]);
-  const gtsam::Point3 xyz = {pose_target_cam_arr[0], pose_target_cam_arr[1], pose_target_cam_arr[2]};
-  const gtsam::Pose3 pose_target_cam = gtsam::Pose3(rot, xyz);
+  const gtsam::Pose3 pose_target_cam = PoseFromArray(pose_target_cam_arr);
 
   // Project 3D point using new pose estimate.
   cmod_->setCameraPose(pose_target_cam);
@@ -35,7 +56,99 @@ ceres::CostFunction* ReprojectionErrorResidual::Create(const gtsam::Point2& uv,
       new ReprojectionErrorResidual(uv, pt3d_target, cmod));
 }
 
-PoseSolver::PoseSolver(const bool verbose) {
+PlanarTargetProjection::PlanarTargetProjection(const std::shared_ptr<Camera>& cmod,
+                                               const double* pose_target_cam_arr)
+  : cmod_(cmod), pose_target_cam_arr_(pose_target_cam_arr), width_(cmod->width()), height_(cmod->height()) {}
+
+size_t PlanarTargetProjection::addPoint(const gtsam::Point3& pt3d_target) {
+  assert(pt3d_target.z() == 0.0);
+  pts3d_target_.push_back(pt3d_target);
+  uvs_.emplace_back(gtsam::Point2::Constant(utils::NaN));
+  jacobians_.resize(12 * pts3d_target_.size(), utils::NaN);
+  valid_.push_back(0);
+  projections_current_ = false;
+  jacobians_current_ = false;
+  return pts3d_target_.size() - 1;
+}
+
+void PlanarTargetProjection::PrepareForEvaluation(const bool evaluate_jacobians,
+                                                  const bool new_evaluation_point) {
+  GTCAL_TRACE_ZONE("PlanarTargetProjection::PrepareForEvaluation");
+  const size_t size = pts3d_target_.size();
+  // The parameter block is compared as well, as it changes between the solves of the coarse-to-fine levels.
+  if (new_evaluation_point ||
+      !std::equal(pose_target_cam_arr_, pose_target_cam_arr_ + 6, pose_target_cam_prepared_)) {
+    projections_current_ = false;
+    jacobians_current_ = false;
+  }
+  if (!projections_current_) {
+    std::copy(pose_target_cam_arr_, pose_target_cam_arr_ + 6, pose_target_cam_prepared_);
+    cmod_->projectPlanar(PoseFromArray(pose_target_cam_arr_), pts3d_target_.data(), size, uvs_.data());
+    for (size_t ii = 0; ii < size; ii++) {
+      valid_[ii] = gtcal::utils::FilterPixelCoords(uvs_[ii], width_, height_);
+    }
+    projections_current_ = true;
+  }
+  if (!evaluate_jacobians || jacobians_current_) {
+    return;
+  }
+
+  // Central differences of the batch, one parameter at a time, with the steps of ceres::NumericDiffOptions.
+  uvs_plus_.resize(size);
+  uvs_minus_.resize(size);
+  double pose_arr[6];
+  std::copy(pose_target_cam_arr_, pose_target_cam_arr_ + 6, pose_arr);
+  for (size_t jj = 0; jj < 6; jj++) {
+    const double x = pose_arr[jj];
+    const double step = x == 0.0 ? kRelativeStepSize : std::abs(x) * kRelativeStepSize;
+    pose_arr[jj] = x + step;
+    cmod_->projectPlanar(PoseFromArray(pose_arr), pts3d_target_.data(), size, uvs_plus_.data());
+    pose_arr[jj] = x - step;
+    cmod_->projectPlanar(PoseFromArray(pose_arr), pts3d_target_.data(), size, uvs_minus_.data());
+    pose_arr[jj] = x;
+
+    const double inv_two_step = 0.5 / step;
+    for (size_t ii = 0; ii < size; ii++) {
+      jacobians_[12 * ii + jj] = (uvs_plus_[ii].x() - uvs_minus_[ii].x()) * inv_two_step;
+      jacobians_[12 * ii + 6 + jj] = (uvs_plus_[ii].y() - uvs_minus_[ii].y()) * inv_two_step;
+    }
+  }
+
+  // A point whose perturbed projections fall behind the camera has no Jacobian, which fails the evaluation
+  // as the per-point numeric differentiation would.
+  for (size_t ii = 0; ii < size; ii++) {
+    for (size_t kk = 0; kk < 12; kk++) {
+      if (!std::isfinite(jacobians_[12 * ii + kk])) {
+        valid_[ii] = 0;
+      }
+    }
+  }
+  jacobians_current_ = true;
+}
+
+PlanarReprojectionErrorResidual::PlanarReprojectionErrorResidual(const gtsam::Point2& uv,
+                                                                 const PlanarTargetProjection& projection,
+                                                                 const size_t index)
+  : uv_(uv), projection_(projection), index_(index) {}
+
+bool PlanarReprojectionErrorResidual::Evaluate(double const* const* /*parameters*/, double* residuals,
+                                               double** jacobians) const {
+  if (!projection_.valid(index_)) {
+    return false;
+  }
+
+  // Calculate residuals
+  const gtsam::Point2& uv = projection_.uv(index_);
+  residuals[0] = uv.x() - uv_.x();
+  residuals[1] = uv.y() - uv_.y();
+  if (jacobians != nullptr && jacobians[0] != nullptr) {
+    std::copy(projection_.jacobian(index_), projection_.jacobian(index_) + 12, jacobians[0]);
+  }
+  return true;
+}
+
+PoseSolver::PoseSolver(const bool verbose, const CoarseToFineOptions& coarse_to_fine)
+  : coarse_to_fine_(coarse_to_fine) {
   // Set solver options.
   options_.max_num_iterations = 100;
   options_.linear_solver_type = ceres::DENSE_QR;
@@ -46,31 +159,77 @@ PoseSolver::PoseSolver(const bool verbose) {
   loss_function_ = new ceres::HuberLoss(loss_scaling_param_);
 }
 
-PoseSolver::~PoseSolver() {}
+PoseSolver::~PoseSolver() { delete loss_function_; }
 
 bool PoseSolver::solve(const std::vector<Measurement>& measurements, const gtsam::Point3Vector& pts3d_target,
                        const std::shared_ptr<gtcal::Camera>& camera, gtsam::Pose3& pose_target_cam) const {
-  // Ensure the same number of pixels and 3D points were given.
-  assert(measurements.size() == pts3d_target.size());
+  return solvePose(measurements, pts3d_target, camera, pose_target_cam);
+}
+
+bool PoseSolver::solve(const MeasurementSpan& measurements, const gtsam::Point3Vector& pts3d_target,
+                       const std::shared_ptr<gtcal::Camera>& camera, gtsam::Pose3& pose_target_cam) const {
+  return solvePose(measurements, pts3d_target, camera, pose_target_cam);
+}
+
+template <typename MeasurementRange>
+bool PoseSolver::solvePose(const MeasurementRange& measurements, const gtsam::Point3Vector& pts3d_target,
+                           const std::shared_ptr<gtcal::Camera>& camera,
+                           gtsam::Pose3& pose_target_cam) const {
+  GTCAL_TRACE_ZONE("PoseSolver::solve");
+  GTCAL_ALLOC_SCOPE("PoseSolver::solve");
+
+  // Each measurement must refer to a target point. Partial views of the target are fine.
+  assert(measurements.size() <= pts3d_target.size());
 
   // Create initial pose estimate array.
   const gtsam::Point3& xyz = pose_target_cam.translation();
   const gtsam::Point3 rpy = pose_target_cam.rotation().rpy();
   double pose_target_cam_arr[6] = {xyz.x(), xyz.y(), xyz.z(), rpy.x(), rpy.y(), rpy.z()};
 
-  // Create residuals and solve problem.
-  ceres::Problem problem;
-  for (const auto& meas : measurements) {
-    auto cost_functor = ReprojectionErrorResidual::Create(meas.uv, pts3d_target.at(meas.point_id), camera);
-    problem.AddResidualBlock(cost_functor, loss_function_, pose_target_cam_arr);
+  // Coarse-to-fine levels, adding measurements in an order that keeps every level spread over the image.
+  const std::vector<size_t> levels = CoarseToFineLevels(measurements.size(), coarse_to_fine_);
+  const std::vector<uint32_t> order =
+      levels.size() > 1 ? StratifiedOrder(measurements) : std::vector<uint32_t>();
+
+  // Create residuals and solve problem. Each level adds its residuals to the problem and runs a few
+  // iterations from the estimate of the previous level; the last level holds every residual and runs to
+  // convergence.
+  // The loss function is shared by every solve, so the problem must not delete it. The points of a planar
+  // target are projected by a single homography per evaluation point, see PlanarTargetProjection.
+  const bool planar = IsPlanarTarget(pts3d_target);
+  PlanarTargetProjection planar_projection(camera, pose_target_cam_arr);
+  ceres::Problem::Options problem_options;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  if (planar) {
+    problem_options.evaluation_callback = &planar_projection;
+  }
+  ceres::Problem problem(problem_options);
+  ceres::Solver::Options coarse_options;
+  if (levels.size() > 1) {
+    coarse_options = options_;
+    coarse_options.max_num_iterations = static_cast<int>(coarse_to_fine_.iterations_per_level);
   }
-
-  // Solve problem and update pose argument.
   ceres::Solver::Summary summary;
-  ceres::Solve(options_, &problem, &summary);
-  gtsam::Rot3 R = gtsam::Rot3::RzRyRx(pose_target_cam_arr[3], pose_target_cam_arr[4], pose_target_cam_arr[5]);
-  gtsam::Point3 t = {pose_target_cam_arr[0], pose_target_cam_arr[1], pose_target_cam_arr[2]};
-  pose_target_cam = gtsam::Pose3(R, t);
+  size_t num_added = 0;
+  for (size_t ll = 0; ll < levels.size(); ll++) {
+    for (; num_added < levels[ll]; num_added++) {
+      const Measurement meas = measurements[order.empty() ? num_added : order[num_added]];
+      const gtsam::Point3& pt3d_target = pts3d_target.at(meas.point_id);
+      ceres::CostFunction* cost_functor =
+          planar ? new PlanarReprojectionErrorResidual(meas.uv, planar_projection,
+                                                       planar_projection.addPoint(pt3d_target))
+                 : ReprojectionErrorResidual::Create(meas.uv, pt3d_target, camera);
+      problem.AddResidualBlock(cost_functor, loss_function_, pose_target_cam_arr);
+    }
+
+    // Solve problem. A coarse level that fails leaves the estimate to the next level.
+    GTCAL_TRACE_ZONE("PoseSolver::ceresSolve");
+    GTCAL_ALLOC_SCOPE("PoseSolver::ceresSolve");
+    ceres::Solve(ll + 1 < levels.size() ? coarse_options : options_, &problem, &summary);
+  }
+
+  // Update pose argument.
+  pose_target_cam = PoseFromArray(pose_target_cam_arr);
 
   // Check if the problem successfully converged.
   if (summary.termination_type == ceres::FAILURE) {
@@ -1,4 +1,6 @@
 #include "gtcal/pose_solver_gtsam.h"
+#include "gtcal/alloc_tracker.h"
+#include "gtcal/trace.h"
 #include "gtcal/utils.h"
 
 #include <gtsam/nonlinear/NonlinearFactorGraph.h>
@@ -7,6 +9,8 @@
 #include <gtsam/nonlinear/Values.h>
 #include <gtsam/inference/Symbol.h>
 
+#include <cmath>
+
 using gtsam::symbol_shorthand::K;
 using gtsam::symbol_shorthand::L;
 using gtsam::symbol_shorthand::X;
@@ -18,50 +22,93 @@ PoseSolverGtsam::PoseSolverGtsam(const Options& options) : options_(options) {}
 bool PoseSolverGtsam::solve(const std::vector<Measurement>& measurements,
                             const gtsam::Point3Vector& pts3d_target, const std::shared_ptr<Camera>& camera,
                             gtsam::Pose3& pose_initial_target_cam) const {
+  return solvePose(measurements, pts3d_target, camera, pose_initial_target_cam);
+}
+
+bool PoseSolverGtsam::solve(const MeasurementSpan& measurements, const gtsam::Point3Vector& pts3d_target,
+                            const std::shared_ptr<Camera>& camera,
+                            gtsam::Pose3& pose_initial_target_cam) const {
+  return solvePose(measurements, pts3d_target, camera, pose_initial_target_cam);
+}
+
+template <typename MeasurementRange>
+bool PoseSolverGtsam::solvePose(const MeasurementRange& measurements, const gtsam::Point3Vector& pts3d_target,
+                                const std::shared_ptr<Camera>& camera,
+                                gtsam::Pose3& pose_initial_target_cam) const {
+  GTCAL_TRACE_ZONE("PoseSolverGtsam::solve");
+  GTCAL_ALLOC_SCOPE("PoseSolverGtsam::solve");
+
   // Create factor graph.
   gtsam::NonlinearFactorGraph graph;
 
   // Add camera pose prior to graph.
   graph.addPrior(X(0), pose_initial_target_cam, options_.pose_prior_noise_model);
 
-  // Add projection factors to graph based on camera type.
+  // Get the camera model. The calibration is shared by every projection factor.
+  std::shared_ptr<gtsam::Cal3_S2> K_linear;
+  std::shared_ptr<gtsam::Cal3Fisheye> K_fisheye;
   const auto model_type = camera->modelType();
   if (model_type == Camera::ModelType::CAL3_S2) {  // Cal3_S2.
-    // Get camera model.
     const auto cmod = std::get<std::shared_ptr<CameraWrapper<gtsam::Cal3_S2>>>(camera->cameraVariant());
     assert(cmod && "[PoseSolverGtsam::solve] Camera model is not of type Cal3_S2.");
-
-    // Add projection factors to graph.
-    for (const auto& meas : measurements) {
-      graph.emplace_shared<gtsam::GenericProjectionFactor<gtsam::Pose3, gtsam::Point3, gtsam::Cal3_S2>>(
-          meas.uv, options_.pixel_meas_noise_model, X(0), L(meas.point_id),
-          std::make_shared<gtsam::Cal3_S2>(cmod->calibration()));
-    }
+    K_linear = std::make_shared<gtsam::Cal3_S2>(cmod->calibration());
   } else if (model_type == Camera::ModelType::CAL3_FISHEYE) {  // Cal3_Fisheye.
     const auto cmod = std::get<std::shared_ptr<CameraWrapper<gtsam::Cal3Fisheye>>>(camera->cameraVariant());
     assert(cmod && "[PoseSolverGtsam::solve] Camera model is not of type Cal3Fisheye.");
-    // Add projection factors to graph.
-    for (const auto& meas : measurements) {
-      graph.emplace_shared<gtsam::GenericProjectionFactor<gtsam::Pose3, gtsam::Point3, gtsam::Cal3Fisheye>>(
-          meas.uv, options_.pixel_meas_noise_model, X(0), L(meas.point_id),
-          std::make_shared<gtsam::Cal3Fisheye>(cmod->calibration()));
-    }
-  }
-
-  // Add landmark priors to graph.
-  for (const auto& meas : measurements) {
-    graph.addPrior(L(meas.point_id), pts3d_target.at(meas.point_id), options_.landmark_prior_noise_model);
+    K_fisheye = std::make_shared<gtsam::Cal3Fisheye>(cmod->calibration());
   }
 
-  // Create initial estimate for landmarks and camera pose.
+  // Add the projection factor and landmark prior of a measurement to the graph, and its landmark to the
+  // initial estimate.
   gtsam::Values initial_estimate;
-  for (const auto& meas : measurements) {
+  const auto add_measurement = [&](const Measurement& meas) {
+    if (K_linear) {
+      graph.emplace_shared<gtsam::GenericProjectionFactor<gtsam::Pose3, gtsam::Point3, gtsam::Cal3_S2>>(
+          meas.uv, options_.pixel_meas_noise_model, X(0), L(meas.point_id), K_linear);
+    } else if (K_fisheye) {
+      graph.emplace_shared<gtsam::GenericProjectionFactor<gtsam::Pose3, gtsam::Point3, gtsam::Cal3Fisheye>>(
+          meas.uv, options_.pixel_meas_noise_model, X(0), L(meas.point_id), K_fisheye);
+    }
+    graph.addPrior(L(meas.point_id), pts3d_target.at(meas.point_id), options_.landmark_prior_noise_model);
     initial_estimate.insert<gtsam::Point3>(L(meas.point_id), pts3d_target.at(meas.point_id));
-  }
+  };
   initial_estimate.insert<gtsam::Pose3>(X(0), pose_initial_target_cam);
 
-  // Solve and return the optimized camera pose. TODO: add check in case the optimization fails.
-  gtsam::Values result = gtsam::LevenbergMarquardtOptimizer(graph, initial_estimate).optimize();
+  // Coarse-to-fine levels, adding measurements in an order that keeps every level spread over the image.
+  // Each level runs a few iterations from the estimate of the previous level; the last level holds every
+  // measurement and runs to convergence.
+  const std::vector<size_t> levels = CoarseToFineLevels(measurements.size(), options_.coarse_to_fine);
+  const std::vector<uint32_t> order =
+      levels.size() > 1 ? StratifiedOrder(measurements) : std::vector<uint32_t>();
+  const gtsam::LevenbergMarquardtParams params;
+  gtsam::LevenbergMarquardtParams coarse_params;
+  coarse_params.maxIterations = options_.coarse_to_fine.iterations_per_level;
+
+  // Solve and return the optimized camera pose. A level fails if the optimizer throws (e.g. on an
+  // indeterminant system) or ends with a non-finite error, which would otherwise seed the next level.
+  gtsam::Values result;
+  size_t num_added = 0;
+  for (size_t ll = 0; ll < levels.size(); ll++) {
+    for (; num_added < levels[ll]; num_added++) {
+      add_measurement(measurements[order.empty() ? num_added : order[num_added]]);
+    }
+    if (ll > 0) {
+      initial_estimate.update<gtsam::Pose3>(X(0), result.at<gtsam::Pose3>(X(0)));
+    }
+
+    GTCAL_TRACE_ZONE("PoseSolverGtsam::optimize");
+    GTCAL_ALLOC_SCOPE("PoseSolverGtsam::optimize");
+    try {
+      gtsam::LevenbergMarquardtOptimizer optimizer(graph, initial_estimate,
+                                                   ll + 1 < levels.size() ? coarse_params : params);
+      result = optimizer.optimize();
+      if (!std::isfinite(optimizer.error())) {
+        return false;
+      }
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
   pose_initial_target_cam = result.at<gtsam::Pose3>(X(0));
 
   return true;
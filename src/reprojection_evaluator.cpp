@@ -0,0 +1,463 @@
+#include "gtcal/reprojection_evaluator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gtcal {
+namespace {
+
+// Number of measurements gathered and projected at a time.
+static constexpr size_t kBlockSize = 256;
+
+// Intrinsics of a camera, flattened for the kernels. Cal3_S2 cameras have no distortion coefficients.
+struct Intrinsics {
+  bool fisheye = false;
+  double fx = 0.0, fy = 0.0, skew = 0.0, u0 = 0.0, v0 = 0.0;
+  double k1 = 0.0, k2 = 0.0, k3 = 0.0, k4 = 0.0;
+  double width = 0.0, height = 0.0;
+};
+
+// Transform from the target frame to the camera frame: p_cam = R * p_target + t, row-major R.
+struct Transform {
+  double R[9];
+  double t[3];
+};
+
+// Gathered measurements and their residuals, one array per coordinate.
+struct Block {
+  alignas(16) double x[kBlockSize];
+  alignas(16) double y[kBlockSize];
+  alignas(16) double z[kBlockSize];
+  alignas(16) double u[kBlockSize];
+  alignas(16) double v[kBlockSize];
+  alignas(16) double du[kBlockSize];
+  alignas(16) double dv[kBlockSize];
+};
+
+// Histograms of one thread, merged once every frame was evaluated.
+struct Accumulator {
+  std::vector<std::vector<ResidualHistogram>> regions;
+  size_t num_invalid = 0;
+  std::vector<double> frame_errors;
+  std::unique_ptr<Block> block = std::make_unique<Block>();
+};
+
+/**
+ * @brief Return the flattened intrinsics of a camera.
+ *
+ */
+Intrinsics GetIntrinsics(const Camera& camera) {
+  Intrinsics intrinsics;
+  std::visit(
+      [&intrinsics](auto&& arg) {
+        using T = std::decay_t<decltype(arg)>;
+        const auto calibration = arg->calibration();
+        intrinsics.fx = calibration.fx();
+        intrinsics.fy = calibration.fy();
+        intrinsics.skew = calibration.skew();
+        intrinsics.u0 = calibration.px();
+        intrinsics.v0 = calibration.py();
+        if constexpr (std::is_same_v<T, std::shared_ptr<CameraWrapper<gtsam::Cal3Fisheye>>>) {
+          intrinsics.fisheye = true;
+          intrinsics.k1 = calibration.k1();
+          intrinsics.k2 = calibration.k2();
+          intrinsics.k3 = calibration.k3();
+          intrinsics.k4 = calibration.k4();
+        }
+      },
+      camera.cameraVariant());
+  intrinsics.width = static_cast<double>(camera.width());
+  intrinsics.height = static_cast<double>(camera.height());
+  return intrinsics;
+}
+
+/**
+ * @brief Return the transform from the target frame to the frame of a camera at the given pose.
+ *
+ */
+Transform GetTransform(const gtsam::Pose3& pose_target_cam) {
+  // p_cam = R_target_cam^T * (p_target - t_target_cam).
+  const gtsam::Matrix3 R_cam_target = pose_target_cam.rotation().matrix().transpose();
+  const gtsam::Point3 t = -(R_cam_target * pose_target_cam.translation());
+  Transform transform;
+  for (size_t row = 0; row < 3; row++) {
+    for (size_t col = 0; col < 3; col++) {
+      transform.R[3 * row + col] = R_cam_target(row, col);
+    }
+    transform.t[row] = t(row);
+  }
+  return transform;
+}
+
+/**
+ * @brief Project the points of measurements [begin, end) of a block and store their residuals, NaN for
+ * points behind the camera. Scalar version, used for the tail of a block and without SSE2.
+ *
+ */
+void ProjectScalar(const Transform& T, const Intrinsics& K, Block& b, const size_t begin, const size_t end) {
+  for (size_t ii = begin; ii < end; ii++) {
+    const double xc = T.R[0] * b.x[ii] + T.R[1] * b.y[ii] + T.R[2] * b.z[ii] + T.t[0];
+    const double yc = T.R[3] * b.x[ii] + T.R[4] * b.y[ii] + T.R[5] * b.z[ii] + T.t[1];
+    const double zc = T.R[6] * b.x[ii] + T.R[7] * b.y[ii] + T.R[8] * b.z[ii] + T.t[2];
+    if (!(zc > 0.0)) {
+      b.du[ii] = b.dv[ii] = std::numeric_limits<double>::quiet_NaN();
+      continue;
+    }
+    double xn = xc / zc, yn = yc / zc;
+    if (K.fisheye) {
+      // Same as gtsam::Cal3Fisheye::uncalibrate.
+      const double r = std::sqrt(xn * xn + yn * yn);
+      const double theta = std::atan(r);
+      const double t2 = theta * theta;
+      const double scaling = r > 1e-8 ? theta / r : 1.0 - r * r / 3.0;
+      const double s = scaling * (1.0 + t2 * (K.k1 + t2 * (K.k2 + t2 * (K.k3 + t2 * K.k4))));
+      xn *= s;
+      yn *= s;
+    }
+    b.du[ii] = K.fx * xn + K.skew * yn + K.u0 - b.u[ii];
+    b.dv[ii] = K.fy * yn + K.v0 - b.v[ii];
+  }
+}
+
+/**
+ * @brief Project the points of the first count measurements of a block and store their residuals.
+ *
+ */
+void ProjectBlock(const Transform& T, const Intrinsics& K, Block& b, const size_t count) {
+  size_t ii = 0;
+#if defined(__SSE2__)
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d nan = _mm_set1_pd(std::numeric_limits<double>::quiet_NaN());
+  const auto row = [&T](const size_t r, const __m128d x, const __m128d y, const __m128d z) {
+    const __m128d xy =
+        _mm_add_pd(_mm_mul_pd(_mm_set1_pd(T.R[3 * r]), x), _mm_mul_pd(_mm_set1_pd(T.R[3 * r + 1]), y));
+    return _mm_add_pd(_mm_add_pd(xy, _mm_mul_pd(_mm_set1_pd(T.R[3 * r + 2]), z)), _mm_set1_pd(T.t[r]));
+  };
+  for (; ii + 2 <= count; ii += 2) {
+    const __m128d x = _mm_load_pd(b.x + ii), y = _mm_load_pd(b.y + ii), z = _mm_load_pd(b.z + ii);
+    const __m128d zc = row(2, x, y, z);
+    const __m128d valid = _mm_cmpgt_pd(zc, zero);
+    __m128d xn = _mm_div_pd(row(0, x, y, z), zc);
+    __m128d yn = _mm_div_pd(row(1, x, y, z), zc);
+    if (K.fisheye) {
+      const __m128d r = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xn, xn), _mm_mul_pd(yn, yn)));
+      alignas(16) double r_lanes[2], theta_lanes[2];
+      _mm_store_pd(r_lanes, r);
+      theta_lanes[0] = std::atan(r_lanes[0]);
+      theta_lanes[1] = std::atan(r_lanes[1]);
+      const __m128d theta = _mm_load_pd(theta_lanes);
+      const __m128d t2 = _mm_mul_pd(theta, theta);
+      __m128d poly = _mm_add_pd(_mm_set1_pd(K.k3), _mm_mul_pd(t2, _mm_set1_pd(K.k4)));
+      poly = _mm_add_pd(_mm_set1_pd(K.k2), _mm_mul_pd(t2, poly));
+      poly = _mm_add_pd(_mm_set1_pd(K.k1), _mm_mul_pd(t2, poly));
+      poly = _mm_add_pd(_mm_set1_pd(1.0), _mm_mul_pd(t2, poly));
+      // theta / r away from the optical axis, its series expansion 1 - r^2 / 3 near it.
+      const __m128d far = _mm_cmpgt_pd(r, _mm_set1_pd(1e-8));
+      const __m128d near_scaling =
+          _mm_sub_pd(_mm_set1_pd(1.0), _mm_div_pd(_mm_mul_pd(r, r), _mm_set1_pd(3.0)));
+      const __m128d safe_r = _mm_or_pd(_mm_and_pd(far, r), _mm_andnot_pd(far, _mm_set1_pd(1.0)));
+      const __m128d far_scaling = _mm_div_pd(theta, safe_r);
+      const __m128d scaling = _mm_or_pd(_mm_and_pd(far, far_scaling), _mm_andnot_pd(far, near_scaling));
+      const __m128d s = _mm_mul_pd(scaling, poly);
+      xn = _mm_mul_pd(xn, s);
+      yn = _mm_mul_pd(yn, s);
+    }
+    const __m128d fx_xn = _mm_mul_pd(_mm_set1_pd(K.fx), xn);
+    const __m128d u = _mm_add_pd(_mm_add_pd(fx_xn, _mm_mul_pd(_mm_set1_pd(K.skew), yn)), _mm_set1_pd(K.u0));
+    const __m128d v = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(K.fy), yn), _mm_set1_pd(K.v0));
+    const __m128d du = _mm_sub_pd(u, _mm_load_pd(b.u + ii));
+    const __m128d dv = _mm_sub_pd(v, _mm_load_pd(b.v + ii));
+    _mm_store_pd(b.du + ii, _mm_or_pd(_mm_and_pd(valid, du), _mm_andnot_pd(valid, nan)));
+    _mm_store_pd(b.dv + ii, _mm_or_pd(_mm_and_pd(valid, dv), _mm_andnot_pd(valid, nan)));
+  }
+#endif
+  ProjectScalar(T, K, b, ii, count);
+}
+
+/**
+ * @brief Return the value at the given percentile of a vector, reordering it.
+ *
+ */
+double Percentile(std::vector<double>& values, const double percentile) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  const size_t rank = std::min(values.size() - 1, static_cast<size_t>(percentile / 100.0 * values.size()));
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+
+}  // namespace
+
+ResidualHistogram::ResidualHistogram(const double bin_width, const size_t num_bins)
+  : bin_width_(bin_width), bins_(std::max<size_t>(num_bins, 1), 0) {
+  assert(bin_width > 0.0 && "[ResidualHistogram::ResidualHistogram] Bin width must be positive.");
+}
+
+void ResidualHistogram::record(const double du, const double dv) {
+  const double error_squared = du * du + dv * dv;
+  const double error = std::sqrt(error_squared);
+  const double bin = error / bin_width_;
+  bins_[bin < static_cast<double>(bins_.size()) ? static_cast<size_t>(bin) : bins_.size() - 1]++;
+  count_++;
+  sum_ += error;
+  sum_squares_ += error_squared;
+  sum_du_ += du;
+  sum_dv_ += dv;
+  max_ = std::max(max_, error);
+}
+
+void ResidualHistogram::merge(const ResidualHistogram& other) {
+  assert(other.bins_.size() == bins_.size() && other.bin_width_ == bin_width_ &&
+         "[ResidualHistogram::merge] Histograms must have the same bins.");
+  for (size_t ii = 0; ii < bins_.size(); ii++) {
+    bins_[ii] += other.bins_[ii];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  sum_squares_ += other.sum_squares_;
+  sum_du_ += other.sum_du_;
+  sum_dv_ += other.sum_dv_;
+  max_ = std::max(max_, other.max_);
+}
+
+double ResidualHistogram::rms() const {
+  return count_ == 0 ? 0.0 : std::sqrt(sum_squares_ / static_cast<double>(count_));
+}
+
+double ResidualHistogram::mean() const { return count_ == 0 ? 0.0 : sum_ / static_cast<double>(count_); }
+
+gtsam::Point2 ResidualHistogram::bias() const {
+  if (count_ == 0) {
+    return gtsam::Point2(0.0, 0.0);
+  }
+  return gtsam::Point2(sum_du_ / static_cast<double>(count_), sum_dv_ / static_cast<double>(count_));
+}
+
+double ResidualHistogram::percentile(const double percentile) const {
+  if (count_ == 0) {
+    return 0.0;
+  }
+  const double rank = std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(count_);
+  double seen = 0.0;
+  for (size_t ii = 0; ii < bins_.size(); ii++) {
+    const double in_bin = static_cast<double>(bins_[ii]);
+    if (in_bin > 0.0 && seen + in_bin >= rank) {
+      // The last bin holds every error past the histogram range, up to the maximum.
+      const double low = bin_width_ * static_cast<double>(ii);
+      const double high = ii + 1 < bins_.size() ? low + bin_width_ : std::max(max_, low);
+      return std::min(max_, low + (high - low) * (rank - seen) / in_bin);
+    }
+    seen += in_bin;
+  }
+  return max_;
+}
+
+ReprojectionEvaluator::ReprojectionEvaluator() : ReprojectionEvaluator(Options()) {}
+
+ReprojectionEvaluator::ReprojectionEvaluator(const Options& options) : options_(options) {
+  assert(options_.region_cols > 0 && options_.region_rows > 0 &&
+         "[ReprojectionEvaluator::ReprojectionEvaluator] Need at least one region.");
+}
+
+ReprojectionEvaluator::Result ReprojectionEvaluator::evaluate(
+    const std::vector<std::shared_ptr<Camera>>& cameras, const std::vector<gtsam::Pose3>& poses_target_cam,
+    const gtsam::Point3Vector& pts3d_target, const MeasurementBlock& measurements) const {
+  assert(poses_target_cam.size() >= measurements.numFrames() &&
+         "[ReprojectionEvaluator::evaluate] Need a pose per frame.");
+  const size_t num_frames = measurements.numFrames();
+  const size_t num_regions = options_.region_cols * options_.region_rows;
+  const ResidualHistogram empty(options_.bin_width, options_.num_bins);
+
+  std::vector<Intrinsics> intrinsics;
+  intrinsics.reserve(cameras.size());
+  for (const auto& camera : cameras) {
+    intrinsics.push_back(GetIntrinsics(*camera));
+  }
+
+  Result result{empty, std::vector<ResidualHistogram>(cameras.size(), empty),
+                std::vector<std::vector<ResidualHistogram>>(
+                    cameras.size(), std::vector<ResidualHistogram>(num_regions, empty)),
+                std::vector<FrameStatistics>(num_frames), {}, {}, 0};
+  if (options_.keep_residuals) {
+    result.residual_u.assign(measurements.size(), std::numeric_limits<float>::quiet_NaN());
+    result.residual_v.assign(measurements.size(), std::numeric_limits<float>::quiet_NaN());
+  }
+
+  // Evaluates one frame into the histograms of the calling thread.
+  const auto evaluate_frame = [&](const size_t frame_index, Accumulator& acc) {
+    const MeasurementSpan frame = measurements.frame(frame_index);
+    const size_t frame_offset = static_cast<size_t>(frame.u() - measurements.u().data());
+    const Transform transform = GetTransform(poses_target_cam[frame_index]);
+    FrameStatistics& stats = result.frames[frame_index];
+    stats.camera_id = frame.empty() ? 0 : frame.cameraIds()[0];
+    acc.frame_errors.clear();
+    double sum_squares = 0.0;
+
+    size_t begin = 0;
+    while (begin < frame.size()) {
+      // Gather a block of measurements of the same camera.
+      const uint16_t camera_id = frame.cameraIds()[begin];
+      assert(camera_id < cameras.size() && "[ReprojectionEvaluator::evaluate] Unknown camera id.");
+      Block& b = *acc.block;
+      size_t count = 0;
+      while (begin + count < frame.size() && count < kBlockSize &&
+             frame.cameraIds()[begin + count] == camera_id) {
+        const size_t index = begin + count;
+        assert(frame.pointIds()[index] < pts3d_target.size() &&
+               "[ReprojectionEvaluator::evaluate] Unknown point id.");
+        const gtsam::Point3& pt3d = pts3d_target[frame.pointIds()[index]];
+        b.x[count] = pt3d.x();
+        b.y[count] = pt3d.y();
+        b.z[count] = pt3d.z();
+        b.u[count] = frame.u()[index];
+        b.v[count] = frame.v()[index];
+        count++;
+      }
+      const Intrinsics& K = intrinsics[camera_id];
+      ProjectBlock(transform, K, b, count);
+
+      // Record the residuals.
+      std::vector<ResidualHistogram>& regions = acc.regions[camera_id];
+      for (size_t ii = 0; ii < count; ii++) {
+        if (options_.keep_residuals) {
+          result.residual_u[frame_offset + begin + ii] = static_cast<float>(b.du[ii]);
+          result.residual_v[frame_offset + begin + ii] = static_cast<float>(b.dv[ii]);
+        }
+        if (std::isnan(b.du[ii])) {
+          stats.num_invalid++;
+          continue;
+        }
+        const double col = std::clamp(b.u[ii] / K.width * static_cast<double>(options_.region_cols), 0.0,
+                                      static_cast<double>(options_.region_cols - 1));
+        const double row = std::clamp(b.v[ii] / K.height * static_cast<double>(options_.region_rows), 0.0,
+                                      static_cast<double>(options_.region_rows - 1));
+        regions[static_cast<size_t>(row) * options_.region_cols + static_cast<size_t>(col)].record(b.du[ii],
+                                                                                                  b.dv[ii]);
+        const double error_squared = b.du[ii] * b.du[ii] + b.dv[ii] * b.dv[ii];
+        sum_squares += error_squared;
+        acc.frame_errors.push_back(std::sqrt(error_squared));
+      }
+      begin += count;
+    }
+
+    acc.num_invalid += stats.num_invalid;
+    stats.count = acc.frame_errors.size();
+    if (stats.count > 0) {
+      stats.rms = std::sqrt(sum_squares / static_cast<double>(stats.count));
+      stats.max = *std::max_element(acc.frame_errors.begin(), acc.frame_errors.end());
+      stats.median = Percentile(acc.frame_errors, 50.0);
+      stats.p95 = Percentile(acc.frame_errors, 95.0);
+    }
+  };
+
+  // Spread the frames over threads, each with its own histograms.
+  const size_t max_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  const size_t num_threads = std::clamp<size_t>(num_frames, 1, max_threads);
+  std::vector<Accumulator> accumulators(num_threads);
+  for (auto& acc : accumulators) {
+    acc.regions = result.regions;
+  }
+  std::atomic<size_t> next_frame{0};
+  const auto worker = [&](Accumulator& acc) {
+    for (size_t ii = next_frame.fetch_add(1); ii < num_frames; ii = next_frame.fetch_add(1)) {
+      evaluate_frame(ii, acc);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t tt = 1; tt < num_threads; tt++) {
+    threads.emplace_back(worker, std::ref(accumulators[tt]));
+  }
+  worker(accumulators.front());
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Merge the histograms: regions into cameras, cameras into the total.
+  for (const Accumulator& acc : accumulators) {
+    for (size_t cc = 0; cc < cameras.size(); cc++) {
+      for (size_t rr = 0; rr < num_regions; rr++) {
+        result.regions[cc][rr].merge(acc.regions[cc][rr]);
+      }
+    }
+    result.num_invalid += acc.num_invalid;
+  }
+  for (size_t cc = 0; cc < cameras.size(); cc++) {
+    for (const ResidualHistogram& region : result.regions[cc]) {
+      result.cameras[cc].merge(region);
+    }
+    result.total.merge(result.cameras[cc]);
+  }
+  return result;
+}
+
+void ReprojectionEvaluator::writeReport(const Result& result, std::ostream& os,
+                                        const size_t num_worst_frames) const {
+  char line[256];
+  std::snprintf(line, sizeof(line), "Reprojection errors [px]: %llu residuals, %zu invalid\n",
+                static_cast<unsigned long long>(result.total.count()), result.num_invalid);
+  os << line;
+  std::snprintf(line, sizeof(line), "  %-8s %10s %8s %8s %8s %8s %8s %8s %16s\n", "camera", "count", "rms",
+                "mean", "p50", "p95", "p99", "max", "bias");
+  os << line;
+  const auto write_row = [&](const char* name, const ResidualHistogram& histogram) {
+    std::snprintf(line, sizeof(line), "  %-8s %10llu %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %7.3f,%8.3f\n",
+                  name, static_cast<unsigned long long>(histogram.count()), histogram.rms(), histogram.mean(),
+                  histogram.percentile(50.0), histogram.percentile(95.0), histogram.percentile(99.0),
+                  histogram.max(), histogram.bias().x(), histogram.bias().y());
+    os << line;
+  };
+  for (size_t cc = 0; cc < result.cameras.size(); cc++) {
+    write_row(std::to_string(cc).c_str(), result.cameras[cc]);
+  }
+  write_row("all", result.total);
+
+  // RMS of every region, laid out like the image.
+  for (size_t cc = 0; cc < result.regions.size(); cc++) {
+    os << "Camera " << cc << " RMS per region [px]:\n";
+    for (size_t row = 0; row < options_.region_rows; row++) {
+      os << " ";
+      for (size_t col = 0; col < options_.region_cols; col++) {
+        const ResidualHistogram& region = result.regions[cc][row * options_.region_cols + col];
+        std::snprintf(line, sizeof(line), " %8.3f", region.rms());
+        os << line;
+      }
+      os << "\n";
+    }
+  }
+
+  // Frames with the highest RMS.
+  std::vector<size_t> order(result.frames.size());
+  std::iota(order.begin(), order.end(), 0);
+  const size_t num_listed = std::min(num_worst_frames, order.size());
+  std::partial_sort(order.begin(), order.begin() + num_listed, order.end(),
+                    [&result](const size_t lhs, const size_t rhs) {
+                      return result.frames[lhs].rms > result.frames[rhs].rms;
+                    });
+  if (num_listed > 0) {
+    std::snprintf(line, sizeof(line), "  %-8s %8s %8s %8s %8s %8s %8s %8s\n", "frame", "camera", "count",
+                  "invalid", "rms", "p50", "p95", "max");
+    os << "Worst frames:\n" << line;
+  }
+  for (size_t ii = 0; ii < num_listed; ii++) {
+    const FrameStatistics& frame = result.frames[order[ii]];
+    std::snprintf(line, sizeof(line), "  %-8zu %8zu %8zu %8zu %8.3f %8.3f %8.3f %8.3f\n", order[ii],
+                  frame.camera_id, frame.count, frame.num_invalid, frame.rms, frame.median, frame.p95,
+                  frame.max);
+    os << line;
+  }
+}
+
+}  // namespace gtcal
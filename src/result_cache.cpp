@@ -0,0 +1,350 @@
+#include "gtcal/result_cache.h"
+#include "gtcal/binary_io.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+namespace gtcal {
+namespace {
+
+namespace fs = std::filesystem;
+
+static constexpr char kEntryExtension[] = ".gtcr";
+
+struct Header {
+  char magic[8] = {};
+  uint32_t version = 0;
+  uint32_t num_cameras = 0;
+  uint64_t key = 0;
+  uint64_t num_frames = 0;
+  uint32_t checksum = 0;
+  uint32_t reserved = 0;
+};
+static_assert(sizeof(Header) == 40, "Header must be 40 bytes.");
+
+/**
+ * @brief Append the sigmas of a noise model, or a marker if it isn't set.
+ *
+ */
+template <typename NoiseModel>
+void WriteNoiseModel(const NoiseModel& model, io::ByteWriter& writer) {
+  writer.write<uint8_t>(model != nullptr);
+  if (model != nullptr) {
+    const gtsam::Vector sigmas = model->sigmas();
+    writer.write<uint32_t>(static_cast<uint32_t>(sigmas.size()));
+    writer.writeBytes(sigmas.data(), sigmas.size() * sizeof(double));
+  }
+}
+
+/**
+ * @brief Return the record of a camera.
+ *
+ */
+ResultCacheCamera MakeRecord(const Camera& camera) {
+  ResultCacheCamera record;
+  record.model_type = static_cast<uint32_t>(camera.modelType());
+  record.width = static_cast<uint32_t>(camera.width());
+  record.height = static_cast<uint32_t>(camera.height());
+
+  const std::vector<double> intrinsics = camera.intrinsicsParameters();
+  record.num_intrinsics = static_cast<uint32_t>(intrinsics.size());
+  std::copy(intrinsics.begin(), intrinsics.end(), record.intrinsics);
+
+  const gtsam::Pose3 pose = camera.pose();
+  const gtsam::Quaternion q = pose.rotation().toQuaternion();
+  const double pose_values[7] = {pose.x(), pose.y(), pose.z(), q.w(), q.x(), q.y(), q.z()};
+  std::copy(std::begin(pose_values), std::end(pose_values), record.pose);
+  return record;
+}
+
+/**
+ * @brief Return a camera model with the record's calibration and pose.
+ *
+ */
+std::shared_ptr<Camera> MakeCamera(const ResultCacheCamera& record) {
+  const double* k = record.intrinsics;
+  const double* p = record.pose;
+  const gtsam::Pose3 pose(gtsam::Rot3::Quaternion(p[3], p[4], p[5], p[6]), gtsam::Point3(p[0], p[1], p[2]));
+  auto camera = std::make_shared<Camera>();
+  if (static_cast<Camera::ModelType>(record.model_type) == Camera::ModelType::CAL3_FISHEYE) {
+    camera->setCameraModel<gtsam::Cal3Fisheye>(
+        record.width, record.height, gtsam::Cal3Fisheye(k[0], k[1], 0., k[2], k[3], k[4], k[5], k[6], k[7]),
+        pose);
+  } else {
+    camera->setCameraModel<gtsam::Cal3_S2>(record.width, record.height,
+                                           gtsam::Cal3_S2(k[0], k[1], 0., k[2], k[3]), pose);
+  }
+  return camera;
+}
+
+/**
+ * @brief Return true if the mapped entry file is a valid entry of the key.
+ *
+ */
+bool ValidateEntry(const io::MappedFile& file, const uint64_t key) {
+  if (!file.isOpen() || file.size() < sizeof(Header)) {
+    return false;
+  }
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(Header));
+  if (std::memcmp(header.magic, kResultCacheMagic, sizeof(header.magic)) != 0 ||
+      header.version != kResultCacheVersion || header.key != key ||
+      file.size() != sizeof(Header) + uint64_t{header.num_cameras} * sizeof(ResultCacheCamera)) {
+    return false;
+  }
+  const char* records = file.data() + sizeof(Header);
+  if (io::Fnv1a32(records, header.num_cameras * sizeof(ResultCacheCamera)) != header.checksum) {
+    return false;
+  }
+  const auto* cameras = reinterpret_cast<const ResultCacheCamera*>(records);
+  return std::all_of(cameras, cameras + header.num_cameras,
+                     [](const ResultCacheCamera& record) { return record.num_intrinsics <= 8; });
+}
+
+}  // namespace
+
+uint64_t ComputeResultCacheKey(const MeasurementBlock& measurements, const gtsam::Point3Vector& pts3d_target,
+                               const std::vector<std::shared_ptr<Camera>>& cameras,
+                               const BatchSolver::Options& options,
+                               const std::vector<gtsam::Matrix2>* covariances) {
+  assert((covariances == nullptr || covariances->size() == measurements.size()) &&
+         "[ComputeResultCacheKey] One covariance per measurement is required.");
+
+  // The measurement and covariance arrays are hashed in place and only their hashes go into the key buffer.
+  io::ByteWriter writer;
+  writer.write<uint64_t>(measurements.size());
+  writer.write(io::XxHash64(measurements.u().data(), measurements.size() * sizeof(float)));
+  writer.write(io::XxHash64(measurements.v().data(), measurements.size() * sizeof(float)));
+  writer.write(io::XxHash64(measurements.cameraIds().data(), measurements.size() * sizeof(uint16_t)));
+  writer.write(io::XxHash64(measurements.pointIds().data(), measurements.size() * sizeof(uint32_t)));
+  writer.write<uint64_t>(measurements.numFrames());
+  for (size_t ii = 0; ii < measurements.numFrames(); ii++) {
+    writer.write<uint32_t>(static_cast<uint32_t>(measurements.frame(ii).size()));
+  }
+  writer.write<uint8_t>(covariances != nullptr);
+  if (covariances != nullptr) {
+    writer.write(io::XxHash64(covariances->data(), covariances->size() * sizeof(gtsam::Matrix2)));
+  }
+
+  writer.write<uint64_t>(pts3d_target.size());
+  for (const gtsam::Point3& pt : pts3d_target) {
+    const double xyz[3] = {pt.x(), pt.y(), pt.z()};
+    writer.write(xyz);
+  }
+
+  writer.write<uint64_t>(cameras.size());
+  for (const auto& camera : cameras) {
+    writer.write(MakeRecord(*camera));
+  }
+
+  WriteNoiseModel(options.pose_prior_noise_model, writer);
+  WriteNoiseModel(options.landmark_prior_noise_model, writer);
+  WriteNoiseModel(options.pixel_meas_noise_model, writer);
+  writer.write<uint8_t>(options.use_target_factors);
+  writer.write(static_cast<uint32_t>(options.optimizer_type));
+  writer.write(static_cast<uint32_t>(options.ordering_type));
+  writer.write<uint64_t>(options.max_iterations);
+  writer.write(options.pose_relinearize_threshold);
+  writer.write(options.landmark_relinearize_threshold);
+  writer.write(options.calibration_relinearize_threshold);
+  writer.write<uint64_t>(options.relinearize_skip);
+  writer.write<uint8_t>(options.freeze_converged_calibration);
+  writer.write<uint64_t>(options.calibration_check_interval);
+  writer.write(options.calibration_freeze_tolerance);
+  writer.write<uint64_t>(options.calibration_freeze_checks);
+  return io::XxHash64(writer.buffer().data(), writer.size());
+}
+
+ResultCache::ResultCache(const std::string& directory, const Options& options)
+  : options_(options), directory_(directory) {
+  std::error_code ec;
+  fs::create_directories(directory_, ec);
+  if (!fs::is_directory(directory_, ec)) {
+    return;
+  }
+
+  // Index the entries from the most to the least recently used. Temporary files of writes in progress and
+  // unrelated files are skipped.
+  std::vector<std::tuple<fs::file_time_type, uint64_t, size_t>> found;
+  for (const auto& item : fs::directory_iterator(directory_, ec)) {
+    const std::string name = item.path().filename().string();
+    if (!item.is_regular_file(ec) || name.size() != 16 + std::strlen(kEntryExtension) ||
+        item.path().extension() != kEntryExtension ||
+        name.find_first_not_of("0123456789abcdef") != 16) {
+      continue;
+    }
+    const uint64_t key = std::stoull(name.substr(0, 16), nullptr, 16);
+    found.emplace_back(item.last_write_time(ec), key, item.file_size(ec));
+  }
+  if (ec) {
+    return;
+  }
+  std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a > b; });
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& [time, key, file_size] : found) {
+    entries_.push_back({key, file_size, io::MappedFile()});
+    index_[key] = std::prev(entries_.end());
+    size_bytes_ += file_size;
+  }
+  evict();
+  is_open_ = true;
+}
+
+ResultCache::ResultCache(const std::string& directory) : ResultCache(directory, Options()) {}
+
+std::string ResultCache::entryPath(const uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016" PRIx64 "%s", key, kEntryExtension);
+  return directory_ + "/" + name;
+}
+
+bool ResultCache::lookup(const uint64_t key, CachedCalibration& result) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  const auto found = index_.find(key);
+  if (found == index_.end()) {
+    stats_.num_misses++;
+    return false;
+  }
+  const EntryList::iterator it = found->second;
+
+  // Map and validate the entry once. Another process replacing the file doesn't change the mapping.
+  if (!it->file.isOpen() && (!it->file.open(entryPath(key)) || !ValidateEntry(it->file, key))) {
+    remove(it);
+    stats_.num_misses++;
+    return false;
+  }
+
+  Header header;
+  std::memcpy(&header, it->file.data(), sizeof(Header));
+  const auto* records = reinterpret_cast<const ResultCacheCamera*>(it->file.data() + sizeof(Header));
+  result.cameras.clear();
+  for (size_t ii = 0; ii < header.num_cameras; ii++) {
+    result.cameras.push_back(MakeCamera(records[ii]));
+  }
+  result.num_frames = header.num_frames;
+
+  // Most recently used, here and for the processes that index the directory later.
+  entries_.splice(entries_.begin(), entries_, it);
+  std::error_code ec;
+  fs::last_write_time(entryPath(key), fs::file_time_type::clock::now(), ec);
+  stats_.num_hits++;
+  return true;
+}
+
+bool ResultCache::store(const uint64_t key, const CachedCalibration& result) {
+  std::vector<ResultCacheCamera> records;
+  records.reserve(result.cameras.size());
+  for (const auto& camera : result.cameras) {
+    records.push_back(MakeRecord(*camera));
+  }
+
+  Header header;
+  std::memcpy(header.magic, kResultCacheMagic, sizeof(header.magic));
+  header.version = kResultCacheVersion;
+  header.num_cameras = static_cast<uint32_t>(records.size());
+  header.key = key;
+  header.num_frames = result.num_frames;
+  header.checksum = io::Fnv1a32(records.data(), records.size() * sizeof(ResultCacheCamera));
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (!is_open_) {
+    return false;
+  }
+
+  // Write next to the entry and rename into place. The process id keeps the temporary files of processes
+  // sharing the directory apart.
+  const std::string path = entryPath(key);
+  const std::string tmp_path = path + ".tmp" + std::to_string(::getpid());
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ResultCacheCamera));
+    if (!file.good()) {
+      file.close();
+      std::error_code ec;
+      fs::remove(tmp_path, ec);
+      return false;
+    }
+  }
+
+  // The previous entry of the key is dropped from the index, its file is replaced by the rename.
+  const auto found = index_.find(key);
+  if (found != index_.end()) {
+    size_bytes_ -= found->second->file_size;
+    entries_.erase(found->second);
+    index_.erase(found);
+  }
+  std::error_code ec;
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    fs::remove(tmp_path, ec);
+    return false;
+  }
+
+  const size_t file_size = sizeof(Header) + records.size() * sizeof(ResultCacheCamera);
+  entries_.push_front({key, file_size, io::MappedFile()});
+  index_[key] = entries_.begin();
+  size_bytes_ += file_size;
+  stats_.num_stores++;
+  evict();
+  return true;
+}
+
+bool ResultCache::store(const uint64_t key, const BatchSolver::State& state) {
+  CachedCalibration result;
+  result.cameras = state.cameras;
+  result.num_frames = state.num_frames;
+  return store(key, result);
+}
+
+void ResultCache::clear() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  while (!entries_.empty()) {
+    remove(entries_.begin());
+  }
+}
+
+size_t ResultCache::size() const {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+size_t ResultCache::sizeBytes() const {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return size_bytes_;
+}
+
+ResultCache::Stats ResultCache::stats() const {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void ResultCache::remove(EntryList::iterator it) {
+  std::error_code ec;
+  fs::remove(entryPath(it->key), ec);
+  size_bytes_ -= it->file_size;
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+void ResultCache::evict() {
+  const auto over_limits = [this]() {
+    return (options_.max_entries > 0 && entries_.size() > options_.max_entries) ||
+           (options_.max_bytes > 0 && size_bytes_ > options_.max_bytes);
+  };
+  while (!entries_.empty() && over_limits()) {
+    remove(std::prev(entries_.end()));
+    stats_.num_evictions++;
+  }
+}
+
+}  // namespace gtcal
@@ -0,0 +1,133 @@
+#include "gtcal/rig.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace gtcal {
+namespace {
+
+// Number of intrinsics per camera record, after the image size.
+static constexpr size_t kNumPinholeIntrinsics = 4;
+static constexpr size_t kNumFisheyeIntrinsics = 8;
+
+/**
+ * @brief Return true if a camera record (everything after the "camera" keyword) was parsed.
+ *
+ */
+bool ParseCamera(std::istringstream& record, size_t& camera_id, std::shared_ptr<Camera>& camera) {
+  std::string model;
+  size_t width = 0, height = 0;
+  if (!(record >> camera_id >> model >> width >> height) || width == 0 || height == 0) {
+    return false;
+  }
+
+  const size_t num_intrinsics = model == "pinhole"   ? kNumPinholeIntrinsics
+                                : model == "fisheye" ? kNumFisheyeIntrinsics
+                                                     : 0;
+  if (num_intrinsics == 0) {
+    return false;
+  }
+  std::vector<double> K(num_intrinsics);
+  for (auto& value : K) {
+    if (!(record >> value)) {
+      return false;
+    }
+  }
+
+  camera = std::make_shared<Camera>();
+  if (model == "pinhole") {
+    camera->setCameraModel<gtsam::Cal3_S2>(width, height, gtsam::Cal3_S2(K[0], K[1], 0., K[2], K[3]));
+  } else {
+    camera->setCameraModel<gtsam::Cal3Fisheye>(
+        width, height, gtsam::Cal3Fisheye(K[0], K[1], 0., K[2], K[3], K[4], K[5], K[6], K[7]));
+  }
+  return true;
+}
+
+}  // namespace
+
+std::vector<std::shared_ptr<Camera>> Rig::cloneCameras() const {
+  std::vector<std::shared_ptr<Camera>> clones;
+  clones.reserve(cameras.size());
+  for (const auto& camera : cameras) {
+    clones.push_back(camera->clone());
+  }
+  return clones;
+}
+
+bool ParseRig(std::string_view text, Rig& rig, std::string& error) {
+  rig = Rig();
+  bool has_target = false;
+  std::istringstream lines{std::string(text)};
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(lines, line)) {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream record(line);
+    std::string keyword;
+    if (!(record >> keyword) || keyword == "frame") {
+      continue;
+    }
+
+    const std::string where = "line " + std::to_string(line_number) + ": ";
+    if (keyword == "target") {
+      if (!(record >> rig.grid_spacing >> rig.num_rows >> rig.num_cols) || rig.grid_spacing <= 0.0 ||
+          rig.num_rows == 0 || rig.num_cols == 0) {
+        error = where + "expected 'target <grid_spacing> <num_rows> <num_cols>'.";
+        return false;
+      }
+      has_target = true;
+    } else if (keyword == "camera") {
+      size_t camera_id = 0;
+      std::shared_ptr<Camera> camera;
+      if (!ParseCamera(record, camera_id, camera)) {
+        error = where + "expected 'camera <camera_id> pinhole|fisheye <width> <height> <intrinsics...>'.";
+        return false;
+      }
+      if (camera_id != rig.cameras.size()) {
+        error = where + "camera ids must be 0, 1, ..., n - 1 in order.";
+        return false;
+      }
+      rig.cameras.push_back(camera);
+    } else {
+      error = where + "unknown record '" + keyword + "'.";
+      return false;
+    }
+  }
+
+  if (!has_target || rig.cameras.empty()) {
+    error = "a rig needs a target and at least one camera.";
+    return false;
+  }
+  return true;
+}
+
+bool LoadRig(const std::string& path, Rig& rig, std::string& error) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    error = "can't open " + path + ".";
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return ParseRig(buffer.str(), rig, error);
+}
+
+void WriteRig(const Rig& rig, std::ostream& os) {
+  os << std::setprecision(12);
+  os << "target " << rig.grid_spacing << " " << rig.num_rows << " " << rig.num_cols << "\n";
+  for (size_t ii = 0; ii < rig.cameras.size(); ii++) {
+    const auto& camera = rig.cameras.at(ii);
+    os << "camera " << ii << " "
+       << (camera->modelType() == Camera::ModelType::CAL3_FISHEYE ? "fisheye" : "pinhole") << " "
+       << camera->width() << " " << camera->height();
+    for (const double value : camera->intrinsicsParameters()) {
+      os << " " << value;
+    }
+    os << "\n";
+  }
+}
+
+}  // namespace gtcal
@@ -0,0 +1,169 @@
+#include "gtcal/scenario_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+#include <gtsam/geometry/PinholeCamera.h>
+
+#include "gtcal/philox.h"
+
+namespace gtcal {
+namespace {
+
+// Substreams of a frame's CounterRng stream.
+static constexpr uint32_t kPoseSubstream = 0;
+static constexpr uint32_t kNoiseSubstream = 1;
+
+/**
+ * @brief Return the rotation of a camera at the given position looking at a point, with its x axis along the
+ * target x axis before the roll about the optical axis.
+ *
+ */
+gtsam::Rot3 LookAt(const gtsam::Point3& position, const gtsam::Point3& point, const double roll) {
+  const gtsam::Vector3 z = (point - position).normalized();
+  const gtsam::Vector3 x = (gtsam::Vector3::UnitX() - z.x() * z).normalized();
+  const gtsam::Vector3 y = z.cross(x);
+  gtsam::Matrix3 R;
+  R << x, y, z;
+  return gtsam::Rot3(gtsam::Matrix3(R * gtsam::Rot3::RzRyRx(0., 0., roll).matrix()));
+}
+
+}  // namespace
+
+ScenarioGenerator::ScenarioGenerator(const Rig& rig) : ScenarioGenerator(rig, Options()) {}
+
+ScenarioGenerator::ScenarioGenerator(const Rig& rig, const Options& options)
+  : options_(options),
+    cameras_(rig.cloneCameras()),
+    pts3d_target_(rig.target().pointsTarget()),
+    target_center_(rig.target().get3dCenter()) {
+  assert(!cameras_.empty() && "[ScenarioGenerator] The rig has no cameras.");
+  assert(options_.min_distance > 0.0 && options_.min_distance <= options_.max_distance &&
+         "[ScenarioGenerator] Invalid distance range.");
+  assert(options_.arc_period > 0 && "[ScenarioGenerator] The arc period must be positive.");
+  assert(options_.frames_per_batch > 0 && "[ScenarioGenerator] Batches must hold at least one frame.");
+}
+
+gtsam::Pose3 ScenarioGenerator::framePose(const size_t index) const {
+  const double max_view_angle = utils::DegToRad(options_.max_view_angle_deg);
+  if (options_.trajectory == Trajectory::ARC) {
+    const double phase = 2.0 * M_PI * static_cast<double>(index % options_.arc_period) / options_.arc_period;
+    const double theta = max_view_angle * std::sin(phase);
+    const double distance = 0.5 * (options_.min_distance + options_.max_distance);
+    const gtsam::Point3 position =
+        target_center_ + distance * gtsam::Point3(std::sin(theta), 0., -std::cos(theta));
+    return gtsam::Pose3(LookAt(position, target_center_, 0.), position);
+  }
+
+  // Uniform directions on the spherical cap, with cos(view angle) uniform in [cos(max_view_angle), 1].
+  CounterRng rng(options_.seed, index, kPoseSubstream);
+  const double view_angle = std::acos(rng.uniform(std::cos(max_view_angle), 1.0));
+  const double azimuth = rng.uniform(0.0, 2.0 * M_PI);
+  const double distance = rng.uniform(options_.min_distance, options_.max_distance);
+  const double max_roll = utils::DegToRad(options_.max_roll_deg);
+  const double roll = rng.uniform(-max_roll, max_roll);
+  const gtsam::Point3 direction(std::sin(view_angle) * std::cos(azimuth),
+                                std::sin(view_angle) * std::sin(azimuth), -std::cos(view_angle));
+  const gtsam::Point3 position = target_center_ + distance * direction;
+  return gtsam::Pose3(LookAt(position, target_center_, roll), position);
+}
+
+ScenarioGenerator::Frame ScenarioGenerator::frame(const size_t index,
+                                                  std::vector<Measurement>& measurements) const {
+  Frame frame;
+  frame.camera_id = index % cameras_.size();
+  frame.timestamp_ns = static_cast<int64_t>(index) * options_.frame_period_ns;
+  frame.pose_target_cam = framePose(index);
+
+  // Every point draws its noise, visible or not, so a point's noise doesn't depend on the others.
+  measurements.clear();
+  CounterRng rng(options_.seed, index, kNoiseSubstream);
+  std::visit(
+      [&](auto&& model) {
+        const auto calibration = model->calibration();
+        const gtsam::PinholeCamera<std::decay_t<decltype(calibration)>> camera(frame.pose_target_cam,
+                                                                                calibration);
+        for (size_t ii = 0; ii < pts3d_target_.size(); ii++) {
+          const double noise_u = rng.normal(0.0, options_.pixel_sigma);
+          const gtsam::Point2 noise(noise_u, rng.normal(0.0, options_.pixel_sigma));
+          if (frame.pose_target_cam.transformTo(pts3d_target_[ii]).z() <= 0.0) {
+            continue;
+          }
+          const gtsam::Point2 uv = camera.project(pts3d_target_[ii]) + noise;
+          if (utils::FilterPixelCoords(uv, model->width(), model->height())) {
+            measurements.emplace_back(uv, frame.camera_id, ii);
+          }
+        }
+      },
+      cameras_.at(frame.camera_id)->cameraVariant());
+  return frame;
+}
+
+void ScenarioGenerator::generateBatch(const size_t first, const size_t count,
+                                      std::vector<std::vector<Measurement>>& batch,
+                                      std::vector<Frame>& frames) const {
+  batch.resize(count);
+  frames.resize(count);
+  const size_t max_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  const size_t num_threads = std::clamp<size_t>(count, 1, max_threads);
+
+  std::atomic<size_t> next_frame{0};
+  const auto worker = [&]() {
+    for (size_t ii = next_frame.fetch_add(1); ii < count; ii = next_frame.fetch_add(1)) {
+      frames[ii] = frame(first + ii, batch[ii]);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t tt = 0; tt < num_threads; tt++) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void ScenarioGenerator::generate(const size_t first, const size_t count, MeasurementBlock& block,
+                                 std::vector<Frame>* frames) const {
+  std::vector<std::vector<Measurement>> batch;
+  std::vector<Frame> batch_frames;
+  generateBatch(first, count, batch, batch_frames);
+
+  size_t num_measurements = block.size();
+  for (const auto& measurements : batch) {
+    num_measurements += measurements.size();
+  }
+  block.reserve(num_measurements, block.numFrames() + count);
+  for (size_t ii = 0; ii < count; ii++) {
+    for (const auto& meas : batch[ii]) {
+      block.push_back(meas);
+    }
+    block.endFrame(batch_frames[ii].timestamp_ns);
+  }
+  if (frames != nullptr) {
+    frames->insert(frames->end(), batch_frames.begin(), batch_frames.end());
+  }
+}
+
+bool ScenarioGenerator::generate(DetectionLogWriter& writer, std::vector<Frame>* frames) const {
+  std::vector<std::vector<Measurement>> batch;
+  std::vector<Frame> batch_frames;
+  for (size_t first = 0; first < options_.num_frames; first += options_.frames_per_batch) {
+    const size_t count = std::min(options_.frames_per_batch, options_.num_frames - first);
+    generateBatch(first, count, batch, batch_frames);
+    for (size_t ii = 0; ii < count; ii++) {
+      if (!writer.append(batch_frames[ii].timestamp_ns, batch[ii])) {
+        return false;
+      }
+    }
+    if (frames != nullptr) {
+      frames->insert(frames->end(), batch_frames.begin(), batch_frames.end());
+    }
+  }
+  return true;
+}
+
+}  // namespace gtcal
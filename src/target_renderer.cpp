@@ -0,0 +1,322 @@
+#include "gtcal/target_renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gtcal {
+namespace {
+
+// Undistorted bearings must reproject within this distance of their sample, in pixels.
+static constexpr double kMaxRayReprojectionError = 0.01;
+
+// Target plane and board seen from one pose, in grid units (the grid spacing is 1).
+struct Shading {
+  float R[9];  // Rotation from the camera to the target frame, row-major.
+  float ox, oy, oz;  // Camera center in the target frame.
+  float num_cols, num_rows, margin;
+  float dark, light, background;
+};
+
+/**
+ * @brief Return the intensity of the target along the camera bearing (x, y, 1).
+ *
+ */
+float ShadeSample(const float x, const float y, const Shading& sh) {
+  const float dx = sh.R[0] * x + sh.R[1] * y + sh.R[2];
+  const float dy = sh.R[3] * x + sh.R[4] * y + sh.R[5];
+  const float dz = sh.R[6] * x + sh.R[7] * y + sh.R[8];
+  const float t = -sh.oz / dz;
+  const float col = sh.ox + t * dx, row = sh.oy + t * dy;
+  if (!(t > 0.f) || !(col >= -1.f - sh.margin) || !(col < sh.num_cols + sh.margin) ||
+      !(row >= -1.f - sh.margin) || !(row < sh.num_rows + sh.margin)) {
+    return sh.background;
+  }
+  if (col < -1.f || col >= sh.num_cols || row < -1.f || row >= sh.num_rows) {
+    return sh.light;
+  }
+  const int parity = (static_cast<int>(std::floor(col)) + static_cast<int>(std::floor(row))) & 1;
+  return parity == 0 ? sh.dark : sh.light;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Same as ShadeSample() for four bearings.
+ *
+ */
+__m128 ShadeSamplesSse2(const __m128 x, const __m128 y, const Shading& sh) {
+  const auto dot = [&](const size_t row) {
+    const __m128 xy = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sh.R[3 * row]), x),
+                                 _mm_mul_ps(_mm_set1_ps(sh.R[3 * row + 1]), y));
+    return _mm_add_ps(xy, _mm_set1_ps(sh.R[3 * row + 2]));
+  };
+  const __m128 t = _mm_div_ps(_mm_set1_ps(-sh.oz), dot(2));
+  const __m128 col = _mm_add_ps(_mm_set1_ps(sh.ox), _mm_mul_ps(t, dot(0)));
+  const __m128 row = _mm_add_ps(_mm_set1_ps(sh.oy), _mm_mul_ps(t, dot(1)));
+
+  // Ordered comparisons are false for NaN, so bearings without a valid intersection get the background.
+  const auto inside = [&](const float low_offset, const float high_offset) {
+    const __m128 low = _mm_set1_ps(-1.f - low_offset);
+    const __m128 in_cols =
+        _mm_and_ps(_mm_cmpge_ps(col, low), _mm_cmplt_ps(col, _mm_set1_ps(sh.num_cols + high_offset)));
+    const __m128 in_rows =
+        _mm_and_ps(_mm_cmpge_ps(row, low), _mm_cmplt_ps(row, _mm_set1_ps(sh.num_rows + high_offset)));
+    return _mm_and_ps(_mm_cmpgt_ps(t, _mm_setzero_ps()), _mm_and_ps(in_cols, in_rows));
+  };
+  const __m128 on_margin = inside(sh.margin, sh.margin);
+  const __m128 on_board = inside(0.f, 0.f);
+
+  // Floor of the grid coordinates. Values out of the int32 range are off the board.
+  const auto floor_int = [](const __m128 value) {
+    const __m128i truncated = _mm_cvttps_epi32(value);
+    const __m128 above = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), value);
+    return _mm_add_epi32(truncated, _mm_castps_si128(above));  // Adds -1 where truncation rounded up.
+  };
+  const __m128i parity = _mm_and_si128(_mm_add_epi32(floor_int(col), floor_int(row)), _mm_set1_epi32(1));
+  const __m128 is_dark =
+      _mm_and_ps(on_board, _mm_castsi128_ps(_mm_cmpeq_epi32(parity, _mm_setzero_si128())));
+
+  __m128 value = _mm_set1_ps(sh.background);
+  value = _mm_or_ps(_mm_and_ps(on_margin, _mm_set1_ps(sh.light)), _mm_andnot_ps(on_margin, value));
+  return _mm_or_ps(_mm_and_ps(is_dark, _mm_set1_ps(sh.dark)), _mm_andnot_ps(is_dark, value));
+}
+#endif
+
+/**
+ * @brief Shade a row of samples.
+ *
+ */
+void ShadeRow(const float* x, const float* y, const size_t num_samples, const Shading& sh, float* values) {
+  size_t ii = 0;
+#if defined(__SSE2__)
+  for (; ii + 4 <= num_samples; ii += 4) {
+    _mm_storeu_ps(values + ii, ShadeSamplesSse2(_mm_loadu_ps(x + ii), _mm_loadu_ps(y + ii), sh));
+  }
+#endif
+  for (; ii < num_samples; ii++) {
+    values[ii] = ShadeSample(x[ii], y[ii], sh);
+  }
+}
+
+/**
+ * @brief Blur an image in place with a separable Gaussian kernel, clamping at the borders.
+ *
+ */
+void GaussianBlur(const size_t width, const size_t height, const double sigma, std::vector<float>& pixels) {
+  const auto radius = static_cast<long>(std::ceil(3.0 * sigma));
+  std::vector<float> kernel(2 * radius + 1);
+  for (long kk = -radius; kk <= radius; kk++) {
+    kernel[kk + radius] = static_cast<float>(std::exp(-0.5 * kk * kk / (sigma * sigma)));
+  }
+  const float sum = std::accumulate(kernel.begin(), kernel.end(), 0.f);
+  for (auto& weight : kernel) {
+    weight /= sum;
+  }
+
+  // Rows are padded with their border values, and the vertical pass accumulates whole rows.
+  const auto w = static_cast<long>(width), h = static_cast<long>(height);
+  std::vector<float> padded(w + 2 * radius), blurred(pixels.size());
+  for (long y = 0; y < h; y++) {
+    const float* row = pixels.data() + y * w;
+    std::fill(padded.begin(), padded.begin() + radius, row[0]);
+    std::copy(row, row + w, padded.begin() + radius);
+    std::fill(padded.end() - radius, padded.end(), row[w - 1]);
+    for (long x = 0; x < w; x++) {
+      float value = 0.f;
+      for (long kk = 0; kk <= 2 * radius; kk++) {
+        value += kernel[kk] * padded[x + kk];
+      }
+      blurred[y * w + x] = value;
+    }
+  }
+  for (long y = 0; y < h; y++) {
+    float* row = pixels.data() + y * w;
+    std::fill(row, row + w, 0.f);
+    for (long kk = -radius; kk <= radius; kk++) {
+      const float weight = kernel[kk + radius];
+      const float* source = blurred.data() + std::clamp(y + kk, 0l, h - 1) * w;
+      for (long x = 0; x < w; x++) {
+        row[x] += weight * source[x];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Fill values with Gaussian noise, two samples per accepted draw with the Marsaglia polar method,
+ * which is several times cheaper than std::normal_distribution.
+ *
+ */
+void GaussianNoise(std::mt19937_64& rng, const float sigma, std::vector<float>& values) {
+  static constexpr float kScale = 2.f / static_cast<float>(1 << 24);
+  for (size_t ii = 0; ii < values.size();) {
+    // Two 24-bit uniforms in [-1, 1) from one draw, kept when they fall inside the unit circle.
+    const uint64_t bits = rng();
+    const float u = static_cast<float>(bits >> 40) * kScale - 1.f;
+    const float v = static_cast<float>((bits >> 16) & 0xffffff) * kScale - 1.f;
+    const float s = u * u + v * v;
+    if (s >= 1.f || s == 0.f) {
+      continue;
+    }
+    const float factor = sigma * std::sqrt(-2.f * std::log(s) / s);
+    values[ii++] = factor * u;
+    if (ii < values.size()) {
+      values[ii++] = factor * v;
+    }
+  }
+}
+
+/**
+ * @brief Call fn(ii) for ii in [0, num_items) on num_threads threads, handing out one item at a time.
+ *
+ */
+void ParallelFor(const size_t num_items, const size_t num_threads, const std::function<void(size_t)>& fn) {
+  std::atomic<size_t> next_item{0};
+  const auto worker = [&]() {
+    for (size_t ii = next_item.fetch_add(1); ii < num_items; ii = next_item.fetch_add(1)) {
+      fn(ii);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t tt = 0; tt < num_threads; tt++) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace
+
+TargetRenderer::TargetRenderer(const utils::CalibrationTarget& target, const Camera& camera)
+  : TargetRenderer(target, camera, Options()) {}
+
+TargetRenderer::TargetRenderer(const utils::CalibrationTarget& target, const Camera& camera,
+                               const Options& options)
+  : target_(target), options_(options), width_(camera.width()), height_(camera.height()) {
+  assert(options_.samples_per_axis > 0 && "[TargetRenderer] At least one sample per pixel is required.");
+  const size_t samples = options_.samples_per_axis;
+  const size_t row_size = width_ * samples, num_rows = height_ * samples;
+  rays_x_.assign(row_size * num_rows, std::numeric_limits<float>::quiet_NaN());
+  rays_y_.assign(row_size * num_rows, std::numeric_limits<float>::quiet_NaN());
+
+  // Undistort every sample once, in parallel over the sample rows.
+  std::visit(
+      [&](auto&& model) {
+        const auto calibration = model->calibration();
+        ParallelFor(num_rows, numThreads(num_rows), [&](const size_t row) {
+          const double v = static_cast<double>(row) / samples + 0.5 / samples - 0.5;
+          for (size_t col = 0; col < row_size; col++) {
+            const gtsam::Point2 uv(static_cast<double>(col) / samples + 0.5 / samples - 0.5, v);
+            gtsam::Point2 xy;
+            try {
+              xy = calibration.calibrate(uv);
+            } catch (const std::exception&) {
+              continue;
+            }
+            if (!((calibration.uncalibrate(xy) - uv).norm() < kMaxRayReprojectionError)) {
+              continue;
+            }
+            const size_t index = row * row_size + col;
+            rays_x_[index] = static_cast<float>(xy.x());
+            rays_y_[index] = static_cast<float>(xy.y());
+          }
+        });
+      },
+      camera.cameraVariant());
+}
+
+Image TargetRenderer::render(const gtsam::Pose3& pose_target_cam, const uint64_t index) const {
+  // Grid units make the board checks independent of the grid spacing.
+  Shading sh;
+  const gtsam::Matrix3 R = pose_target_cam.rotation().matrix();
+  for (size_t ii = 0; ii < 9; ii++) {
+    sh.R[ii] = static_cast<float>(R(ii / 3, ii % 3));
+  }
+  const gtsam::Point3 origin = pose_target_cam.translation() / target_.gridSpacing();
+  sh.ox = static_cast<float>(origin.x());
+  sh.oy = static_cast<float>(origin.y());
+  sh.oz = static_cast<float>(origin.z());
+  sh.num_cols = static_cast<float>(target_.numCols());
+  sh.num_rows = static_cast<float>(target_.numRows());
+  sh.margin = static_cast<float>(options_.margin);
+  sh.dark = options_.dark;
+  sh.light = options_.light;
+  sh.background = options_.background;
+
+  // Average the samples of each pixel.
+  const size_t samples = options_.samples_per_axis;
+  const size_t row_size = width_ * samples;
+  const float sample_weight = 1.f / static_cast<float>(samples * samples);
+  std::vector<float> pixels(width_ * height_, 0.f);
+  std::vector<float> values(row_size);
+  for (size_t y = 0; y < height_; y++) {
+    float* pixel_row = pixels.data() + y * width_;
+    for (size_t sy = 0; sy < samples; sy++) {
+      const size_t offset = (y * samples + sy) * row_size;
+      ShadeRow(rays_x_.data() + offset, rays_y_.data() + offset, row_size, sh, values.data());
+      for (size_t x = 0; x < width_; x++) {
+        for (size_t sx = 0; sx < samples; sx++) {
+          pixel_row[x] += sample_weight * values[x * samples + sx];
+        }
+      }
+    }
+  }
+
+  if (options_.blur_sigma > 0.0) {
+    GaussianBlur(width_, height_, options_.blur_sigma, pixels);
+  }
+
+  // Vignetting, noise seeded by the image index, and quantization.
+  const float cx = 0.5f * (static_cast<float>(width_) - 1.f);
+  const float cy = 0.5f * (static_cast<float>(height_) - 1.f);
+  const float vignetting_scale = static_cast<float>(options_.vignetting) / std::max(cx * cx + cy * cy, 1.f);
+  std::vector<float> column_falloff(width_);
+  for (size_t x = 0; x < width_; x++) {
+    column_falloff[x] = vignetting_scale * (x - cx) * (x - cx);
+  }
+  std::seed_seq seed{static_cast<uint32_t>(options_.seed), static_cast<uint32_t>(options_.seed >> 32),
+                     static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32)};
+  std::mt19937_64 rng(seed);
+  std::vector<float> noise(width_, 0.f);
+  Image image(width_, height_);
+  for (size_t y = 0; y < height_; y++) {
+    const float row_gain = 1.f - vignetting_scale * (y - cy) * (y - cy);
+    if (options_.noise_sigma > 0.0) {
+      GaussianNoise(rng, static_cast<float>(options_.noise_sigma), noise);
+    }
+    const float* pixel_row = pixels.data() + y * width_;
+    uint8_t* image_row = image.pixels.data() + y * width_;
+    for (size_t x = 0; x < width_; x++) {
+      const float value = pixel_row[x] * (row_gain - column_falloff[x]) + noise[x];
+      image_row[x] = static_cast<uint8_t>(std::clamp(value, 0.f, 255.f) + 0.5f);
+    }
+  }
+  return image;
+}
+
+void TargetRenderer::render(const std::vector<gtsam::Pose3>& poses_target_cam,
+                            std::vector<Image>& images) const {
+  images.assign(poses_target_cam.size(), Image());
+  ParallelFor(poses_target_cam.size(), numThreads(poses_target_cam.size()),
+              [&](const size_t ii) { images[ii] = render(poses_target_cam[ii], ii); });
+}
+
+size_t TargetRenderer::numThreads(const size_t num_items) const {
+  const size_t max_threads =
+      options_.num_threads > 0 ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+  return std::clamp<size_t>(num_items, 1, max_threads);
+}
+
+}  // namespace gtcal
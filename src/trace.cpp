@@ -0,0 +1,116 @@
+#include "gtcal/trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace gtcal {
+namespace trace {
+namespace {
+
+/**
+ * @brief Write a JSON string, escaping quotes, backslashes and control characters.
+ *
+ */
+void WriteJsonString(std::ostream& os, const char* text) {
+  os << '"';
+  for (const char* p = text; *p != '\0'; ++p) {
+    if (*p == '"' || *p == '\\') {
+      os << '\\' << *p;
+    } else if (static_cast<unsigned char>(*p) < 0x20) {
+      os << ' ';
+    } else {
+      os << *p;
+    }
+  }
+  os << '"';
+}
+
+}  // namespace
+
+void Start() { enabled.store(true, std::memory_order_relaxed); }
+
+void Stop() { enabled.store(false, std::memory_order_relaxed); }
+
+void Clear() {
+  Registry::Instance().forEachBuffer(
+      [](ThreadBuffer& buffer) { buffer.num_cleared.store(buffer.numWritten(), std::memory_order_relaxed); });
+}
+
+void SetThreadName(const std::string& name) {
+  ThreadBuffer& buffer = Registry::Instance().threadBuffer();
+  Registry::Instance().forEachBuffer([&buffer, &name](ThreadBuffer& other) {
+    if (&other == &buffer) {
+      other.name = name;
+    }
+  });
+}
+
+std::vector<CollectedEvent> Collect(uint64_t* num_dropped) {
+  std::vector<CollectedEvent> events;
+  uint64_t dropped = 0;
+  Registry::Instance().forEachBuffer([&events, &dropped](ThreadBuffer& buffer) {
+    // Only the last kEventsPerThread events are still in the ring.
+    const uint64_t end = buffer.numWritten();
+    const uint64_t cleared = std::min(buffer.num_cleared.load(std::memory_order_relaxed), end);
+    const uint64_t begin = std::max(cleared, end > kEventsPerThread ? end - kEventsPerThread : 0);
+    dropped += begin - cleared;
+    for (uint64_t ii = begin; ii < end; ii++) {
+      const Event& event = buffer.event(ii);
+      events.push_back({event.name, buffer.threadId(), event.begin_ns, event.end_ns});
+    }
+  });
+  std::sort(events.begin(), events.end(), [](const CollectedEvent& lhs, const CollectedEvent& rhs) {
+    return lhs.begin_ns < rhs.begin_ns || (lhs.begin_ns == rhs.begin_ns && lhs.end_ns > rhs.end_ns);
+  });
+  if (num_dropped != nullptr) {
+    *num_dropped = dropped;
+  }
+  return events;
+}
+
+void WriteChromeTrace(std::ostream& os) {
+  uint64_t num_dropped = 0;
+  const std::vector<CollectedEvent> events = Collect(&num_dropped);
+  const int64_t origin_ns = events.empty() ? 0 : events.front().begin_ns;
+
+  const std::ios::fmtflags flags = os.flags();
+  const std::streamsize precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  os << "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped_events\": " << num_dropped
+     << "}, \"traceEvents\": [";
+
+  // Thread names as metadata events.
+  bool first = true;
+  Registry::Instance().forEachBuffer([&os, &first](ThreadBuffer& buffer) {
+    const std::string name =
+        buffer.name.empty() ? "thread " + std::to_string(buffer.threadId()) : buffer.name;
+    os << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+       << buffer.threadId() << ", \"args\": {\"name\": ";
+    WriteJsonString(os, name.c_str());
+    os << "}}";
+    first = false;
+  });
+
+  // Zones as complete events, in microseconds since the first zone.
+  for (const CollectedEvent& event : events) {
+    os << (first ? "\n" : ",\n") << "{\"name\": ";
+    WriteJsonString(os, event.name);
+    os << ", \"cat\": \"gtcal\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread_id
+       << ", \"ts\": " << 1e-3 * static_cast<double>(event.begin_ns - origin_ns)
+       << ", \"dur\": " << 1e-3 * static_cast<double>(event.end_ns - event.begin_ns) << "}";
+    first = false;
+  }
+  os << "\n]}\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+bool WriteChromeTrace(const std::string& path) {
+  std::ofstream file(path);
+  WriteChromeTrace(file);
+  return static_cast<bool>(file);
+}
+
+}  // namespace trace
+}  // namespace gtcal
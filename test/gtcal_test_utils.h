@@ -2,6 +2,9 @@
 
 #include <gtsam/geometry/Pose3.h>
 #include <iomanip>
+#include <random>
+#include "gtcal/calibration_target.h"
+#include "gtcal/philox.h"
 #include "gtcal/utils.h"
 
 #define IMAGE_WIDTH 1024
@@ -14,93 +17,13 @@
 namespace gtcal {
 namespace utils {
 
-class CalibrationTarget {
-public:
-  CalibrationTarget(const double grid_spacing, const size_t num_rows, const size_t num_cols)
-    : grid_spacing_(grid_spacing), num_rows_(num_rows), num_cols_(num_cols),
-      grid_pts3d_target_(generateGridPts3d(grid_spacing, num_rows, num_cols)) {}
-
-  /**
-   * @brief Return target 3D points in the target frame.
-   *
-   * @return const gtsam::Point3Vector&
-   */
-  const gtsam::Point3Vector& pointsTarget() const { return grid_pts3d_target_; }
-
-  /**
-   * @brief Return the grid spacing.
-   *
-   * @return double
-   */
-  double gridSpacing() const { return grid_spacing_; }
-
-  /**
-   * @brief Return the number of rows.
-   *
-   * @return size_t
-   */
-  size_t numRows() const { return num_rows_; }
-
-  /**
-   * @brief Return the number of columns.
-   *
-   * @return size_t
-   */
-  size_t numCols() const { return num_cols_; }
-
-  /**
-   * @brief Return the target center point in target frame with a z-coordinate = 0.0.
-   *
-   * @return gtsam::Point3
-   */
-  gtsam::Point3 get3dCenter() const {
-    const double x_center = (grid_spacing_ * num_cols_) / 2.0;
-    const double y_center = (grid_spacing_ * num_rows_) / 2.0;
-
-    return {x_center, y_center, z_coordinate_};
-  }
-
-private:
-  /**
-   * @brief Return vector with 3D points of calibration target in target frame using the target's grid
-   * spacing, number of rows and columns.
-   *
-   * @param grid_spacing spacing between target points.
-   * @param num_rows  number of rows.
-   * @param num_cols number of cols.
-   * @return gtsam::Point3Vector
-   */
-  gtsam::Point3Vector generateGridPts3d(const double grid_spacing, const size_t num_rows,
-                                        const size_t num_cols) {
-    gtsam::Point3Vector grid_pts3d;
-    grid_pts3d.reserve(num_rows * num_cols);
-
-    for (size_t jj = 0; jj < num_cols; jj++) {
-      for (size_t ii = 0; ii < num_rows; ii++) {
-        const gtsam::Point3 pt3d =
-            (gtsam::Point3() << jj * grid_spacing, ii * grid_spacing, z_coordinate_).finished();
-        grid_pts3d.push_back(pt3d);
-      }
-    }
-
-    return grid_pts3d;
-  }
-
-private:
-  const double grid_spacing_;
-  const size_t num_rows_;
-  const size_t num_cols_;
-  const gtsam::Point3Vector grid_pts3d_target_;
-  const double z_coordinate_ = 0.0;
-};
-
 static gtsam::Pose3Vector GeneratePosesAroundTarget(const CalibrationTarget& target, const double radius,
                                                     const double y_dist,
-                                                    const gtsam::Point3& initial_offset) {
+                                                    const gtsam::Point3& initial_offset,
+                                                    const size_t num_poses = 10) {
   // Define bounds and theta angles.
   const double theta_min_rad = -M_PI_4;
   const double theta_max_rad = M_PI_4;
-  const size_t num_poses = 10;
   const double theta_delta_rad = (theta_max_rad - theta_min_rad) / (num_poses - 1);
   std::vector<double> thetas_rad;
   for (size_t ii = 0; ii < num_poses; ii++) {
@@ -127,38 +50,38 @@ static gtsam::Pose3Vector GeneratePosesAroundTarget(const CalibrationTarget& tar
   return poses_target_cam;
 }
 
-// TODO: figure out how to fix seed.
-static gtsam::Pose3 ApplyNoise(const gtsam::Pose3& pose, const double xyz_std_dev, const double rot_std_dev) {
-  // Create random number generators.
-  static std::default_random_engine gen;
-  std::normal_distribution<double> xyz_dist(0.0, xyz_std_dev);
-  std::normal_distribution<double> rot_dist(0.0, rot_std_dev);
-
+// The noise only depends on the generator's seed and stream and on how many numbers it gave before, so
+// callers on different threads should use their own generator, e.g. CounterRng(seed, pose index).
+static gtsam::Pose3 ApplyNoise(const gtsam::Pose3& pose, const double xyz_std_dev, const double rot_std_dev,
+                               CounterRng& rng) {
   // Apply noise to translation.
   const gtsam::Vector3& xyz = pose.translation();
-  const gtsam::Vector3 xyz_noisy = xyz + gtsam::Vector3{xyz_dist(gen), xyz_dist(gen), xyz_dist(gen)};
+  const gtsam::Vector3 xyz_noisy =
+      xyz + xyz_std_dev * gtsam::Vector3{rng.normal(), rng.normal(), rng.normal()};
 
   // Apply noise to rotation.
   const gtsam::Rot3 R = pose.rotation();
-  const gtsam::Rot3 R_noisy = gtsam::Rot3::Expmap({rot_dist(gen), rot_dist(gen), rot_dist(gen)}) * R;
+  const gtsam::Rot3 R_noisy =
+      gtsam::Rot3::Expmap(rot_std_dev * gtsam::Vector3{rng.normal(), rng.normal(), rng.normal()}) * R;
 
   return gtsam::Pose3(R_noisy, xyz_noisy);
 }
 
-gtsam::Vector6 PoseToVector(const gtsam::Pose3& pose) {
+static gtsam::Vector6 PoseToVector(const gtsam::Pose3& pose) {
   const gtsam::Vector3& xyz_vec = pose.translation();
   const gtsam::Vector3 rot_vec = pose.rotation().rpy();
   return (gtsam::Vector6() << xyz_vec.x(), xyz_vec.y(), xyz_vec.z(), rot_vec.x(), rot_vec.y(), rot_vec.z())
       .finished();
 }
 
-std::string PoseVectorFmt(const gtsam::Vector6& pose_vec) {
+static std::string PoseVectorFmt(const gtsam::Vector6& pose_vec) {
   std::stringstream ss;
   ss << std::fixed << std::setprecision(4) << pose_vec.transpose();
   return ss.str();
 }
 
-std::vector<gtsam::Pose3> DefaultCameraPoses(const std::vector<gtsam::Pose3>& poses_target_cam_offset) {
+static std::vector<gtsam::Pose3> DefaultCameraPoses(
+    const std::vector<gtsam::Pose3>& poses_target_cam_offset) {
   // Define first camera poses directly in front of target.
   const gtsam::Rot3 R0_target_cam = gtsam::Rot3::RzRyRx(0., 0., 0.);
   const gtsam::Point3 xyz0_target_cam = {0., 0., 0.};
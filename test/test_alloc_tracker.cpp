@@ -0,0 +1,222 @@
+#include "gtcal/alloc_tracker.h"
+#include "gtcal/batch_solver.h"
+#include "gtcal/pose_solver.h"
+#include "gtcal/pose_solver_gtsam.h"
+#include "gtcal_test_utils.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Allocation budgets of a steady-state solve of one frame: a fixed part per solve and a part per measurement.
+// They leave headroom over the current counts, and are meant to catch per-measurement churn creeping in.
+static constexpr uint64_t kPoseSolverAllocationsPerSolve = 4000;
+static constexpr uint64_t kPoseSolverAllocationsPerMeasurement = 16;
+static constexpr uint64_t kPoseSolverGtsamAllocationsPerSolve = 10000;
+static constexpr uint64_t kPoseSolverGtsamAllocationsPerMeasurement = 1500;
+static constexpr uint64_t kBatchSolverAllocationsPerFrame = 20000;
+static constexpr uint64_t kBatchSolverAllocationsPerMeasurement = 2000;
+
+/**
+ * @brief Return the totals of a named scope, or empty totals if it wasn't recorded.
+ *
+ */
+gtcal::alloc::ScopeTotal FindScopeTotal(const char* name) {
+  for (const auto& total : gtcal::alloc::ScopeTotals()) {
+    if (std::strcmp(total.name, name) == 0) {
+      return total;
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+// Tests that scopes count the allocations of the calling thread only, nested scopes included.
+TEST(AllocTracker, Scope) {
+  ASSERT_TRUE(gtcal::alloc::IsCounting());
+
+  const gtcal::alloc::Scope outer;
+  {
+    const gtcal::alloc::Scope inner;
+    auto values = std::make_unique<std::vector<double>>(100);
+    EXPECT_EQ(inner.stats().allocations, 2ul);
+    EXPECT_GE(inner.stats().bytes, 100 * sizeof(double));
+    EXPECT_EQ(inner.stats().deallocations, 0ul);
+    values.reset();
+    EXPECT_EQ(inner.stats().deallocations, 2ul);
+  }
+  EXPECT_EQ(outer.stats().allocations, 2ul);
+
+  // Allocations of other threads aren't counted. Starting a thread allocates on the calling thread, so only
+  // compare the counts before and after joining.
+  gtcal::alloc::AllocationStats thread_stats;
+  std::thread thread([&thread_stats]() {
+    const gtcal::alloc::Scope scope;
+    std::vector<int> values(1000);
+    values.resize(10000);
+    thread_stats = scope.stats();
+  });
+  const uint64_t allocations = outer.stats().allocations;
+  thread.join();
+  EXPECT_EQ(thread_stats.allocations, 2ul);
+  EXPECT_LE(outer.stats().allocations, allocations + 1);
+}
+
+// Tests the totals of named scopes and their report.
+TEST(AllocTracker, ScopeTotals) {
+  gtcal::alloc::ResetScopeTotals();
+  for (size_t ii = 0; ii < 3; ii++) {
+    const gtcal::alloc::Scope scope("AllocTracker::test");
+    const auto value = std::make_shared<double>(1.0);
+  }
+  {
+    const gtcal::alloc::Scope scope("AllocTracker::empty");
+  }
+
+  const auto totals = gtcal::alloc::ScopeTotals();
+  ASSERT_EQ(totals.size(), 2ul);
+  EXPECT_STREQ(totals[0].name, "AllocTracker::test");
+  EXPECT_EQ(totals[0].calls, 3ul);
+  EXPECT_EQ(totals[0].stats.allocations, 3ul);
+  EXPECT_EQ(totals[0].stats.deallocations, 3ul);
+  EXPECT_EQ(totals[1].calls, 1ul);
+  EXPECT_EQ(totals[1].stats.allocations, 0ul);
+
+  std::stringstream report;
+  gtcal::alloc::WriteScopeReport(report);
+  EXPECT_NE(report.str().find("AllocTracker::test"), std::string::npos);
+  EXPECT_NE(report.str().find("allocs/call"), std::string::npos);
+
+  // Names past kMaxScopes are gathered in a single entry.
+  static char names[gtcal::alloc::kMaxScopes][16];
+  for (size_t ii = 0; ii < gtcal::alloc::kMaxScopes; ii++) {
+    std::snprintf(names[ii], sizeof(names[ii]), "scope %zu", ii);
+    gtcal::alloc::RecordScope(names[ii], {});
+  }
+  EXPECT_EQ(gtcal::alloc::ScopeTotals().size(), gtcal::alloc::kMaxScopes + 1);
+  EXPECT_EQ(FindScopeTotal("(other)").calls, 2ul);
+
+  gtcal::alloc::ResetScopeTotals();
+  EXPECT_TRUE(gtcal::alloc::ScopeTotals().empty());
+}
+
+struct AllocationBudgetFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+  gtsam::Pose3Vector poses_target_cam;
+  std::vector<std::vector<gtcal::Measurement>> frames;
+
+  void SetUp() override {
+    // Frames looking at the target from slightly different positions.
+    const gtsam::Point3 center = target.get3dCenter();
+    const auto camera = makeCamera(false);
+    for (size_t ii = 0; ii < 12; ii++) {
+      const double dx = 0.03 * (static_cast<double>(ii % 4) - 1.5);
+      const double dy = 0.03 * (static_cast<double>(ii / 4) - 1.);
+      poses_target_cam.emplace_back(gtsam::Rot3::RzRyRx(-0.5 * dy, 0.5 * dx, 0.),
+                                    gtsam::Point3(center.x() + dx, center.y() + dy, -0.85));
+      camera->setCameraPose(poses_target_cam.back());
+      std::vector<gtcal::Measurement> measurements;
+      for (size_t jj = 0; jj < target_points3d.size(); jj++) {
+        const gtsam::Point2 uv = camera->project(target_points3d.at(jj));
+        if (gtcal::utils::FilterPixelCoords(uv, camera->width(), camera->height())) {
+          measurements.emplace_back(uv, 0, jj);
+        }
+      }
+      ASSERT_GT(measurements.size(), target_points3d.size() / 2);
+      frames.push_back(std::move(measurements));
+    }
+  }
+
+  std::shared_ptr<gtcal::Camera> makeCamera(const bool fisheye) const {
+    auto camera = std::make_shared<gtcal::Camera>();
+    if (fisheye) {
+      camera->setCameraModel<gtsam::Cal3Fisheye>(
+          IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0., 0., 0., 0.), gtsam::Pose3());
+    } else {
+      camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3_S2(FX, FY, 0., CX, CY),
+                                             gtsam::Pose3());
+    }
+    return camera;
+  }
+
+  /**
+   * @brief Return the allocations of solving the last frame, after solving the others to warm up the
+   * solver.
+   *
+   */
+  template <typename Solver>
+  uint64_t poseSolveAllocations(const Solver& solver, const std::shared_ptr<gtcal::Camera>& camera) const {
+    const gtsam::Pose3 perturbation(gtsam::Rot3::RzRyRx(0.02, -0.02, 0.03), {0.02, -0.01, 0.02});
+    uint64_t allocations = 0;
+    for (size_t ii = 0; ii < frames.size(); ii++) {
+      gtsam::Pose3 pose_target_cam = poses_target_cam.at(ii) * perturbation;
+      const gtcal::alloc::Scope scope;
+      EXPECT_TRUE(solver.solve(frames.at(ii), target_points3d, camera, pose_target_cam));
+      allocations = scope.stats().allocations;
+    }
+    return allocations;
+  }
+};
+
+// Tests that a steady-state solve of the Ceres pose solver stays within its allocation budget.
+TEST_F(AllocationBudgetFixture, PoseSolver) {
+  const gtcal::PoseSolver solver;
+  for (const bool fisheye : {false, true}) {
+    const uint64_t allocations = poseSolveAllocations(solver, makeCamera(fisheye));
+    EXPECT_GT(allocations, 0ul);
+    EXPECT_LE(allocations,
+              kPoseSolverAllocationsPerSolve + kPoseSolverAllocationsPerMeasurement * frames.back().size())
+        << (fisheye ? "Cal3Fisheye" : "Cal3_S2");
+  }
+}
+
+// Tests that a steady-state solve of the gtsam pose solver stays within its allocation budget.
+TEST_F(AllocationBudgetFixture, PoseSolverGtsam) {
+  const gtcal::PoseSolverGtsam solver{gtcal::PoseSolverGtsam::Options()};
+  for (const bool fisheye : {false, true}) {
+    const uint64_t allocations = poseSolveAllocations(solver, makeCamera(fisheye));
+    EXPECT_GT(allocations, 0ul);
+    EXPECT_LE(allocations, kPoseSolverGtsamAllocationsPerSolve +
+                               kPoseSolverGtsamAllocationsPerMeasurement * frames.back().size())
+        << (fisheye ? "Cal3Fisheye" : "Cal3_S2");
+  }
+}
+
+// Tests that streaming a frame into iSAM2 stays within its allocation budget once the graph holds a few
+// frames. A single thread keeps the whole update on the calling thread, where the scope counts.
+TEST_F(AllocationBudgetFixture, BatchSolver) {
+  for (const bool use_target_factors : {false, true}) {
+    gtcal::BatchSolver::Options options;
+    options.use_target_factors = use_target_factors;
+    options.num_threads = 1;
+    const gtcal::BatchSolver solver(target_points3d, options);
+    const auto camera = makeCamera(false);
+    gtcal::BatchSolver::State state({camera}, options);
+
+    uint64_t allocations = 0;
+    for (size_t ii = 0; ii < frames.size(); ii++) {
+      camera->setCameraPose(poses_target_cam.at(ii));
+      const gtcal::alloc::Scope scope;
+      solver.solve(frames.at(ii), state);
+      allocations = scope.stats().allocations;
+    }
+    EXPECT_GT(allocations, 0ul);
+    EXPECT_LE(allocations,
+              kBatchSolverAllocationsPerFrame + kBatchSolverAllocationsPerMeasurement * frames.back().size())
+        << (use_target_factors ? "target factors" : "landmark variables");
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,203 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/async_batch_solver.h"
+#include "gtcal/bounded_queue.h"
+#include "gtcal/camera.h"
+#include "gtcal/latency_histogram.h"
+#include "gtcal/utils.h"
+#include <gtest/gtest.h>
+
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using gtsam::symbol_shorthand::K;
+using gtsam::symbol_shorthand::X;
+
+// Tests that the bounded queue is FIFO and rejects pushes when full.
+TEST(BoundedQueue, PushPop) {
+  gtcal::BoundedQueue<int> queue(3);
+  EXPECT_EQ(queue.capacity(), 4);
+
+  // Fill the queue.
+  for (int ii = 0; ii < 4; ii++) {
+    int item = ii;
+    EXPECT_TRUE(queue.tryPush(item));
+  }
+  int item = 4;
+  EXPECT_FALSE(queue.tryPush(item));
+  EXPECT_EQ(item, 4);
+  EXPECT_EQ(queue.sizeApprox(), 4);
+
+  // Drain it in order.
+  for (int ii = 0; ii < 4; ii++) {
+    ASSERT_TRUE(queue.tryPop(item));
+    EXPECT_EQ(item, ii);
+  }
+  EXPECT_FALSE(queue.tryPop(item));
+}
+
+// Tests that no items are lost or duplicated with several producers.
+TEST(BoundedQueue, MultipleProducers) {
+  gtcal::BoundedQueue<size_t> queue(16);
+  const size_t num_producers = 4;
+  const size_t num_items = 10000;
+
+  std::vector<std::thread> producers;
+  for (size_t pp = 0; pp < num_producers; pp++) {
+    producers.emplace_back([&queue, pp, num_items]() {
+      for (size_t ii = 0; ii < num_items; ii++) {
+        size_t item = pp * num_items + ii;
+        while (!queue.tryPush(item)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Consume everything and check that each item shows up once.
+  std::vector<size_t> counts(num_producers * num_items, 0);
+  size_t num_popped = 0;
+  size_t item = 0;
+  while (num_popped < counts.size()) {
+    if (queue.tryPop(item)) {
+      counts.at(item)++;
+      num_popped++;
+    }
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(std::all_of(counts.begin(), counts.end(), [](const size_t count) { return count == 1; }));
+}
+
+// Tests the latency histogram statistics.
+TEST(LatencyHistogram, Percentiles) {
+  gtcal::LatencyHistogram histogram;
+  EXPECT_EQ(histogram.percentile(50.).count(), 0);
+
+  for (int ii = 1; ii <= 1000; ii++) {
+    histogram.record(std::chrono::microseconds(ii));
+  }
+  EXPECT_EQ(histogram.count(), 1000);
+  EXPECT_EQ(histogram.mean().count(), 500500);
+  EXPECT_EQ(histogram.max().count(), 1000000);
+
+  // Percentiles are bucket upper bounds, within 25% of the exact value.
+  EXPECT_NEAR(histogram.percentile(50.).count(), 500000, 0.25 * 500000);
+  EXPECT_NEAR(histogram.percentile(99.).count(), 990000, 0.25 * 990000);
+  EXPECT_EQ(histogram.percentile(100.).count(), 1000000);
+
+  histogram.reset();
+  EXPECT_EQ(histogram.count(), 0);
+}
+
+struct AsyncBatchSolverFixture : public testing::Test {
+protected:
+  // Target points.
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+
+  // Camera calibration and ground truth poses.
+  const gtsam::Cal3_S2 K_linear = gtsam::Cal3_S2(FX, FY, 0., CX, CY);
+  gtsam::Pose3Vector poses_target_cam;
+
+  void SetUp() override {
+    const gtsam::Point3 center = target.get3dCenter();
+    const gtsam::Pose3 pose0_target_cam(gtsam::Rot3(), {center.x(), center.y(), -0.85});
+    for (size_t ii = 0; ii < 4; ii++) {
+      const double offset = 0.02 * ii;
+      poses_target_cam.push_back(
+          pose0_target_cam.compose(gtsam::Pose3(gtsam::Rot3::RzRyRx(0., offset, 0.), {offset, 0., 0.})));
+    }
+  }
+
+  std::vector<gtcal::Measurement> generateMeasurements(const gtsam::Pose3& pose_target_cam) const {
+    gtcal::Camera camera;
+    camera.setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose_target_cam);
+    std::vector<gtcal::Measurement> measurements;
+    for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+      const gtsam::Point2 uv = camera.project(target_points3d.at(ii));
+      if (gtcal::utils::FilterPixelCoords(uv, camera.width(), camera.height())) {
+        measurements.emplace_back(uv, 0, ii);
+      }
+    }
+    return measurements;
+  }
+
+  std::unique_ptr<gtcal::BatchSolver::State> makeState() const {
+    auto camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, poses_target_cam.front());
+    return std::make_unique<gtcal::BatchSolver::State>(std::vector<std::shared_ptr<gtcal::Camera>>{camera});
+  }
+};
+
+// Tests that queued frames are processed in the background and the estimate is published.
+TEST_F(AsyncBatchSolverFixture, ProcessesFrames) {
+  const gtcal::BatchSolver solver(target_points3d);
+  gtcal::AsyncBatchSolver async_solver(solver, makeState());
+  EXPECT_EQ(async_solver.snapshot(), nullptr);
+
+  for (const auto& pose_target_cam : poses_target_cam) {
+    EXPECT_TRUE(async_solver.push(generateMeasurements(pose_target_cam)));
+  }
+  async_solver.flush();
+
+  // Check the published estimate.
+  const auto snapshot = async_solver.snapshot();
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_EQ(snapshot->num_frames, poses_target_cam.size());
+  EXPECT_TRUE(snapshot->estimate.exists(K(0)));
+  EXPECT_TRUE(snapshot->estimate.exists(X(poses_target_cam.size() - 1)));
+
+  // Check the counters and latency histograms.
+  const auto stats = async_solver.stats();
+  EXPECT_EQ(stats.num_pushed, poses_target_cam.size());
+  EXPECT_EQ(stats.num_processed, poses_target_cam.size());
+  EXPECT_EQ(stats.num_dropped, 0);
+  EXPECT_EQ(stats.num_failed, 0);
+  EXPECT_EQ(async_solver.queueWaitHistogram().count(), poses_target_cam.size());
+  EXPECT_EQ(async_solver.updateHistogram().count(), poses_target_cam.size());
+
+  // The state is handed back once stopped and further pushes are rejected.
+  const auto state = async_solver.stop();
+  ASSERT_TRUE(state);
+  EXPECT_EQ(state->num_frames, poses_target_cam.size());
+  EXPECT_FALSE(async_solver.push(generateMeasurements(poses_target_cam.front())));
+}
+
+// Tests that every frame is accounted for when the queue overflows with the drop-newest policy.
+TEST_F(AsyncBatchSolverFixture, DropNewest) {
+  const gtcal::BatchSolver solver(target_points3d);
+  gtcal::AsyncBatchSolver::Options options;
+  options.queue_capacity = 2;
+  options.drop_policy = gtcal::AsyncBatchSolver::DropPolicy::DROP_NEWEST;
+  gtcal::AsyncBatchSolver async_solver(solver, makeState(), options);
+
+  // Push frames faster than they can be solved.
+  const size_t num_frames = 32;
+  size_t num_accepted = 0;
+  for (size_t ii = 0; ii < num_frames; ii++) {
+    const gtsam::Pose3& pose_target_cam = poses_target_cam.at(ii % poses_target_cam.size());
+    std::vector<gtcal::Measurement> measurements = generateMeasurements(pose_target_cam);
+    const size_t num_measurements = measurements.size();
+    if (async_solver.push(std::move(measurements))) {
+      num_accepted++;
+    } else {
+      // A rejected frame is handed back to the caller.
+      EXPECT_EQ(measurements.size(), num_measurements);
+    }
+  }
+  async_solver.flush();
+
+  const auto stats = async_solver.stats();
+  EXPECT_EQ(stats.num_pushed, num_accepted);
+  EXPECT_EQ(stats.num_pushed + stats.num_dropped, num_frames);
+  EXPECT_EQ(stats.num_processed + stats.num_failed, num_accepted);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
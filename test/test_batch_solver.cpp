@@ -8,6 +8,7 @@
 #include <gtsam/slam/GeneralSFMFactor.h>
 #include <gtsam/slam/SmartProjectionFactor.h>
 
+#include <cmath>
 #include <vector>
 
 using gtsam::symbol_shorthand::K;
@@ -130,7 +131,254 @@ TEST_F(BatchSolverFixture, Initialization) {
   EXPECT_EQ(batch_solver.targetPoints().size(), target_points3d.size());
 }
 
+// Tests that solving a few frames adds a pose per frame and keeps the estimate at the ground truth when
+// starting from it.
+TEST_F(BatchSolverFixture, SolveFrames) {
+  gtcal::BatchSolver::State state({linear_cam});
+  gtcal::BatchSolver batch_solver(target_points3d);
+
+  // Ground truth camera used to generate the measurements.
+  auto truth_cam = std::make_shared<gtcal::Camera>();
+  const gtsam::Pose3 delta1(gtsam::Rot3::RzRyRx(0., 0.1, 0.), {0.1, 0., 0.});
+  const gtsam::Pose3 delta2(gtsam::Rot3::RzRyRx(0.1, 0., 0.), {0., -0.1, 0.});
+  const gtsam::Pose3Vector poses_target_cam = {pose0_target_cam, pose0_target_cam.compose(delta1),
+                                               pose0_target_cam.compose(delta2)};
+  for (const auto& pose_target_cam : poses_target_cam) {
+    truth_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose_target_cam);
+    const auto measurements = GenerateMeasurements(0, pose_target_cam, target_points3d, truth_cam);
+    ASSERT_FALSE(measurements.empty());
+
+    // Initialize the frame pose at the ground truth and solve.
+    linear_cam->setCameraPose(pose_target_cam);
+    batch_solver.solve(measurements, state);
+  }
+
+  // Check that every frame got a pose and the estimate matches the ground truth.
+  EXPECT_EQ(state.num_frames, poses_target_cam.size());
+  EXPECT_EQ(state.num_camera_updates.at(0), poses_target_cam.size());
+  for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+    ASSERT_TRUE(state.current_estimate.exists(X(ii)));
+    EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(ii)).equals(poses_target_cam.at(ii), 1e-3));
+  }
+  ASSERT_TRUE(state.current_estimate.exists(K(0)));
+  EXPECT_TRUE(state.current_estimate.at<gtsam::Cal3_S2>(K(0)).equals(K_linear, 1e-3));
 
+  // The camera model holds the latest estimate.
+  EXPECT_TRUE(linear_cam->pose().equals(poses_target_cam.back(), 1e-3));
+}
+
+// Tests that the landmark-free graph only holds frame poses and intrinsics and reaches the same estimate as
+// the landmark graph.
+TEST_F(BatchSolverFixture, SolveFramesWithTargetFactors) {
+  // Ground truth camera and noisy measurements, so the estimate is off the ground truth.
+  auto truth_cam = std::make_shared<gtcal::Camera>();
+  const gtsam::Pose3 delta(gtsam::Rot3::RzRyRx(0.05, -0.05, 0.), {-0.05, 0.05, 0.});
+  const gtsam::Pose3Vector poses_target_cam = {pose0_target_cam, pose0_target_cam.compose(delta),
+                                               pose0_target_cam.compose(delta.inverse())};
+  std::vector<std::vector<gtcal::Measurement>> frames;
+  for (const auto& pose_target_cam : poses_target_cam) {
+    truth_cam->setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT, K_fisheye, pose_target_cam);
+    frames.push_back(GenerateMeasurements(0, pose_target_cam, target_points3d, truth_cam));
+    for (size_t ii = 0; ii < frames.back().size(); ii++) {
+      const double index = static_cast<double>(ii + frames.size());
+      frames.back().at(ii).uv += 0.3 * gtsam::Point2(std::sin(1.7 * index), std::cos(2.3 * index));
+    }
+  }
+
+  // Solve the same frames with both graphs. Every variable is relinearized on every update and a few extra
+  // iterations run at the end, so both reach the minimum of the same cost.
+  std::vector<gtsam::Values> estimates;
+  for (const bool use_target_factors : {false, true}) {
+    gtcal::BatchSolver::Options options;
+    options.use_target_factors = use_target_factors;
+    options.pose_relinearize_threshold = 0.;
+    options.landmark_relinearize_threshold = 0.;
+    options.calibration_relinearize_threshold = 0.;
+    gtcal::BatchSolver batch_solver(target_points3d, options);
+    auto camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT, K_fisheye, pose0_target_cam);
+    gtcal::BatchSolver::State state({camera}, options);
+    for (size_t ii = 0; ii < frames.size(); ii++) {
+      camera->setCameraPose(poses_target_cam.at(ii));
+      batch_solver.solve(frames.at(ii), state);
+    }
+    for (size_t ii = 0; ii < 5; ii++) {
+      ASSERT_TRUE(batch_solver.optimize(state));
+    }
+
+    // Only the frame poses and the calibration are variables of the landmark-free graph.
+    if (use_target_factors) {
+      EXPECT_EQ(state.current_estimate.size(), poses_target_cam.size() + 1);
+      EXPECT_FALSE(state.current_estimate.exists(L(0)));
+    }
+    for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+      EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(ii)).equals(poses_target_cam.at(ii), 1e-2));
+    }
+    estimates.push_back(state.current_estimate);
+  }
+
+  // The landmark priors are tight enough for both graphs to agree.
+  const gtsam::Values& landmark_estimate = estimates.front();
+  const gtsam::Values& target_estimate = estimates.back();
+  for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+    const auto pose_target_cam = landmark_estimate.at<gtsam::Pose3>(X(ii));
+    EXPECT_TRUE(target_estimate.at<gtsam::Pose3>(X(ii)).equals(pose_target_cam, 1e-6));
+  }
+  const auto K_landmark = landmark_estimate.at<gtsam::Cal3Fisheye>(K(0));
+  EXPECT_TRUE(target_estimate.at<gtsam::Cal3Fisheye>(K(0)).equals(K_landmark, 1e-5));
+}
+
+// Tests that a frame whose iSAM2 update throws leaves the state as it was and the next frame still solves.
+TEST_F(BatchSolverFixture, FailedUpdateKeepsState) {
+  gtcal::BatchSolver::Options options;
+  options.use_target_factors = true;
+  gtcal::BatchSolver batch_solver(target_points3d, options);
+  gtcal::BatchSolver::State state({linear_cam}, options);
+
+  auto truth_cam = std::make_shared<gtcal::Camera>();
+  truth_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose0_target_cam);
+  const auto measurements = GenerateMeasurements(0, pose0_target_cam, target_points3d, truth_cam);
+  linear_cam->setCameraPose(pose0_target_cam);
+  batch_solver.solve(measurements, state);
+  const size_t num_factors = state.graph.size();
+
+  // Initialized behind the target, no measurement constrains the frame pose and the system is indeterminant.
+  linear_cam->setCameraPose(gtsam::Pose3(R0_target_cam, {target_center_x, target_center_y, 0.85}));
+  EXPECT_ANY_THROW(batch_solver.solve(measurements, state));
+  EXPECT_EQ(state.num_frames, 1);
+  EXPECT_EQ(state.num_camera_updates.at(0), 1);
+  EXPECT_EQ(state.graph.size(), num_factors);
+  EXPECT_FALSE(state.current_estimate.exists(X(1)));
+
+  // The next frame takes the pose index of the failed one.
+  const gtsam::Pose3 delta(gtsam::Rot3::RzRyRx(0.05, -0.05, 0.), {-0.05, 0.05, 0.});
+  const gtsam::Pose3 pose1_target_cam = pose0_target_cam.compose(delta);
+  truth_cam->setCameraPose(pose1_target_cam);
+  linear_cam->setCameraPose(pose1_target_cam);
+  batch_solver.solve(GenerateMeasurements(0, pose1_target_cam, target_points3d, truth_cam), state);
+  EXPECT_EQ(state.num_frames, 2);
+  EXPECT_EQ(state.num_camera_updates.at(0), 2);
+  EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(1)).equals(pose1_target_cam, 1e-3));
+  EXPECT_TRUE(state.current_estimate.at<gtsam::Cal3_S2>(K(0)).equals(K_linear, 1e-3));
+}
+
+// Tests that per-measurement covariances become the noise models of the factors and reach the same estimate.
+TEST_F(BatchSolverFixture, SolveFramesWithCovariances) {
+  for (const bool use_target_factors : {false, true}) {
+    gtcal::BatchSolver::Options options;
+    options.use_target_factors = use_target_factors;
+    gtcal::BatchSolver batch_solver(target_points3d, options);
+    gtcal::BatchSolver::State state({linear_cam});
+
+    auto truth_cam = std::make_shared<gtcal::Camera>();
+    truth_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose0_target_cam);
+    const auto measurements = GenerateMeasurements(0, pose0_target_cam, target_points3d, truth_cam);
+    std::vector<gtsam::Matrix2> covariances(measurements.size());
+    for (size_t ii = 0; ii < covariances.size(); ii++) {
+      covariances.at(ii) << 0.04 + 0.01 * (ii % 3), 0.01, 0.01, 0.09;
+    }
+    linear_cam->setCameraPose(pose0_target_cam);
+    batch_solver.solve(measurements, covariances, state);
+
+    // Every measurement factor has the covariance of its measurement.
+    size_t index = 0;
+    for (const auto& factor : state.graph) {
+      const auto noise_factor = std::dynamic_pointer_cast<gtsam::NoiseModelFactor>(factor);
+      if (!noise_factor || noise_factor->dim() != 2) {
+        continue;
+      }
+      const auto gaussian =
+          std::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(noise_factor->noiseModel());
+      ASSERT_TRUE(gaussian);
+      EXPECT_TRUE(gtsam::assert_equal(covariances.at(index++), gaussian->covariance(), 1e-9));
+    }
+    EXPECT_EQ(index, measurements.size());
+    EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(0)).equals(pose0_target_cam, 1e-3));
+    EXPECT_TRUE(state.current_estimate.at<gtsam::Cal3_S2>(K(0)).equals(K_linear, 1e-3));
+  }
+}
+
+
+// Tests that the batch optimizers converge to the ground truth from perturbed initial poses.
+TEST_F(BatchSolverFixture, BatchOptimizers) {
+  const gtsam::Pose3 delta(gtsam::Rot3::RzRyRx(0.05, -0.05, 0.), {-0.05, 0.05, 0.});
+  const gtsam::Pose3Vector poses_target_cam = {pose0_target_cam, pose0_target_cam.compose(delta),
+                                               pose0_target_cam.compose(delta.inverse())};
+  const gtsam::Pose3 perturbation(gtsam::Rot3::RzRyRx(0.01, -0.01, 0.02), {0.01, -0.01, 0.01});
+
+  for (const auto optimizer_type : {gtcal::BatchSolver::OptimizerType::LEVENBERG_MARQUARDT,
+                                    gtcal::BatchSolver::OptimizerType::DOGLEG}) {
+    gtcal::BatchSolver::Options options;
+    options.optimizer_type = optimizer_type;
+    options.ordering_type = gtcal::BatchSolver::OrderingType::COLAMD;
+    options.num_threads = 2;
+    gtcal::BatchSolver batch_solver(target_points3d, options);
+    auto camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose0_target_cam);
+    gtcal::BatchSolver::State state({camera});
+
+    // Nothing to optimize yet.
+    EXPECT_FALSE(batch_solver.optimize(state));
+
+    auto truth_cam = std::make_shared<gtcal::Camera>();
+    for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+      truth_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, poses_target_cam.at(ii));
+      const auto measurements = GenerateMeasurements(0, poses_target_cam.at(ii), target_points3d, truth_cam);
+
+      // The first pose sets the frame, the others start off the ground truth.
+      camera->setCameraPose(ii == 0 ? poses_target_cam.at(ii) : poses_target_cam.at(ii) * perturbation);
+      batch_solver.solve(measurements, state);
+    }
+
+    // Solving only accumulates the graph, the estimate holds the initial values.
+    EXPECT_EQ(state.num_frames, poses_target_cam.size());
+    EXPECT_FALSE(state.current_estimate.at<gtsam::Pose3>(X(1)).equals(poses_target_cam.at(1), 1e-3));
+
+    ASSERT_TRUE(batch_solver.optimize(state));
+    for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+      EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(ii)).equals(poses_target_cam.at(ii), 1e-3));
+    }
+    const auto K_estimate = state.current_estimate.at<gtsam::Cal3_S2>(K(0));
+    EXPECT_TRUE(K_estimate.equals(K_linear, 1e-3));
+
+    // The camera model holds the optimized calibration.
+    const std::vector<double> expected = {K_estimate.fx(), K_estimate.fy(), K_estimate.px(), K_estimate.py()};
+    EXPECT_EQ(camera->intrinsicsParameters(), expected);
+  }
+}
+
+// Tests that per-type relinearization thresholds and frozen intrinsics keep the estimate at the ground truth.
+TEST_F(BatchSolverFixture, FreezeConvergedCalibration) {
+  gtcal::BatchSolver::Options options;
+  options.calibration_relinearize_threshold = 0.1;
+  options.freeze_converged_calibration = true;
+  options.calibration_check_interval = 1;
+  options.calibration_freeze_tolerance = 0.25;
+  options.calibration_freeze_checks = 2;
+  gtcal::BatchSolver batch_solver(target_points3d, options);
+  gtcal::BatchSolver::State state({linear_cam}, options);
+  EXPECT_FALSE(state.calibration_frozen.at(0));
+
+  auto truth_cam = std::make_shared<gtcal::Camera>();
+  gtsam::Pose3Vector poses_target_cam;
+  for (size_t ii = 0; ii < 12; ii++) {
+    const double offset = 0.02 * (static_cast<double>(ii % 4) - 1.5);
+    const gtsam::Pose3 delta(gtsam::Rot3::RzRyRx(offset, -offset, 0.), {offset, -offset, 0.});
+    poses_target_cam.push_back(pose0_target_cam.compose(delta));
+    truth_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, poses_target_cam.back());
+    const auto measurements = GenerateMeasurements(0, poses_target_cam.back(), target_points3d, truth_cam);
+    linear_cam->setCameraPose(poses_target_cam.back());
+    batch_solver.solve(measurements, state);
+  }
+
+  // The calibration sigmas settle after a few frames.
+  EXPECT_TRUE(state.calibration_frozen.at(0));
+  EXPECT_EQ(state.calibration_sigmas.at(0).size(), 5);
+  for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+    EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(ii)).equals(poses_target_cam.at(ii), 1e-3));
+  }
+  EXPECT_TRUE(state.current_estimate.at<gtsam::Cal3_S2>(K(0)).equals(K_linear, 1e-3));
+}
 
 TEST(BatchSolver, DISABLED_GtsamBatchSolver) {
   // Define initial camera parameters.
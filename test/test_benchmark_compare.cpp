@@ -0,0 +1,170 @@
+#include "gtcal/benchmark_compare.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Return a Google Benchmark JSON run with the given repetitions of each benchmark, in microseconds.
+ *
+ */
+std::string MakeRun(const std::vector<std::pair<std::string, std::vector<double>>>& benchmarks) {
+  std::stringstream ss;
+  ss << "{\n  \"context\": {\"date\": \"2026-10-16T10:00:00+00:00\", \"num_cpus\": 8,\n"
+     << "    \"caches\": [{\"type\": \"Data\", \"level\": 1, \"size\": 32768}]},\n  \"benchmarks\": [";
+  bool first = true;
+  for (const auto& [name, times] : benchmarks) {
+    for (size_t ii = 0; ii < times.size(); ii++) {
+      ss << (first ? "\n" : ",\n") << "    {\"name\": \"" << name << "\", \"run_name\": \"" << name
+         << "\", \"run_type\": \"iteration\", \"repetitions\": " << times.size()
+         << ", \"repetition_index\": " << ii << ", \"threads\": 1, \"iterations\": 100, \"real_time\": "
+         << times[ii] << ", \"cpu_time\": " << 2.0 * times[ii]
+         << ", \"time_unit\": \"us\", \"frames/s\": 1.5e+03, \"label\": \"a \\\"quoted\\\" label\"}";
+      first = false;
+    }
+    ss << ",\n    {\"name\": \"" << name << "_median\", \"run_name\": \"" << name
+       << "\", \"run_type\": \"aggregate\", \"aggregate_name\": \"median\", \"real_time\": 1e9, "
+       << "\"cpu_time\": 1e9, \"time_unit\": \"us\"}";
+  }
+  ss << "\n  ]\n}\n";
+  return ss.str();
+}
+
+}  // namespace
+
+// Tests the exact and approximate p-values of the Mann-Whitney U test.
+TEST(MannWhitney, PValue) {
+  // U = 0 and U = 2 of 5 x 5 samples: 2 * 1 / 252 and 2 * (1 + 1 + 2) / 252.
+  EXPECT_NEAR(gtcal::MannWhitneyPValue({1, 2, 3, 4, 5}, {6, 7, 8, 9, 10}), 2.0 / 252.0, 1e-12);
+  EXPECT_NEAR(gtcal::MannWhitneyPValue({6, 7, 8, 9, 10}, {1, 2, 3, 4, 5}), 2.0 / 252.0, 1e-12);
+  EXPECT_NEAR(gtcal::MannWhitneyPValue({1, 2, 3, 4, 5}, {3.5, 6, 7, 8, 9}), 8.0 / 252.0, 1e-12);
+  EXPECT_EQ(gtcal::MannWhitneyPValue({1, 2, 3}, {1, 2, 3}), 1.0);
+  EXPECT_EQ(gtcal::MannWhitneyPValue({}, {1, 2, 3}), 1.0);
+
+  // Normal approximation above the exact sizes: matches the exact test closely near the boundary.
+  std::vector<double> a, b;
+  for (size_t ii = 0; ii < 30; ii++) {
+    a.push_back(static_cast<double>(ii));
+    b.push_back(static_cast<double>(ii) + 8.5);
+  }
+  const double p_approximate = gtcal::MannWhitneyPValue(a, b);
+  a.resize(gtcal::BenchmarkComparator::kMaxExactSize);
+  b.resize(gtcal::BenchmarkComparator::kMaxExactSize);
+  const double p_exact = gtcal::MannWhitneyPValue(a, b);
+  EXPECT_GT(p_approximate, 0.0);
+  EXPECT_LT(p_approximate, 0.05);
+  EXPECT_LT(p_exact, 0.05);
+  for (double& value : b) {
+    value += 100.0;
+  }
+  a.resize(30, 0.0);
+  b.resize(30, 200.0);
+  EXPECT_LT(gtcal::MannWhitneyPValue(a, b), 1e-9);
+}
+
+// Tests that repetitions are gathered per benchmark in nanoseconds and aggregates are skipped.
+TEST(BenchmarkJson, Parse) {
+  std::vector<gtcal::BenchmarkSamples> benchmarks;
+  std::string error;
+  ASSERT_TRUE(gtcal::ParseBenchmarkJson(
+      MakeRun({{"BM_PoseSolver/0/130/4/real_time", {10, 11, 12}}, {"BM_CameraProject/1/520", {2}}}),
+      benchmarks, error))
+      << error;
+  ASSERT_EQ(benchmarks.size(), 2ul);
+  EXPECT_EQ(benchmarks[0].name, "BM_PoseSolver/0/130/4/real_time");
+  EXPECT_EQ(benchmarks[0].real_time_ns, (std::vector<double>{1e4, 1.1e4, 1.2e4}));
+  EXPECT_EQ(benchmarks[0].cpu_time_ns, (std::vector<double>{2e4, 2.2e4, 2.4e4}));
+  EXPECT_EQ(benchmarks[1].real_time_ns, (std::vector<double>{2e3}));
+
+  // A run with aggregates only falls back to the medians, errored runs are skipped.
+  ASSERT_TRUE(gtcal::ParseBenchmarkJson(
+      "{\"benchmarks\": [{\"name\": \"BM_A_mean\", \"run_name\": \"BM_A\", \"run_type\": \"aggregate\", "
+      "\"aggregate_name\": \"mean\", \"real_time\": 5, \"cpu_time\": 5, \"time_unit\": \"ms\"}, "
+      "{\"name\": \"BM_A_median\", \"run_name\": \"BM_A\", \"run_type\": \"aggregate\", "
+      "\"aggregate_name\": \"median\", \"real_time\": 4, \"cpu_time\": 4, \"time_unit\": \"ms\"}, "
+      "{\"name\": \"BM_B\", \"error_occurred\": true, \"error_message\": \"failed\", \"real_time\": 0, "
+      "\"cpu_time\": 0, \"time_unit\": \"ns\"}]}",
+      benchmarks, error))
+      << error;
+  ASSERT_EQ(benchmarks.size(), 1ul);
+  EXPECT_EQ(benchmarks[0].name, "BM_A");
+  EXPECT_EQ(benchmarks[0].real_time_ns, (std::vector<double>{4e6}));
+
+  EXPECT_FALSE(gtcal::ParseBenchmarkJson("{\"context\": {}}", benchmarks, error));
+  EXPECT_FALSE(gtcal::ParseBenchmarkJson("{\"benchmarks\": [{\"name\": ", benchmarks, error));
+  EXPECT_FALSE(gtcal::ParseBenchmarkJson("{\"benchmarks\": []}", benchmarks, error));
+  EXPECT_FALSE(gtcal::LoadBenchmarkJson("/nonexistent/gtcal_benchmarks.json", benchmarks, error));
+}
+
+// Tests the verdicts of the comparator and its reports.
+TEST(BenchmarkComparator, Compare) {
+  std::vector<gtcal::BenchmarkSamples> baseline, contender;
+  std::string error;
+  ASSERT_TRUE(gtcal::ParseBenchmarkJson(MakeRun({{"BM_PoseSolver/0", {100, 101, 99, 100, 102}},
+                                                 {"BM_PoseSolver/1", {100, 101, 99, 100, 102}},
+                                                 {"BM_PoseSolverGtsam/0", {100, 101, 99, 100, 102}},
+                                                 {"BM_BatchSolverGraph/10", {100, 101, 99, 100, 102}},
+                                                 {"BM_CameraProject/0", {100, 101}},
+                                                 {"BM_Removed", {100}}}),
+                                        baseline, error))
+      << error;
+  ASSERT_TRUE(gtcal::ParseBenchmarkJson(MakeRun({{"BM_PoseSolver/0", {120, 121, 119, 120, 122}},
+                                                 {"BM_PoseSolver/1", {100, 103, 98, 101, 100}},
+                                                 {"BM_PoseSolverGtsam/0", {80, 81, 79, 80, 82}},
+                                                 {"BM_BatchSolverGraph/10", {99, 130, 98, 131, 97}},
+                                                 {"BM_CameraProject/0", {120, 121}},
+                                                 {"BM_Added", {100}}}),
+                                        contender, error))
+      << error;
+
+  const gtcal::BenchmarkComparator comparator;
+  const auto comparisons = comparator.compare(baseline, contender);
+  using Verdict = gtcal::BenchmarkComparator::Verdict;
+  const std::vector<Verdict> verdicts = {Verdict::REGRESSION, Verdict::UNCHANGED, Verdict::IMPROVEMENT,
+                                         Verdict::UNCHANGED,  Verdict::REGRESSION, Verdict::MISSING,
+                                         Verdict::NEW};
+  ASSERT_EQ(comparisons.size(), verdicts.size());
+  for (size_t ii = 0; ii < verdicts.size(); ii++) {
+    EXPECT_EQ(comparisons[ii].verdict, verdicts[ii]) << comparisons[ii].name;
+  }
+  EXPECT_NEAR(comparisons[0].change, 0.2, 1e-12);
+  EXPECT_NEAR(comparisons[0].p_value, 2.0 / 252.0, 1e-12);
+  EXPECT_NEAR(comparisons[0].baseline_median_ns, 1e5, 1e-6);
+
+  // The median of the noisy benchmark barely moved, and 2 repetitions can't reach alpha: threshold only.
+  EXPECT_LT(std::abs(comparisons[3].change), 0.05);
+  EXPECT_TRUE(std::isnan(comparisons[4].p_value));
+  EXPECT_EQ(gtcal::BenchmarkComparator::NumRegressions(comparisons), 2ul);
+
+  // A 30% threshold lets every change through.
+  gtcal::BenchmarkComparator::Options options;
+  options.threshold = 0.3;
+  EXPECT_EQ(gtcal::BenchmarkComparator::NumRegressions(
+                gtcal::BenchmarkComparator(options).compare(baseline, contender)),
+            0ul);
+
+  std::stringstream report;
+  comparator.writeReport(comparisons, report);
+  const std::string text = report.str();
+  EXPECT_NE(text.find("BM_PoseSolver/0"), std::string::npos);
+  EXPECT_EQ(text.find("BM_PoseSolver/1 "), std::string::npos);
+  EXPECT_NE(text.find("+20.0%"), std::string::npos);
+  EXPECT_NE(text.find("Summary: 7 benchmarks, 2 regressions, 1 improvements, 2 unchanged, 1 missing, 1 new."),
+            std::string::npos);
+  EXPECT_NE(text.find("BM_PoseSolverGtsam"), std::string::npos);
+
+  std::stringstream json;
+  comparator.writeJson(comparisons, json);
+  EXPECT_NE(json.str().find("\"num_regressions\": 2"), std::string::npos);
+  EXPECT_NE(json.str().find("\"verdict\": \"MISSING\""), std::string::npos);
+  EXPECT_NE(json.str().find("\"p_value\": null"), std::string::npos);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
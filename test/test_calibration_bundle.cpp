@@ -0,0 +1,167 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/binary_io.h"
+#include "gtcal/calibration_bundle.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+
+struct CalibrationBundleFixture : public testing::Test {
+protected:
+  std::string bundle_path;
+  std::vector<std::shared_ptr<gtcal::Camera>> cameras;
+  gtsam::Rot3 R_rect_cam = gtsam::Rot3::Ry(0.3);
+
+  void SetUp() override {
+    bundle_path = testing::TempDir() + "gtcal_bundle_test.bin";
+    const gtsam::Pose3 pose(gtsam::Rot3::RzRyRx(0.1, -0.2, 0.3), gtsam::Point3(0.5, -1., 2.));
+    cameras.push_back(std::make_shared<gtcal::Camera>());
+    cameras.back()->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                                   gtsam::Cal3_S2(FX, FY, 0., CX, CY), pose);
+    cameras.push_back(std::make_shared<gtcal::Camera>());
+    cameras.back()->setCameraModel<gtsam::Cal3Fisheye>(
+        IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0.1, -0.01, 0.001, 0.), pose);
+  }
+
+  void TearDown() override { std::filesystem::remove(bundle_path); }
+
+  /**
+   * @brief Return the expected source pixel of an undistorted pixel.
+   *
+   */
+  std::optional<gtsam::Point2> expectedSourcePixel(const size_t index, const gtsam::Rot3& R, const double x,
+                                                   const double y) const {
+    const gtsam::Point3 ray = R.unrotate(gtsam::Point3((x - CX) / FX, (y - CY) / FY, 1.));
+    if (ray.z() <= 0.) {
+      return std::nullopt;
+    }
+    const gtsam::Point2 xy(ray.x() / ray.z(), ray.y() / ray.z());
+    const gtsam::Point2 uv = std::visit([&](auto&& arg) { return arg->calibration().uncalibrate(xy); },
+                                        cameras.at(index)->cameraVariant());
+    if (uv.x() < 0. || uv.y() < 0. || uv.x() > IMAGE_WIDTH - 1. || uv.y() > IMAGE_HEIGHT - 1.) {
+      return std::nullopt;
+    }
+    return uv;
+  }
+};
+
+// Tests that the maps sample the original image where the camera models project, in every map format.
+TEST_F(CalibrationBundleFixture, Maps) {
+  // Half floats have a 0.5 pixel step for offsets between 512 and 1024 pixels.
+  const std::vector<std::pair<gtcal::MapFormat, double>> formats = {{gtcal::MapFormat::FLOAT32, 1e-3},
+                                                                     {gtcal::MapFormat::FLOAT16, 0.26},
+                                                                     {gtcal::MapFormat::FIXED16, 0.04}};
+  for (const auto& [format, tol] : formats) {
+    gtcal::CalibrationBundleOptions options;
+    options.map_format = format;
+    options.num_threads = 3;
+    options.rectification_rotations = {R_rect_cam, gtsam::Rot3()};
+    ASSERT_TRUE(gtcal::WriteCalibrationBundle(bundle_path, cameras, {}, options));
+
+    gtcal::CalibrationBundleReader reader(bundle_path);
+    ASSERT_TRUE(reader.isOpen());
+    ASSERT_EQ(reader.numCameras(), 2);
+    size_t num_invalid = 0;
+    for (size_t index = 0; index < 2; index++) {
+      const auto map_address = reinterpret_cast<uintptr_t>(reader.mapData(index));
+      EXPECT_EQ(map_address % gtcal::kCalibrationBundleMapAlignment, 0);
+      const gtsam::Rot3 R = index == 0 ? R_rect_cam : gtsam::Rot3();
+      for (size_t y = 0; y < IMAGE_HEIGHT; y += 7) {
+        for (size_t x = 0; x < IMAGE_WIDTH; x += 11) {
+          const std::optional<gtsam::Point2> expected = expectedSourcePixel(index, R, x, y);
+          gtsam::Point2 uv;
+          ASSERT_EQ(reader.sourcePixel(index, x, y, uv), expected.has_value()) << x << " " << y;
+          if (expected) {
+            EXPECT_NEAR(uv.x(), expected->x(), tol);
+            EXPECT_NEAR(uv.y(), expected->y(), tol);
+          } else {
+            num_invalid++;
+          }
+        }
+      }
+    }
+
+    // The rotated pinhole view leaves the original image on one side.
+    EXPECT_GT(num_invalid, 0);
+    gtsam::Point2 uv;
+    EXPECT_FALSE(reader.sourcePixel(0, IMAGE_WIDTH, 0, uv));
+  }
+}
+
+// Tests that the calibrations, poses and covariances are read back.
+TEST_F(CalibrationBundleFixture, Records) {
+  gtcal::CalibrationBundleOptions options;
+  options.map_format = gtcal::MapFormat::NONE;
+  const std::vector<gtsam::Matrix> covariances = {2. * gtsam::Matrix::Identity(5, 5), gtsam::Matrix()};
+  ASSERT_TRUE(gtcal::WriteCalibrationBundle(bundle_path, cameras, covariances, options));
+  EXPECT_EQ(std::filesystem::file_size(bundle_path), 32 + 2 * sizeof(gtcal::CalibrationBundleCamera));
+
+  gtcal::CalibrationBundleReader reader(bundle_path);
+  ASSERT_TRUE(reader.isOpen());
+  ASSERT_EQ(reader.numCameras(), 2);
+  for (size_t index = 0; index < 2; index++) {
+    EXPECT_EQ(reader.mapData(index), nullptr);
+    const std::shared_ptr<gtcal::Camera> camera = reader.makeCamera(index);
+    EXPECT_EQ(camera->modelType(), cameras.at(index)->modelType());
+    EXPECT_EQ(camera->width(), IMAGE_WIDTH);
+    EXPECT_EQ(camera->height(), IMAGE_HEIGHT);
+    EXPECT_EQ(camera->intrinsicsParameters(), cameras.at(index)->intrinsicsParameters());
+    EXPECT_TRUE(camera->pose().equals(cameras.at(index)->pose(), 1e-9));
+  }
+
+  const gtcal::CalibrationBundleCamera& pinhole = reader.camera(0);
+  EXPECT_EQ(pinhole.covariance_dim, 5);
+  for (size_t ii = 0; ii < 25; ii++) {
+    EXPECT_DOUBLE_EQ(pinhole.covariance[ii], ii % 6 == 0 ? 2. : 0.);
+  }
+  const gtcal::CalibrationBundleCamera& fisheye = reader.camera(1);
+  EXPECT_EQ(fisheye.covariance_dim, 9);
+  EXPECT_EQ(fisheye.num_intrinsics, 8);
+  for (size_t ii = 0; ii < 81; ii++) {
+    EXPECT_EQ(fisheye.covariance[ii], 0.);
+  }
+}
+
+// Tests that damaged bundles are rejected.
+TEST_F(CalibrationBundleFixture, Invalid) {
+  gtcal::CalibrationBundleOptions options;
+  options.map_format = gtcal::MapFormat::FIXED16;
+  ASSERT_TRUE(gtcal::WriteCalibrationBundle(bundle_path, cameras, {}, options));
+  const size_t file_size = std::filesystem::file_size(bundle_path);
+
+  // A flipped byte in a camera record.
+  {
+    std::fstream file(bundle_path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(40);
+    const char byte = static_cast<char>(file.get() ^ 0x01);
+    file.seekp(40);
+    file.put(byte);
+  }
+  EXPECT_FALSE(gtcal::CalibrationBundleReader(bundle_path).isOpen());
+
+  // A truncated map.
+  ASSERT_TRUE(gtcal::WriteCalibrationBundle(bundle_path, cameras, {}, options));
+  ASSERT_TRUE(gtcal::CalibrationBundleReader(bundle_path).isOpen());
+  std::filesystem::resize_file(bundle_path, file_size - 1);
+  EXPECT_FALSE(gtcal::CalibrationBundleReader(bundle_path).isOpen());
+
+  EXPECT_FALSE(gtcal::CalibrationBundleReader(testing::TempDir() + "gtcal_missing_bundle.bin").isOpen());
+}
+
+// Tests the half precision conversions used by the float16 maps.
+TEST(CalibrationBundle, HalfFloat) {
+  for (const float value : {0.f, -0.f, 1.f, -2.5f, 0.125f, 65504.f, 6.1035156e-05f, 5.9604645e-08f}) {
+    EXPECT_EQ(gtcal::io::HalfToFloat(gtcal::io::FloatToHalf(value)), value);
+  }
+  EXPECT_NEAR(gtcal::io::HalfToFloat(gtcal::io::FloatToHalf(300.3f)), 300.3f, 0.125f);
+  EXPECT_TRUE(std::isinf(gtcal::io::HalfToFloat(gtcal::io::FloatToHalf(1e6f))));
+  EXPECT_TRUE(std::isnan(gtcal::io::HalfToFloat(gtcal::io::FloatToHalf(NAN))));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
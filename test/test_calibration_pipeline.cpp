@@ -0,0 +1,139 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/calibration_pipeline.h"
+#include "gtcal/detection_log.h"
+#include "gtcal/rig.h"
+#include <gtest/gtest.h>
+
+#include <gtsam/inference/Symbol.h>
+
+#include <filesystem>
+#include <vector>
+
+using gtsam::symbol_shorthand::K;
+using gtsam::symbol_shorthand::X;
+
+struct CalibrationPipelineFixture : public testing::Test {
+protected:
+  const gtsam::Cal3_S2 K_true = gtsam::Cal3_S2(FX, FY, 0., CX, CY);
+  gtcal::Rig rig;
+  std::string log_path, result_path;
+  gtsam::Pose3Vector poses_target_cam;
+
+  void SetUp() override {
+    log_path = testing::TempDir() + "gtcal_pipeline_test.bin";
+    result_path = testing::TempDir() + "gtcal_pipeline_result.txt";
+
+    // The rig starts off the true intrinsics.
+    std::string error;
+    ASSERT_TRUE(gtcal::ParseRig("target 0.15 10 13\ncamera 0 pinhole 1024 570 202 198 510 237\n", rig, error))
+        << error;
+
+    // Views of the target from two distances and several directions.
+    const gtsam::Point3 center = rig.target().get3dCenter();
+    for (const double z : {-0.85, -1.0}) {
+      for (const double rx : {-0.2, 0., 0.2}) {
+        for (const double ry : {-0.25, 0., 0.25}) {
+          poses_target_cam.emplace_back(gtsam::Rot3::RzRyRx(rx, ry, 0.),
+                                        gtsam::Point3(center.x(), center.y(), z));
+        }
+      }
+    }
+
+    // Every view is logged twice, so the second one isn't a keyframe, and one frame has too few measurements.
+    auto camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_true);
+    const gtsam::Point3Vector target_points3d = rig.target().pointsTarget();
+    gtcal::DetectionLogWriter writer(log_path);
+    ASSERT_TRUE(writer.isOpen());
+    int64_t timestamp_ns = 0;
+    for (const auto& pose_target_cam : poses_target_cam) {
+      camera->setCameraPose(pose_target_cam);
+      std::vector<gtcal::Measurement> measurements;
+      for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+        const gtsam::Point2 uv = camera->project(target_points3d.at(ii));
+        if (gtcal::utils::FilterPixelCoords(uv, camera->width(), camera->height())) {
+          measurements.emplace_back(uv, 0, ii);
+        }
+      }
+      ASSERT_TRUE(writer.append(timestamp_ns++, measurements));
+      ASSERT_TRUE(writer.append(timestamp_ns++, measurements));
+      if (timestamp_ns == 10) {
+        measurements.resize(5);
+        ASSERT_TRUE(writer.append(timestamp_ns++, measurements));
+      }
+    }
+    ASSERT_TRUE(writer.close());
+  }
+
+  void TearDown() override {
+    std::filesystem::remove(log_path);
+    std::filesystem::remove(result_path);
+  }
+};
+
+// Tests that the pipeline recovers the intrinsics and frame poses and that the keyframes don't depend on the
+// number of threads.
+TEST_F(CalibrationPipelineFixture, Calibrate) {
+  gtcal::BatchSolver::Options solver_options;
+  solver_options.optimizer_type = gtcal::BatchSolver::OptimizerType::LEVENBERG_MARQUARDT;
+  std::vector<gtcal::CalibrationPipeline::Keyframe> keyframes;
+
+  for (const size_t num_threads : {1, 4}) {
+    gtcal::CalibrationPipeline::Options options;
+    options.num_threads = num_threads;
+    options.queue_capacity = 4;
+    gtcal::CalibrationPipeline pipeline(rig, solver_options, options);
+    ASSERT_TRUE(pipeline.run({log_path}));
+
+    const gtcal::CalibrationPipeline::Stats stats = pipeline.stats();
+    EXPECT_EQ(stats.num_frames, 2 * poses_target_cam.size() + 1);
+    EXPECT_EQ(stats.num_rejected, 1);
+    EXPECT_EQ(stats.num_keyframes, poses_target_cam.size());
+    EXPECT_EQ(stats.num_batch_failures, 0);
+    EXPECT_EQ(pipeline.poseHistogram().count(), stats.num_frames);
+    EXPECT_EQ(pipeline.batchHistogram().count(), stats.num_keyframes);
+
+    // Keyframes are the first frame of each view.
+    ASSERT_EQ(pipeline.keyframes().size(), poses_target_cam.size());
+    const auto& state = pipeline.state();
+    for (size_t ii = 0; ii < pipeline.keyframes().size(); ii++) {
+      const auto& keyframe = pipeline.keyframes().at(ii);
+      EXPECT_EQ(keyframe.pose_index, ii);
+      EXPECT_TRUE(state.current_estimate.at<gtsam::Pose3>(X(ii)).equals(poses_target_cam.at(ii), 1e-3));
+    }
+    EXPECT_TRUE(state.current_estimate.at<gtsam::Cal3_S2>(K(0)).equals(K_true, 1e-2));
+    EXPECT_EQ(state.cameras.at(0)->intrinsicsParameters().size(), 4);
+
+    if (keyframes.empty()) {
+      keyframes = pipeline.keyframes();
+    } else {
+      for (size_t ii = 0; ii < keyframes.size(); ii++) {
+        EXPECT_EQ(pipeline.keyframes().at(ii).timestamp_ns, keyframes.at(ii).timestamp_ns);
+      }
+    }
+
+    // The result is a valid rig with the calibrated intrinsics.
+    ASSERT_TRUE(pipeline.writeResult(result_path));
+    gtcal::Rig result;
+    std::string error;
+    ASSERT_TRUE(gtcal::LoadRig(result_path, result, error)) << error;
+    ASSERT_EQ(result.cameras.size(), 1);
+    const std::vector<double> intrinsics = result.cameras.at(0)->intrinsicsParameters();
+    EXPECT_NEAR(intrinsics.at(0), FX, 1e-2);
+    EXPECT_NEAR(intrinsics.at(1), FY, 1e-2);
+    EXPECT_NEAR(intrinsics.at(2), CX, 1e-2);
+    EXPECT_NEAR(intrinsics.at(3), CY, 1e-2);
+  }
+}
+
+// Tests that a missing log fails the run.
+TEST_F(CalibrationPipelineFixture, MissingLog) {
+  gtcal::CalibrationPipeline pipeline(rig, gtcal::BatchSolver::Options());
+  EXPECT_FALSE(pipeline.run({testing::TempDir() + "gtcal_missing_log.bin"}));
+  EXPECT_EQ(pipeline.stats().num_frames, 0);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -6,6 +6,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 struct CameraFixture : public testing::Test {
 protected:
@@ -174,6 +175,63 @@ TEST_F(CameraFixture, Intrinsics) {
   EXPECT_EQ(fisheye_cam_params.at(7), K_fisheye->k4());
 }
 
+// Tests that planar targets projected through the homography match the point by point projection.
+TEST_F(CameraFixture, PlanarBatchProjection) {
+  ASSERT_TRUE(gtcal::IsPlanarTarget(target_points3d));
+  const gtsam::Pose3 pose(gtsam::Rot3::RzRyRx(0.2, -0.15, 0.1),
+                          gtsam::Point3(target_center_x + 0.1, target_center_y - 0.2, -1.5));
+  const gtsam::Cal3Fisheye K_distorted(FX, FY, 0., CX, CY, 0.1, -0.02, 0.003, -0.0004);
+
+  gtcal::Camera cal3_s2_cam, fisheye_cam;
+  cal3_s2_cam.setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, *K_cal3_s2, pose);
+  fisheye_cam.setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT, K_distorted, pose);
+  for (const gtcal::Camera* camera : {&cal3_s2_cam, &fisheye_cam}) {
+    gtsam::Point2Vector uvs;
+    camera->project(target_points3d, uvs);
+    ASSERT_EQ(uvs.size(), target_points3d.size());
+    for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+      const gtsam::Point2 uv_expected = camera->project(target_points3d[ii]);
+      EXPECT_NEAR(uvs[ii].x(), uv_expected.x(), 1e-9);
+      EXPECT_NEAR(uvs[ii].y(), uv_expected.y(), 1e-9);
+      EXPECT_TRUE(camera->projectPlanar(pose, target_points3d[ii]).isApprox(uv_expected, 1e-12));
+    }
+  }
+
+  // The homography of a Cal3_S2 camera maps straight to pixels.
+  const auto& wrapper = std::get<0>(cal3_s2_cam.cameraVariant());
+  const gtsam::Point3 uvw = wrapper->planarHomography(pose) * gtsam::Point3(0.3, 0.6, 1.);
+  const gtsam::Point2 uv_expected = wrapper->project(gtsam::Point3(0.3, 0.6, 0.));
+  EXPECT_NEAR(uvw.x() / uvw.z(), uv_expected.x(), 1e-9);
+  EXPECT_NEAR(uvw.y() / uvw.z(), uv_expected.y(), 1e-9);
+}
+
+// Tests the point by point fallback of non-planar inputs and points behind the camera.
+TEST_F(CameraFixture, BatchProjectionFallback) {
+  gtcal::Camera camera;
+  camera.setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, *K_cal3_s2, pose0_target_cam);
+  gtsam::Point3Vector pts3d = {target_points3d.at(0), target_points3d.at(5), gtsam::Point3(0.1, 0.2, 0.3)};
+  ASSERT_FALSE(gtcal::IsPlanarTarget(pts3d));
+  gtsam::Point2Vector uvs;
+  camera.project(pts3d, uvs);
+  ASSERT_EQ(uvs.size(), pts3d.size());
+  for (size_t ii = 0; ii < pts3d.size(); ii++) {
+    EXPECT_TRUE(uvs[ii].isApprox(camera.project(pts3d[ii]), 1e-12));
+  }
+
+  // A point behind the camera is NaN, on both paths.
+  pts3d.push_back(gtsam::Point3(0.1, 0.2, -1.));
+  camera.project(pts3d, uvs);
+  EXPECT_TRUE(std::isnan(uvs.back().x()) && std::isnan(uvs.back().y()));
+
+  const gtsam::Pose3 pose_behind(R0_target_cam, gtsam::Point3(target_center_x, target_center_y, 0.85));
+  camera.setCameraPose(pose_behind);
+  camera.project(target_points3d, uvs);
+  for (const gtsam::Point2& uv : uvs) {
+    EXPECT_TRUE(std::isnan(uv.x()) && std::isnan(uv.y()));
+  }
+  EXPECT_TRUE(std::isnan(camera.projectPlanar(pose_behind, target_points3d.at(0)).x()));
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,205 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/batch_solver.h"
+#include "gtcal/camera.h"
+#include "gtcal/checkpoint.h"
+#include "gtcal/utils.h"
+#include <gtest/gtest.h>
+
+#include <gtsam/inference/Symbol.h>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+using gtsam::symbol_shorthand::K;
+using gtsam::symbol_shorthand::X;
+
+struct CheckpointFixture : public testing::Test {
+protected:
+  // Camera calibrations.
+  const gtsam::Cal3_S2 K_linear = gtsam::Cal3_S2(FX, FY, 0., CX, CY);
+  const gtsam::Cal3Fisheye K_fisheye = gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0., 0., 0., 0.);
+
+  // Target points.
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+
+  // Ground truth poses and solver state with a linear and a fisheye camera.
+  gtsam::Pose3Vector poses_target_cam;
+  std::unique_ptr<gtcal::BatchSolver::State> state;
+  std::string path;
+
+  void SetUp() override {
+    const gtsam::Point3 center = target.get3dCenter();
+    const gtsam::Pose3 pose0_target_cam(gtsam::Rot3(), {center.x(), center.y(), -0.85});
+    for (size_t ii = 0; ii < 3; ii++) {
+      const double offset = 0.03 * ii;
+      poses_target_cam.push_back(
+          pose0_target_cam.compose(gtsam::Pose3(gtsam::Rot3::RzRyRx(offset, 0., 0.), {0., offset, 0.})));
+    }
+
+    auto linear_cam = std::make_shared<gtcal::Camera>();
+    linear_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose0_target_cam);
+    auto fisheye_cam = std::make_shared<gtcal::Camera>();
+    fisheye_cam->setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT, K_fisheye, pose0_target_cam);
+    state = std::make_unique<gtcal::BatchSolver::State>(
+        std::vector<std::shared_ptr<gtcal::Camera>>{linear_cam, fisheye_cam});
+
+    path = testing::TempDir() + "gtcal_checkpoint_test.bin";
+  }
+
+  void TearDown() override { std::filesystem::remove(path); }
+
+  // Solve one frame seen by the given camera at the given ground truth pose.
+  void solveFrame(const gtcal::BatchSolver& solver, const size_t camera_index,
+                  const gtsam::Pose3& pose_target_cam) {
+    const auto& camera = state->cameras.at(camera_index);
+    camera->setCameraPose(pose_target_cam);
+    std::vector<gtcal::Measurement> measurements;
+    for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+      const gtsam::Point2 uv = camera->project(target_points3d.at(ii));
+      if (gtcal::utils::FilterPixelCoords(uv, camera->width(), camera->height())) {
+        measurements.emplace_back(uv, camera_index, ii);
+      }
+    }
+    solver.solve(measurements, *state);
+  }
+};
+
+// Tests that a state written incrementally and asynchronously is restored.
+TEST_F(CheckpointFixture, WriteAndLoad) {
+  // Check the calibration convergence after every frame so the tracking state is checkpointed too.
+  gtcal::BatchSolver::Options solver_options;
+  solver_options.freeze_converged_calibration = true;
+  solver_options.calibration_check_interval = 1;
+  const gtcal::BatchSolver solver(target_points3d, solver_options);
+  gtcal::CheckpointWriter::Options options;
+  options.full_snapshot_interval = 2;
+  gtcal::CheckpointWriter writer(path, options);
+  ASSERT_TRUE(writer.isOpen());
+
+  // Append a record after every frame, alternating cameras.
+  for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+    solveFrame(solver, 0, poses_target_cam.at(ii));
+    EXPECT_TRUE(writer.append(*state));
+    solveFrame(solver, 1, poses_target_cam.at(ii));
+    EXPECT_TRUE(writer.append(*state));
+  }
+  EXPECT_TRUE(writer.flush());
+  EXPECT_EQ(writer.numRecords(), 2 * poses_target_cam.size());
+
+  // Load and compare.
+  auto loaded = gtcal::LoadCheckpoint(path);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->num_frames, state->num_frames);
+  EXPECT_EQ(loaded->num_camera_updates, state->num_camera_updates);
+  EXPECT_EQ(loaded->camera_indices, state->camera_indices);
+  EXPECT_EQ(loaded->graph.size(), state->graph.size());
+  EXPECT_TRUE(loaded->current_estimate.equals(state->current_estimate, 1e-4));
+
+  // Check the calibration convergence tracking.
+  EXPECT_EQ(loaded->calibration_converged_checks, state->calibration_converged_checks);
+  EXPECT_EQ(loaded->calibration_frozen, state->calibration_frozen);
+  EXPECT_EQ(loaded->num_variables_relinearized, state->num_variables_relinearized);
+  ASSERT_EQ(loaded->calibration_sigmas.size(), state->calibration_sigmas.size());
+  for (size_t ii = 0; ii < state->calibration_sigmas.size(); ii++) {
+    EXPECT_GT(state->calibration_sigmas.at(ii).size(), 0);
+    EXPECT_EQ(loaded->calibration_sigmas.at(ii), state->calibration_sigmas.at(ii));
+  }
+
+  // Check the camera models.
+  ASSERT_EQ(loaded->numCameras(), 2);
+  EXPECT_EQ(loaded->cameras.at(0)->modelType(), gtcal::Camera::ModelType::CAL3_S2);
+  EXPECT_EQ(loaded->cameras.at(1)->modelType(), gtcal::Camera::ModelType::CAL3_FISHEYE);
+  for (size_t ii = 0; ii < loaded->numCameras(); ii++) {
+    EXPECT_EQ(loaded->cameras.at(ii)->intrinsicsParameters(), state->cameras.at(ii)->intrinsicsParameters());
+    EXPECT_TRUE(loaded->cameras.at(ii)->pose().equals(state->cameras.at(ii)->pose(), 1e-12));
+  }
+
+  // The loaded state can keep solving.
+  const size_t num_frames = loaded->num_frames;
+  state = std::move(loaded);
+  solveFrame(solver, 0, poses_target_cam.front());
+  EXPECT_EQ(state->num_frames, num_frames + 1);
+  EXPECT_TRUE(state->current_estimate.exists(X(num_frames)));
+}
+
+// Tests that a record torn by a crash is skipped and the previous records are still loaded.
+TEST_F(CheckpointFixture, TruncatedRecord) {
+  const gtcal::BatchSolver solver(target_points3d);
+  gtcal::CheckpointWriter::Options options;
+  options.async = false;
+  gtcal::CheckpointWriter writer(path, options);
+
+  solveFrame(solver, 0, poses_target_cam.at(0));
+  ASSERT_TRUE(writer.append(*state));
+  solveFrame(solver, 0, poses_target_cam.at(1));
+  ASSERT_TRUE(writer.append(*state));
+  solveFrame(solver, 0, poses_target_cam.at(2));
+  ASSERT_TRUE(writer.append(*state));
+  ASSERT_TRUE(writer.flush());
+
+  // Chop off the end of the last record.
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 16);
+  const auto loaded = gtcal::LoadCheckpoint(path);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->num_frames, 2);
+  EXPECT_TRUE(loaded->current_estimate.exists(X(1)));
+  EXPECT_FALSE(loaded->current_estimate.exists(X(2)));
+  EXPECT_TRUE(loaded->current_estimate.exists(K(0)));
+}
+
+// Tests that landmark-free graphs are checkpointed too.
+TEST_F(CheckpointFixture, TargetFactors) {
+  gtcal::BatchSolver::Options solver_options;
+  solver_options.use_target_factors = true;
+  const gtcal::BatchSolver solver(target_points3d, solver_options);
+  gtcal::CheckpointWriter writer(path);
+
+  for (const auto& pose_target_cam : poses_target_cam) {
+    solveFrame(solver, 1, pose_target_cam);
+    ASSERT_TRUE(writer.append(*state));
+  }
+  ASSERT_TRUE(writer.flush());
+
+  const auto loaded = gtcal::LoadCheckpoint(path);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->graph.size(), state->graph.size());
+  EXPECT_TRUE(loaded->current_estimate.equals(state->current_estimate, 1e-4));
+}
+
+// Tests that a record holding a noise model that can't be checkpointed fails the writer without corrupting
+// the records before it.
+TEST_F(CheckpointFixture, UnsupportedNoiseModel) {
+  const gtcal::BatchSolver solver(target_points3d);
+  gtcal::CheckpointWriter writer(path);
+
+  solveFrame(solver, 0, poses_target_cam.at(0));
+  ASSERT_TRUE(writer.append(*state));
+  const auto robust_noise = gtsam::noiseModel::Robust::Create(
+      gtsam::noiseModel::mEstimator::Huber::Create(1.), gtsam::noiseModel::Isotropic::Sigma(6, 0.1));
+  state->graph.addPrior(X(0), poses_target_cam.at(0), robust_noise);
+  EXPECT_TRUE(writer.append(*state));
+  EXPECT_FALSE(writer.flush());
+  EXPECT_FALSE(writer.append(*state));
+
+  const auto loaded = gtcal::LoadCheckpoint(path);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->num_frames, 1);
+  EXPECT_EQ(loaded->graph.size() + 1, state->graph.size());
+}
+
+// Tests that invalid files are rejected.
+TEST_F(CheckpointFixture, InvalidFile) {
+  EXPECT_FALSE(gtcal::LoadCheckpoint(path));
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a checkpoint";
+  }
+  EXPECT_FALSE(gtcal::LoadCheckpoint(path));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,94 @@
+#include "gtcal/coarse_to_fine.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <set>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Return measurements on a regular grid of the given size covering a 640x480 image, row by row.
+ *
+ */
+std::vector<gtcal::Measurement> MakeGrid(const size_t num_cols, const size_t num_rows) {
+  std::vector<gtcal::Measurement> measurements;
+  for (size_t row = 0; row < num_rows; row++) {
+    for (size_t col = 0; col < num_cols; col++) {
+      const gtsam::Point2 uv(640. * (col + 0.5) / num_cols, 480. * (row + 0.5) / num_rows);
+      measurements.emplace_back(uv, 0, measurements.size());
+    }
+  }
+  return measurements;
+}
+
+/**
+ * @brief Return the number of distinct blocks of a blocks x blocks split of the image hit by the first
+ * measurements of the order.
+ *
+ */
+size_t CountBlocks(const std::vector<gtcal::Measurement>& measurements, const std::vector<uint32_t>& order,
+                   const size_t count, const size_t blocks) {
+  std::set<size_t> hit;
+  for (size_t ii = 0; ii < count; ii++) {
+    const gtsam::Point2& uv = measurements.at(order.at(ii)).uv;
+    const auto col = static_cast<size_t>(uv.x() / 640. * blocks);
+    const auto row = static_cast<size_t>(uv.y() / 480. * blocks);
+    hit.insert(row * blocks + col);
+  }
+  return hit.size();
+}
+
+}  // namespace
+
+// Tests the number of measurements of each level.
+TEST(CoarseToFine, Levels) {
+  gtcal::CoarseToFineOptions options;
+  EXPECT_EQ(gtcal::CoarseToFineLevels(2000, options), std::vector<size_t>{2000});
+
+  options.enabled = true;
+  EXPECT_EQ(gtcal::CoarseToFineLevels(2000, options), (std::vector<size_t>{64, 256, 1024, 2000}));
+  EXPECT_EQ(gtcal::CoarseToFineLevels(1024, options), (std::vector<size_t>{64, 256, 1024}));
+  EXPECT_EQ(gtcal::CoarseToFineLevels(399, options), std::vector<size_t>{399});
+
+  options.initial_measurements = 100;
+  options.growth_factor = 2.5;
+  EXPECT_EQ(gtcal::CoarseToFineLevels(1000, options), (std::vector<size_t>{100, 250, 625, 1000}));
+}
+
+// Tests that the order is a permutation whose prefixes cover the image evenly.
+TEST(CoarseToFine, StratifiedOrder) {
+  const std::vector<gtcal::Measurement> measurements = MakeGrid(64, 48);
+  const std::vector<uint32_t> order = gtcal::StratifiedOrder(measurements);
+  ASSERT_EQ(order.size(), measurements.size());
+  std::vector<uint32_t> sorted = order;
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<uint32_t> indices(measurements.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+  EXPECT_EQ(sorted, indices);
+
+  // Every prefix of 4^k measurements has one measurement in each block of a 2^k x 2^k split of the image.
+  for (const size_t blocks : {2ul, 4ul, 8ul, 16ul}) {
+    EXPECT_EQ(CountBlocks(measurements, order, blocks * blocks, blocks), blocks * blocks) << blocks;
+  }
+
+  // The first measurements of the input, all in the top rows, would only cover a strip of the image.
+  EXPECT_EQ(CountBlocks(measurements, indices, 16, 4), 1ul);
+}
+
+// Tests the structure of arrays overload and degenerate inputs.
+TEST(CoarseToFine, StratifiedOrderSpan) {
+  const std::vector<gtcal::Measurement> measurements = MakeGrid(40, 30);
+  const gtcal::MeasurementBlock block(measurements);
+  EXPECT_EQ(gtcal::StratifiedOrder(block.span()), gtcal::StratifiedOrder(measurements));
+
+  EXPECT_TRUE(gtcal::StratifiedOrder(std::vector<gtcal::Measurement>()).empty());
+  const std::vector<gtcal::Measurement> same(5, gtcal::Measurement(gtsam::Point2(10., 10.), 0, 0));
+  EXPECT_EQ(gtcal::StratifiedOrder(same), (std::vector<uint32_t>{0, 1, 2, 3, 4}));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
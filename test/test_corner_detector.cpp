@@ -0,0 +1,168 @@
+#include "gtcal/calibration_target.h"
+#include "gtcal/corner_detector.h"
+#include <gtest/gtest.h>
+
+#include <gtsam/geometry/Cal3_S2.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+static constexpr size_t kWidth = 640;
+static constexpr size_t kHeight = 480;
+static constexpr uint8_t kDark = 40;
+static constexpr uint8_t kLight = 210;
+
+/**
+ * @brief Render the target's checkerboard seen by a pinhole camera, with 4x4 samples per pixel.
+ *
+ */
+gtcal::Image RenderTarget(const gtcal::utils::CalibrationTarget& target, const gtsam::Cal3_S2& K,
+                          const gtsam::Pose3& pose_target_cam) {
+  gtcal::Image image(kWidth, kHeight);
+  const gtsam::Point3& origin = pose_target_cam.translation();
+  const auto num_rows = static_cast<double>(target.numRows());
+  const auto num_cols = static_cast<double>(target.numCols());
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      double intensity = 0.0;
+      for (size_t sy = 0; sy < 4; sy++) {
+        for (size_t sx = 0; sx < 4; sx++) {
+          const gtsam::Point2 uv(x + (sx + 0.5) / 4.0 - 0.5, y + (sy + 0.5) / 4.0 - 0.5);
+          const gtsam::Point2 xy = K.calibrate(uv);
+          const gtsam::Point3 ray = pose_target_cam.rotation().rotate(gtsam::Point3(xy.x(), xy.y(), 1.0));
+          const double t = -origin.z() / ray.z();
+          const double col = (origin.x() + t * ray.x()) / target.gridSpacing();
+          const double row = (origin.y() + t * ray.y()) / target.gridSpacing();
+          bool dark = false;
+          if (t > 0.0 && col >= -1.0 && col < num_cols && row >= -1.0 && row < num_rows) {
+            dark = ((static_cast<int>(std::floor(col)) + static_cast<int>(std::floor(row))) & 1) == 0;
+          }
+          intensity += dark ? kDark : kLight;
+        }
+      }
+      image.at(x, y) = static_cast<uint8_t>(std::lround(intensity / 16.0));
+    }
+  }
+  return image;
+}
+
+/**
+ * @brief Return the pixel of a target point.
+ *
+ */
+gtsam::Point2 Project(const gtsam::Cal3_S2& K, const gtsam::Pose3& pose_target_cam,
+                      const gtsam::Point3& point) {
+  const gtsam::Point3 point_cam = pose_target_cam.transformTo(point);
+  return K.uncalibrate(gtsam::Point2(point_cam.x() / point_cam.z(), point_cam.y() / point_cam.z()));
+}
+
+}  // namespace
+
+struct CornerDetectorFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target = gtcal::utils::CalibrationTarget(0.04, 6, 9);
+  const gtsam::Cal3_S2 K = gtsam::Cal3_S2(500., 510., 0., 320., 240.);
+  std::vector<gtsam::Pose3> poses_target_cam;
+  std::vector<gtcal::Image> images;
+
+  void SetUp() override {
+    // Views of the target from the front, tilted and rolled up to a half turn.
+    const gtsam::Point3 center = target.get3dCenter();
+    for (const auto& [rx, ry, rz] : std::vector<std::array<double, 3>>{
+             {0., 0., 0.}, {0.3, -0.2, 0.1}, {-0.25, 0.35, -0.4}, {0.1, 0.1, 1.6}, {0.2, -0.1, 3.}}) {
+      const gtsam::Rot3 R = gtsam::Rot3::RzRyRx(rx, ry, rz);
+      poses_target_cam.emplace_back(R, center - R.rotate(gtsam::Point3(0., 0., 0.6)));
+      images.push_back(RenderTarget(target, K, poses_target_cam.back()));
+    }
+  }
+};
+
+// Tests that the vectorized corner response matches the ChESS formula.
+TEST(CornerDetector, CornerResponse) {
+  std::mt19937 rng(7);
+  gtcal::Image image(45, 23);
+  for (auto& pixel : image.pixels) {
+    pixel = static_cast<uint8_t>(rng() % 256);
+  }
+  std::vector<int16_t> response;
+  gtcal::CornerDetector::CornerResponse(image, response);
+  ASSERT_EQ(response.size(), image.pixels.size());
+
+  const int ring[16][2] = {{5, 0},  {5, 2},   {4, 4},   {2, 5},   {0, 5},  {-2, 5}, {-4, 4}, {-5, 2},
+                           {-5, 0}, {-5, -2}, {-4, -4}, {-2, -5}, {0, -5}, {2, -5}, {4, -4}, {5, -2}};
+  for (size_t y = 0; y < image.height; y++) {
+    for (size_t x = 0; x < image.width; x++) {
+      int expected = 0;
+      if (x >= 5 && y >= 5 && x + 5 < image.width && y + 5 < image.height) {
+        int I[16], ring_sum = 0;
+        for (size_t n = 0; n < 16; n++) {
+          I[n] = image.at(x + ring[n][0], y + ring[n][1]);
+          ring_sum += I[n];
+        }
+        for (size_t n = 0; n < 4; n++) {
+          expected += std::abs(I[n] + I[n + 8] - I[n + 4] - I[n + 12]);
+        }
+        for (size_t n = 0; n < 8; n++) {
+          expected -= std::abs(I[n] - I[n + 8]);
+        }
+        const int local_sum =
+            image.at(x - 1, y) + image.at(x + 1, y) + image.at(x, y - 1) + image.at(x, y + 1);
+        expected -= std::abs(ring_sum - 4 * local_sum);
+      }
+      EXPECT_EQ(response.at(y * image.width + x), expected) << x << " " << y;
+    }
+  }
+}
+
+// Tests that every target point is found and labelled in rendered views. The response centroid is accurate to
+// about half a pixel.
+TEST_F(CornerDetectorFixture, Detect) {
+  const gtcal::CornerDetector detector(target);
+  for (size_t ii = 0; ii < images.size(); ii++) {
+    std::vector<gtcal::Measurement> measurements;
+    ASSERT_TRUE(detector.detect(images.at(ii), 2, measurements)) << "view " << ii;
+    ASSERT_EQ(measurements.size(), target.pointsTarget().size());
+    for (size_t jj = 0; jj < measurements.size(); jj++) {
+      const auto& meas = measurements.at(jj);
+      EXPECT_EQ(meas.camera_id, 2);
+      EXPECT_EQ(meas.point_id, jj);
+      const gtsam::Point2 uv = Project(K, poses_target_cam.at(ii), target.pointsTarget().at(jj));
+      EXPECT_LT((meas.uv - uv).norm(), 0.6) << "view " << ii << ", point " << jj;
+    }
+  }
+}
+
+
+// Tests detecting several images in parallel, with images that don't show the whole target.
+TEST_F(CornerDetectorFixture, DetectParallel) {
+  gtcal::CornerDetector::Options options;
+  options.num_threads = 3;
+  const gtcal::CornerDetector detector(target, options);
+
+  images.emplace_back(kWidth, kHeight, kLight);
+  images.push_back(RenderTarget(target, K, gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(0.1, 0.05, -0.3))));
+  std::vector<std::vector<gtcal::Measurement>> measurements;
+  EXPECT_EQ(detector.detect(images, 0, measurements), images.size() - 2);
+  ASSERT_EQ(measurements.size(), images.size());
+  for (size_t ii = 0; ii < images.size() - 2; ii++) {
+    std::vector<gtcal::Measurement> expected;
+    ASSERT_TRUE(detector.detect(images.at(ii), 0, expected));
+    ASSERT_EQ(measurements.at(ii).size(), expected.size());
+    for (size_t jj = 0; jj < expected.size(); jj++) {
+      EXPECT_EQ(measurements.at(ii).at(jj).point_id, expected.at(jj).point_id);
+      EXPECT_EQ(measurements.at(ii).at(jj).uv, expected.at(jj).uv);
+    }
+  }
+  EXPECT_TRUE(measurements.at(images.size() - 2).empty());
+  EXPECT_TRUE(measurements.at(images.size() - 1).empty());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,185 @@
+#include "gtcal/corner_refiner.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+static constexpr size_t kWidth = 320;
+static constexpr size_t kHeight = 80;
+static constexpr double kDark = 40.0;
+static constexpr double kLight = 210.0;
+
+struct XCorner {
+  gtsam::Point2 uv;
+  double angle;  // Rotation of the corner's edges, in radians.
+};
+
+/**
+ * @brief Render X-corners (two dark and two light quadrants) with 8x8 samples per pixel, blurred by a 3x3
+ * binomial kernel like a camera's point spread function, plus Gaussian noise. Each pixel shows the corner
+ * closest to it.
+ *
+ */
+gtcal::Image RenderCorners(const std::vector<XCorner>& corners, const double noise_sigma, std::mt19937& rng) {
+  std::vector<double> sharp(kWidth * kHeight);
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      const XCorner* corner = &corners.front();
+      for (const auto& other : corners) {
+        if ((other.uv - gtsam::Point2(x, y)).norm() < (corner->uv - gtsam::Point2(x, y)).norm()) {
+          corner = &other;
+        }
+      }
+      const double c = std::cos(corner->angle), s = std::sin(corner->angle);
+      double intensity = 0.0;
+      for (size_t sy = 0; sy < 8; sy++) {
+        for (size_t sx = 0; sx < 8; sx++) {
+          const double dx = x + (sx + 0.5) / 8.0 - 0.5 - corner->uv.x();
+          const double dy = y + (sy + 0.5) / 8.0 - 0.5 - corner->uv.y();
+          intensity += (c * dx + s * dy) * (-s * dx + c * dy) > 0.0 ? kDark : kLight;
+        }
+      }
+      sharp.at(y * kWidth + x) = intensity / 64.0;
+    }
+  }
+
+  std::normal_distribution<double> noise(0.0, noise_sigma);
+  gtcal::Image image(kWidth, kHeight);
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 0; x < kWidth; x++) {
+      double intensity = 0.0;
+      for (int ky = -1; ky <= 1; ky++) {
+        for (int kx = -1; kx <= 1; kx++) {
+          const size_t xx = std::clamp<int>(x + kx, 0, kWidth - 1);
+          const size_t yy = std::clamp<int>(y + ky, 0, kHeight - 1);
+          intensity += (2 - std::abs(kx)) * (2 - std::abs(ky)) * sharp.at(yy * kWidth + xx) / 16.0;
+        }
+      }
+      const double value = std::round(intensity + (noise_sigma > 0.0 ? noise(rng) : 0.0));
+      image.at(x, y) = static_cast<uint8_t>(std::clamp(value, 0.0, 255.0));
+    }
+  }
+  return image;
+}
+
+/**
+ * @brief Return 7 corners, one more than a full batch of four plus a partial one, spaced 40 pixels apart.
+ *
+ */
+std::vector<XCorner> MakeCorners() {
+  std::vector<XCorner> corners;
+  for (size_t ii = 0; ii < 7; ii++) {
+    corners.push_back({gtsam::Point2(30.0 + 40.0 * ii + 0.13 * ii, 40.0 - 0.37 + 0.11 * ii), 0.2 * ii - 0.5});
+  }
+  return corners;
+}
+
+}  // namespace
+
+// Tests that corners refine to near their true position from a pixel away, in batches with a partial one.
+TEST(CornerRefiner, Refine) {
+  std::mt19937 rng(7);
+  const std::vector<XCorner> corners = MakeCorners();
+  const gtcal::Image image = RenderCorners(corners, 0.0, rng);
+
+  std::vector<gtcal::Measurement> measurements;
+  for (size_t ii = 0; ii < corners.size(); ii++) {
+    const gtsam::Point2 offset(std::cos(1.7 * ii), std::sin(1.7 * ii));
+    measurements.emplace_back(corners.at(ii).uv + offset, 3, ii);
+  }
+  const gtcal::CornerRefiner refiner;
+  std::vector<gtsam::Matrix2> covariances;
+  ASSERT_EQ(refiner.refine(image, measurements, covariances), corners.size());
+  ASSERT_EQ(measurements.size(), corners.size());
+  ASSERT_EQ(covariances.size(), corners.size());
+  for (size_t ii = 0; ii < corners.size(); ii++) {
+    EXPECT_EQ(measurements.at(ii).camera_id, 3ul);
+    EXPECT_EQ(measurements.at(ii).point_id, ii);
+    EXPECT_LT((measurements.at(ii).uv - corners.at(ii).uv).norm(), 0.08) << ii;
+    // Covariances are symmetric positive definite, at least min_sigma^2 on the diagonal.
+    EXPECT_DOUBLE_EQ(covariances.at(ii)(0, 1), covariances.at(ii)(1, 0));
+    EXPECT_GT(covariances.at(ii).determinant(), 0.0);
+    EXPECT_GE(covariances.at(ii)(0, 0), 1e-4);
+    EXPECT_GE(covariances.at(ii)(1, 1), 1e-4);
+  }
+}
+
+// Tests that the predicted covariance matches the scatter of the refined corners in noisy images.
+TEST(CornerRefiner, Covariance) {
+  static constexpr size_t kNumTrials = 40;
+  std::mt19937 rng(11);
+  const std::vector<XCorner> corners = MakeCorners();
+  gtcal::CornerRefiner::Options options;
+  options.min_sigma = 0.0;
+  const gtcal::CornerRefiner refiner(options);
+
+  std::vector<std::vector<gtsam::Point2>> refined(corners.size());
+  double predicted = 0.0;
+  for (size_t trial = 0; trial < kNumTrials; trial++) {
+    const gtcal::Image image = RenderCorners(corners, 5.0, rng);
+    std::vector<gtcal::Measurement> measurements;
+    for (size_t ii = 0; ii < corners.size(); ii++) {
+      measurements.emplace_back(corners.at(ii).uv, 0, ii);
+    }
+    std::vector<gtsam::Matrix2> covariances;
+    ASSERT_EQ(refiner.refine(image, measurements, covariances), corners.size());
+    for (size_t ii = 0; ii < corners.size(); ii++) {
+      predicted += covariances.at(ii).trace() / (kNumTrials * corners.size());
+      refined.at(ii).push_back(measurements.at(ii).uv);
+    }
+  }
+
+  // Scatter about the mean of each corner, leaving out the small bias of the refinement.
+  double empirical = 0.0;
+  for (const auto& uvs : refined) {
+    gtsam::Point2 mean = gtsam::Point2::Zero();
+    for (const auto& uv : uvs) {
+      mean += uv / kNumTrials;
+    }
+    for (const auto& uv : uvs) {
+      empirical += (uv - mean).squaredNorm() / ((kNumTrials - 1) * corners.size());
+    }
+  }
+  EXPECT_GT(empirical / predicted, 0.5) << empirical << " " << predicted;
+  EXPECT_LT(empirical / predicted, 2.0) << empirical << " " << predicted;
+}
+
+// Tests that flat areas, edges and corners too close to the border are dropped.
+TEST(CornerRefiner, Rejected) {
+  std::mt19937 rng(3);
+  gtcal::Image image(kWidth, kHeight, 128);
+  for (size_t y = 0; y < kHeight; y++) {
+    for (size_t x = 160; x < kWidth; x++) {
+      image.at(x, y) = 30;
+    }
+  }
+  std::vector<gtcal::Measurement> measurements = {
+      gtcal::Measurement(gtsam::Point2(60.0, 40.0), 0, 0),   // Flat.
+      gtcal::Measurement(gtsam::Point2(160.0, 40.0), 0, 1),  // Edge.
+      gtcal::Measurement(gtsam::Point2(2.0, 40.0), 0, 2),    // Border.
+      gtcal::Measurement(gtsam::Point2(160.0, 78.0), 0, 3)};
+  std::vector<gtsam::Matrix2> covariances;
+  const gtcal::CornerRefiner refiner;
+  EXPECT_EQ(refiner.refine(image, measurements, covariances), 0ul);
+  EXPECT_TRUE(measurements.empty());
+  EXPECT_TRUE(covariances.empty());
+
+  // Only the corner survives, in order.
+  const std::vector<XCorner> corners = MakeCorners();
+  const gtcal::Image corner_image = RenderCorners(corners, 0.0, rng);
+  measurements = {gtcal::Measurement(gtsam::Point2(2.0, 2.0), 0, 0),
+                  gtcal::Measurement(corners.at(1).uv + gtsam::Point2(0.5, -0.5), 0, 1),
+                  gtcal::Measurement(gtsam::Point2(kWidth - 3.0, 40.0), 0, 2)};
+  ASSERT_EQ(refiner.refine(corner_image, measurements, covariances), 1ul);
+  EXPECT_EQ(measurements.front().point_id, 1ul);
+  EXPECT_EQ(covariances.size(), 1ul);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,138 @@
+#include "gtcal/detection_importer.h"
+#include "gtcal/detection_log.h"
+#include "gtcal/measurement_block.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Return a CSV dump with a header, a few malformed lines and frames of 10 detections.
+std::string MakeCsv(const size_t num_frames) {
+  std::ostringstream csv;
+  csv << "timestamp_ns,camera_id,point_id,u,v\n";
+  for (size_t ii = 0; ii < num_frames; ii++) {
+    for (size_t jj = 0; jj < 10; jj++) {
+      csv << ii * 1000 << "," << ii % 3 << "," << jj << "," << 0.5 * jj + ii << "," << 200.25 - jj << "\n";
+    }
+    if (ii % 7 == 0) {
+      csv << "# comment\n"
+          << "1,2,not a number,3,4\r\n";
+    }
+  }
+  return csv.str();
+}
+
+// Check that two blocks hold the same frames.
+void ExpectSameFrames(const gtcal::MeasurementBlock& a, const gtcal::MeasurementBlock& b) {
+  ASSERT_EQ(a.numFrames(), b.numFrames());
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t ii = 0; ii < a.numFrames(); ii++) {
+    EXPECT_EQ(a.timestamp(ii), b.timestamp(ii));
+    ASSERT_EQ(a.frame(ii).size(), b.frame(ii).size());
+  }
+  EXPECT_EQ(a.u(), b.u());
+  EXPECT_EQ(a.v(), b.v());
+  EXPECT_EQ(a.cameraIds(), b.cameraIds());
+  EXPECT_EQ(a.pointIds(), b.pointIds());
+}
+
+}  // namespace
+
+// Tests that CSV frames are grouped and malformed lines are skipped.
+TEST(DetectionImporter, Csv) {
+  const std::string csv = MakeCsv(20);
+  gtcal::DetectionImporter importer;
+  gtcal::MeasurementBlock measurements;
+  ASSERT_TRUE(importer.importText(csv, measurements));
+
+  ASSERT_EQ(measurements.numFrames(), 20);
+  EXPECT_EQ(measurements.size(), 200);
+  EXPECT_EQ(importer.stats().num_skipped_lines, 1 + 3 * 2);
+  EXPECT_EQ(importer.stats().num_frames, 20);
+  EXPECT_EQ(measurements.timestamp(3), 3000);
+  const gtcal::MeasurementSpan frame = measurements.frame(4);
+  ASSERT_EQ(frame.size(), 10);
+  EXPECT_EQ(frame[2].camera_id, 1);
+  EXPECT_EQ(frame[2].point_id, 2);
+  EXPECT_DOUBLE_EQ(frame[2].uv.x(), 5.);
+  EXPECT_DOUBLE_EQ(frame[2].uv.y(), 198.25);
+}
+
+// Tests that splitting the input across threads, including inside frames, gives the same result.
+TEST(DetectionImporter, ParallelCsv) {
+  const std::string csv = MakeCsv(200);
+  gtcal::MeasurementBlock expected;
+  gtcal::DetectionImporter::Options options;
+  options.num_threads = 1;
+  ASSERT_TRUE(gtcal::DetectionImporter(options).importText(csv, expected));
+
+  for (const size_t num_threads : {2, 3, 8}) {
+    options.num_threads = num_threads;
+    options.min_bytes_per_thread = 1;
+    gtcal::DetectionImporter importer(options);
+    gtcal::MeasurementBlock measurements;
+    ASSERT_TRUE(importer.importText(csv, measurements));
+    EXPECT_EQ(importer.stats().num_threads, num_threads);
+    ExpectSameFrames(measurements, expected);
+  }
+}
+
+// Tests JSONL frames, including an empty and a malformed one.
+TEST(DetectionImporter, Jsonl) {
+  const std::string jsonl =
+      "{\"timestamp_ns\": 10, \"camera_id\": 1, \"detections\": [[3, 10.5, 20.25], [4, 11.5, 21.25]]}\n"
+      "{\"timestamp_ns\": 20, \"camera_id\": 0, \"detections\": []}\n"
+      "{\"timestamp_ns\": 30, \"camera_id\": 0, \"detections\": [[3, 10.5, oops]]}\n"
+      "{\"camera_id\": 2, \"timestamp_ns\": 40, \"detections\": [[7,1,2],[8,3,4],[9,5,6]]}\n";
+  gtcal::DetectionImporter importer;
+  gtcal::MeasurementBlock measurements;
+  ASSERT_TRUE(importer.importText(jsonl, measurements));
+
+  EXPECT_EQ(importer.stats().num_skipped_lines, 1);
+  ASSERT_EQ(measurements.numFrames(), 3);
+  EXPECT_EQ(measurements.frame(0).size(), 2);
+  EXPECT_TRUE(measurements.frame(1).empty());
+  ASSERT_EQ(measurements.frame(2).size(), 3);
+  EXPECT_EQ(measurements.timestamp(2), 40);
+  EXPECT_EQ(measurements.frame(2)[1].camera_id, 2);
+  EXPECT_EQ(measurements.frame(2)[1].point_id, 8);
+  EXPECT_DOUBLE_EQ(measurements.frame(2)[1].uv.y(), 4.);
+}
+
+// Tests importing a file into a detection log.
+TEST(DetectionImporter, FileToLog) {
+  const std::string csv_path = testing::TempDir() + "gtcal_importer_test.csv";
+  const std::string log_path = testing::TempDir() + "gtcal_importer_test.bin";
+  {
+    std::ofstream file(csv_path);
+    file << MakeCsv(30);
+  }
+
+  gtcal::DetectionImporter importer;
+  {
+    gtcal::DetectionLogWriter writer(log_path);
+    ASSERT_TRUE(importer.importFileToLog(csv_path, writer));
+    ASSERT_TRUE(writer.close());
+  }
+  gtcal::DetectionLogReader reader(log_path);
+  ASSERT_TRUE(reader.isOpen());
+  EXPECT_EQ(reader.numFrames(), 30);
+  gtcal::MeasurementSpan measurements;
+  ASSERT_TRUE(reader.frame(29, measurements));
+  EXPECT_EQ(measurements.size(), 10);
+  EXPECT_EQ(reader.timestamp(29), 29000);
+
+  gtcal::MeasurementBlock missing;
+  EXPECT_FALSE(importer.importFile(testing::TempDir() + "does_not_exist.csv", missing));
+  std::filesystem::remove(csv_path);
+  std::filesystem::remove(log_path);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
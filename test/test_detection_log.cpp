@@ -0,0 +1,133 @@
+#include "gtcal/detection_log.h"
+#include "gtcal/measurement_block.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+struct DetectionLogFixture : public testing::Test {
+protected:
+  std::string path;
+  gtcal::MeasurementBlock frames;
+
+  void SetUp() override {
+    path = testing::TempDir() + "gtcal_detection_log_test.bin";
+
+    // Frames of varying size from two cameras, including an empty one.
+    for (size_t ii = 0; ii < 23; ii++) {
+      const size_t num_measurements = ii == 5 ? 0 : 10 + ii;
+      for (size_t jj = 0; jj < num_measurements; jj++) {
+        frames.push_back({0.5 * ii + jj, 100. - 0.25 * jj}, ii % 2, 1000 * ii + jj);
+      }
+      frames.endFrame(static_cast<int64_t>(ii) * 33'000'000);
+    }
+  }
+
+  void TearDown() override { std::filesystem::remove(path); }
+
+  // Write every frame to the log.
+  void writeLog(const gtcal::DetectionLogWriter::Options& options) {
+    gtcal::DetectionLogWriter writer(path, options);
+    ASSERT_TRUE(writer.isOpen());
+    for (size_t ii = 0; ii < frames.numFrames(); ii++) {
+      ASSERT_TRUE(writer.append(frames.timestamp(ii), frames.frame(ii)));
+    }
+    EXPECT_EQ(writer.numFrames(), frames.numFrames());
+    ASSERT_TRUE(writer.close());
+  }
+
+  // Check that every frame of the log matches the written one.
+  void expectFrames(gtcal::DetectionLogReader& reader, const size_t num_frames) {
+    ASSERT_EQ(reader.numFrames(), num_frames);
+    for (size_t ii = 0; ii < num_frames; ii++) {
+      gtcal::MeasurementSpan measurements;
+      ASSERT_TRUE(reader.frame(ii, measurements));
+      EXPECT_EQ(reader.timestamp(ii), frames.timestamp(ii));
+      const gtcal::MeasurementSpan expected = frames.frame(ii);
+      ASSERT_EQ(measurements.size(), expected.size());
+      for (size_t jj = 0; jj < expected.size(); jj++) {
+        EXPECT_EQ(measurements[jj].uv, expected[jj].uv);
+        EXPECT_EQ(measurements[jj].camera_id, expected[jj].camera_id);
+        EXPECT_EQ(measurements[jj].point_id, expected[jj].point_id);
+      }
+    }
+  }
+};
+
+// Tests that frames are read back in any order.
+TEST_F(DetectionLogFixture, WriteAndRead) {
+  gtcal::DetectionLogWriter::Options options;
+  options.frames_per_chunk = 4;
+  writeLog(options);
+
+  gtcal::DetectionLogReader reader(path);
+  ASSERT_TRUE(reader.isOpen());
+  EXPECT_EQ(reader.numChunks(), 6);
+  expectFrames(reader, frames.numFrames());
+
+  // Seek backwards.
+  gtcal::MeasurementSpan measurements;
+  ASSERT_TRUE(reader.frame(2, measurements));
+  EXPECT_EQ(measurements.front().point_id, 2000);
+  EXPECT_FALSE(reader.frame(frames.numFrames(), measurements));
+}
+
+// Tests that compressed logs read back the same. Without LZ4 support the chunks are stored uncompressed.
+TEST_F(DetectionLogFixture, Compression) {
+  gtcal::DetectionLogWriter::Options options;
+  options.frames_per_chunk = 8;
+  options.compression = gtcal::DetectionLogWriter::Compression::LZ4;
+  writeLog(options);
+
+  gtcal::DetectionLogReader reader(path);
+  ASSERT_TRUE(reader.isOpen());
+  expectFrames(reader, frames.numFrames());
+}
+
+// Tests that the index is rebuilt from the chunks when the trailer is lost.
+TEST_F(DetectionLogFixture, MissingIndex) {
+  gtcal::DetectionLogWriter::Options options;
+  options.frames_per_chunk = 4;
+  writeLog(options);
+
+  // Chop off the trailer and part of the index.
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 48);
+  gtcal::DetectionLogReader reader(path);
+  ASSERT_TRUE(reader.isOpen());
+  expectFrames(reader, frames.numFrames());
+}
+
+// Tests that corrupted chunks are detected.
+TEST_F(DetectionLogFixture, CorruptedChunk) {
+  gtcal::DetectionLogWriter::Options options;
+  options.frames_per_chunk = 4;
+  writeLog(options);
+
+  // Flip a byte in the first chunk's payload.
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(16 + 32 + 8);
+    file.put('\x7f');
+  }
+  gtcal::DetectionLogReader reader(path);
+  ASSERT_TRUE(reader.isOpen());
+  gtcal::MeasurementSpan measurements;
+  EXPECT_FALSE(reader.frame(0, measurements));
+  EXPECT_TRUE(reader.frame(4, measurements));
+}
+
+// Tests that invalid files are rejected.
+TEST_F(DetectionLogFixture, InvalidFile) {
+  EXPECT_FALSE(gtcal::DetectionLogReader(path).isOpen());
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a detection log";
+  }
+  EXPECT_FALSE(gtcal::DetectionLogReader(path).isOpen());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
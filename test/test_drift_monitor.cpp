@@ -0,0 +1,155 @@
+#include "gtcal/drift_monitor.h"
+#include "gtcal_test_utils.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Tests the EWMA of a constant and of a step.
+TEST(Ewma, Step) {
+  gtcal::Ewma ewma(0.1);
+  for (size_t ii = 0; ii < 10; ii++) {
+    ewma.add(2.0);
+  }
+  EXPECT_EQ(ewma.mean(), 2.0);
+  EXPECT_EQ(ewma.variance(), 0.0);
+
+  ewma.reset();
+  ewma.add(0.0);
+  for (size_t ii = 1; ii <= 20; ii++) {
+    ewma.add(1.0);
+    EXPECT_NEAR(ewma.mean(), 1.0 - std::pow(0.9, ii), 1e-12);
+  }
+  EXPECT_GT(ewma.variance(), 0.0);
+  EXPECT_EQ(ewma.count(), 21ul);
+}
+
+struct DriftMonitorFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+  const gtsam::Cal3Fisheye calibration{FX, FY, 0., CX, CY, 0.05, -0.01, 0.002, 0.};
+  std::mt19937 rng{3};
+
+  gtcal::Camera makeCamera(const gtsam::Cal3Fisheye& K) const {
+    gtcal::Camera camera;
+    camera.setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT, K);
+    return camera;
+  }
+
+  /**
+   * @brief Return the noisy measurements of frame ii of a slow sweep in front of the target, seen by a camera
+   * with the given calibration.
+   *
+   */
+  std::vector<gtcal::Measurement> makeFrame(const size_t ii, const gtsam::Cal3Fisheye& K) {
+    const gtsam::Point3 center = target.get3dCenter();
+    const double t = static_cast<double>(ii);
+    const double dx = 0.15 * std::sin(0.05 * t);
+    const double dy = 0.1 * std::cos(0.037 * t);
+    const gtsam::Pose3 pose_target_cam(gtsam::Rot3::RzRyRx(-1.5 * dy, 1.5 * dx, 0.1 * std::sin(0.02 * t)),
+                                       gtsam::Point3(center.x() + dx, center.y() + dy, -0.75));
+    gtcal::Camera camera = makeCamera(K);
+    camera.setCameraPose(pose_target_cam);
+
+    std::normal_distribution<double> noise(0.0, 0.15);
+    std::vector<gtcal::Measurement> measurements;
+    for (size_t jj = 0; jj < target_points3d.size(); jj++) {
+      const gtsam::Point2 uv = camera.project(target_points3d[jj]);
+      if (gtcal::utils::FilterPixelCoords(uv, IMAGE_WIDTH, IMAGE_HEIGHT)) {
+        measurements.emplace_back(uv + gtsam::Point2(noise(rng), noise(rng)), 0, jj);
+      }
+    }
+    return measurements;
+  }
+};
+
+// Tests that a stable calibration stays OK and that a change of the distortion and principal point is
+// flagged.
+TEST_F(DriftMonitorFixture, Detect) {
+  for (const auto solver_type :
+       {gtcal::DriftMonitor::PoseSolverType::CERES, gtcal::DriftMonitor::PoseSolverType::GTSAM}) {
+    gtcal::DriftMonitor::Options options;
+    options.pose_solver_type = solver_type;
+    gtcal::DriftMonitor monitor(makeCamera(calibration), target_points3d, options);
+
+    size_t ii = 0;
+    for (; ii < 400; ii++) {
+      const auto result = monitor.addFrame(makeFrame(ii, calibration));
+      ASSERT_TRUE(result.accepted) << ii;
+      EXPECT_LT(result.rms, 0.5);
+      const auto expected_state = ii + 1 < options.warmup_frames ? gtcal::DriftMonitor::State::WARMING_UP
+                                                                 : gtcal::DriftMonitor::State::OK;
+      EXPECT_EQ(monitor.status().state, expected_state);
+    }
+    const auto status = monitor.status();
+    EXPECT_EQ(status.num_rejected, 0ul);
+    EXPECT_NEAR(status.baseline_rms, 0.15 * std::sqrt(2.0), 0.05);
+    EXPECT_NEAR(status.current_rms, status.baseline_rms, 0.05);
+    EXPECT_NEAR(status.current_quantile, status.baseline_quantile, 0.1);
+    EXPECT_GT(status.baseline_quantile, status.baseline_rms);
+
+    // The lens shifts: the distortion grows and the principal point moves.
+    const gtsam::Cal3Fisheye drifted(FX, FY, 0., CX + 4., CY - 3., 0.2, -0.01, 0.002, 0.);
+    size_t num_drift_frames = 0;
+    for (; ii < 600 && !monitor.drifted(); ii++, num_drift_frames++) {
+      EXPECT_TRUE(monitor.addFrame(makeFrame(ii, drifted)).accepted) << ii;
+    }
+    EXPECT_TRUE(monitor.drifted());
+    EXPECT_LT(num_drift_frames, 100ul);
+    EXPECT_GT(monitor.status().current_rms, options.rms_ratio * monitor.status().baseline_rms);
+
+    // A new baseline accepts the drifted calibration.
+    monitor.resetBaseline();
+    EXPECT_EQ(monitor.status().state, gtcal::DriftMonitor::State::WARMING_UP);
+    for (size_t jj = 0; jj < 200; jj++, ii++) {
+      monitor.addFrame(makeFrame(ii, drifted));
+    }
+    EXPECT_EQ(monitor.status().state, gtcal::DriftMonitor::State::OK);
+  }
+}
+
+// Tests that frames that can't be solved are rejected without touching the statistics.
+TEST_F(DriftMonitorFixture, Reject) {
+  gtcal::DriftMonitor monitor(makeCamera(calibration), target_points3d);
+  auto measurements = makeFrame(0, calibration);
+
+  // Too few measurements.
+  const std::vector<gtcal::Measurement> few(measurements.begin(), measurements.begin() + 5);
+  EXPECT_FALSE(monitor.addFrame(few).accepted);
+
+  // An unknown target point.
+  auto unknown = measurements;
+  unknown.back().point_id = target_points3d.size();
+  EXPECT_FALSE(monitor.addFrame(unknown).accepted);
+
+  // Measurements shuffled across the target.
+  auto shuffled = measurements;
+  std::shuffle(shuffled.begin(), shuffled.end(), rng);
+  for (size_t jj = 0; jj < shuffled.size(); jj++) {
+    shuffled[jj].point_id = measurements[jj].point_id;
+  }
+  EXPECT_FALSE(monitor.addFrame(shuffled).accepted);
+
+  const auto status = monitor.status();
+  EXPECT_EQ(status.num_frames, 3ul);
+  EXPECT_EQ(status.num_rejected, 3ul);
+  EXPECT_EQ(status.baseline_rms, 0.0);
+  EXPECT_TRUE(monitor.addFrame(measurements).accepted);
+
+  // The span overload agrees with the vector one.
+  gtcal::MeasurementBlock block;
+  for (const auto& meas : measurements) {
+    block.push_back(meas.uv, meas.camera_id, meas.point_id);
+  }
+  block.endFrame(0);
+  const auto result = monitor.addFrame(block.frame(0));
+  EXPECT_TRUE(result.accepted);
+  EXPECT_LT(result.rms, 0.5);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
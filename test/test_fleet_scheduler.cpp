@@ -0,0 +1,272 @@
+#include "gtcal/fleet_scheduler.h"
+#include "gtcal_test_utils.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Scheduler = gtcal::FleetScheduler;
+
+/**
+ * @brief Return a job of the given number of steps that appends its name to order at every step.
+ *
+ */
+Scheduler::Job MakeJob(const std::string& name, const size_t num_steps, std::mutex& mutex,
+                       std::vector<std::string>& order) {
+  Scheduler::Job job;
+  job.name = name;
+  auto steps_left = std::make_shared<size_t>(num_steps);
+  job.step = [name, steps_left, &mutex, &order]() {
+    const std::lock_guard<std::mutex> lock(mutex);
+    order.push_back(name);
+    return --*steps_left == 0 ? Scheduler::StepResult::DONE : Scheduler::StepResult::CONTINUE;
+  };
+  return job;
+}
+
+/**
+ * @brief Return a job whose first step blocks until the future is ready, to hold the only worker while
+ * other jobs are queued.
+ *
+ */
+Scheduler::Job MakeBlockingJob(const std::shared_future<void>& release) {
+  Scheduler::Job job;
+  job.priority = 100;
+  job.step = [release]() {
+    release.wait();
+    return Scheduler::StepResult::DONE;
+  };
+  return job;
+}
+
+}  // namespace
+
+// Tests that queued jobs run by priority, then deadline, then submission order.
+TEST(FleetScheduler, Order) {
+  Scheduler::Options options;
+  options.num_threads = 1;
+  Scheduler scheduler(options);
+  std::promise<void> release;
+  scheduler.submit(MakeBlockingJob(release.get_future().share()));
+
+  std::mutex mutex;
+  std::vector<std::string> order;
+  const auto now = Scheduler::Clock::now();
+  auto low = MakeJob("low", 1, mutex, order);
+  low.priority = -1;
+  auto late = MakeJob("late", 1, mutex, order);
+  late.deadline = now + std::chrono::hours(2);
+  auto early = MakeJob("early", 1, mutex, order);
+  early.deadline = now + std::chrono::hours(1);
+  auto high = MakeJob("high", 1, mutex, order);
+  high.priority = 1;
+  for (auto* job : {&low, &late, &early, &high}) {
+    scheduler.submit(std::move(*job));
+  }
+  scheduler.submit(MakeJob("first", 1, mutex, order));
+  scheduler.submit(MakeJob("second", 1, mutex, order));
+
+  while (scheduler.jobStatus(0).state != Scheduler::JobState::RUNNING) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(scheduler.stats().num_queued, 6ul);
+  release.set_value();
+  scheduler.wait();
+  EXPECT_EQ(order, (std::vector<std::string>{"high", "early", "late", "first", "second", "low"}));
+  EXPECT_EQ(scheduler.stats().num_succeeded, 7ul);
+  EXPECT_EQ(scheduler.jobStatus(1).state, Scheduler::JobState::SUCCEEDED);
+  EXPECT_EQ(scheduler.jobStatus(1).num_steps, 1ul);
+}
+
+// Tests that a long job takes turns with the jobs queued behind it instead of holding its worker.
+TEST(FleetScheduler, TakeTurns) {
+  Scheduler::Options options;
+  options.num_threads = 1;
+  Scheduler scheduler(options);
+  std::promise<void> release;
+  scheduler.submit(MakeBlockingJob(release.get_future().share()));
+
+  std::mutex mutex;
+  std::vector<std::string> order;
+  const size_t large_id = scheduler.submit(MakeJob("large", 100, mutex, order));
+  for (size_t ii = 0; ii < 3; ii++) {
+    scheduler.submit(MakeJob("small", 2, mutex, order));
+  }
+  release.set_value();
+  scheduler.wait();
+
+  // Every small job finishes after at most a couple of steps of the large one.
+  ASSERT_EQ(order.size(), 106ul);
+  EXPECT_EQ(std::find(order.begin() + 8, order.end(), "small"), order.end());
+  EXPECT_EQ(scheduler.jobStatus(large_id).num_steps, 100ul);
+  EXPECT_EQ(scheduler.stats().num_steps, 107ul);
+  EXPECT_EQ(scheduler.stepTime().count(), 107ul);
+  EXPECT_EQ(scheduler.queueLatency().count(), 5ul);
+  EXPECT_EQ(scheduler.jobLatency().count(), 5ul);
+}
+
+// Tests that a job is stopped once over its memory limit, and that failures are recorded.
+TEST(FleetScheduler, Failures) {
+  Scheduler scheduler;
+  auto memory = std::make_shared<size_t>(0);
+  Scheduler::Job growing;
+  growing.memory_limit = 1000;
+  growing.step = [memory]() {
+    *memory += 300;
+    return Scheduler::StepResult::CONTINUE;
+  };
+  growing.memory_usage = [memory]() { return *memory; };
+  const size_t growing_id = scheduler.submit(std::move(growing));
+
+  Scheduler::Job failing;
+  failing.step = []() { return Scheduler::StepResult::FAILED; };
+  const size_t failing_id = scheduler.submit(std::move(failing));
+
+  Scheduler::Job throwing;
+  throwing.step = []() -> Scheduler::StepResult { throw std::runtime_error("Step failed."); };
+  const size_t throwing_id = scheduler.submit(std::move(throwing));
+
+  Scheduler::Job late;
+  late.deadline = Scheduler::Clock::now() - std::chrono::seconds(1);
+  late.step = []() { return Scheduler::StepResult::DONE; };
+  const size_t late_id = scheduler.submit(std::move(late));
+  scheduler.wait();
+
+  const auto status = scheduler.jobStatus(growing_id);
+  EXPECT_EQ(status.state, Scheduler::JobState::MEMORY_LIMIT_EXCEEDED);
+  EXPECT_EQ(status.num_steps, 4ul);
+  EXPECT_EQ(status.peak_memory, 1200ul);
+  EXPECT_EQ(memory.use_count(), 1);  // The job's closures were released.
+  EXPECT_EQ(scheduler.jobStatus(failing_id).state, Scheduler::JobState::FAILED);
+  EXPECT_EQ(scheduler.jobStatus(throwing_id).state, Scheduler::JobState::FAILED);
+  EXPECT_EQ(scheduler.jobStatus(late_id).state, Scheduler::JobState::SUCCEEDED);
+  EXPECT_TRUE(scheduler.jobStatus(late_id).missed_deadline);
+
+  const auto stats = scheduler.stats();
+  EXPECT_EQ(stats.num_submitted, 4ul);
+  EXPECT_EQ(stats.num_memory_limit_exceeded, 1ul);
+  EXPECT_EQ(stats.num_failed, 2ul);
+  EXPECT_EQ(stats.num_succeeded, 1ul);
+  EXPECT_EQ(stats.num_missed_deadlines, 1ul);
+  EXPECT_EQ(stats.num_queued + stats.num_running, 0ul);
+}
+
+// Tests many jobs over several workers, and that unfinished jobs are cancelled when the scheduler stops.
+TEST(FleetScheduler, Threads) {
+  std::atomic<size_t> num_steps{0};
+  const auto sentinel = std::make_shared<int>(0);
+  {
+    Scheduler::Options options;
+    options.num_threads = 4;
+    Scheduler scheduler(options);
+    EXPECT_EQ(scheduler.numThreads(), 4ul);
+    for (size_t ii = 0; ii < 200; ii++) {
+      Scheduler::Job job;
+      job.priority = static_cast<int>(ii % 3);
+      auto steps_left = std::make_shared<size_t>(1 + ii % 5);
+      job.step = [steps_left, &num_steps]() {
+        num_steps++;
+        return --*steps_left == 0 ? Scheduler::StepResult::DONE : Scheduler::StepResult::CONTINUE;
+      };
+      scheduler.submit(std::move(job));
+    }
+    scheduler.wait();
+    EXPECT_EQ(scheduler.stats().num_succeeded, 200ul);
+    EXPECT_EQ(num_steps.load(), 600ul);
+
+    // Never finishes on its own.
+    Scheduler::Job endless;
+    endless.step = [sentinel]() { return Scheduler::StepResult::CONTINUE; };
+    scheduler.submit(std::move(endless));
+  }
+  EXPECT_EQ(sentinel.use_count(), 1);
+}
+
+// Tests that resources are created once per key and shared.
+TEST(SharedResources, GetOrCreate) {
+  gtcal::SharedResources resources;
+  size_t num_created = 0;
+  const auto make = [&num_created]() {
+    num_created++;
+    const gtcal::utils::CalibrationTarget target(0.15, 10, 13);
+    return std::make_shared<const gtsam::Point3Vector>(target.pointsTarget());
+  };
+  const auto first = resources.getOrCreate<gtsam::Point3Vector>("target", make);
+  const auto second = resources.getOrCreate<gtsam::Point3Vector>("target", make);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(num_created, 1ul);
+  EXPECT_EQ(first->size(), 130ul);
+  EXPECT_EQ(resources.size(), 1ul);
+  resources.clear();
+  EXPECT_EQ(resources.size(), 0ul);
+  EXPECT_EQ(first.use_count(), 2);
+}
+
+// Tests calibration jobs of several rigs sharing the target geometry.
+TEST(FleetScheduler, CalibrationJobs) {
+  const gtcal::utils::CalibrationTarget target(0.15, 10, 13);
+  gtcal::SharedResources resources;
+  const auto pts3d_target = resources.getOrCreate<gtsam::Point3Vector>(
+      "target", [&target]() { return std::make_shared<const gtsam::Point3Vector>(target.pointsTarget()); });
+
+  // Frames of a single camera looking at the target from slightly different poses.
+  const gtsam::Point3 center = target.get3dCenter();
+  gtcal::Camera truth;
+  truth.setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3_S2(FX, FY, 0., CX, CY));
+  auto measurements = std::make_shared<gtcal::MeasurementBlock>();
+  for (size_t ii = 0; ii < 12; ii++) {
+    const double dx = 0.05 * (static_cast<double>(ii % 4) - 1.5);
+    const double dy = 0.05 * (static_cast<double>(ii / 4) - 1.);
+    truth.setCameraPose(gtsam::Pose3(gtsam::Rot3::RzRyRx(-dy, dx, 0.),
+                                     gtsam::Point3(center.x() + dx, center.y() + dy, -0.85)));
+    for (size_t jj = 0; jj < pts3d_target->size(); jj++) {
+      const gtsam::Point2 uv = truth.project(pts3d_target->at(jj));
+      if (gtcal::utils::FilterPixelCoords(uv, IMAGE_WIDTH, IMAGE_HEIGHT)) {
+        measurements->push_back(uv, 0, jj);
+      }
+    }
+    measurements->endFrame(static_cast<int64_t>(ii));
+  }
+
+  Scheduler::Options options;
+  options.num_threads = 2;
+  Scheduler scheduler(options);
+  std::mutex mutex;
+  std::vector<size_t> num_frames;
+  for (size_t ii = 0; ii < 4; ii++) {
+    auto camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                           gtsam::Cal3_S2(FX + 5., FY - 5., 0., CX + 3., CY - 2.));
+    const auto on_done = [&](const gtcal::BatchSolver::State& state) {
+      const std::lock_guard<std::mutex> lock(mutex);
+      num_frames.push_back(state.num_frames);
+    };
+    auto job = gtcal::MakeCalibrationJob(pts3d_target, {camera}, measurements, gtcal::BatchSolver::Options(),
+                                         5, on_done);
+    job.memory_limit = size_t{1} << 30;
+    scheduler.submit(std::move(job));
+  }
+  scheduler.wait();
+
+  EXPECT_EQ(scheduler.stats().num_succeeded, 4ul);
+  EXPECT_EQ(num_frames, std::vector<size_t>(4, measurements->numFrames()));
+  for (size_t ii = 0; ii < 4; ii++) {
+    EXPECT_EQ(scheduler.jobStatus(ii).num_steps, 3ul);
+    EXPECT_GT(scheduler.jobStatus(ii).peak_memory, 0ul);
+  }
+
+  // The jobs released their reference to the target geometry.
+  EXPECT_EQ(pts3d_target.use_count(), 2);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -50,6 +50,20 @@ TEST_F(GtcalTestUtils, PosesAroundTarget) {
   const auto poses_target_cam =
       gtcal::utils::GeneratePosesAroundTarget(target, -3.0, -target_center_y / 2, initial_offset);
   EXPECT_EQ(poses_target_cam.size(), 10);
+  const auto more_poses_target_cam =
+      gtcal::utils::GeneratePosesAroundTarget(target, -3.0, -target_center_y / 2, initial_offset, 25);
+  EXPECT_EQ(more_poses_target_cam.size(), 25);
+}
+
+// Tests that pose noise is reproducible from the generator's seed and stream.
+TEST_F(GtcalTestUtils, ApplyNoise) {
+  const gtsam::Pose3 pose(gtsam::Rot3::RzRyRx(0.1, -0.2, 0.3), gtsam::Point3(1., 2., 3.));
+  gtcal::CounterRng rng0(7, 0), rng0_again(7, 0), rng1(7, 1);
+  const gtsam::Pose3 noisy0 = gtcal::utils::ApplyNoise(pose, 0.01, 0.01, rng0);
+  EXPECT_TRUE(noisy0.equals(gtcal::utils::ApplyNoise(pose, 0.01, 0.01, rng0_again)));
+  EXPECT_FALSE(noisy0.equals(gtcal::utils::ApplyNoise(pose, 0.01, 0.01, rng1)));
+  EXPECT_TRUE(noisy0.equals(pose, 0.1));
+  EXPECT_FALSE(noisy0.equals(pose, 1e-6));
 }
 
 // Tests the default pose function.
@@ -0,0 +1,89 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/camera.h"
+#include "gtcal/homography.h"
+#include "gtcal/measurement_block.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+struct HomographyFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+  std::shared_ptr<gtcal::Camera> camera = nullptr;
+  gtsam::Matrix3 K;
+
+  void SetUp() override {
+    camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3_S2(FX, FY, 0., CX, CY));
+    K << FX, 0., CX, 0., FY, CY, 0., 0., 1.;
+  }
+
+  // Return the measurements of the target points seen from the given pose.
+  std::vector<gtcal::Measurement> project(const gtsam::Pose3& pose_target_cam) const {
+    camera->setCameraPose(pose_target_cam);
+    std::vector<gtcal::Measurement> measurements;
+    for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+      const gtsam::Point2 uv = camera->project(target_points3d.at(ii));
+      if (gtcal::utils::FilterPixelCoords(uv, camera->width(), camera->height())) {
+        measurements.emplace_back(uv, 0, ii);
+      }
+    }
+    return measurements;
+  }
+};
+
+// Tests that the pose is recovered exactly from noiseless measurements of tilted views.
+TEST_F(HomographyFixture, PoseFromHomography) {
+  const gtsam::Point3 center = target.get3dCenter();
+  const std::vector<gtsam::Pose3> poses_target_cam = {
+      gtsam::Pose3(gtsam::Rot3(), {center.x(), center.y(), -0.85}),
+      gtsam::Pose3(gtsam::Rot3::RzRyRx(0.2, -0.3, 0.1), {center.x() + 0.3, center.y() - 0.2, -0.9}),
+      gtsam::Pose3(gtsam::Rot3::RzRyRx(-0.25, 0.35, -0.4), {center.x() - 0.3, center.y() + 0.1, -1.1})};
+
+  for (const auto& pose_target_cam : poses_target_cam) {
+    const std::vector<gtcal::Measurement> measurements = project(pose_target_cam);
+    ASSERT_GE(measurements.size(), 4);
+
+    gtsam::Matrix3 H_image_target;
+    ASSERT_TRUE(gtcal::EstimateHomography(measurements, target_points3d, H_image_target));
+    gtsam::Pose3 pose_estimate;
+    ASSERT_TRUE(gtcal::PoseFromHomography(H_image_target, gtcal::CameraMatrix(*camera), pose_estimate));
+    EXPECT_TRUE(pose_estimate.equals(pose_target_cam, 1e-6));
+
+    // Both measurement containers give the same homography.
+    gtcal::MeasurementBlock block(measurements);
+    gtsam::Matrix3 H_span;
+    ASSERT_TRUE(gtcal::EstimateHomography(block.span(), target_points3d, H_span));
+    EXPECT_TRUE(H_span.isApprox(H_image_target, 1e-4));
+  }
+}
+
+// Tests that the camera matrix is built from the intrinsics of both camera models.
+TEST_F(HomographyFixture, CameraMatrix) {
+  EXPECT_TRUE(gtcal::CameraMatrix(*camera).isApprox(K));
+  gtcal::Camera fisheye;
+  fisheye.setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                             gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0.1, 0.01, 0., 0.));
+  EXPECT_TRUE(gtcal::CameraMatrix(fisheye).isApprox(K));
+}
+
+// Tests that too few or collinear points are rejected.
+TEST_F(HomographyFixture, Degenerate) {
+  const gtsam::Point3 center = target.get3dCenter();
+  const std::vector<gtcal::Measurement> measurements =
+      project(gtsam::Pose3(gtsam::Rot3(), {center.x(), center.y(), -0.85}));
+
+  gtsam::Matrix3 H_image_target;
+  const std::vector<gtcal::Measurement> three(measurements.begin(), measurements.begin() + 3);
+  EXPECT_FALSE(gtcal::EstimateHomography(three, target_points3d, H_image_target));
+
+  // The first points are a single column of the target.
+  const std::vector<gtcal::Measurement> column(measurements.begin(), measurements.begin() + target.numRows());
+  EXPECT_FALSE(gtcal::EstimateHomography(column, target_points3d, H_image_target));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,66 @@
+#include "gtcal/image.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Tests that a written PGM image reads back, and reading raw images.
+TEST(Image, PgmAndRaw) {
+  gtcal::Image image(7, 3);
+  for (size_t ii = 0; ii < image.pixels.size(); ii++) {
+    image.pixels.at(ii) = static_cast<uint8_t>(ii * 11);
+  }
+  const std::string path = testing::TempDir() + "gtcal_image_test.pgm";
+  ASSERT_TRUE(gtcal::WritePgm(path, image));
+
+  gtcal::Image read;
+  std::string error;
+  ASSERT_TRUE(gtcal::ReadPgm(path, read, error)) << error;
+  EXPECT_EQ(read.width, image.width);
+  EXPECT_EQ(read.height, image.height);
+  EXPECT_EQ(read.pixels, image.pixels);
+  EXPECT_EQ(read.at(2, 1), 9 * 11);
+
+  // Headers may have comments, the pixels are the last width * height bytes.
+  const std::string raw(reinterpret_cast<const char*>(image.pixels.data()), image.pixels.size());
+  ASSERT_TRUE(gtcal::ParsePgm("P5 # comment\n7 3\n# another\n255\n" + raw, read, error)) << error;
+  EXPECT_EQ(read.pixels, image.pixels);
+
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << raw;
+  }
+  ASSERT_TRUE(gtcal::ReadRawImage(path, 7, 3, read, error)) << error;
+  EXPECT_EQ(read.pixels, image.pixels);
+  EXPECT_FALSE(gtcal::ReadRawImage(path, 7, 4, read, error));
+  EXPECT_FALSE(error.empty());
+  std::filesystem::remove(path);
+}
+
+// Tests that invalid PGM images are rejected with an error.
+TEST(Image, InvalidPgm) {
+  const std::vector<std::string> invalid = {"",
+                                            "P2\n2 2\n255\n0 0 0 0",
+                                            "P5\n2 2\n65535\n\1\1\1\1\1\1\1\1",
+                                            "P5\n2\n255\n",
+                                            "P5\n2 2\n255\n\1\1\1",
+                                            "P5\n0 2\n255\n"};
+  for (const auto& data : invalid) {
+    gtcal::Image image;
+    std::string error;
+    EXPECT_FALSE(gtcal::ParsePgm(data, image, error)) << data;
+    EXPECT_FALSE(error.empty());
+    EXPECT_TRUE(image.empty());
+  }
+
+  gtcal::Image image;
+  std::string error;
+  EXPECT_FALSE(gtcal::ReadPgm(testing::TempDir() + "gtcal_missing_image.pgm", image, error));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/batch_solver.h"
+#include "gtcal/camera.h"
+#include "gtcal/measurement_block.h"
+#include "gtcal/utils.h"
+#include <gtest/gtest.h>
+
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+using gtsam::symbol_shorthand::K;
+using gtsam::symbol_shorthand::X;
+
+// Tests frame grouping, views and conversions.
+TEST(MeasurementBlock, Frames) {
+  gtcal::MeasurementBlock block;
+  EXPECT_TRUE(block.empty());
+  EXPECT_EQ(block.numFrames(), 0);
+
+  block.push_back({10.5, 20.25}, 0, 3);
+  block.push_back({11.5, 21.25}, 0, 4);
+  block.endFrame(100);
+  block.appendFrame({gtcal::Measurement({30., 40.}, 1, 7)}, 200);
+  block.endFrame(300);  // Empty frame.
+
+  ASSERT_EQ(block.size(), 3);
+  ASSERT_EQ(block.numFrames(), 3);
+  EXPECT_EQ(block.frame(0).size(), 2);
+  EXPECT_EQ(block.frame(1).size(), 1);
+  EXPECT_TRUE(block.frame(2).empty());
+  EXPECT_EQ(block.timestamp(0), 100);
+  EXPECT_EQ(block.timestamp(2), 300);
+
+  // Iterating a frame yields the measurements.
+  const gtcal::MeasurementSpan frame = block.frame(0);
+  size_t ii = 0;
+  for (const auto& meas : frame) {
+    EXPECT_EQ(meas.camera_id, 0);
+    EXPECT_EQ(meas.point_id, 3 + ii);
+    EXPECT_DOUBLE_EQ(meas.uv.x(), 10.5 + ii);
+    EXPECT_DOUBLE_EQ(meas.uv.y(), 20.25 + ii);
+    ii++;
+  }
+  EXPECT_EQ(ii, 2);
+  EXPECT_EQ(block.frame(1).front().point_id, 7);
+  EXPECT_EQ(block.frame(1).u()[0], 30.f);
+  EXPECT_EQ(std::distance(frame.begin(), frame.end()), 2);
+
+  // The iterator is a C++20 random access iterator yielding values.
+  static_assert(std::random_access_iterator<gtcal::MeasurementSpan::Iterator>);
+  EXPECT_EQ(2 + frame.begin(), frame.end());
+  EXPECT_TRUE(frame.begin() <= frame.end() && frame.end() > frame.begin());
+  EXPECT_EQ((*std::ranges::max_element(frame, {}, &gtcal::Measurement::point_id)).point_id, 4);
+
+  // Back to a vector, which can now be sorted.
+  std::vector<gtcal::Measurement> measurements = block.toVector();
+  ASSERT_EQ(measurements.size(), 3);
+  std::sort(measurements.begin(), measurements.end(),
+            [](const gtcal::Measurement& a, const gtcal::Measurement& b) { return a.point_id > b.point_id; });
+  EXPECT_EQ(measurements.front().point_id, 7);
+  EXPECT_EQ(measurements.front().camera_id, 1);
+
+  block.clear();
+  EXPECT_TRUE(block.empty());
+  EXPECT_EQ(block.numFrames(), 0);
+}
+
+// Tests that the batch solver reaches the same estimate from a measurement block as from vectors.
+TEST(MeasurementBlock, BatchSolver) {
+  const gtcal::utils::CalibrationTarget target(0.15, 10, 13);
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+  const gtsam::Cal3_S2 K_linear(FX, FY, 0., CX, CY);
+  const gtsam::Point3 center = target.get3dCenter();
+  const gtsam::Pose3 pose0_target_cam(gtsam::Rot3(), {center.x(), center.y(), -0.85});
+  const gtsam::Pose3 delta(gtsam::Rot3::RzRyRx(0.05, 0., 0.), {0., 0.05, 0.});
+  const gtsam::Pose3Vector poses_target_cam = {pose0_target_cam, pose0_target_cam.compose(delta)};
+
+  // Generate the measurements as vectors and as one block.
+  auto truth_cam = std::make_shared<gtcal::Camera>();
+  std::vector<std::vector<gtcal::Measurement>> frames;
+  gtcal::MeasurementBlock block;
+  for (const auto& pose_target_cam : poses_target_cam) {
+    truth_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose_target_cam);
+    std::vector<gtcal::Measurement> measurements;
+    for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+      const gtsam::Point2 uv = truth_cam->project(target_points3d.at(ii));
+      if (gtcal::utils::FilterPixelCoords(uv, truth_cam->width(), truth_cam->height())) {
+        measurements.emplace_back(uv, 0, ii);
+      }
+    }
+    block.appendFrame(measurements);
+    frames.push_back(std::move(measurements));
+  }
+
+  // Solve both.
+  const gtcal::BatchSolver solver(target_points3d);
+  auto vector_cam = std::make_shared<gtcal::Camera>();
+  vector_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose0_target_cam);
+  auto block_cam = std::make_shared<gtcal::Camera>();
+  block_cam->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT, K_linear, pose0_target_cam);
+  gtcal::BatchSolver::State vector_state({vector_cam});
+  gtcal::BatchSolver::State block_state({block_cam});
+  for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+    vector_cam->setCameraPose(poses_target_cam.at(ii));
+    solver.solve(frames.at(ii), vector_state);
+    block_cam->setCameraPose(poses_target_cam.at(ii));
+    solver.solve(block.frame(ii), block_state);
+  }
+
+  EXPECT_EQ(block_state.graph.size(), vector_state.graph.size());
+  EXPECT_TRUE(block_state.current_estimate.equals(vector_state.current_estimate, 1e-3));
+  EXPECT_TRUE(block_state.current_estimate.at<gtsam::Pose3>(X(1)).equals(poses_target_cam.at(1), 1e-3));
+  EXPECT_TRUE(block_state.current_estimate.at<gtsam::Cal3_S2>(K(0)).equals(K_linear, 1e-3));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
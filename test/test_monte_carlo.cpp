@@ -0,0 +1,128 @@
+#include "gtcal/monte_carlo.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+struct MonteCarloHarnessFixture : public testing::Test {
+protected:
+  gtcal::Rig rig;
+
+  void SetUp() override {
+    std::string error;
+    ASSERT_TRUE(gtcal::ParseRig("target 0.04 6 9\n"
+                                "camera 0 pinhole 1024 570 600 600 512 285\n"
+                                "camera 1 fisheye 1024 570 400 400 512 285 -0.02 0.01 0 0\n",
+                                rig, error))
+        << error;
+  }
+};
+
+// Tests the moments and percentiles of values recorded from several threads.
+TEST(StreamingStatistics, Record) {
+  static constexpr size_t kNumThreads = 4;
+  static constexpr size_t kValuesPerThread = 2500;
+  gtcal::StreamingStatistics statistics;
+  std::vector<std::thread> threads;
+  for (size_t tt = 0; tt < kNumThreads; tt++) {
+    threads.emplace_back([&statistics, tt]() {
+      for (size_t ii = 0; ii < kValuesPerThread; ii++) {
+        statistics.record(1e-3 * static_cast<double>(tt * kValuesPerThread + ii + 1));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Values 0.001, 0.002, ..., 10.
+  ASSERT_EQ(statistics.count(), kNumThreads * kValuesPerThread);
+  EXPECT_NEAR(statistics.mean(), 5.0005, 1e-9);
+  EXPECT_NEAR(statistics.stdDev(), std::sqrt(1e4 * (1e4 + 1.0) / 12.0) * 1e-3, 1e-6);
+  EXPECT_NEAR(statistics.max(), 10.0, 1e-9);
+  EXPECT_NEAR(statistics.percentile(50.0), 5.0, 0.05);
+  EXPECT_NEAR(statistics.percentile(90.0), 9.0, 0.05);
+  EXPECT_NEAR(statistics.percentile(99.0), 9.9, 0.05);
+
+  // Percentiles are estimated in the value domain, so tiny and negative values keep their precision.
+  gtcal::StreamingStatistics tiny;
+  for (size_t ii = 0; ii < 1000; ii++) {
+    tiny.record(-1e-12 * static_cast<double>((ii * 7) % 1000 + 1));
+  }
+  EXPECT_NEAR(tiny.percentile(50.0), -5e-10, 2.5e-11);
+  EXPECT_NEAR(tiny.percentile(90.0), -1e-10, 1e-11);
+  EXPECT_EQ(tiny.max(), -1e-12);
+
+  gtcal::StreamingStatistics empty;
+  EXPECT_EQ(empty.count(), 0ul);
+  EXPECT_EQ(empty.mean(), 0.0);
+  EXPECT_EQ(empty.stdDev(), 0.0);
+  EXPECT_EQ(empty.max(), 0.0);
+  EXPECT_EQ(empty.percentile(50.0), 0.0);
+}
+
+// Tests that the solvers recover the poses and intrinsics of the trials, and that the statistics don't depend
+// on the number of threads.
+TEST_F(MonteCarloHarnessFixture, Run) {
+  gtcal::MonteCarloHarness::Options options;
+  options.num_trials = 6;
+  options.frames_per_trial = 8;
+  options.seed = 5;
+
+  double translation_means[gtcal::MonteCarloHarness::kNumSolvers] = {};
+  for (const size_t num_threads : {1, 3}) {
+    options.num_threads = num_threads;
+    gtcal::MonteCarloHarness harness(rig, options);
+    harness.run();
+    EXPECT_EQ(harness.numTrialsCompleted(), options.num_trials);
+    EXPECT_EQ(harness.numThreads(), num_threads);
+
+    for (size_t ss = 0; ss < gtcal::MonteCarloHarness::kNumSolvers; ss++) {
+      const auto& statistics = harness.statistics(static_cast<gtcal::MonteCarloHarness::Solver>(ss));
+      EXPECT_EQ(statistics.num_failures.load(), 0ul) << ss;
+      EXPECT_EQ(statistics.translation_error.count(), options.num_trials * options.frames_per_trial) << ss;
+      EXPECT_LT(statistics.translation_error.percentile(50.0), 5e-3) << ss;
+      EXPECT_LT(statistics.rotation_error_deg.percentile(50.0), 0.5) << ss;
+      if (num_threads == 1) {
+        translation_means[ss] = statistics.translation_error.mean();
+      } else {
+        EXPECT_NEAR(statistics.translation_error.mean(), translation_means[ss], 1e-12) << ss;
+      }
+    }
+
+    // Both cameras of every trial are calibrated by the batch solver.
+    const auto& batch = harness.statistics(gtcal::MonteCarloHarness::Solver::BATCH_SOLVER);
+    EXPECT_EQ(batch.intrinsics_error.count(), 2 * options.num_trials);
+    EXPECT_LT(batch.intrinsics_error.percentile(50.0), 3.0);
+    EXPECT_EQ(batch.solve_time.count(), options.num_trials);
+  }
+}
+
+// Tests that the JSON summary holds every solver and statistic.
+TEST_F(MonteCarloHarnessFixture, Json) {
+  gtcal::MonteCarloHarness::Options options;
+  options.num_trials = 2;
+  options.frames_per_trial = 4;
+  options.run_pose_solver_gtsam = false;
+  gtcal::MonteCarloHarness harness(rig, options);
+  harness.run();
+
+  std::stringstream ss;
+  harness.writeJson(ss);
+  const std::string json = ss.str();
+  for (const char* key :
+       {"\"num_trials\": 2", "\"frames_per_trial\": 4", "\"pose_solver\"", "\"pose_solver_gtsam\"",
+        "\"batch_solver\"", "\"translation_error_m\"", "\"rotation_error_deg\"", "\"intrinsics_error_px\"",
+        "\"solve_time_us\"", "\"p99\""}) {
+    EXPECT_NE(json.find(key), std::string::npos) << key;
+  }
+  EXPECT_EQ(json.front(), '{');
+  EXPECT_EQ(harness.statistics(gtcal::MonteCarloHarness::Solver::POSE_SOLVER_GTSAM).solve_time.count(), 0ul);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,61 @@
+#include "gtcal/p2_quantile.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Tests the P² estimates against the exact quantiles of a few distributions.
+TEST(P2Quantile, Accuracy) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::exponential_distribution<double> exponential(2.0);
+  std::normal_distribution<double> normal(1.0, 0.3);
+
+  for (const double p : {0.5, 0.9, 0.95}) {
+    gtcal::P2Quantile estimates[3] = {gtcal::P2Quantile(p), gtcal::P2Quantile(p), gtcal::P2Quantile(p)};
+    std::vector<double> samples[3];
+    for (size_t ii = 0; ii < 20000; ii++) {
+      const double values[3] = {uniform(rng), exponential(rng), std::abs(normal(rng))};
+      for (size_t dd = 0; dd < 3; dd++) {
+        estimates[dd].add(values[dd]);
+        samples[dd].push_back(values[dd]);
+      }
+    }
+    for (size_t dd = 0; dd < 3; dd++) {
+      std::sort(samples[dd].begin(), samples[dd].end());
+      const double exact = samples[dd][static_cast<size_t>(p * (samples[dd].size() - 1))];
+      EXPECT_EQ(estimates[dd].count(), samples[dd].size());
+      EXPECT_NEAR(estimates[dd].value(), exact, 0.02 * exact) << "p = " << p << ", distribution " << dd;
+    }
+  }
+}
+
+// Tests the P² estimate with up to five samples, where it is exact, and after a reset.
+TEST(P2Quantile, FewSamples) {
+  gtcal::P2Quantile median(0.5);
+  EXPECT_EQ(median.value(), 0.0);
+  median.add(3.0);
+  EXPECT_EQ(median.value(), 3.0);
+  median.add(1.0);
+  median.add(2.0);
+  EXPECT_EQ(median.value(), 2.0);
+
+  median.reset();
+  EXPECT_EQ(median.count(), 0ul);
+  for (const double x : {5.0, 4.0, 1.0, 2.0, 3.0}) {
+    median.add(x);
+  }
+  EXPECT_EQ(median.value(), 3.0);
+  gtcal::P2Quantile p90(0.9);
+  for (const double x : {5.0, 4.0, 1.0, 2.0, 3.0}) {
+    p90.add(x);
+  }
+  EXPECT_EQ(p90.value(), 5.0);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
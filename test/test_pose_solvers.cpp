@@ -6,6 +6,8 @@
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <cmath>
+#include <memory>
 
 struct BasePoseSolverFixture {
 public:
@@ -163,6 +165,38 @@ TEST_F(PoseSolverFixture, CeresFirstAndSecondPoses) {
   EXPECT_TRUE(pose1_target_cam.equals(pose_target_cam_init, 1e-7));
 }
 
+// Tests that the batched projection of a planar target matches the per-point reprojection residual, values
+// and numeric Jacobians.
+TEST_F(PoseSolverFixture, PlanarTargetProjection) {
+  const gtsam::Point3& xyz = pose0_target_cam.translation();
+  const gtsam::Point3 rpy = pose0_target_cam.rotation().rpy();
+  double pose_target_cam_arr[6] = {xyz.x(), xyz.y(), xyz.z(), rpy.x(), rpy.y(), rpy.z()};
+  const double* parameters[1] = {pose_target_cam_arr};
+
+  gtcal::PlanarTargetProjection projection(camera, pose_target_cam_arr);
+  std::vector<std::unique_ptr<ceres::CostFunction>> planar_residuals, residuals;
+  for (const gtcal::Measurement& meas : measurements) {
+    const gtsam::Point3& pt3d_target = target_points3d.at(meas.point_id);
+    planar_residuals.emplace_back(
+        new gtcal::PlanarReprojectionErrorResidual(meas.uv, projection, projection.addPoint(pt3d_target)));
+    residuals.emplace_back(gtcal::ReprojectionErrorResidual::Create(meas.uv, pt3d_target, camera->clone()));
+  }
+  projection.PrepareForEvaluation(true, true);
+
+  for (size_t ii = 0; ii < measurements.size(); ii++) {
+    double planar_error[2], error[2], planar_jacobian[12], jacobian[12];
+    double* planar_jacobians[1] = {planar_jacobian};
+    double* jacobians[1] = {jacobian};
+    ASSERT_TRUE(planar_residuals[ii]->Evaluate(parameters, planar_error, planar_jacobians));
+    ASSERT_TRUE(residuals[ii]->Evaluate(parameters, error, jacobians));
+    EXPECT_NEAR(planar_error[0], error[0], 1e-9);
+    EXPECT_NEAR(planar_error[1], error[1], 1e-9);
+    for (size_t kk = 0; kk < 12; kk++) {
+      EXPECT_NEAR(planar_jacobian[kk], jacobian[kk], 1e-4 * std::max(1.0, std::abs(jacobian[kk])));
+    }
+  }
+}
+
 // Tests that the gtsam pose solver is able to find a solution in the case of translation and rotation using
 // the first two poses from the synthetic pose set.
 TEST_F(PoseSolverFixture, GtsamFirstAndSecondPoses) {
@@ -176,6 +210,76 @@ TEST_F(PoseSolverFixture, GtsamFirstAndSecondPoses) {
   EXPECT_TRUE(pose_target_cam_est.equals(pose1_target_cam, 1e-3));
 }
 
+struct DenseTargetFixture : public testing::Test {
+protected:
+  // About 2000 target points filling the image.
+  const gtcal::utils::CalibrationTarget target{0.0375, 40, 52};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+  std::shared_ptr<gtcal::Camera> camera = nullptr;
+  gtsam::Pose3 pose_target_cam;
+  gtsam::Pose3 pose_initial_target_cam;
+  std::vector<gtcal::Measurement> measurements;
+
+  void SetUp() override {
+    const gtsam::Point3 center = target.get3dCenter();
+    pose_target_cam = gtsam::Pose3(gtsam::Rot3::RzRyRx(0.02, -0.03, 0.01), {center.x(), center.y(), -0.85});
+    pose_initial_target_cam =
+        pose_target_cam * gtsam::Pose3(gtsam::Rot3::RzRyRx(0.02, -0.02, 0.03), {0.02, -0.01, 0.02});
+
+    camera = std::make_shared<gtcal::Camera>();
+    camera->setCameraModel<gtsam::Cal3Fisheye>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                               gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0., 0., 0., 0.),
+                                               pose_target_cam);
+    for (size_t ii = 0; ii < target_points3d.size(); ii++) {
+      const gtsam::Point2 uv = camera->project(target_points3d.at(ii));
+      if (gtcal::utils::FilterPixelCoords(uv, camera->width(), camera->height())) {
+        measurements.push_back(gtcal::Measurement(uv, 0, ii));
+      }
+    }
+    ASSERT_GT(measurements.size(), 1000ul);
+  }
+};
+
+// Tests that the Ceres pose solver converges to the same pose with and without the coarse-to-fine schedule.
+TEST_F(DenseTargetFixture, CeresCoarseToFine) {
+  gtcal::CoarseToFineOptions coarse_to_fine;
+  coarse_to_fine.enabled = true;
+  ASSERT_GT(gtcal::CoarseToFineLevels(measurements.size(), coarse_to_fine).size(), 2ul);
+  const gtcal::PoseSolver full_solver;
+  const gtcal::PoseSolver coarse_to_fine_solver(false, coarse_to_fine);
+
+  gtsam::Pose3 pose_full = pose_initial_target_cam;
+  ASSERT_TRUE(full_solver.solve(measurements, target_points3d, camera, pose_full));
+  gtsam::Pose3 pose_coarse_to_fine = pose_initial_target_cam;
+  ASSERT_TRUE(coarse_to_fine_solver.solve(measurements, target_points3d, camera, pose_coarse_to_fine));
+  EXPECT_TRUE(pose_coarse_to_fine.equals(pose_full, 1e-5));
+  EXPECT_TRUE(pose_coarse_to_fine.equals(pose_target_cam, 1e-5));
+}
+
+// Tests that the gtsam pose solver converges to the same pose with and without the coarse-to-fine schedule.
+TEST_F(DenseTargetFixture, GtsamCoarseToFine) {
+  gtcal::PoseSolverGtsam::Options options;
+  const gtcal::PoseSolverGtsam full_solver(options);
+  options.coarse_to_fine.enabled = true;
+  const gtcal::PoseSolverGtsam coarse_to_fine_solver(options);
+
+  gtsam::Pose3 pose_full = pose_initial_target_cam;
+  ASSERT_TRUE(full_solver.solve(measurements, target_points3d, camera, pose_full));
+  gtsam::Pose3 pose_coarse_to_fine = pose_initial_target_cam;
+  ASSERT_TRUE(coarse_to_fine_solver.solve(measurements, target_points3d, camera, pose_coarse_to_fine));
+  EXPECT_TRUE(pose_coarse_to_fine.equals(pose_full, 1e-4));
+  EXPECT_TRUE(pose_coarse_to_fine.equals(pose_target_cam, 1e-3));
+}
+
+// Tests that a failed optimization is reported and leaves the pose unchanged.
+TEST_F(DenseTargetFixture, GtsamFailure) {
+  const gtcal::PoseSolverGtsam pose_solver(gtcal::PoseSolverGtsam::Options{});
+  measurements.front().uv = gtsam::Point2::Constant(gtcal::utils::NaN);
+  gtsam::Pose3 pose = pose_initial_target_cam;
+  EXPECT_FALSE(pose_solver.solve(measurements, target_points3d, camera, pose));
+  EXPECT_TRUE(pose.equals(pose_initial_target_cam));
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,195 @@
+#include "gtcal/reprojection_evaluator.h"
+#include "gtcal_test_utils.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+// Tests the statistics of the residual histogram.
+TEST(ResidualHistogram, Statistics) {
+  gtcal::ResidualHistogram histogram(0.5, 10);
+  EXPECT_EQ(histogram.count(), 0ul);
+  EXPECT_EQ(histogram.rms(), 0.0);
+  EXPECT_EQ(histogram.percentile(50.0), 0.0);
+
+  histogram.record(3.0, 4.0);
+  histogram.record(0.0, -1.0);
+  histogram.record(0.3, 0.0);
+  histogram.record(-60.0, 80.0);  // Past the last bin.
+  EXPECT_EQ(histogram.count(), 4ul);
+  EXPECT_EQ(histogram.bins()[0], 1ul);
+  EXPECT_EQ(histogram.bins()[2], 1ul);
+  EXPECT_EQ(histogram.bins()[9], 2ul);
+  EXPECT_NEAR(histogram.mean(), (5.0 + 1.0 + 0.3 + 100.0) / 4.0, 1e-12);
+  EXPECT_NEAR(histogram.rms(), std::sqrt((25.0 + 1.0 + 0.09 + 1e4) / 4.0), 1e-12);
+  EXPECT_NEAR(histogram.bias().x(), (3.0 + 0.3 - 60.0) / 4.0, 1e-12);
+  EXPECT_NEAR(histogram.bias().y(), (4.0 - 1.0 + 80.0) / 4.0, 1e-12);
+  EXPECT_EQ(histogram.max(), 100.0);
+
+  // Percentiles interpolate inside their bin, and the last bin reaches up to the maximum.
+  EXPECT_NEAR(histogram.percentile(25.0), 0.5, 1e-12);
+  EXPECT_NEAR(histogram.percentile(50.0), 1.5, 1e-12);
+  EXPECT_GT(histogram.percentile(99.0), 4.5);
+  EXPECT_EQ(histogram.percentile(100.0), 100.0);
+
+  gtcal::ResidualHistogram other(0.5, 10);
+  other.record(0.1, 0.1);
+  histogram.merge(other);
+  EXPECT_EQ(histogram.count(), 5ul);
+  EXPECT_EQ(histogram.bins()[0], 2ul);
+}
+
+struct ReprojectionEvaluatorFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector target_points3d = target.pointsTarget();
+  std::vector<std::shared_ptr<gtcal::Camera>> cameras;
+  std::vector<gtsam::Pose3> poses_target_cam;
+  gtcal::MeasurementBlock measurements;
+
+  void SetUp() override {
+    cameras.push_back(std::make_shared<gtcal::Camera>());
+    cameras.back()->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                                   gtsam::Cal3_S2(FX, FY, 0.5, CX, CY));
+    cameras.push_back(std::make_shared<gtcal::Camera>());
+    cameras.back()->setCameraModel<gtsam::Cal3Fisheye>(
+        IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0.05, -0.01, 0.002, 0.));
+
+    // Frames of both cameras, with a deterministic pixel noise that grows with the frame index.
+    const gtsam::Point3 center = target.get3dCenter();
+    for (size_t ii = 0; ii < 12; ii++) {
+      const size_t camera_id = ii % 2;
+      const double dx = 0.03 * (static_cast<double>(ii % 4) - 1.5);
+      const double dy = 0.03 * (static_cast<double>(ii / 4) - 1.);
+      poses_target_cam.emplace_back(gtsam::Rot3::RzRyRx(-0.5 * dy, 0.5 * dx, 0.05 * dx),
+                                    gtsam::Point3(center.x() + dx, center.y() + dy, -0.85));
+      cameras[camera_id]->setCameraPose(poses_target_cam.back());
+      const double noise = 0.1 * static_cast<double>(ii + 1);
+      for (size_t jj = 0; jj < target_points3d.size(); jj++) {
+        const gtsam::Point2 uv = cameras[camera_id]->project(target_points3d[jj]);
+        if (gtcal::utils::FilterPixelCoords(uv, IMAGE_WIDTH, IMAGE_HEIGHT)) {
+          const gtsam::Point2 offset(noise * std::sin(1.7 * jj), noise * std::cos(2.3 * jj));
+          measurements.push_back(uv + offset, camera_id, jj);
+        }
+      }
+      measurements.endFrame(static_cast<int64_t>(ii));
+    }
+  }
+
+  /**
+   * @brief Return the residual of a measurement computed with Camera::project.
+   *
+   */
+  gtsam::Point2 referenceResidual(const size_t frame_index, const gtcal::Measurement& meas) const {
+    cameras[meas.camera_id]->setCameraPose(poses_target_cam[frame_index]);
+    return cameras[meas.camera_id]->project(target_points3d[meas.point_id]) - meas.uv;
+  }
+};
+
+// Tests the residuals and statistics against Camera::project.
+TEST_F(ReprojectionEvaluatorFixture, Evaluate) {
+  gtcal::ReprojectionEvaluator::Options options;
+  options.keep_residuals = true;
+  options.num_threads = 3;
+  const gtcal::ReprojectionEvaluator evaluator(options);
+  const auto result = evaluator.evaluate(cameras, poses_target_cam, target_points3d, measurements);
+
+  ASSERT_EQ(result.residual_u.size(), measurements.size());
+  ASSERT_EQ(result.frames.size(), measurements.numFrames());
+  EXPECT_EQ(result.num_invalid, 0ul);
+  EXPECT_EQ(result.total.count(), measurements.size());
+
+  std::vector<double> errors;
+  double sum_squares[2] = {0.0, 0.0};
+  size_t offset = 0;
+  for (size_t ii = 0; ii < measurements.numFrames(); ii++) {
+    const gtcal::MeasurementSpan frame = measurements.frame(ii);
+    double frame_sum_squares = 0.0;
+    for (size_t jj = 0; jj < frame.size(); jj++, offset++) {
+      const gtsam::Point2 residual = referenceResidual(ii, frame[jj]);
+      EXPECT_NEAR(result.residual_u[offset], residual.x(), 1e-4);
+      EXPECT_NEAR(result.residual_v[offset], residual.y(), 1e-4);
+      frame_sum_squares += residual.squaredNorm();
+      sum_squares[frame.cameraIds()[jj]] += residual.squaredNorm();
+      errors.push_back(residual.norm());
+    }
+    const auto& stats = result.frames[ii];
+    EXPECT_EQ(stats.camera_id, ii % 2);
+    EXPECT_EQ(stats.count, frame.size());
+    EXPECT_NEAR(stats.rms, std::sqrt(frame_sum_squares / frame.size()), 1e-9);
+    EXPECT_LE(stats.median, stats.p95);
+    EXPECT_LE(stats.p95, stats.max);
+  }
+
+  // Noisier frames come last.
+  EXPECT_LT(result.frames.front().rms, result.frames.back().rms);
+
+  // Per camera and per region statistics.
+  for (size_t cc = 0; cc < 2; cc++) {
+    const auto& histogram = result.cameras[cc];
+    EXPECT_NEAR(histogram.rms(), std::sqrt(sum_squares[cc] / histogram.count()), 1e-9);
+    uint64_t region_count = 0;
+    for (const auto& region : result.regions[cc]) {
+      region_count += region.count();
+    }
+    EXPECT_EQ(region_count, histogram.count());
+    EXPECT_EQ(result.regions[cc].size(), options.region_cols * options.region_rows);
+  }
+  EXPECT_EQ(result.cameras[0].count() + result.cameras[1].count(), result.total.count());
+
+  // Histogram percentiles are within a bin of the exact ones.
+  std::sort(errors.begin(), errors.end());
+  for (const double percentile : {50.0, 95.0, 99.0}) {
+    const double exact = errors[static_cast<size_t>(percentile / 100.0 * (errors.size() - 1))];
+    EXPECT_NEAR(result.total.percentile(percentile), exact, 2.0 * options.bin_width) << percentile;
+  }
+
+  std::stringstream report;
+  evaluator.writeReport(result, report);
+  EXPECT_NE(report.str().find("Worst frames"), std::string::npos);
+  EXPECT_NE(report.str().find("RMS per region"), std::string::npos);
+}
+
+// Tests that the result doesn't depend on the number of threads.
+TEST_F(ReprojectionEvaluatorFixture, Threads) {
+  gtcal::ReprojectionEvaluator::Options options;
+  options.num_threads = 1;
+  const auto single = gtcal::ReprojectionEvaluator(options).evaluate(cameras, poses_target_cam,
+                                                                     target_points3d, measurements);
+  options.num_threads = 8;
+  const auto multi = gtcal::ReprojectionEvaluator(options).evaluate(cameras, poses_target_cam,
+                                                                    target_points3d, measurements);
+  EXPECT_EQ(single.total.bins(), multi.total.bins());
+  EXPECT_NEAR(single.total.rms(), multi.total.rms(), 1e-12);
+  EXPECT_EQ(single.total.max(), multi.total.max());
+  for (size_t ii = 0; ii < single.frames.size(); ii++) {
+    EXPECT_EQ(single.frames[ii].rms, multi.frames[ii].rms);
+    EXPECT_EQ(single.frames[ii].p95, multi.frames[ii].p95);
+  }
+}
+
+// Tests that points behind the camera are counted as invalid and left out of the statistics.
+TEST_F(ReprojectionEvaluatorFixture, Invalid) {
+  // Turn the camera of the first frame around.
+  const gtsam::Pose3 turn(gtsam::Rot3::RzRyRx(M_PI, 0., 0.), gtsam::Point3());
+  poses_target_cam[0] = poses_target_cam[0] * turn;
+  gtcal::ReprojectionEvaluator::Options options;
+  options.keep_residuals = true;
+  const gtcal::ReprojectionEvaluator evaluator(options);
+  const auto result = evaluator.evaluate(cameras, poses_target_cam, target_points3d, measurements);
+
+  const size_t frame_size = measurements.frame(0).size();
+  EXPECT_EQ(result.num_invalid, frame_size);
+  EXPECT_EQ(result.frames[0].num_invalid, frame_size);
+  EXPECT_EQ(result.frames[0].count, 0ul);
+  EXPECT_EQ(result.total.count(), measurements.size() - frame_size);
+  EXPECT_TRUE(std::isnan(result.residual_u[0]));
+  EXPECT_FALSE(std::isnan(result.residual_u[frame_size]));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,218 @@
+#include "gtcal_test_utils.h"
+#include "gtcal/binary_io.h"
+#include "gtcal/result_cache.h"
+#include "gtcal/utils.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct ResultCacheFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target{0.15, 10, 13};
+  const gtsam::Point3Vector pts3d_target = target.pointsTarget();
+  std::string directory;
+  std::vector<std::shared_ptr<gtcal::Camera>> cameras;
+  gtcal::MeasurementBlock measurements;
+
+  void SetUp() override {
+    directory = testing::TempDir() + "gtcal_result_cache_test";
+    std::filesystem::remove_all(directory);
+
+    const gtsam::Pose3 pose(gtsam::Rot3::RzRyRx(0.1, -0.2, 0.3), gtsam::Point3(0.5, -1., 2.));
+    cameras.push_back(std::make_shared<gtcal::Camera>());
+    cameras.back()->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                                   gtsam::Cal3_S2(FX, FY, 0., CX, CY), pose);
+    cameras.push_back(std::make_shared<gtcal::Camera>());
+    cameras.back()->setCameraModel<gtsam::Cal3Fisheye>(
+        IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3Fisheye(FX, FY, 0., CX, CY, 0.1, -0.01, 0.001, 0.), pose);
+
+    for (size_t ii = 0; ii < 3; ii++) {
+      for (size_t jj = 0; jj < 20; jj++) {
+        measurements.push_back(gtsam::Point2(10. * jj + ii, 5. * jj), ii % 2, jj);
+      }
+      measurements.endFrame(static_cast<int64_t>(ii));
+    }
+  }
+
+  void TearDown() override { std::filesystem::remove_all(directory); }
+
+  /**
+   * @brief Return a calibration of the cameras with the focal length offset by the given amount.
+   *
+   */
+  gtcal::CachedCalibration makeResult(const double offset) const {
+    gtcal::CachedCalibration result;
+    result.num_frames = 3;
+    result.cameras.push_back(std::make_shared<gtcal::Camera>());
+    result.cameras.back()->setCameraModel<gtsam::Cal3_S2>(
+        IMAGE_WIDTH, IMAGE_HEIGHT, gtsam::Cal3_S2(FX + offset, FY + offset, 0., CX, CY), cameras[0]->pose());
+    return result;
+  }
+};
+
+// Tests the hash against the reference XXH64 values.
+TEST(XxHash64, Reference) {
+  const std::string fox = "The quick brown fox jumps over the lazy dog";
+  EXPECT_EQ(gtcal::io::XxHash64("", 0), 0xEF46DB3751D8E999ull);
+  EXPECT_EQ(gtcal::io::XxHash64("abc", 3), 0x44BC2CF5AD770999ull);
+  EXPECT_EQ(gtcal::io::XxHash64("abc", 3, 1), 0xBEA9CA8199328908ull);
+  EXPECT_EQ(gtcal::io::XxHash64(fox.data(), fox.size()), 0x0B242D361FDA71BCull);
+}
+
+// Tests that the key changes with everything that changes the solution, and only with that.
+TEST_F(ResultCacheFixture, Key) {
+  const gtcal::BatchSolver::Options options;
+  const uint64_t key = gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, options);
+  EXPECT_EQ(gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, options), key);
+
+  auto threads = options;
+  threads.num_threads = 3;
+  EXPECT_EQ(gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, threads), key);
+
+  auto iterations = options;
+  iterations.max_iterations = 10;
+  EXPECT_NE(gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, iterations), key);
+
+  auto noise = options;
+  noise.pixel_meas_noise_model = gtsam::noiseModel::Isotropic::Sigma(2, 2.0);
+  EXPECT_NE(gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, noise), key);
+
+  // A pixel moved, a frame boundary moved, other intrinsics and another target.
+  gtcal::MeasurementBlock moved;
+  for (size_t ii = 0; ii < measurements.size(); ii++) {
+    moved.push_back(measurements[ii].uv + gtsam::Point2(ii == 7 ? 1e-3 : 0., 0.), measurements[ii].camera_id,
+                    measurements[ii].point_id);
+    if (ii % 20 == 19) {
+      moved.endFrame();
+    }
+  }
+  EXPECT_NE(gtcal::ComputeResultCacheKey(moved, pts3d_target, cameras, options), key);
+
+  gtcal::MeasurementBlock regrouped;
+  regrouped.append(measurements.span().subspan(0, 30));
+  regrouped.endFrame();
+  regrouped.append(measurements.span().subspan(30, 30));
+  regrouped.endFrame();
+  EXPECT_NE(gtcal::ComputeResultCacheKey(regrouped, pts3d_target, cameras, options), key);
+
+  std::vector<std::shared_ptr<gtcal::Camera>> other_cameras = {cameras[0]->clone(), cameras[1]};
+  other_cameras[0]->setCameraModel<gtsam::Cal3_S2>(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                                   gtsam::Cal3_S2(FX + 1., FY, 0., CX, CY));
+  EXPECT_NE(gtcal::ComputeResultCacheKey(measurements, pts3d_target, other_cameras, options), key);
+
+  const gtcal::utils::CalibrationTarget other_target(0.16, 10, 13);
+  EXPECT_NE(gtcal::ComputeResultCacheKey(measurements, other_target.pointsTarget(), cameras, options), key);
+
+  // A covariance-weighted solve of the same detections is another problem, and so are other covariances.
+  std::vector<gtsam::Matrix2> covariances(measurements.size(), gtsam::Matrix2::Identity());
+  const uint64_t weighted_key =
+      gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, options, &covariances);
+  EXPECT_NE(weighted_key, key);
+  EXPECT_EQ(gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, options, &covariances),
+            weighted_key);
+  covariances[11](0, 1) = covariances[11](1, 0) = 0.1;
+  EXPECT_NE(gtcal::ComputeResultCacheKey(measurements, pts3d_target, cameras, options, &covariances),
+            weighted_key);
+}
+
+// Tests that a stored calibration is returned as stored, also by a cache opened later on the directory.
+TEST_F(ResultCacheFixture, StoreLookup) {
+  gtcal::CachedCalibration stored;
+  stored.cameras = cameras;
+  stored.num_frames = 42;
+  {
+    gtcal::ResultCache cache(directory);
+    ASSERT_TRUE(cache.isOpen());
+    gtcal::CachedCalibration result;
+    EXPECT_FALSE(cache.lookup(1, result));
+    ASSERT_TRUE(cache.store(1, stored));
+    EXPECT_EQ(cache.size(), 1ul);
+    EXPECT_EQ(cache.stats().num_misses, 1ul);
+    EXPECT_EQ(cache.stats().num_stores, 1ul);
+  }
+
+  gtcal::ResultCache cache(directory);
+  ASSERT_EQ(cache.size(), 1ul);
+  gtcal::CachedCalibration result;
+  ASSERT_TRUE(cache.lookup(1, result));
+  EXPECT_EQ(cache.stats().num_hits, 1ul);
+  EXPECT_EQ(result.num_frames, 42ul);
+  ASSERT_EQ(result.cameras.size(), 2ul);
+  for (size_t ii = 0; ii < 2; ii++) {
+    EXPECT_EQ(result.cameras[ii]->modelType(), cameras[ii]->modelType());
+    EXPECT_EQ(result.cameras[ii]->width(), cameras[ii]->width());
+    EXPECT_EQ(result.cameras[ii]->intrinsicsParameters(), cameras[ii]->intrinsicsParameters());
+    EXPECT_TRUE(result.cameras[ii]->pose().equals(cameras[ii]->pose(), 1e-12));
+  }
+
+  // A new store replaces the entry.
+  ASSERT_TRUE(cache.store(1, makeResult(5.)));
+  ASSERT_TRUE(cache.lookup(1, result));
+  ASSERT_EQ(result.cameras.size(), 1ul);
+  EXPECT_DOUBLE_EQ(result.cameras[0]->intrinsicsParameters()[0], FX + 5.);
+  EXPECT_EQ(cache.size(), 1ul);
+  EXPECT_EQ(cache.sizeBytes(), std::filesystem::file_size(directory + "/0000000000000001.gtcr"));
+
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0ul);
+  EXPECT_TRUE(std::filesystem::is_empty(directory));
+}
+
+// Tests that the least recently used entries are evicted over the limits.
+TEST_F(ResultCacheFixture, Eviction) {
+  gtcal::ResultCache::Options options;
+  options.max_entries = 2;
+  gtcal::ResultCache cache(directory, options);
+  gtcal::CachedCalibration result;
+  ASSERT_TRUE(cache.store(1, makeResult(1.)));
+  ASSERT_TRUE(cache.store(2, makeResult(2.)));
+  ASSERT_TRUE(cache.lookup(1, result));
+  ASSERT_TRUE(cache.store(3, makeResult(3.)));
+  EXPECT_EQ(cache.size(), 2ul);
+  EXPECT_EQ(cache.stats().num_evictions, 1ul);
+  EXPECT_FALSE(cache.lookup(2, result));
+  EXPECT_FALSE(std::filesystem::exists(directory + "/0000000000000002.gtcr"));
+  EXPECT_TRUE(cache.lookup(1, result));
+  EXPECT_TRUE(cache.lookup(3, result));
+
+  // A cache opened with a smaller size limit evicts down to it on open, here the least recently used entry.
+  const size_t entry_size = cache.sizeBytes() / 2;
+  gtcal::ResultCache::Options small;
+  small.max_bytes = entry_size;
+  gtcal::ResultCache reopened(directory, small);
+  EXPECT_EQ(reopened.size(), 1ul);
+  EXPECT_EQ(reopened.stats().num_evictions, 1ul);
+  EXPECT_TRUE(reopened.lookup(3, result));
+}
+
+// Tests that corrupted entries are removed and count as misses.
+TEST_F(ResultCacheFixture, Corrupted) {
+  {
+    gtcal::ResultCache cache(directory);
+    ASSERT_TRUE(cache.store(7, makeResult(0.)));
+  }
+  const std::string path = directory + "/0000000000000007.gtcr";
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(60);
+    file.put('x');
+  }
+  std::ofstream(directory + "/notes.txt") << "Not an entry.";
+
+  gtcal::ResultCache cache(directory);
+  EXPECT_EQ(cache.size(), 1ul);
+  gtcal::CachedCalibration result;
+  EXPECT_FALSE(cache.lookup(7, result));
+  EXPECT_EQ(cache.size(), 0ul);
+  EXPECT_EQ(cache.stats().num_misses, 1ul);
+  EXPECT_FALSE(std::filesystem::exists(path));
+  EXPECT_TRUE(std::filesystem::exists(directory + "/notes.txt"));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,86 @@
+#include "gtcal/rig.h"
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+// Tests parsing a rig with both camera models.
+TEST(Rig, Parse) {
+  const std::string text =
+      "# Two camera rig.\n"
+      "target 0.15 10 13\n"
+      "\n"
+      "camera 0 pinhole 1024 570 200 201 512 235  # front\n"
+      "camera 1 fisheye 640 480 300 301 320 240 0.1 0.01 0.001 0.0001\n"
+      "frame 0 0 0 0 0 1 0 0 0\n";
+
+  gtcal::Rig rig;
+  std::string error;
+  ASSERT_TRUE(gtcal::ParseRig(text, rig, error)) << error;
+  EXPECT_DOUBLE_EQ(rig.grid_spacing, 0.15);
+  EXPECT_EQ(rig.num_rows, 10);
+  EXPECT_EQ(rig.num_cols, 13);
+  EXPECT_EQ(rig.target().pointsTarget().size(), 130);
+
+  ASSERT_EQ(rig.cameras.size(), 2);
+  EXPECT_EQ(rig.cameras.at(0)->modelType(), gtcal::Camera::ModelType::CAL3_S2);
+  EXPECT_EQ(rig.cameras.at(0)->width(), 1024);
+  EXPECT_EQ(rig.cameras.at(0)->height(), 570);
+  EXPECT_EQ(rig.cameras.at(0)->intrinsicsParameters(), std::vector<double>({200, 201, 512, 235}));
+  EXPECT_EQ(rig.cameras.at(1)->modelType(), gtcal::Camera::ModelType::CAL3_FISHEYE);
+  EXPECT_EQ(rig.cameras.at(1)->intrinsicsParameters(),
+            std::vector<double>({300, 301, 320, 240, 0.1, 0.01, 0.001, 0.0001}));
+
+  // Clones don't share the camera models.
+  const auto clones = rig.cloneCameras();
+  clones.at(0)->setCameraPose(gtsam::Pose3(gtsam::Rot3(), {1., 2., 3.}));
+  EXPECT_TRUE(rig.cameras.at(0)->pose().equals(gtsam::Pose3()));
+}
+
+// Tests that a written rig parses back to the same rig.
+TEST(Rig, WriteAndParse) {
+  gtcal::Rig rig;
+  std::string error;
+  ASSERT_TRUE(gtcal::ParseRig("target 0.3 4 5\ncamera 0 fisheye 640 480 300.25 301.5 320.125 240.75 0.1 "
+                              "-0.02 0.003 -0.0004\n",
+                              rig, error));
+
+  std::ostringstream os;
+  gtcal::WriteRig(rig, os);
+  gtcal::Rig parsed;
+  ASSERT_TRUE(gtcal::ParseRig(os.str(), parsed, error)) << error;
+  EXPECT_DOUBLE_EQ(parsed.grid_spacing, rig.grid_spacing);
+  EXPECT_EQ(parsed.num_rows, rig.num_rows);
+  EXPECT_EQ(parsed.num_cols, rig.num_cols);
+  ASSERT_EQ(parsed.cameras.size(), 1);
+  EXPECT_EQ(parsed.cameras.at(0)->intrinsicsParameters(), rig.cameras.at(0)->intrinsicsParameters());
+}
+
+// Tests that invalid rigs are rejected with an error.
+TEST(Rig, Invalid) {
+  const std::vector<std::string> texts = {
+      "",
+      "target 0.15 10 13\n",
+      "camera 0 pinhole 1024 570 200 200 512 235\n",
+      "target 0.15 10\ncamera 0 pinhole 1024 570 200 200 512 235\n",
+      "target 0.15 10 13\ncamera 1 pinhole 1024 570 200 200 512 235\n",
+      "target 0.15 10 13\ncamera 0 pinhole 1024 570 200 200 512\n",
+      "target 0.15 10 13\ncamera 0 kannala 1024 570 200 200 512 235\n",
+      "target 0.15 10 13\ncamera 0 pinhole 1024 570 200 200 512 235\nlidar 0\n",
+  };
+  for (const auto& text : texts) {
+    gtcal::Rig rig;
+    std::string error;
+    EXPECT_FALSE(gtcal::ParseRig(text, rig, error)) << text;
+    EXPECT_FALSE(error.empty());
+  }
+
+  gtcal::Rig rig;
+  std::string error;
+  EXPECT_FALSE(gtcal::LoadRig(testing::TempDir() + "gtcal_missing_rig.txt", rig, error));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
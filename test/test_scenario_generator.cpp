@@ -0,0 +1,188 @@
+#include "gtcal/philox.h"
+#include "gtcal/scenario_generator.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <filesystem>
+#include <vector>
+
+struct ScenarioGeneratorFixture : public testing::Test {
+protected:
+  gtcal::Rig rig;
+  std::string log_path;
+
+  void SetUp() override {
+    log_path = testing::TempDir() + "gtcal_scenario_test.bin";
+    std::string error;
+    ASSERT_TRUE(gtcal::ParseRig("target 0.04 6 9\n"
+                                "camera 0 pinhole 1024 570 600 600 512 285\n"
+                                "camera 1 fisheye 1024 570 400 400 512 285 -0.02 0.01 0 0\n",
+                                rig, error))
+        << error;
+  }
+
+  void TearDown() override { std::filesystem::remove(log_path); }
+
+  /**
+   * @brief Return the noise-free projection of a target point in a frame.
+   *
+   */
+  gtsam::Point2 Project(const gtcal::ScenarioGenerator::Frame& frame, const size_t point_id) const {
+    gtcal::Camera camera = *rig.cameras.at(frame.camera_id)->clone();
+    camera.setCameraPose(frame.pose_target_cam);
+    return camera.project(rig.target().pointsTarget().at(point_id));
+  }
+};
+
+// Tests Philox4x32-10 against the known answers of the Random123 reference implementation.
+TEST(Philox4x32, KnownAnswers) {
+  using Counter = gtcal::Philox4x32::Counter;
+  EXPECT_EQ(gtcal::Philox4x32::Generate({0, 0, 0, 0}, {0, 0}),
+            (Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  EXPECT_EQ(gtcal::Philox4x32::Generate({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                                       {0xffffffff, 0xffffffff}),
+            (Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+  EXPECT_EQ(gtcal::Philox4x32::Generate({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                                       {0xa4093822, 0x299f31d0}),
+            (Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+}
+
+// Tests that streams are reproducible and independent, and the moments of the normal numbers.
+TEST(CounterRng, Streams) {
+  gtcal::CounterRng rng(3, 5), same(3, 5), other_stream(3, 6), other_substream(3, 5, 1), other_seed(4, 5);
+  for (size_t ii = 0; ii < 10; ii++) {
+    const uint32_t value = rng();
+    EXPECT_EQ(value, same());
+    EXPECT_NE(value, other_stream());
+    EXPECT_NE(value, other_substream());
+    EXPECT_NE(value, other_seed());
+  }
+
+  static constexpr size_t kNumSamples = 100000;
+  double sum = 0.0, sum2 = 0.0;
+  for (size_t ii = 0; ii < kNumSamples; ii++) {
+    const double value = rng.normal(1.0, 2.0);
+    sum += value;
+    sum2 += value * value;
+  }
+  const double mean = sum / kNumSamples;
+  EXPECT_NEAR(mean, 1.0, 0.03);
+  EXPECT_NEAR(std::sqrt(sum2 / kNumSamples - mean * mean), 2.0, 0.03);
+}
+
+// Tests that frames see the target from the configured views, with the configured noise.
+TEST_F(ScenarioGeneratorFixture, Frames) {
+  const gtsam::Point3 center = rig.target().get3dCenter();
+  for (const auto trajectory :
+       {gtcal::ScenarioGenerator::Trajectory::ARC, gtcal::ScenarioGenerator::Trajectory::SPHERE}) {
+    gtcal::ScenarioGenerator::Options options;
+    options.trajectory = trajectory;
+    options.pixel_sigma = 0.5;
+    options.seed = 11;
+    const gtcal::ScenarioGenerator generator(rig, options);
+
+    double sum2 = 0.0;
+    size_t num_measurements = 0;
+    for (size_t ii = 0; ii < 200; ii++) {
+      std::vector<gtcal::Measurement> measurements;
+      const gtcal::ScenarioGenerator::Frame frame = generator.frame(ii, measurements);
+      EXPECT_EQ(frame.camera_id, ii % 2);
+      EXPECT_EQ(frame.timestamp_ns, static_cast<int64_t>(ii) * options.frame_period_ns);
+
+      // The camera looks at the target center from within the view cone and distance range.
+      const gtsam::Point3 center_cam = frame.pose_target_cam.transformTo(center);
+      EXPECT_NEAR(center_cam.x(), 0.0, 1e-9);
+      EXPECT_NEAR(center_cam.y(), 0.0, 1e-9);
+      EXPECT_GE(center_cam.z(), options.min_distance - 1e-9);
+      EXPECT_LE(center_cam.z(), options.max_distance + 1e-9);
+      const gtsam::Point3 direction = (frame.pose_target_cam.translation() - center).normalized();
+      EXPECT_LE(std::acos(-direction.z()), gtcal::utils::DegToRad(options.max_view_angle_deg) + 1e-9);
+
+      // Every point is in view from these distances.
+      EXPECT_EQ(measurements.size(), rig.target().pointsTarget().size());
+      for (const auto& meas : measurements) {
+        EXPECT_EQ(meas.camera_id, frame.camera_id);
+        sum2 += (meas.uv - Project(frame, meas.point_id)).squaredNorm();
+        num_measurements++;
+      }
+
+      // Frames are reproducible on their own.
+      std::vector<gtcal::Measurement> again;
+      EXPECT_TRUE(generator.frame(ii, again).pose_target_cam.equals(frame.pose_target_cam));
+      ASSERT_EQ(again.size(), measurements.size());
+      EXPECT_EQ(again.back().uv, measurements.back().uv);
+    }
+    EXPECT_NEAR(std::sqrt(sum2 / (2 * num_measurements)), options.pixel_sigma, 0.02);
+  }
+}
+
+// Tests that batches don't depend on the number of threads and match the frames generated one by one.
+TEST_F(ScenarioGeneratorFixture, Batches) {
+  gtcal::ScenarioGenerator::Options options;
+  options.num_frames = 50;
+  gtcal::MeasurementBlock blocks[2];
+  std::vector<gtcal::ScenarioGenerator::Frame> frames[2];
+  for (const size_t tt : {0, 1}) {
+    options.num_threads = tt == 0 ? 1 : 4;
+    const gtcal::ScenarioGenerator generator(rig, options);
+    generator.generate(0, 20, blocks[tt], &frames[tt]);
+    generator.generate(20, 30, blocks[tt], &frames[tt]);
+  }
+  ASSERT_EQ(blocks[0].numFrames(), 50ul);
+  ASSERT_EQ(blocks[1].numFrames(), 50ul);
+  EXPECT_EQ(blocks[0].u(), blocks[1].u());
+  EXPECT_EQ(blocks[0].v(), blocks[1].v());
+  EXPECT_EQ(blocks[0].pointIds(), blocks[1].pointIds());
+
+  const gtcal::ScenarioGenerator generator(rig, options);
+  for (const size_t ii : {0, 19, 20, 49}) {
+    std::vector<gtcal::Measurement> measurements;
+    const auto frame = generator.frame(ii, measurements);
+    EXPECT_EQ(blocks[1].timestamp(ii), frame.timestamp_ns);
+    EXPECT_TRUE(frames[1].at(ii).pose_target_cam.equals(frame.pose_target_cam));
+    const gtcal::MeasurementSpan span = blocks[1].frame(ii);
+    ASSERT_EQ(span.size(), measurements.size());
+    for (size_t jj = 0; jj < span.size(); jj++) {
+      EXPECT_EQ(span[jj].point_id, measurements.at(jj).point_id);
+      EXPECT_FLOAT_EQ(span[jj].uv.x(), measurements.at(jj).uv.x());
+      EXPECT_FLOAT_EQ(span[jj].uv.y(), measurements.at(jj).uv.y());
+    }
+  }
+}
+
+// Tests that scenarios stream into a detection log in batches.
+TEST_F(ScenarioGeneratorFixture, Log) {
+  gtcal::ScenarioGenerator::Options options;
+  options.num_frames = 70;
+  options.frames_per_batch = 16;
+  const gtcal::ScenarioGenerator generator(rig, options);
+  std::vector<gtcal::ScenarioGenerator::Frame> frames;
+  {
+    gtcal::DetectionLogWriter writer(log_path);
+    ASSERT_TRUE(writer.isOpen());
+    ASSERT_TRUE(generator.generate(writer, &frames));
+    ASSERT_TRUE(writer.close());
+  }
+  ASSERT_EQ(frames.size(), 70ul);
+
+  gtcal::MeasurementBlock block;
+  generator.generate(0, options.num_frames, block);
+  gtcal::DetectionLogReader reader(log_path);
+  ASSERT_TRUE(reader.isOpen());
+  ASSERT_EQ(reader.numFrames(), 70ul);
+  for (size_t ii = 0; ii < reader.numFrames(); ii++) {
+    EXPECT_EQ(reader.timestamp(ii), frames.at(ii).timestamp_ns);
+    gtcal::MeasurementSpan span;
+    ASSERT_TRUE(reader.frame(ii, span));
+    ASSERT_EQ(span.size(), block.frame(ii).size());
+    for (size_t jj = 0; jj < span.size(); jj++) {
+      EXPECT_EQ(span.u()[jj], block.frame(ii).u()[jj]);
+      EXPECT_EQ(span.cameraIds()[jj], frames.at(ii).camera_id);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
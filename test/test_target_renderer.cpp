@@ -0,0 +1,164 @@
+#include "gtcal/calibration_target.h"
+#include "gtcal/corner_detector.h"
+#include "gtcal/target_renderer.h"
+#include <gtest/gtest.h>
+
+#include <gtsam/geometry/Cal3Fisheye.h>
+#include <gtsam/geometry/Cal3_S2.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+static constexpr size_t kWidth = 640;
+static constexpr size_t kHeight = 480;
+
+/**
+ * @brief Return the pixel of a point in the target frame.
+ *
+ */
+gtsam::Point2 Project(const gtcal::Camera& camera, const gtsam::Pose3& pose_target_cam,
+                      const gtsam::Point3& point) {
+  gtcal::Camera posed = *camera.clone();
+  posed.setCameraPose(pose_target_cam);
+  return posed.project(point);
+}
+
+}  // namespace
+
+struct TargetRendererFixture : public testing::Test {
+protected:
+  const gtcal::utils::CalibrationTarget target = gtcal::utils::CalibrationTarget(0.04, 6, 9);
+  gtcal::Camera pinhole;
+  gtcal::Camera fisheye;
+  std::vector<gtsam::Pose3> poses_target_cam;
+
+  void SetUp() override {
+    pinhole.setCameraModel<gtsam::Cal3_S2>(kWidth, kHeight, gtsam::Cal3_S2(500., 510., 0., 320., 240.));
+    fisheye.setCameraModel<gtsam::Cal3Fisheye>(
+        kWidth, kHeight, gtsam::Cal3Fisheye(400., 405., 0., 320., 240., -0.02, 0.01, 0., 0.));
+    const gtsam::Point3 center = target.get3dCenter();
+    for (const auto& [rx, ry, rz] :
+         std::vector<std::array<double, 3>>{{0., 0., 0.}, {0.3, -0.2, 0.1}, {-0.25, 0.35, -0.4}}) {
+      const gtsam::Rot3 R = gtsam::Rot3::RzRyRx(rx, ry, rz);
+      poses_target_cam.emplace_back(R, center - R.rotate(gtsam::Point3(0., 0., 0.6)));
+    }
+  }
+};
+
+// Tests that square centers, the margin and the background get their intensities through both camera models.
+TEST_F(TargetRendererFixture, SquareIntensities) {
+  for (const gtcal::Camera* camera : {&pinhole, &fisheye}) {
+    const gtcal::TargetRenderer renderer(target, *camera);
+    ASSERT_EQ(renderer.width(), kWidth);
+    ASSERT_EQ(renderer.height(), kHeight);
+    for (const auto& pose_target_cam : poses_target_cam) {
+      const gtcal::Image image = renderer.render(pose_target_cam);
+      ASSERT_EQ(image.width, kWidth);
+      ASSERT_EQ(image.height, kHeight);
+      const double spacing = target.gridSpacing();
+      for (int col = -1; col < static_cast<int>(target.numCols()); col++) {
+        for (int row = -1; row < static_cast<int>(target.numRows()); row++) {
+          const gtsam::Point3 center((col + 0.5) * spacing, (row + 0.5) * spacing, 0.);
+          const gtsam::Point2 uv = Project(*camera, pose_target_cam, center);
+          const bool dark = ((col + row) & 1) == 0;
+          EXPECT_EQ(image.at(std::lround(uv.x()), std::lround(uv.y())), dark ? 40 : 210) << col << " " << row;
+        }
+      }
+      // Margin just outside the squares, background well outside the board.
+      const gtsam::Point2 margin = Project(*camera, pose_target_cam, gtsam::Point3(-1.25 * spacing, 0., 0.));
+      EXPECT_EQ(image.at(std::lround(margin.x()), std::lround(margin.y())), 210);
+      const gtsam::Point2 outside = Project(*camera, pose_target_cam, gtsam::Point3(-3. * spacing, 0., 0.));
+      EXPECT_EQ(image.at(std::lround(outside.x()), std::lround(outside.y())), 128);
+    }
+  }
+}
+
+// Tests that the corner detector finds the rendered corners where the camera projects them.
+TEST_F(TargetRendererFixture, DetectRenderedCorners) {
+  gtcal::TargetRenderer::Options options;
+  options.blur_sigma = 0.7;
+  options.noise_sigma = 2.0;
+  options.vignetting = 0.3;
+  for (const gtcal::Camera* camera : {&pinhole, &fisheye}) {
+    const gtcal::TargetRenderer renderer(target, *camera, options);
+    const gtcal::CornerDetector detector(target);
+    for (size_t ii = 0; ii < poses_target_cam.size(); ii++) {
+      const gtcal::Image image = renderer.render(poses_target_cam.at(ii), ii);
+      std::vector<gtcal::Measurement> measurements;
+      ASSERT_TRUE(detector.detect(image, 0, measurements)) << ii;
+      ASSERT_EQ(measurements.size(), target.pointsTarget().size());
+      for (const auto& meas : measurements) {
+        const gtsam::Point2 uv =
+            Project(*camera, poses_target_cam.at(ii), target.pointsTarget().at(meas.point_id));
+        EXPECT_LT((meas.uv - uv).norm(), 0.6) << meas.point_id;
+      }
+    }
+  }
+}
+
+// Tests that batches render the same images on any number of threads, and the effects of noise, blur and
+// vignetting.
+TEST_F(TargetRendererFixture, EffectsAndReproducibility) {
+  gtcal::TargetRenderer::Options options;
+  options.noise_sigma = 4.0;
+  options.seed = 17;
+  std::vector<gtcal::Image> single, parallel;
+  options.num_threads = 1;
+  gtcal::TargetRenderer(target, pinhole, options).render(poses_target_cam, single);
+  options.num_threads = 3;
+  gtcal::TargetRenderer(target, pinhole, options).render(poses_target_cam, parallel);
+  ASSERT_EQ(single.size(), poses_target_cam.size());
+  ASSERT_EQ(parallel.size(), poses_target_cam.size());
+  for (size_t ii = 0; ii < single.size(); ii++) {
+    EXPECT_EQ(single.at(ii).pixels, parallel.at(ii).pixels) << ii;
+  }
+
+  // The noise depends on the image index and the seed.
+  const gtcal::TargetRenderer noisy(target, pinhole, options);
+  EXPECT_EQ(noisy.render(poses_target_cam.front(), 0).pixels, single.front().pixels);
+  EXPECT_NE(noisy.render(poses_target_cam.front(), 1).pixels, single.front().pixels);
+  options.seed = 18;
+  EXPECT_NE(gtcal::TargetRenderer(target, pinhole, options).render(poses_target_cam.front(), 0).pixels,
+            single.front().pixels);
+
+  // Noise around the background intensity, seen from a pose where the target is out of view.
+  const gtsam::Pose3 away(gtsam::Rot3(), gtsam::Point3(10., 10., -1.));
+  const gtcal::Image background = noisy.render(away);
+  double sum = 0.0, sum2 = 0.0;
+  for (const uint8_t pixel : background.pixels) {
+    sum += pixel;
+    sum2 += pixel * pixel;
+  }
+  const double mean = sum / background.pixels.size();
+  EXPECT_NEAR(mean, 128.0, 0.1);
+  EXPECT_NEAR(std::sqrt(sum2 / background.pixels.size() - mean * mean), 4.0, 0.2);
+
+  // Vignetting darkens the corners and keeps the center.
+  options = gtcal::TargetRenderer::Options();
+  options.vignetting = 0.5;
+  const gtcal::Image vignetted = gtcal::TargetRenderer(target, pinhole, options).render(away);
+  EXPECT_EQ(vignetted.at(kWidth / 2, kHeight / 2), 128);
+  EXPECT_EQ(vignetted.at(0, 0), 64);
+
+  // Blur spreads the edges: fewer pixels between the dark and light intensities without it.
+  const auto num_edge_pixels = [](const gtcal::Image& image) {
+    return std::count_if(image.pixels.begin(), image.pixels.end(),
+                         [](const uint8_t pixel) { return pixel > 45 && pixel < 205 && pixel != 128; });
+  };
+  options = gtcal::TargetRenderer::Options();
+  const gtcal::TargetRenderer sharp_renderer(target, pinhole, options);
+  options.blur_sigma = 1.5;
+  const gtcal::TargetRenderer blurred_renderer(target, pinhole, options);
+  const auto sharp = num_edge_pixels(sharp_renderer.render(poses_target_cam.front()));
+  const auto blurred = num_edge_pixels(blurred_renderer.render(poses_target_cam.front()));
+  EXPECT_GT(blurred, 2 * sharp);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
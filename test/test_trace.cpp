@@ -0,0 +1,133 @@
+#include "gtcal/trace.h"
+#include <gtest/gtest.h>
+
+#include <barrier>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Return the collected events with the given name.
+ *
+ */
+std::vector<gtcal::trace::CollectedEvent> EventsNamed(const std::vector<gtcal::trace::CollectedEvent>& events,
+                                                      const std::string& name) {
+  std::vector<gtcal::trace::CollectedEvent> named;
+  for (const auto& event : events) {
+    if (name == event.name) {
+      named.push_back(event);
+    }
+  }
+  return named;
+}
+
+}  // namespace
+
+// Tests that nested zones record on the calling thread only while tracing is started.
+TEST(Trace, Zones) {
+  gtcal::trace::Clear();
+  {
+    const gtcal::trace::Zone zone("Disabled");
+  }
+  gtcal::trace::Start();
+  {
+    const gtcal::trace::Zone outer("Outer");
+    for (size_t ii = 0; ii < 3; ii++) {
+      const gtcal::trace::Zone inner("Inner");
+    }
+  }
+  gtcal::trace::Stop();
+
+  uint64_t num_dropped = 1;
+  const auto events = gtcal::trace::Collect(&num_dropped);
+  EXPECT_EQ(num_dropped, 0ul);
+  ASSERT_EQ(events.size(), 4ul);
+  EXPECT_STREQ(events[0].name, "Outer");
+  const auto inner = EventsNamed(events, "Inner");
+  ASSERT_EQ(inner.size(), 3ul);
+  for (const auto& event : inner) {
+    EXPECT_GE(event.begin_ns, events[0].begin_ns);
+    EXPECT_LE(event.begin_ns, event.end_ns);
+    EXPECT_LE(event.end_ns, events[0].end_ns);
+    EXPECT_EQ(event.thread_id, events[0].thread_id);
+  }
+
+  gtcal::trace::Clear();
+  EXPECT_TRUE(gtcal::trace::Collect().empty());
+}
+
+// Tests that concurrent threads record on their own tracks and that overwritten events count as dropped.
+TEST(Trace, Threads) {
+  gtcal::trace::Clear();
+  gtcal::trace::Start();
+  const size_t num_threads = 4;
+  std::barrier running(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t ii = 0; ii < num_threads; ii++) {
+    threads.emplace_back([&running] {
+      gtcal::trace::SetThreadName("worker");
+      for (size_t jj = 0; jj < 100; jj++) {
+        const gtcal::trace::Zone zone("Work");
+      }
+      // Keep every thread alive until all recorded, so that none reuses the buffer of another.
+      running.arrive_and_wait();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto events = gtcal::trace::Collect();
+  ASSERT_EQ(events.size(), num_threads * 100);
+  std::set<uint32_t> thread_ids;
+  for (size_t ii = 0; ii < events.size(); ii++) {
+    thread_ids.insert(events[ii].thread_id);
+    if (ii > 0) {
+      EXPECT_LE(events[ii - 1].begin_ns, events[ii].begin_ns);
+    }
+  }
+  EXPECT_EQ(thread_ids.size(), num_threads);
+
+  // Overflow the ring of the calling thread.
+  gtcal::trace::Clear();
+  for (size_t ii = 0; ii < gtcal::trace::kEventsPerThread + 10; ii++) {
+    const gtcal::trace::Zone zone("Overflow");
+  }
+  gtcal::trace::Stop();
+  uint64_t num_dropped = 0;
+  events = gtcal::trace::Collect(&num_dropped);
+  EXPECT_EQ(events.size(), gtcal::trace::kEventsPerThread);
+  EXPECT_EQ(num_dropped, 10ul);
+  gtcal::trace::Clear();
+}
+
+// Tests the Chrome trace event JSON output.
+TEST(Trace, ChromeTrace) {
+  gtcal::trace::Clear();
+  gtcal::trace::SetThreadName("main \"thread\"");
+  gtcal::trace::Start();
+  {
+    const gtcal::trace::Zone zone("PoseSolver::solve");
+  }
+  gtcal::trace::Stop();
+
+  std::stringstream ss;
+  gtcal::trace::WriteChromeTrace(ss);
+  const std::string json = ss.str();
+  EXPECT_NE(json.find("\"traceEvents\": ["), std::string::npos);
+  EXPECT_NE(json.find("\"dropped_events\": 0"), std::string::npos);
+  EXPECT_NE(json.find("\"args\": {\"name\": \"main \\\"thread\\\"\"}"), std::string::npos);
+  EXPECT_NE(json.find("{\"name\": \"PoseSolver::solve\", \"cat\": \"gtcal\", \"ph\": \"X\", \"pid\": 1"),
+            std::string::npos);
+  EXPECT_NE(json.find("\"ts\": 0.000"), std::string::npos);
+  EXPECT_EQ(json.find("\"Overflow\""), std::string::npos);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}